@@ -0,0 +1,39 @@
+/**
+  ******************************************************************************
+  * @file    buffer_pool.h
+  * @brief   Shared pool of payload-sized blocks for the network handlers.
+  *
+  *          A web request is read into one block and its reply page is built
+  *          and sent from another, one ES-WiFi payload at a time, so nothing
+  *          ever needs to hold a whole request or page. An access point scan
+  *          borrows one as well, older module firmware sends it in a single
+  *          reply. Blocks are borrowed for the duration of one handler and
+  *          given back before it returns.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "es_wifi.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define POOL_BLOCK_SIZE             ES_WIFI_PAYLOAD_SIZE   /* one send or receive */
+#define POOL_BLOCKS                 2                      /* request in, page out */
+
+/* Exported functions --------------------------------------------------------*/
+uint8_t *POOL_Alloc(void);
+void     POOL_Free(uint8_t *block);
+uint8_t  POOL_GetHighWater(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BUFFER_POOL_H */
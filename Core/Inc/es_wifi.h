@@ -67,6 +67,7 @@ typedef int8_t (*IO_DeInit_Func)( void);
 typedef void (*IO_Delay_Func)(uint32_t);
 typedef int16_t (*IO_Send_Func)( uint8_t *, uint16_t len, uint32_t);
 typedef int16_t (*IO_Receive_Func)(uint8_t *, uint16_t len, uint32_t);
+typedef int16_t (*IO_ReceivePayload_Func)(uint8_t *, uint16_t, uint8_t *, uint16_t len, uint8_t *, uint16_t, uint32_t);
 
 
 /* Exported typedef ----------------------------------------------------------*/
@@ -134,6 +135,20 @@ typedef enum {
   ES_WIFI_FUNCTION_AWS = 0x01,
 } ES_WIFI_CredsFunction_t;
 
+/* AT command classes of the transport statistics */
+typedef enum {
+  ES_WIFI_CMD_CONTROL           = 0,   /*!< setup and query commands */
+  ES_WIFI_CMD_SEND              = 1,   /*!< S3 and its payload */
+  ES_WIFI_CMD_RECEIVE           = 2,   /*!< R0 */
+  ES_WIFI_CMD_ACCEPT            = 3,   /*!< MR and P? of the accept poll */
+  ES_WIFI_CMD_CLASSES           = 4,
+} ES_WIFI_CmdClass_t;
+
+#define ES_WIFI_STATS_BUCKETS         10
+/* Upper bound (excluded) of latency bucket i in us: 250, 500, 1000 ... 64000.
+   The last bucket holds everything above. */
+#define ES_WIFI_STATS_BUCKET_US(i)    (250UL << (i))
+
 //FIXME should be the multiple read/write slot ??
 #define ES_WIFI_TLS_MULTIPLE_WRITE_SLOT 0
 
@@ -249,12 +264,30 @@ typedef struct {
   uint8_t            Backlog;
 } ES_WIFI_Conn_t;
 
+typedef struct {
+  uint32_t          Count;
+  uint32_t          Errors;                    /*!< commands not answered by OK */
+  uint32_t          MaxUs;
+  uint64_t          TotalUs;
+  uint32_t          Histogram[ES_WIFI_STATS_BUCKETS];
+} ES_WIFI_CmdStats_t;
+
+typedef struct {
+  ES_WIFI_CmdStats_t Cmd[ES_WIFI_CMD_CLASSES];
+  uint32_t          BytesOut;                  /*!< socket payload accepted by S3 */
+  uint32_t          BytesIn;                   /*!< socket payload returned by R0 */
+  uint32_t          Timeouts;                  /*!< commands without a complete reply */
+  uint32_t          Crashes;                   /*!< ES_WIFI_STATUS_MODULE_CRASH, the module is reset */
+  uint32_t          Resets;                    /*!< soft, hard and crash resets */
+} ES_WIFI_Stats_t;
+
 typedef struct {
   IO_Init_Func       IO_Init;
   IO_DeInit_Func     IO_DeInit;
   IO_Delay_Func      IO_Delay;
   IO_Send_Func       IO_Send;
   IO_Receive_Func    IO_Receive;
+  IO_ReceivePayload_Func IO_ReceivePayload;
 } ES_WIFI_IO_t;
 
 typedef struct {
@@ -266,24 +299,32 @@ typedef struct {
   uint8_t           Product_Name[ES_WIFI_PRODUCT_NAME_SIZE];
   uint32_t          CPU_Clock;
   ES_WIFI_SecurityType_t Security;
+  uint8_t           CredsLoaded;  /*!< C1 to C3 taken since the last reset, C0 alone can rejoin */
   ES_WIFI_Network_t NetSettings;
   ES_WIFI_APSettings_t APSettings;
   ES_WIFI_IO_t       fops;
-  uint8_t            CmdData[ES_WIFI_DATA_SIZE];
+  uint8_t            CmdData[ES_WIFI_CMD_SIZE];  /*!< commands and their replies, payloads bypass it */
   uint32_t           Timeout;
   uint32_t           BufferSize;  
+  uint32_t           AcceptPollDelay;   /*!< current accept poll interval in ms */
+#if (ES_WIFI_USE_STATS == 1)
+  ES_WIFI_Stats_t    Stats;
+#endif
 } ES_WIFIObject_t;
 
 
 /* Exported functions --------------------------------------------------------*/
 ES_WIFI_Status_t  ES_WIFI_Init(ES_WIFIObject_t *Obj);
 ES_WIFI_Status_t  ES_WIFI_SetTimeout(ES_WIFIObject_t *Obj, uint32_t Timeout);
-ES_WIFI_Status_t  ES_WIFI_ListAccessPoints(ES_WIFIObject_t *Obj, ES_WIFI_APs_t *APs);
+ES_WIFI_Status_t  ES_WIFI_ListAccessPoints(ES_WIFIObject_t *Obj, ES_WIFI_APs_t *APs, uint8_t *pdata, uint16_t len);
 ES_WIFI_Status_t  ES_WIFI_Connect(ES_WIFIObject_t *Obj, const char* SSID, const char* Password,
                                           ES_WIFI_SecurityType_t SecType);
 ES_WIFI_Status_t  ES_WIFI_Disconnect(ES_WIFIObject_t *Obj);
 uint8_t           ES_WIFI_IsConnected(ES_WIFIObject_t *Obj);
+ES_WIFI_Status_t  ES_WIFI_GetRSSI(ES_WIFIObject_t *Obj, int16_t *rssi);
 ES_WIFI_Status_t  ES_WIFI_GetNetworkSettings(ES_WIFIObject_t *Obj);
+ES_WIFI_Status_t  ES_WIFI_SetNetworkSettings(ES_WIFIObject_t *Obj, ES_WIFI_Network_t *NetSettings);
+ES_WIFI_Status_t  ES_WIFI_Reconnect(ES_WIFIObject_t *Obj);
 ES_WIFI_Status_t  ES_WIFI_GetMACAddress(ES_WIFIObject_t *Obj, uint8_t *mac);
 ES_WIFI_Status_t  ES_WIFI_GetIPAddress(ES_WIFIObject_t *Obj, uint8_t *ipaddr);
 ES_WIFI_Status_t  ES_WIFI_GetProductID(ES_WIFIObject_t *Obj, uint8_t *productID);
@@ -333,12 +374,19 @@ ES_WIFI_Status_t  ES_WIFI_GetUARTConfig(ES_WIFIObject_t *Obj, ES_WIFI_UARTConfig
 #endif
 
 ES_WIFI_Status_t  ES_WIFI_GetSystemConfig(ES_WIFIObject_t *Obj, ES_WIFI_SystemConfig_t *pconf);
+ES_WIFI_Status_t  ES_WIFI_EnterSleepMode(ES_WIFIObject_t *Obj, uint32_t Duration);
+
+#if (ES_WIFI_USE_STATS == 1)
+ES_WIFI_Status_t  ES_WIFI_GetStats(ES_WIFIObject_t *Obj, ES_WIFI_Stats_t *Stats);
+ES_WIFI_Status_t  ES_WIFI_ResetStats(ES_WIFIObject_t *Obj);
+#endif
 
 ES_WIFI_Status_t  ES_WIFI_RegisterBusIO(ES_WIFIObject_t *Obj, IO_Init_Func IO_Init,
                                                               IO_DeInit_Func  IO_DeInit,
                                                               IO_Delay_Func   IO_Delay,
                                                               IO_Send_Func    IO_Send,
-                                                              IO_Receive_Func  IO_Receive);
+                                                              IO_Receive_Func  IO_Receive,
+                                                              IO_ReceivePayload_Func IO_ReceivePayload);
 
 ES_WIFI_Status_t  ES_WIFI_StoreCreds( ES_WIFIObject_t *Obj,
                                       ES_WIFI_CredsFunction_t credsFunction, uint8_t credSet,
@@ -57,10 +57,16 @@ extern osMutexId es_wifi_mutex;
 #define ES_WIFI_STACK_REV_SIZE                      16
 #define ES_WIFI_RTOS_REV_SIZE                       16
 
-#define ES_WIFI_DATA_SIZE                           2000  /*Increased from 1400 to fit scan result.*/
+#define ES_WIFI_DATA_SIZE                           2000  /* longest reply accepted, past it the module is reset */
+#define ES_WIFI_CMD_SIZE                            256   /* command buffer, socket payloads go to the caller's buffers */
 #define ES_WIFI_MAX_DETECTED_AP                     10
    
 #define ES_WIFI_TIMEOUT                             30000
+
+/* Accept polling: the MR/P? poll interval doubles from MIN to MAX while no
+   client shows up and drops back to MIN as soon as the module reports activity */
+#define ES_WIFI_ACCEPT_POLL_MIN_MS                  5
+#define ES_WIFI_ACCEPT_POLL_MAX_MS                  100
                                                     
 #define ES_WIFI_USE_PING                            1
 #define ES_WIFI_USE_AWS                             0
@@ -69,6 +75,19 @@ extern osMutexId es_wifi_mutex;
                                                     
 #define ES_WIFI_USE_SPI                             1  
 #define ES_WIFI_USE_UART                            (!ES_WIFI_USE_SPI)
+
+/* UART transport: UART4 on PA0/PA1, DMA2 channels 3 (TX) and 5 (RX) */
+#define ES_WIFI_UART_BAUDRATE                       115200
+#define ES_WIFI_UART_RX_RING_SIZE                   2048  /* circular DMA buffer, more than the longest reply */
+#define ES_WIFI_UART_BOOT_TIMEOUT                   2000  /* reset to first prompt (ms) */
+#define ES_WIFI_UART_WAKE_DELAY                     5     /* no ready line on UART, settle time after WAKEUP (ms) */
+
+#define ES_WIFI_SPI_HIGH_SPEED                      1  /* try 20 MHz SPI, back to 10 MHz if the link self-test fails */
+#define ES_WIFI_SPI_SELFTEST_ROUNDS                 4
+
+#define ES_WIFI_USE_SLEEP_WAIT                      1  /* WFI instead of busy-wait on DRDY/SPI events */
+
+#define ES_WIFI_USE_STATS                           1  /* counters and latency histograms per AT command class */
    
 
 
@@ -85,6 +85,7 @@ extern osMutexId es_wifi_mutex;
 #define ES_WIFI_RTOS_REV_SIZE                       16
 
 #define ES_WIFI_DATA_SIZE                           1400
+#define ES_WIFI_CMD_SIZE                            256
 #define ES_WIFI_MAX_DETECTED_AP                     10
    
 #define ES_WIFI_TIMEOUT                             0xFFFF
@@ -96,6 +97,12 @@ extern osMutexId es_wifi_mutex;
                                                     
 #define ES_WIFI_USE_SPI                             0    
 #define ES_WIFI_USE_UART                            (!ES_WIFI_USE_SPI)   
+
+/* UART transport: UART4 on PA0/PA1, DMA2 channels 3 (TX) and 5 (RX) */
+#define ES_WIFI_UART_BAUDRATE                       115200
+#define ES_WIFI_UART_RX_RING_SIZE                   2048  /* circular DMA buffer, more than the longest reply */
+#define ES_WIFI_UART_BOOT_TIMEOUT                   2000  /* reset to first prompt (ms) */
+#define ES_WIFI_UART_WAKE_DELAY                     5     /* no ready line on UART, settle time after WAKEUP (ms) */
    
 
 
@@ -26,6 +26,7 @@
 
 /* Includes ------------------------------------------------------------------*/
 #include "stm32l4xx_hal.h"
+#include "es_wifi_conf.h"
 
 /* Exported constants --------------------------------------------------------*/
 
@@ -53,10 +54,32 @@ void    SPI_WIFI_MspInit(SPI_HandleTypeDef* hspi);
 int8_t  SPI_WIFI_DeInit(void);
 int8_t  SPI_WIFI_Init(uint16_t mode);
 int8_t  SPI_WIFI_ResetModule(void);
+int8_t  SPI_WIFI_WakeUp(uint32_t timeout);
 int16_t SPI_WIFI_ReceiveData(uint8_t *pData, uint16_t len, uint32_t timeout);
+int16_t SPI_WIFI_ReceivePayload(uint8_t *pHead, uint16_t head_len, uint8_t *pData, uint16_t len,
+                                uint8_t *pTail, uint16_t tail_len, uint32_t timeout);
 int16_t SPI_WIFI_SendData( uint8_t *pData, uint16_t len, uint32_t timeout);
 void    SPI_WIFI_Delay(uint32_t Delay);
 void    SPI_WIFI_ISR(void);
+uint32_t SPI_WIFI_GetClock(void);
+uint32_t SPI_WIFI_GetTimeUs(void);
+
+#if (ES_WIFI_USE_UART == 1)
+extern UART_HandleTypeDef huart_wifi;
+
+void    UART_WIFI_MspInit(UART_HandleTypeDef* huart);
+int8_t  UART_WIFI_DeInit(void);
+int8_t  UART_WIFI_Init(uint16_t mode);
+int8_t  UART_WIFI_ResetModule(void);
+int8_t  UART_WIFI_WakeUp(uint32_t timeout);
+int16_t UART_WIFI_ReceiveData(uint8_t *pData, uint16_t len, uint32_t timeout);
+int16_t UART_WIFI_ReceivePayload(uint8_t *pHead, uint16_t head_len, uint8_t *pData, uint16_t len,
+                                 uint8_t *pTail, uint16_t tail_len, uint32_t timeout);
+int16_t UART_WIFI_SendData(uint8_t *pData, uint16_t len, uint32_t timeout);
+void    UART_WIFI_Delay(uint32_t Delay);
+void    UART_WIFI_ISR(void);
+uint32_t UART_WIFI_GetBaudRate(void);
+#endif /* ES_WIFI_USE_UART */
 
 #ifdef __cplusplus
 }
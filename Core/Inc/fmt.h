@@ -0,0 +1,44 @@
+/**
+  ******************************************************************************
+  * @file    fmt.h
+  * @brief   Text formatting without sprintf: integer, hexadecimal, IP address
+  *          and string writers for AT commands, web pages and log lines.
+  *
+  *          Every writer puts its text at buf, terminates it, and returns the
+  *          number of characters written without the terminator, so calls
+  *          chain with p += FMT_...(p, ...) and the buffer is a valid string
+  *          after each of them. There is no bound check: the caller sizes the
+  *          buffer, see the FMT_*_MAX lengths.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef FMT_H
+#define FMT_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported constants --------------------------------------------------------*/
+#define FMT_UINT_MAX        10      /* digits of 4294967295 */
+#define FMT_INT_MAX         11      /* -2147483648 */
+#define FMT_HEX_MAX         8
+#define FMT_IP_MAX          15      /* 255.255.255.255 */
+
+/* Exported functions --------------------------------------------------------*/
+uint16_t FMT_Str(char *buf, const char *s);
+uint16_t FMT_Uint(char *buf, uint32_t value);
+uint16_t FMT_UintPad(char *buf, uint32_t value, uint8_t width, char pad);
+uint16_t FMT_Int(char *buf, int32_t value);
+uint16_t FMT_Hex(char *buf, uint32_t value);
+uint16_t FMT_IP(char *buf, const uint8_t *ip);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FMT_H */
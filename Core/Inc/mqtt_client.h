@@ -0,0 +1,65 @@
+/**
+  ******************************************************************************
+  * @file    mqtt_client.h
+  * @brief   Minimal MQTT 3.1.1 publisher on top of the ES-WiFi TCP client.
+  *
+  *          Supported: CONNECT (clean session, no will, no credentials),
+  *          PUBLISH QoS 0 and 1, PUBACK, PINGREQ/PINGRESP. No subscriptions.
+  *
+  *          Publishes are queued in one transmit buffer and go out together
+  *          on the next MQTT_Flush or MQTT_Process, so a batch of topics costs
+  *          one ES_WIFI_SendData. QoS 1 messages are kept until their PUBACK
+  *          and sent again (DUP set) after a timeout or a reconnection.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef MQTT_CLIENT_H
+#define MQTT_CLIENT_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "wifi.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define MQTT_SOCKET                 2       /* 0: web server, 1: telemetry */
+#define MQTT_TX_BUFFER_SIZE         512     /* publishes packed in one send */
+#define MQTT_RX_BUFFER_SIZE         64
+#define MQTT_MAX_INFLIGHT           4       /* QoS 1 messages waiting for PUBACK */
+#define MQTT_MAX_PACKET             128     /* largest QoS 1 packet kept for retry */
+#define MQTT_MAX_CLIENT_ID          23
+#define MQTT_ACK_TIMEOUT            5000    /* CONNACK, PUBACK, PINGRESP (ms) */
+#define MQTT_RECONNECT_DELAY        5000    /* between two connection attempts (ms) */
+#define MQTT_SEND_TIMEOUT           1000
+
+/* Exported types ------------------------------------------------------------*/
+typedef enum
+{
+  MQTT_STATE_DISCONNECTED = 0,
+  MQTT_STATE_CONNECTING   = 1,   /* CONNECT sent, waiting for CONNACK */
+  MQTT_STATE_CONNECTED    = 2,
+} MQTT_State_t;
+
+typedef enum
+{
+  MQTT_QOS0 = 0,
+  MQTT_QOS1 = 1,
+} MQTT_QoS_t;
+
+/* Exported functions --------------------------------------------------------*/
+void          MQTT_Init(uint8_t *broker_ip, uint16_t broker_port, const char *client_id, uint16_t keepalive);
+WIFI_Status_t MQTT_Publish(const char *topic, const uint8_t *payload, uint16_t len, MQTT_QoS_t qos, uint8_t retain);
+WIFI_Status_t MQTT_Flush(void);
+WIFI_Status_t MQTT_Process(void);
+void          MQTT_Disconnect(void);
+MQTT_State_t  MQTT_GetState(void);
+uint8_t       MQTT_GetPending(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MQTT_CLIENT_H */
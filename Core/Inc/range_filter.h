@@ -0,0 +1,66 @@
+/**
+  ******************************************************************************
+  * @file    range_filter.h
+  * @brief   Fixed-point filter for a stream of ToF ranges.
+  *
+  *          Each sample goes through a sliding median of RANGE_FILTER_WINDOW
+  *          samples, which throws away a short spike whatever its size, then
+  *          an alpha-beta tracker that smooths the noise and estimates the
+  *          velocity. A median output further than RANGE_FILTER_GATE_MM from
+  *          the prediction made it past the median, so it is a real step
+  *          (something walked in): the tracker jumps to it instead of
+  *          slewing, and the filter lags the sensor by the median alone,
+  *          (RANGE_FILTER_WINDOW - 1) / 2 samples.
+  *
+  *          A sample with a bad range status counts as nothing in view,
+  *          RANGE_FILTER_FAR_MM. Everything runs in integers, positions in
+  *          mm and velocities in mm/s, both 24.8 fixed point; the cost of a
+  *          sample does not depend on the data.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef RANGE_FILTER_H
+#define RANGE_FILTER_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported constants --------------------------------------------------------*/
+#define RANGE_FILTER_WINDOW         3       /* median length, odd, 1 = no median */
+#define RANGE_FILTER_ALPHA          128     /* position gain, /256 */
+#define RANGE_FILTER_BETA           32      /* velocity gain, /256 */
+#define RANGE_FILTER_GATE_MM        150     /* further than this from the prediction is a step */
+#define RANGE_FILTER_FAR_MM         8190    /* range taken for an invalid sample */
+#define RANGE_FILTER_MAX_DT_MS      500     /* longer gaps are clamped */
+#define RANGE_FILTER_MAX_SPEED      8000    /* mm/s, velocity estimate clamp */
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct
+{
+  uint16_t Window[RANGE_FILTER_WINDOW]; /* last raw ranges, oldest overwritten */
+  uint8_t  Next;                        /* slot of the next sample */
+  uint8_t  Primed;                      /* 0 until the first sample */
+  uint32_t LastTick;
+  int32_t  Position;                    /* mm, 24.8 */
+  int32_t  Velocity;                    /* mm/s, 24.8, negative when closing in */
+  uint32_t Samples;
+  uint32_t Spikes;                      /* raw samples the median threw away */
+  uint32_t Steps;                       /* tracker jumped to a new range */
+} RANGE_Filter_t;
+
+/* Exported functions --------------------------------------------------------*/
+void     RANGE_FILTER_Init(RANGE_Filter_t *filter);
+uint16_t RANGE_FILTER_Update(RANGE_Filter_t *filter, uint32_t tick, uint16_t mm, uint8_t status);
+uint16_t RANGE_FILTER_GetDistance(const RANGE_Filter_t *filter);
+int32_t  RANGE_FILTER_GetVelocity(const RANGE_Filter_t *filter);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RANGE_FILTER_H */
@@ -60,6 +60,8 @@ void EXTI9_5_IRQHandler(void);
 void TIM1_UP_TIM16_IRQHandler(void);
 void EXTI15_10_IRQHandler(void);
 /* USER CODE BEGIN EFP */
+void I2C2_EV_IRQHandler(void);
+void I2C2_ER_IRQHandler(void);
 
 /* USER CODE END EFP */
 
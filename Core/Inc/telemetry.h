@@ -0,0 +1,62 @@
+/**
+  ******************************************************************************
+  * @file    telemetry.h
+  * @brief   UDP telemetry: batches of raw sensor samples pushed to a collector.
+  *
+  *          Datagram layout, all fields little endian:
+  *
+  *            offset  size  field
+  *            0       2     magic, 'T' 'L'
+  *            2       1     version (TELEMETRY_VERSION)
+  *            3       1     number of samples in this datagram
+  *            4       4     sequence number, +1 per datagram
+  *            8       4     tick of the first sample (ms since boot)
+  *            12      2     samples dropped since the previous datagram
+  *            14      1     s8 RSSI of the WiFi link (dBm), 0 when unknown
+  *            15      1     reserved, 0
+  *            16      10*n  samples:
+  *                          u16 ms since the first sample
+  *                          u16 distance (mm)
+  *                          u16 return signal rate (MCPS, 8.8 fixed point)
+  *                          s16 temperature (0.01 degC)
+  *                          u8  sensor index
+  *                          u8  reserved, 0
+  *
+  *          A gap in the sequence numbers is a lost datagram, the dropped
+  *          field counts samples that never made it into one.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "wifi.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define TELEMETRY_SOCKET            1       /* socket 0 is the web server */
+#define TELEMETRY_BATCH_MS          1000    /* one datagram per interval */
+#define TELEMETRY_MAX_SAMPLES       64      /* per datagram */
+#define TELEMETRY_SEND_TIMEOUT      100
+#define TELEMETRY_VERSION           3
+
+#define TELEMETRY_HEADER_SIZE       16
+#define TELEMETRY_SAMPLE_SIZE       10
+#define TELEMETRY_DATAGRAM_SIZE     (TELEMETRY_HEADER_SIZE + (TELEMETRY_MAX_SAMPLES * TELEMETRY_SAMPLE_SIZE))
+
+/* Exported functions --------------------------------------------------------*/
+WIFI_Status_t TELEMETRY_Init(uint8_t *collector_ip, uint16_t collector_port);
+void          TELEMETRY_AddSample(uint8_t sensor, uint32_t tick, uint16_t distance, uint32_t signal_rate, float temperature);
+void          TELEMETRY_SetLinkQuality(int16_t rssi);
+WIFI_Status_t TELEMETRY_Process(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TELEMETRY_H */
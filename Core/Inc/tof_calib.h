@@ -0,0 +1,51 @@
+/**
+  ******************************************************************************
+  * @file    tof_calib.h
+  * @brief   VL53L0X reference calibration kept in the last flash page.
+  *
+  *          The reference SPAD management and the VHV/phase calibration take
+  *          a few hundred milliseconds and give the same result for a given
+  *          sensor and cover glass. They are run on the first boot and the
+  *          results stored here, one record per sensor; later boots hand
+  *          them back to the sensor instead. The page is left out of FLASH
+  *          in the linker scripts, a record is only trusted when the page
+  *          magic, layout and CRC match. TOF_CALIB_Erase forces a new
+  *          calibration at the next boot (sensor or cover glass changed).
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef TOF_CALIB_H
+#define TOF_CALIB_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32l4xx_hal.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define TOF_CALIB_ADDRESS           0x080FF800  /* last 2 KB page of the 1 MB flash */
+#define TOF_CALIB_SENSORS           4           /* records in the page */
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct
+{
+  uint32_t RefSpadCount;
+  uint8_t  IsApertureSpads;
+  uint8_t  VhvSettings;
+  uint8_t  PhaseCal;
+  uint8_t  Valid;                   /* 1 once the sensor was calibrated */
+} TOF_Calib_t;
+
+/* Exported functions --------------------------------------------------------*/
+HAL_StatusTypeDef TOF_CALIB_Load(uint8_t sensor, TOF_Calib_t *calib);
+HAL_StatusTypeDef TOF_CALIB_Save(uint8_t sensor, const TOF_Calib_t *calib);
+HAL_StatusTypeDef TOF_CALIB_Erase(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TOF_CALIB_H */
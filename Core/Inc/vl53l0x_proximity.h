@@ -0,0 +1,144 @@
+/**
+  ******************************************************************************
+  * @file    vl53l0x_proximity.h
+  * @brief   VL53L0X time-of-flight sensors in continuous ranging.
+  *
+  *          PROXIMITY_SENSORS sensors share the I2C bus, each with its own
+  *          XSHUT and GPIO1 pins (SensorPins in vl53l0x_proximity.c). They
+  *          all boot on the same address, so the init holds every one in
+  *          reset and brings them up one at a time, each moved to an address
+  *          of its own before the next is released. Each sensor has its own
+  *          fence and calibration record; the samples of all of them go to
+  *          one queue, tagged with the sensor index.
+  *
+  *          The reference SPAD and VHV/phase calibrations run on the first
+  *          boot only, later boots restore them from flash (tof_calib.h).
+  *
+  *          Every sensor ranges on its own, back to back or every
+  *          PROXIMITY_INTER_MEASUREMENT_MS, and raises its GPIO1 when a
+  *          sample is ready. The GPIO1 interrupt starts an interrupt driven
+  *          read of the result and clear of the sensor interrupt, the I2C
+  *          interrupt queues the sample at the end, so the CPU is back to the
+  *          web server while the bytes are on the bus (PROXIMITY_ASYNC_FETCH
+  *          0 does it all with blocking reads in the GPIO1 interrupt). A
+  *          sensor whose edge comes while another one is being read is
+  *          fetched right after it, from the I2C interrupt: the reads take
+  *          turns on the one bus, but none waits for the main loop. A sensor
+  *          whose GPIO1 shares its EXTI vector with other devices only flags
+  *          its samples, for that chain or the main loop to read. The
+  *          application drains the queue with VL53L0X_PROXIMITY_GetSample
+  *          whenever it gets to it, so no sample is lost while a web page is
+  *          being served and the CPU never waits for a measurement.
+  *
+  *          With a fence set (VL53L0X_PROXIMITY_SetFence) a sensor checks
+  *          the range itself: GPIO1 is switched to the threshold-crossed-low
+  *          function and only rises for a range inside the fence, so the
+  *          interrupt reports PROXIMITY_EVENT_FENCE without waiting for the
+  *          bus or the main loop, and a quiet scene costs no interrupt at
+  *          all. The range registers keep updating, VL53L0X_PROXIMITY_Process
+  *          reads them every PROXIMITY_POLL_MS for the display and telemetry.
+  *
+  *          The timing budget, VCSEL periods and signal/sigma limits of all
+  *          the sensors are set together from one of ST's ranging profiles,
+  *          PROXIMITY_PROFILE at boot and VL53L0X_PROXIMITY_SetProfile at run
+  *          time: high speed trades precision for a 20 ms sample, high
+  *          accuracy takes 200 ms, long range gives up ambient immunity for
+  *          distance. With timed ranging PROXIMITY_INTER_MEASUREMENT_MS must
+  *          exceed the budget.
+  *
+  *          The I2C bus is shared with the other sensors of the board. When
+  *          the interrupt finds it in use the read is left to
+  *          VL53L0X_PROXIMITY_Process, called from the main loop, which also
+  *          picks up a sample whose edge was missed (GPIO1 still high).
+  *          Blocking transfers to the other sensors from the main loop go
+  *          between VL53L0X_PROXIMITY_LockBus and VL53L0X_PROXIMITY_UnlockBus
+  *          so they never find a fetch on the bus.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef VL53L0X_PROXIMITY_H
+#define VL53L0X_PROXIMITY_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "main.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define PROXIMITY_SENSORS               1       /* on the bus, the board has one */
+#define PROXIMITY_MAX_SENSORS           2       /* entries in SensorPins */
+#define PROXIMITY_INTER_MEASUREMENT_MS  0       /* 0 = back to back, else timed ranging */
+#define PROXIMITY_FIFO_SIZE             16      /* samples kept for the application */
+#define PROXIMITY_IRQ_PRIORITY          2       /* below SysTick, the I2C timeouts run on it */
+#define PROXIMITY_POLL_MS               50      /* range read with a fence set, 0 = never,
+                                                   at most once per timing budget */
+#define PROXIMITY_STOP_TIMEOUT_MS       100     /* ranging stop before a fence change */
+#define PROXIMITY_BOOT_MS               2       /* XSHUT release to I2C ready, 1.2 ms max,
+                                                   also the time held in reset */
+#define PROXIMITY_PROFILE               PROXIMITY_PROFILE_DEFAULT  /* at boot */
+#define PROXIMITY_ASYNC_FETCH           1       /* result read on the I2C interrupt */
+#define PROXIMITY_ASYNC_TIMEOUT_MS      5       /* longest wait for that read to end */
+
+/* Exported types ------------------------------------------------------------*/
+typedef enum
+{
+  PROXIMITY_EVENT_NONE   = 0,
+  PROXIMITY_EVENT_SAMPLE = 1,           /* new sample, no fence set */
+  PROXIMITY_EVENT_FENCE  = 2,           /* something is inside the fence */
+} PROXIMITY_Event_t;
+
+typedef enum
+{
+  PROXIMITY_PROFILE_DEFAULT       = 0,  /* 33 ms, 1.2 m */
+  PROXIMITY_PROFILE_HIGH_SPEED    = 1,  /* 20 ms, +-5% */
+  PROXIMITY_PROFILE_HIGH_ACCURACY = 2,  /* 200 ms, +-3% */
+  PROXIMITY_PROFILE_LONG_RANGE    = 3,  /* 33 ms, 2 m in the dark */
+  PROXIMITY_PROFILE_COUNT
+} PROXIMITY_Profile_t;
+
+typedef struct
+{
+  uint32_t       Tick;                  /* HAL_GetTick when the sample was read */
+  uint8_t        Sensor;                /* index of the sensor that took it */
+  uint16_t       RangeMilliMeter;
+  uint8_t        RangeStatus;           /* 0 when the range is valid */
+  FixPoint1616_t SignalRateRtnMegaCps;
+} PROXIMITY_Sample_t;
+
+typedef struct
+{
+  uint32_t Samples;                     /* read from the sensor */
+  uint32_t Deferred;                    /* left to the main loop, bus busy */
+  uint32_t Missed;                      /* picked up without an edge */
+  uint32_t Overruns;                    /* oldest sample dropped, queue full */
+  uint32_t Errors;                      /* I2C errors */
+  uint32_t FenceEvents;                 /* threshold interrupts */
+  uint8_t  Sensors;                     /* ranging */
+  uint8_t  CalibRestored;               /* sensors with the reference calibration from flash */
+  uint32_t InitMs;                      /* XSHUT release to ranging */
+  uint32_t ShadowHits;                  /* register reads kept off the bus (VL53L0X_SHADOW) */
+} PROXIMITY_Stats_t;
+
+/* Exported functions --------------------------------------------------------*/
+VL53L0X_Error VL53L0X_PROXIMITY_Init(void);
+VL53L0X_Error VL53L0X_PROXIMITY_SetFence(uint8_t sensor, uint16_t mm);
+uint16_t      VL53L0X_PROXIMITY_GetFence(uint8_t sensor);
+VL53L0X_Error VL53L0X_PROXIMITY_SetProfile(PROXIMITY_Profile_t profile);
+PROXIMITY_Profile_t VL53L0X_PROXIMITY_GetProfile(void);
+const char   *VL53L0X_PROXIMITY_ProfileName(PROXIMITY_Profile_t profile);
+PROXIMITY_Event_t VL53L0X_PROXIMITY_ISR(uint16_t pin, uint8_t *sensor);
+void          VL53L0X_PROXIMITY_Process(void);
+void          VL53L0X_PROXIMITY_LockBus(void);
+void          VL53L0X_PROXIMITY_UnlockBus(void);
+uint8_t       VL53L0X_PROXIMITY_GetSample(PROXIMITY_Sample_t *sample);
+uint16_t      VL53L0X_PROXIMITY_GetDistance(uint8_t sensor);
+void          VL53L0X_PROXIMITY_GetStats(PROXIMITY_Stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VL53L0X_PROXIMITY_H */
@@ -26,6 +26,16 @@
 #endif
 
 /* Includes ------------------------------------------------------------------*/
+/**
+ * @def VL53L0X_SHADOW
+ * @brief Keep a copy of the static configuration registers (timeouts, VCSEL periods, sequence, GPIO and
+ *        threshold settings) and serve their reads from RAM, 0 to always read the device
+ */
+#ifndef VL53L0X_SHADOW
+#define VL53L0X_SHADOW      1
+#endif
+#define VL53L0X_SHADOW_REGS 20          /*!< registers in the shadow, at most 32 */
+
 /* Exported types ------------------------------------------------------------*/
 /**
  * @struct  VL53L0X_Dev_t
@@ -40,6 +50,18 @@ typedef struct {
     I2C_HandleTypeDef *I2cHandle;
     uint8_t   I2cDevAddr;
 
+    GPIO_TypeDef *Gpio1Port;    /*!< GPIO1 for VL53L0X_PollingDelay, NULL when not wired. Only used while GPIO1
+                                     is new-sample-ready active high, its EXTI line on the rising edge, unmasked,
+                                     and its vector disabled (the pending flag is the edge) */
+    uint16_t  Gpio1Pin;
+
+#if VL53L0X_SHADOW
+    uint8_t   ShadowData[VL53L0X_SHADOW_REGS];
+    uint32_t  ShadowValid;      /*!< bit n set when ShadowData[n] matches the device */
+    uint8_t   ShadowPage;       /*!< register page selected with 0xFF, only page 0 is shadowed */
+    uint32_t  ShadowHits;       /*!< register reads served from the shadow */
+#endif
+
     char    DevLetter;
 
     int     Id;
@@ -205,8 +227,65 @@ VL53L0X_Error VL53L0X_RdDWord(VL53L0X_DEV Dev, uint8_t index, uint32_t *data);
  */
 VL53L0X_Error VL53L0X_UpdateByte(VL53L0X_DEV Dev, uint8_t index, uint8_t AndData, uint8_t OrData);
 
+/**
+ * Forget the register shadow, the next reads go to the device
+ *
+ * Needed when the device was reset behind the driver's back (XSHUT, power), a soft reset through
+ * the API is caught by the shadow itself. Does nothing without @a VL53L0X_SHADOW.
+ * @param   Dev        Device Handle
+ */
+void VL53L0X_ShadowReset(VL53L0X_DEV Dev);
+
 /** @} end of VL53L0X_registerAccess_group */
 
+/**
+ * @defgroup VL53L0X_asyncAccess_group Interrupt driven register access
+ * @brief    Transfers that return at once, the data phase runs on the I2C
+ *           interrupt and the callback is called from it when it is over.
+ *           One transfer at a time; the next one of a sequence is started
+ *           from the callback. The I2C event and error interrupts must be
+ *           enabled and routed to HAL_I2C_EV_IRQHandler/HAL_I2C_ER_IRQHandler.
+ *  @{
+ */
+
+/**
+ * Completion of an interrupt driven transfer
+ * @param   Dev       Device Handle
+ * @param   Status    VL53L0X_ERROR_NONE or VL53L0X_ERROR_CONTROL_INTERFACE
+ */
+typedef void (*VL53L0X_AsyncCallback_t)(VL53L0X_DEV Dev, VL53L0X_Error Status);
+
+/**
+ * Start reading contiguous registers
+ * @param   Dev       Device Handle
+ * @param   index     The register index
+ * @param   pdata     Pointer to uint8_t buffer to store read data, must stay valid until the callback
+ * @param   count     Number of uint8_t's to read
+ * @param   done      Called from the I2C interrupt with the result
+ * @return  VL53L0X_ERROR_NONE        Transfer started, done will be called
+ * @return  VL53L0X_ERROR_CONTROL_INTERFACE  Bus busy or not started, done will not be called
+ */
+VL53L0X_Error VL53L0X_ReadMulti_IT(VL53L0X_DEV Dev, uint8_t index, uint8_t *pdata, uint32_t count, VL53L0X_AsyncCallback_t done);
+
+/**
+ * Start writing a single byte register
+ * @param   Dev       Device Handle
+ * @param   index     The register index
+ * @param   data      8 bit register data
+ * @param   done      Called from the I2C interrupt with the result
+ * @return  VL53L0X_ERROR_NONE        Transfer started, done will be called
+ * @return  VL53L0X_ERROR_CONTROL_INTERFACE  Bus busy or not started, done will not be called
+ */
+VL53L0X_Error VL53L0X_WrByte_IT(VL53L0X_DEV Dev, uint8_t index, uint8_t data, VL53L0X_AsyncCallback_t done);
+
+/**
+ * Whether an interrupt driven transfer is in progress
+ * @return  1 until its callback was called
+ */
+uint8_t VL53L0X_AsyncBusy(void);
+
+/** @} end of VL53L0X_asyncAccess_group */
+
     
 /**
  * @brief execute delay in all polling API call
@@ -216,6 +295,9 @@ VL53L0X_Error VL53L0X_UpdateByte(VL53L0X_DEV Dev, uint8_t index, uint8_t AndData
  * @code
  * #define VL53L0X_PollingDelay(...) (void)0
  * @endcode
+ * Here the delay is a fraction of the timing budget, so a measurement is picked up a few percent of the budget
+ * after it ends. With GPIO1 usable (see @a VL53L0X_Dev_t::Gpio1Port) it waits on the data ready edge instead,
+ * for up to a few steps, and returns as soon as it comes.
  * @param Dev       Device Handle
  * @return  VL53L0X_ERROR_NONE        Success
  * @return  "Other error code"    See ::VL53L0X_Error
@@ -34,6 +34,7 @@
 #define WIFI_MAX_CONNECTIONS          4
 #define WIFI_MAX_MODULE_NAME          100
 #define WIFI_MAX_CONNECTED_STATIONS   2
+#define WIFI_READAHEAD_SOCKETS        WIFI_MAX_CONNECTIONS  /* TCP sockets below it read ahead, 0 = none */
 #define  WIFI_MSG_JOINED      1
 #define  WIFI_MSG_ASSIGNED    2
 
@@ -115,15 +116,34 @@ typedef struct {
   uint8_t          Gateway_Addr[4];
 } WIFI_Conn_t;
 
+/* Counters of the receive read-ahead: ModuleReads against Reads is what the
+   buffering saves, each module read costs P0, R1, R2 and R0 */
+typedef struct {
+  uint32_t Reads;                                           /*!< WIFI_ReceiveData calls on read-ahead sockets */
+  uint32_t ModuleReads;                                     /*!< of them, reads that went to the module */
+  uint32_t Direct;                                          /*!< of those, payload-sized reads into the caller's buffer */
+  uint32_t Dropped;                                         /*!< bytes left unread when a connection ended */
+} WIFI_ReadAheadStats_t;
+
 /* Exported macro ------------------------------------------------------------*/
 /* Exported functions ------------------------------------------------------- */
 WIFI_Status_t       WIFI_Init(void);
 WIFI_Status_t       WIFI_ListAccessPoints(WIFI_APs_t *APs, uint8_t AP_MaxNbr);
+WIFI_Status_t       WIFI_ScanAccessPoints(ES_WIFI_APs_t *APs);
 WIFI_Status_t       WIFI_Connect(
                              const char* SSID,
                              const char* Password,
                              WIFI_Ecn_t ecn);
 WIFI_Status_t       WIFI_GetIP_Address(uint8_t  *ipaddr);
+WIFI_Status_t       WIFI_Reconnect(void);
+uint8_t             WIFI_HasCredentials(void);
+uint8_t             WIFI_IsConnected(void);
+WIFI_Status_t       WIFI_GetRSSI(int16_t *rssi);
+WIFI_Status_t       WIFI_GetNetworkSettings(uint8_t *ipaddr, uint8_t *mask, uint8_t *gateway, uint8_t *dns);
+WIFI_Status_t       WIFI_SetStaticIP(uint8_t *ipaddr, uint8_t *mask, uint8_t *gateway, uint8_t *dns);
+WIFI_Status_t       WIFI_EnableDHCP(void);
+WIFI_Status_t       WIFI_Sleep(uint32_t duration);
+WIFI_Status_t       WIFI_WakeUp(uint32_t Timeout, uint32_t *latency);
 WIFI_Status_t       WIFI_GetMAC_Address(uint8_t  *mac);
 
 WIFI_Status_t       WIFI_Disconnect(void);
@@ -148,6 +168,8 @@ WIFI_Status_t       WIFI_StopServer(uint32_t socket);
 WIFI_Status_t       WIFI_SendData(uint8_t socket, uint8_t *pdata, uint16_t Reqlen, uint16_t *SentDatalen, uint32_t Timeout);
 WIFI_Status_t       WIFI_SendDataTo(uint8_t socket, uint8_t *pdata, uint16_t Reqlen, uint16_t *SentDatalen, uint32_t Timeout, uint8_t *ipaddr, uint16_t port);
 WIFI_Status_t       WIFI_ReceiveData(uint8_t socket, uint8_t *pdata, uint16_t Reqlen, uint16_t *RcvDatalen, uint32_t Timeout);
+uint16_t            WIFI_ReceivePending(uint8_t socket);
+void                WIFI_GetReadAheadStats(WIFI_ReadAheadStats_t *stats);
 WIFI_Status_t       WIFI_ReceiveDataFrom(uint8_t socket, uint8_t *pdata, uint16_t Reqlen, uint16_t *RcvDatalen, uint32_t Timeout, uint8_t *ipaddr, uint16_t *port);
 WIFI_Status_t       WIFI_StartClient(void);
 WIFI_Status_t       WIFI_StopClient(void);
@@ -159,6 +181,10 @@ WIFI_Status_t       WIFI_ModuleFirmwareUpdate(const char *url);
 WIFI_Status_t       WIFI_GetModuleID(char *Id);
 WIFI_Status_t       WIFI_GetModuleFwRevision(char *rev);
 WIFI_Status_t       WIFI_GetModuleName(char *ModuleName);
+#if (ES_WIFI_USE_STATS == 1)
+WIFI_Status_t       WIFI_GetStats(ES_WIFI_Stats_t *stats);
+WIFI_Status_t       WIFI_ResetStats(void);
+#endif
 #ifdef __cplusplus
 }
 #endif
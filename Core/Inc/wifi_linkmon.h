@@ -0,0 +1,82 @@
+/**
+  ******************************************************************************
+  * @file    wifi_linkmon.h
+  * @brief   WiFi link quality monitor: samples the RSSI of the association
+  *          (CR), keeps the last access point scan (F0) and moves to a
+  *          stronger access point of the same SSID when the link stays weak.
+  *
+  *          The AT command set has no way to pick a BSSID, C0 joins the
+  *          strongest access point of the SSID. Roaming is therefore CD then
+  *          C0, and it is only tried when the cached scan shows an access
+  *          point of the SSID at least LINKMON_ROAM_MARGIN above the current
+  *          signal, so a weak link with nothing better around is left alone.
+  *          A roam drops every socket: LINKMON_EVENT_ROAMED means the servers
+  *          have to be started again. A failed roam leaves the link down, the
+  *          supervisor finds it at its next check.
+  *
+  *          Nothing runs in the background: LINKMON_Process is called from
+  *          the main loop while the link is up and the module awake. A sample
+  *          costs one AT command, a scan blocks for the module's scan time
+  *          (a few seconds) and is only made when the cache is too old.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef WIFI_LINKMON_H
+#define WIFI_LINKMON_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "wifi.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define LINKMON_SAMPLE_PERIOD       5000    /* RSSI sample (ms) */
+#define LINKMON_WEAK_RSSI           (-75)   /* dBm, below it the sample is weak */
+#define LINKMON_WEAK_SAMPLES        3       /* weak samples in a row before a roam */
+#define LINKMON_ROAM_MARGIN         8       /* dB a candidate must be above the link */
+#define LINKMON_SCAN_MAX_AGE        60000   /* cached scan reused for a roam (ms) */
+#define LINKMON_SCAN_PERIOD         600000  /* cache refresh on a good link (ms) */
+#define LINKMON_ROAM_HOLDOFF        120000  /* between two roam decisions (ms) */
+
+/* Exported types ------------------------------------------------------------*/
+typedef enum
+{
+  LINKMON_EVENT_NONE        = 0,
+  LINKMON_EVENT_ROAMED      = 1,    /* joined again, servers have to be restarted */
+  LINKMON_EVENT_ROAM_FAILED = 2,    /* left the access point and could not join */
+} LINKMON_Event_t;
+
+typedef struct
+{
+  uint32_t Samples;
+  uint32_t WeakSamples;
+  int16_t  Rssi;            /* last sample (dBm), 0 before the first one */
+  int16_t  MinRssi;
+  int16_t  MaxRssi;
+  int32_t  TotalRssi;       /* over Samples, for the average */
+  uint32_t SampleFailures;
+  uint32_t Scans;
+  uint32_t ScanFailures;
+  uint32_t Roams;
+  uint32_t RoamFailures;
+  uint32_t NoCandidate;     /* weak link and nothing better in the scan */
+  uint8_t  ScanAPs;         /* access points of the SSID in the last scan */
+  int16_t  ScanBestRssi;    /* strongest of them (dBm), 0 when none */
+} LINKMON_Stats_t;
+
+/* Exported functions --------------------------------------------------------*/
+void            LINKMON_Init(const char *ssid);
+LINKMON_Event_t LINKMON_Process(void);
+void            LINKMON_LinkUp(void);
+int16_t         LINKMON_GetRssi(void);
+const ES_WIFI_APs_t *LINKMON_GetScan(uint32_t *age);
+void            LINKMON_GetStats(LINKMON_Stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* WIFI_LINKMON_H */
@@ -0,0 +1,60 @@
+/**
+  ******************************************************************************
+  * @file    wifi_powersave.h
+  * @brief   WiFi module power save: puts the module to sleep (MS) once the
+  *          network has been idle for a while, and wakes it up again either
+  *          when its sleep window ends or, through the WAKEUP pin, as soon
+  *          as something has to go out.
+  *
+  *          The association is kept while the module sleeps, but it answers
+  *          no command: incoming connections wait for the next wake window,
+  *          which is the responsiveness traded for the lower average current.
+  *          Every early wake-up is timed from the pin edge to CMD/DATA READY,
+  *          see POWERSAVE_GetStats.
+  *
+  *          Nothing runs in the background: POWERSAVE_Process is called from
+  *          the main loop, and no other WiFi call may be made while
+  *          POWERSAVE_IsAsleep is true, except after POWERSAVE_WakeUp.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef WIFI_POWERSAVE_H
+#define WIFI_POWERSAVE_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "wifi.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define POWERSAVE_WAKE_TIMEOUT      100     /* WAKEUP edge to module ready (ms) */
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct
+{
+  uint32_t Sleeps;
+  uint32_t PinWakes;        /* woken early for outbound traffic */
+  uint32_t TimerWakes;      /* slept the whole window */
+  uint32_t WakeFailures;    /* module not ready within POWERSAVE_WAKE_TIMEOUT */
+  uint32_t LastWakeUs;      /* pin wake-ups only */
+  uint32_t MaxWakeUs;
+  uint32_t TotalWakeUs;
+  uint32_t AsleepMs;
+} POWERSAVE_Stats_t;
+
+/* Exported functions --------------------------------------------------------*/
+void          POWERSAVE_Init(uint32_t idle_ms, uint32_t sleep_ms);
+WIFI_Status_t POWERSAVE_Process(void);
+WIFI_Status_t POWERSAVE_WakeUp(void);
+void          POWERSAVE_Touch(void);
+uint8_t       POWERSAVE_IsAsleep(void);
+void          POWERSAVE_GetStats(POWERSAVE_Stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* WIFI_POWERSAVE_H */
@@ -0,0 +1,60 @@
+/**
+  ******************************************************************************
+  * @file    wifi_supervisor.h
+  * @brief   WiFi link supervisor: makes the first join, checks the association
+  *          while the link is up and rejoins with exponential backoff once it
+  *          is lost.
+  *
+  *          Rejoins go from cheapest to most thorough:
+  *            1. C0 alone with the IP settings of the last DHCP lease set as
+  *               static, so the join skips the DHCP exchange
+  *            2. C0 alone with DHCP
+  *            3. full WIFI_Init + WIFI_Connect, the module is reset
+  *          The credentials stay in the module between joins, only a reset
+  *          clears them.
+  *
+  *          Nothing runs in the background: SUPERVISOR_Process is called from
+  *          the main loop and costs one AT command (CS) per check period
+  *          while the link is up. A join attempt blocks for the module's join
+  *          time, the backoff keeps those attempts rare.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef WIFI_SUPERVISOR_H
+#define WIFI_SUPERVISOR_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "wifi.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define SUPERVISOR_CHECK_PERIOD     2000    /* association check while up (ms) */
+#define SUPERVISOR_BACKOFF_MIN      1000    /* first retry delay (ms) */
+#define SUPERVISOR_BACKOFF_MAX      60000   /* retry delay ceiling (ms) */
+#define SUPERVISOR_FAST_ATTEMPTS    2       /* C0-only rejoins before a full one */
+#define SUPERVISOR_MAX_FAILURES     3       /* reported errors that mean link lost */
+
+/* Exported types ------------------------------------------------------------*/
+typedef enum
+{
+  SUPERVISOR_EVENT_NONE      = 0,
+  SUPERVISOR_EVENT_LINK_UP   = 1,   /* joined, servers have to be (re)started */
+  SUPERVISOR_EVENT_LINK_LOST = 2,
+} SUPERVISOR_Event_t;
+
+/* Exported functions --------------------------------------------------------*/
+void               SUPERVISOR_Init(const char *ssid, const char *password, WIFI_Ecn_t ecn);
+SUPERVISOR_Event_t SUPERVISOR_Process(void);
+void               SUPERVISOR_ReportFailure(void);
+uint8_t            SUPERVISOR_IsLinkUp(void);
+uint32_t           SUPERVISOR_GetRejoins(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* WIFI_SUPERVISOR_H */
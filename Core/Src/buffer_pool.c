@@ -0,0 +1,68 @@
+/**
+  ******************************************************************************
+  * @file    buffer_pool.c
+  * @brief   Shared pool of payload-sized blocks for the network handlers.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "buffer_pool.h"
+
+/* Private variables ---------------------------------------------------------*/
+static uint8_t  Blocks[POOL_BLOCKS][POOL_BLOCK_SIZE];
+static uint8_t  InUse[POOL_BLOCKS];
+static uint8_t  Used;
+static uint8_t  HighWater;
+
+/**
+  * @brief  Borrow a block
+  * @param  None
+  * @retval The block, POOL_BLOCK_SIZE bytes, or NULL if all are in use
+  */
+uint8_t *POOL_Alloc(void)
+{
+  uint8_t i;
+
+  for (i = 0; i < POOL_BLOCKS; i++)
+  {
+    if (!InUse[i])
+    {
+      InUse[i] = 1;
+      if (++Used > HighWater)
+      {
+        HighWater = Used;
+      }
+      return Blocks[i];
+    }
+  }
+  return NULL;
+}
+
+/**
+  * @brief  Give a block back
+  * @param  block : block from POOL_Alloc, NULL is ignored
+  * @retval None
+  */
+void POOL_Free(uint8_t *block)
+{
+  uint8_t i;
+
+  for (i = 0; i < POOL_BLOCKS; i++)
+  {
+    if ((block == Blocks[i]) && InUse[i])
+    {
+      InUse[i] = 0;
+      Used--;
+      return;
+    }
+  }
+}
+
+/**
+  * @brief  Most blocks ever in use at the same time
+  * @param  None
+  * @retval Block count
+  */
+uint8_t POOL_GetHighWater(void)
+{
+  return HighWater;
+}
@@ -45,6 +45,7 @@
   */
 /* Includes ------------------------------------------------------------------*/
 #include "es_wifi.h"
+#include "fmt.h"
 
 /* Private defines -----------------------------------------------------------*/
 /* The socket timeout of the non-blocking sockets is supposed to be 0.
@@ -61,6 +62,10 @@
 #define AT_OK_STRING_LEN (sizeof(AT_OK_STRING) - 1)
 
 #define AT_ERROR_STRING "\r\nERROR"
+#define AT_ERROR_STRING_LEN (sizeof(AT_ERROR_STRING) - 1)
+/* An error status is reported at the head of the response or just before the
+   prompt, only that many bytes from the end are searched for it. */
+#define AT_ERROR_WINDOW         64
 
 #define AT_DELIMETER_STRING "\r\n> "
 #define AT_DELIMETER_LEN        4
@@ -88,9 +93,22 @@ static void AT_ParseSystemConfig(char *pdata, ES_WIFI_SystemConfig_t *pConfig);
 static void AT_ParseConnSettings(char *pdata, ES_WIFI_Network_t *NetSettings);
 static void AT_ParseTransportSettings(char *pdata, ES_WIFI_Transport_t *TransportSettings);
 static void AT_ParseIsConnected(char *pdata, uint8_t *isConnected);
+static ES_WIFI_Status_t AT_ParseResponse(uint8_t *pdata, int16_t len, uint8_t **payload, uint16_t *payload_len);
 static ES_WIFI_Status_t AT_ExecuteCommand(ES_WIFIObject_t *Obj, uint8_t* cmd, uint8_t *pdata);
+static ES_WIFI_Status_t AT_ExecuteCommandAs(ES_WIFIObject_t *Obj, ES_WIFI_CmdClass_t Class, uint8_t* cmd, uint8_t *pdata);
+static int16_t AT_ReceiveReply(ES_WIFIObject_t *Obj, uint32_t Timeout);
+static uint16_t AT_SetCommand(ES_WIFIObject_t *Obj, const char *cmd);
+static uint16_t AT_SetCommandNum(ES_WIFIObject_t *Obj, const char *prefix, uint32_t value);
+static uint16_t AT_SetCommandLen(ES_WIFIObject_t *Obj, const char *prefix, uint16_t len);
+static uint16_t AT_SetCommandStr(ES_WIFIObject_t *Obj, const char *prefix, const char *arg);
+static uint16_t AT_SetCommandIP(ES_WIFIObject_t *Obj, const char *prefix, const uint8_t *ip);
+static uint16_t AT_SetCredsFunction(ES_WIFIObject_t *Obj, uint8_t credsFunction, uint8_t credSet);
+static uint16_t AT_SetCredsLength(ES_WIFIObject_t *Obj, uint8_t credSet, uint8_t part, uint16_t len);
 
 uint32_t HAL_GetTick(void);
+#if (ES_WIFI_USE_STATS == 1)
+uint32_t SPI_WIFI_GetTimeUs(void);
+#endif
 /* Private functions ---------------------------------------------------------*/
 /**
   * @brief  Convert char in Hex format to integer.
@@ -274,7 +292,7 @@ static void AT_ParseInfo(ES_WIFIObject_t *Obj,uint8_t *pdata)
 /**
   * @brief  Parses Access point configuration.
   * @param  APs: Access points structure
-  * @param  ptr: pointer to string
+  * @param  ptr: pointer to string, the F0 payload without its leading "\r\n"
   * @retval None.
   */
 static void AT_ParseAP(char *pdata, ES_WIFI_APs_t *APs)
@@ -283,7 +301,7 @@ static void AT_ParseAP(char *pdata, ES_WIFI_APs_t *APs)
   char *ptr;
   APs->nbr = 0;
 
-  ptr = strtok(pdata + 2, ",");
+  ptr = strtok(pdata, ",");
 
   while ((ptr != NULL) && (APs->nbr < ES_WIFI_MAX_DETECTED_AP)) {
     switch (num++) {
@@ -707,6 +725,75 @@ static void AT_ParsePing(int32_t res[], uint32_t count,char* pdata)
 
 
 
+/**
+  * @brief  Classify a module response from its trailer.
+  *         A complete response always ends with the "\r\n> " prompt, possibly
+  *         followed by 0x15 SPI padding, so only the tail has to be checked:
+  *         the cost no longer grows with the payload and payload bytes that
+  *         happen to contain "OK" or "ERROR" are not mistaken for a status.
+  * @param  pdata: pointer to the received response
+  * @param  len: number of bytes received
+  * @param  payload: if not NULL, set to the first payload byte
+  * @param  payload_len: if not NULL, set to the payload length (trailer excluded)
+  * @retval ES_WIFI_STATUS_OK on "OK", ES_WIFI_STATUS_ERROR on "ERROR",
+  *         ES_WIFI_STATUS_IO_ERROR if the response is not properly terminated.
+  */
+static ES_WIFI_Status_t AT_ParseResponse(uint8_t *pdata, int16_t len, uint8_t **payload, uint16_t *payload_len)
+{
+  uint8_t *start = pdata;
+  uint8_t *end;
+  int16_t i;
+
+  /* drop the padding used to complete the last 16-bit SPI frame */
+  while((len > 0) && (pdata[len - 1] == 0x15))
+  {
+    len--;
+  }
+
+  if((len >= 2) && (pdata[0] == '\r') && (pdata[1] == '\n'))
+  {
+    start += 2;
+  }
+  if(payload != NULL)
+  {
+    *payload = start;
+  }
+  if(payload_len != NULL)
+  {
+    *payload_len = 0;
+  }
+
+  if((len >= (int16_t)AT_OK_STRING_LEN) &&
+     (memcmp(pdata + len - AT_OK_STRING_LEN, AT_OK_STRING, AT_OK_STRING_LEN) == 0))
+  {
+    end = pdata + len - AT_OK_STRING_LEN;
+    /* a bare "\r\nOK\r\n> " shares its leading "\r\n" with the trailer */
+    if((payload_len != NULL) && (end > start))
+    {
+      *payload_len = (uint16_t)(end - start);
+    }
+    return ES_WIFI_STATUS_OK;
+  }
+
+  if((len >= AT_DELIMETER_LEN) &&
+     (memcmp(pdata + len - AT_DELIMETER_LEN, AT_DELIMETER_STRING, AT_DELIMETER_LEN) == 0))
+  {
+    if((len >= (int16_t)AT_ERROR_STRING_LEN) &&
+       (memcmp(pdata, AT_ERROR_STRING, AT_ERROR_STRING_LEN) == 0))
+    {
+      return ES_WIFI_STATUS_ERROR;
+    }
+    for(i = len - AT_DELIMETER_LEN - AT_ERROR_STRING_LEN; (i >= 0) && (i >= len - AT_ERROR_WINDOW); i--)
+    {
+      if(memcmp(pdata + i, AT_ERROR_STRING, AT_ERROR_STRING_LEN) == 0)
+      {
+        return ES_WIFI_STATUS_ERROR;
+      }
+    }
+  }
+  return ES_WIFI_STATUS_IO_ERROR;
+}
+
 /**
   * @brief  Execute AT command.
   * @param  Obj: pointer to module handle
@@ -714,7 +801,7 @@ static void AT_ParsePing(int32_t res[], uint32_t count,char* pdata)
   * @param  pdata: pointer to returned data
   * @retval Operation Status.
   */
-static ES_WIFI_Status_t AT_ExecuteCommand(ES_WIFIObject_t *Obj, uint8_t* cmd, uint8_t *pdata)
+static ES_WIFI_Status_t AT_ExecuteCommandIO(ES_WIFIObject_t *Obj, uint8_t* cmd, uint8_t *pdata)
 {
   int ret = 0;
   int16_t recv_len = 0;
@@ -724,21 +811,22 @@ static ES_WIFI_Status_t AT_ExecuteCommand(ES_WIFIObject_t *Obj, uint8_t* cmd, ui
 
   if( ret > 0)
   {
-    recv_len = Obj->fops.IO_Receive(pdata, ES_WIFI_DATA_SIZE, Obj->Timeout);
-    if((recv_len > 0) && (recv_len <= ES_WIFI_DATA_SIZE))
+    recv_len = Obj->fops.IO_Receive(pdata, ES_WIFI_CMD_SIZE, Obj->Timeout);
+    if((recv_len > 0) && (recv_len <= ES_WIFI_CMD_SIZE))
     {
-      if (recv_len == ES_WIFI_DATA_SIZE)
+      if (recv_len == ES_WIFI_CMD_SIZE)
       {
-        // ES_WIFI_DATA_SIZE maybe too small !!
+        // ES_WIFI_CMD_SIZE maybe too small !!
         recv_len--;
       }
       *(pdata + recv_len) = 0;
-      if(strstr((char *)pdata, AT_OK_STRING))
+      ret = AT_ParseResponse(pdata, recv_len, NULL, NULL);
+      if(ret == ES_WIFI_STATUS_OK)
       {
         UNLOCK_WIFI();
         return ES_WIFI_STATUS_OK;
       }
-      else if(strstr((char *)pdata, AT_ERROR_STRING))
+      else if(ret == ES_WIFI_STATUS_ERROR)
       {
         UNLOCK_WIFI();
         return ES_WIFI_STATUS_UNEXPECTED_CLOSED_SOCKET;
@@ -764,8 +852,9 @@ static ES_WIFI_Status_t AT_ExecuteCommand(ES_WIFIObject_t *Obj, uint8_t* cmd, ui
   * @retval Operation Status.
   */
 
-static ES_WIFI_Status_t AT_RequestSendData(ES_WIFIObject_t *Obj, uint8_t* cmd, uint8_t *pcmd_data, uint16_t len, uint8_t *pdata)
+static ES_WIFI_Status_t AT_RequestSendDataIO(ES_WIFIObject_t *Obj, uint8_t* cmd, uint8_t *pcmd_data, uint16_t len, uint8_t *pdata)
 {
+  ES_WIFI_Status_t ret;
   int16_t send_len = 0;
   int16_t recv_len = 0;
   uint16_t cmd_len = 0;
@@ -782,16 +871,17 @@ static ES_WIFI_Status_t AT_RequestSendData(ES_WIFIObject_t *Obj, uint8_t* cmd, u
     send_len = Obj->fops.IO_Send(pcmd_data, len, Obj->Timeout);
     if (send_len == len)
     {
-      recv_len = Obj->fops.IO_Receive(pdata, 0, Obj->Timeout);
+      recv_len = Obj->fops.IO_Receive(pdata, ES_WIFI_CMD_SIZE - 1, Obj->Timeout);
       if (recv_len > 0)
       {
         *(pdata+recv_len) = 0;
-        if(strstr((char *)pdata, AT_OK_STRING))
+        ret = AT_ParseResponse(pdata, recv_len, NULL, NULL);
+        if(ret == ES_WIFI_STATUS_OK)
         {
           UNLOCK_WIFI();
           return ES_WIFI_STATUS_OK;
         }
-        else if(strstr((char *)pdata, AT_ERROR_STRING))
+        else if(ret == ES_WIFI_STATUS_ERROR)
         {
           UNLOCK_WIFI();
           return ES_WIFI_STATUS_UNEXPECTED_CLOSED_SOCKET;
@@ -818,8 +908,148 @@ static ES_WIFI_Status_t AT_RequestSendData(ES_WIFIObject_t *Obj, uint8_t* cmd, u
 }
 
 
+/**
+  * @brief  Read a reply that does not go through AT_ExecuteCommand (event
+  *         messages, dummy reads) into CmdData, NUL terminated.
+  * @param  Obj: pointer to module handle
+  * @param  Timeout: timeout in mS
+  * @retval Length of the reply, negative on error.
+  */
+static int16_t AT_ReceiveReply(ES_WIFIObject_t *Obj, uint32_t Timeout)
+{
+  int16_t len = Obj->fops.IO_Receive(Obj->CmdData, ES_WIFI_CMD_SIZE - 1, Timeout);
+
+  Obj->CmdData[(len > 0) ? len : 0] = 0;
+  return len;
+}
+
+/**
+  * @brief  Put a command without argument in CmdData.
+  * @param  Obj: pointer to module handle
+  * @param  cmd: command, "\r" included
+  * @retval Command length.
+  */
+static uint16_t AT_SetCommand(ES_WIFIObject_t *Obj, const char *cmd)
+{
+  return FMT_Str((char *)Obj->CmdData, cmd);
+}
+
+/**
+  * @brief  Put a command with a decimal argument in CmdData.
+  * @param  Obj: pointer to module handle
+  * @param  prefix: command up to the argument, "P0=" for instance
+  * @param  value: argument
+  * @retval Command length.
+  */
+static uint16_t AT_SetCommandNum(ES_WIFIObject_t *Obj, const char *prefix, uint32_t value)
+{
+  char *p = (char *)Obj->CmdData;
+
+  p += FMT_Str(p, prefix);
+  p += FMT_Uint(p, value);
+  p += FMT_Str(p, "\r");
+  return (uint16_t)(p - (char *)Obj->CmdData);
+}
+
+/**
+  * @brief  Put a command with a data length argument in CmdData, the module
+  *         wants it on 4 digits (S3, PG).
+  * @param  Obj: pointer to module handle
+  * @param  prefix: command up to the length
+  * @param  len: data length
+  * @retval Command length.
+  */
+static uint16_t AT_SetCommandLen(ES_WIFIObject_t *Obj, const char *prefix, uint16_t len)
+{
+  char *p = (char *)Obj->CmdData;
+
+  p += FMT_Str(p, prefix);
+  p += FMT_UintPad(p, len, 4, '0');
+  p += FMT_Str(p, "\r");
+  return (uint16_t)(p - (char *)Obj->CmdData);
+}
+
+/**
+  * @brief  Put a command with a string argument in CmdData.
+  * @param  Obj: pointer to module handle
+  * @param  prefix: command up to the argument
+  * @param  arg: argument
+  * @retval Command length.
+  */
+static uint16_t AT_SetCommandStr(ES_WIFIObject_t *Obj, const char *prefix, const char *arg)
+{
+  char *p = (char *)Obj->CmdData;
+
+  p += FMT_Str(p, prefix);
+  p += FMT_Str(p, arg);
+  p += FMT_Str(p, "\r");
+  return (uint16_t)(p - (char *)Obj->CmdData);
+}
+
+/**
+  * @brief  Put a command with an IP address argument in CmdData.
+  * @param  Obj: pointer to module handle
+  * @param  prefix: command up to the address
+  * @param  ip: address, 4 bytes
+  * @retval Command length.
+  */
+static uint16_t AT_SetCommandIP(ES_WIFIObject_t *Obj, const char *prefix, const uint8_t *ip)
+{
+  char *p = (char *)Obj->CmdData;
+
+  p += FMT_Str(p, prefix);
+  p += FMT_IP(p, ip);
+  p += FMT_Str(p, "\r");
+  return (uint16_t)(p - (char *)Obj->CmdData);
+}
+
+/**
+  * @brief  Put the command selecting a credential set in CmdData (PF).
+  * @param  Obj: pointer to module handle
+  * @param  credsFunction: what the set is selected for
+  * @param  credSet: credential set
+  * @retval Command length.
+  */
+static uint16_t AT_SetCredsFunction(ES_WIFIObject_t *Obj, uint8_t credsFunction, uint8_t credSet)
+{
+  char *p = (char *)Obj->CmdData;
+
+  p += FMT_Str(p, "PF=");
+  p += FMT_Uint(p, credsFunction);
+  p += FMT_Str(p, ",");
+  p += FMT_Uint(p, credSet);
+  p += FMT_Str(p, "\r");
+  return (uint16_t)(p - (char *)Obj->CmdData);
+}
+
+/**
+  * @brief  Put the command storing one credential in CmdData (PG).
+  * @param  Obj: pointer to module handle
+  * @param  credSet: credential set
+  * @param  part: 0 root CA, 1 certificate, 2 key
+  * @param  len: credential length
+  * @retval Command length.
+  */
+static uint16_t AT_SetCredsLength(ES_WIFIObject_t *Obj, uint8_t credSet, uint8_t part, uint16_t len)
+{
+  char *p = (char *)Obj->CmdData;
+
+  p += FMT_Str(p, "PG=");
+  p += FMT_Uint(p, credSet);
+  p += FMT_Str(p, ",");
+  p += FMT_Uint(p, part);
+  p += FMT_Str(p, ",");
+  p += FMT_UintPad(p, len, 4, '0');
+  p += FMT_Str(p, "\r");
+  return (uint16_t)(p - (char *)Obj->CmdData);
+}
+
 /**
   * @brief  Parses Received data.
+  *         The payload goes from the SPI straight into pdata. CmdData gets
+  *         the leading "\r\n" and whatever follows the payload; the last
+  *         bytes of pdata are copied next to them so that the trailer can be
+  *         checked in one piece, wherever it ended up.
   * @param  Obj: pointer to module handle
   * @param  cmd:command formatted string
   * @param  pdata: payload
@@ -827,58 +1057,186 @@ static ES_WIFI_Status_t AT_RequestSendData(ES_WIFIObject_t *Obj, uint8_t* cmd, u
   * @param  ReadData : pointer to received data length.
   * @retval Operation Status.
   */
-static ES_WIFI_Status_t AT_RequestReceiveData(ES_WIFIObject_t *Obj, uint8_t* cmd, char *pdata, uint16_t Reqlen, uint16_t *ReadData)
+static ES_WIFI_Status_t AT_RequestReceiveDataIO(ES_WIFIObject_t *Obj, uint8_t* cmd, char *pdata, uint16_t Reqlen, uint16_t *ReadData)
 {
   int len;
   uint8_t *p=Obj->CmdData;
+  uint8_t *payload;
+  uint16_t payload_len;
+  uint16_t body, tail, keep;
 
   LOCK_WIFI();
   if(Obj->fops.IO_Send(cmd, strlen((char*)cmd), Obj->Timeout) > 0)
   {
-    len = Obj->fops.IO_Receive(p, 0 , Obj->Timeout);
-    if ((p[0]!='\r') || (p[1]!='\n'))
+    len = Obj->fops.IO_ReceivePayload(p, 2, (uint8_t *)pdata, Reqlen,
+                                      p + 2, ES_WIFI_CMD_SIZE - 2 - AT_ERROR_WINDOW, Obj->Timeout);
+    if (len == ES_WIFI_ERROR_STUFFING_FOREVER )
+    {
+      UNLOCK_WIFI();
+      return ES_WIFI_STATUS_MODULE_CRASH;
+    }
+    if ((len < 2) || (p[0]!='\r') || (p[1]!='\n'))
     {
-     return  ES_WIFI_STATUS_IO_ERROR;
+      UNLOCK_WIFI();
+      return  ES_WIFI_STATUS_IO_ERROR;
     }
-    len-=2;
-    p+=2;
-    if (len >= AT_OK_STRING_LEN)
+    if (len >= (int)(AT_OK_STRING_LEN + 2))
     {
-     while(len && (p[len-1]==0x15)) len--;
-     p[len] = '\0';
-     if(strstr( (char*) p + len - AT_OK_STRING_LEN, AT_OK_STRING))
+     body = MIN(len - 2, Reqlen);
+     tail = len - 2 - body;
+     keep = MIN(body, AT_ERROR_WINDOW);
+     memmove(p + 2 + keep, p + 2, tail);
+     memcpy(p + 2, pdata + body - keep, keep);
+
+     if(AT_ParseResponse(p, 2 + keep + tail, &payload, &payload_len) == ES_WIFI_STATUS_OK)
      {
-       *ReadData = len - AT_OK_STRING_LEN;
-	   if (*ReadData > Reqlen)
+       /* payload bytes past pdata's end are dropped, as with any short read */
+       if (payload_len > keep)
        {
-         *ReadData = Reqlen;
+         memcpy(pdata + body, payload + keep, MIN(payload_len - keep, Reqlen - body));
        }
-       memcpy(pdata, p, *ReadData);
+       *ReadData = MIN(body - keep + payload_len, Reqlen);
        UNLOCK_WIFI();
        return ES_WIFI_STATUS_OK;
      }
-     else if(memcmp((char *)p + len - AT_DELIMETER_LEN , AT_DELIMETER_STRING, AT_DELIMETER_LEN) == 0)
-     {
-       *ReadData = 0;
-       UNLOCK_WIFI();
-       return ES_WIFI_STATUS_UNEXPECTED_CLOSED_SOCKET;
-     }
 
      UNLOCK_WIFI();
      *ReadData = 0;
      return ES_WIFI_STATUS_UNEXPECTED_CLOSED_SOCKET;
    }
-   if (len == ES_WIFI_ERROR_STUFFING_FOREVER )
-   {
-     UNLOCK_WIFI();
-     return ES_WIFI_STATUS_MODULE_CRASH;
-   }
   }
   UNLOCK_WIFI();
   return ES_WIFI_STATUS_IO_ERROR;
 }
 
 
+#if (ES_WIFI_USE_STATS == 1)
+/**
+  * @brief  Account one AT command in the transport statistics.
+  * @param  Obj: pointer to module handle
+  * @param  Class: command class
+  * @param  start: SPI_WIFI_GetTimeUs() when the command was issued
+  * @param  status: command status
+  * @retval status, unchanged
+  */
+static ES_WIFI_Status_t AT_RecordCommand(ES_WIFIObject_t *Obj, ES_WIFI_CmdClass_t Class, uint32_t start, ES_WIFI_Status_t status)
+{
+  ES_WIFI_CmdStats_t *cmd = &Obj->Stats.Cmd[Class];
+  uint32_t us = SPI_WIFI_GetTimeUs() - start;
+  uint8_t  bucket = 0;
+
+  while ((bucket < ES_WIFI_STATS_BUCKETS - 1) && (us >= ES_WIFI_STATS_BUCKET_US(bucket)))
+  {
+    bucket++;
+  }
+  cmd->Count++;
+  cmd->TotalUs += us;
+  cmd->Histogram[bucket]++;
+  if (us > cmd->MaxUs)
+  {
+    cmd->MaxUs = us;
+  }
+
+  if (status != ES_WIFI_STATUS_OK)
+  {
+    cmd->Errors++;
+  }
+  if (status == ES_WIFI_STATUS_IO_ERROR)
+  {
+    Obj->Stats.Timeouts++;
+  }
+  else if (status == ES_WIFI_STATUS_MODULE_CRASH)
+  {
+    /* the IO layer has already reset the module */
+    Obj->Stats.Crashes++;
+    Obj->Stats.Resets++;
+  }
+  return status;
+}
+#endif
+
+/**
+  * @brief  Execute AT command, accounted in a given class.
+  * @param  Obj: pointer to module handle
+  * @param  Class: statistics class of the command
+  * @param  cmd: pointer to command string
+  * @param  pdata: pointer to returned data
+  * @retval Operation Status.
+  */
+static ES_WIFI_Status_t AT_ExecuteCommandAs(ES_WIFIObject_t *Obj, ES_WIFI_CmdClass_t Class, uint8_t* cmd, uint8_t *pdata)
+{
+#if (ES_WIFI_USE_STATS == 1)
+  uint32_t start = SPI_WIFI_GetTimeUs();
+
+  return AT_RecordCommand(Obj, Class, start, AT_ExecuteCommandIO(Obj, cmd, pdata));
+#else
+  (void)Class;
+  return AT_ExecuteCommandIO(Obj, cmd, pdata);
+#endif
+}
+
+/**
+  * @brief  Execute a control AT command.
+  * @param  Obj: pointer to module handle
+  * @param  cmd: pointer to command string
+  * @param  pdata: pointer to returned data
+  * @retval Operation Status.
+  */
+static ES_WIFI_Status_t AT_ExecuteCommand(ES_WIFIObject_t *Obj, uint8_t* cmd, uint8_t *pdata)
+{
+  return AT_ExecuteCommandAs(Obj, ES_WIFI_CMD_CONTROL, cmd, pdata);
+}
+
+/**
+  * @brief  Execute AT command with data (S3).
+  * @param  Obj: pointer to module handle
+  * @param  cmd: pointer to command string
+  * @param  pcmd_data: pointer to binary data
+  * @param  len: binary data length
+  * @param  pdata: pointer to returned data
+  * @retval Operation Status.
+  */
+static ES_WIFI_Status_t AT_RequestSendData(ES_WIFIObject_t *Obj, uint8_t* cmd, uint8_t *pcmd_data, uint16_t len, uint8_t *pdata)
+{
+#if (ES_WIFI_USE_STATS == 1)
+  uint32_t start = SPI_WIFI_GetTimeUs();
+  ES_WIFI_Status_t ret = AT_RequestSendDataIO(Obj, cmd, pcmd_data, len, pdata);
+
+  if (ret == ES_WIFI_STATUS_OK)
+  {
+    Obj->Stats.BytesOut += len;
+  }
+  return AT_RecordCommand(Obj, ES_WIFI_CMD_SEND, start, ret);
+#else
+  return AT_RequestSendDataIO(Obj, cmd, pcmd_data, len, pdata);
+#endif
+}
+
+/**
+  * @brief  Read socket data (R0).
+  * @param  Obj: pointer to module handle
+  * @param  cmd:command formatted string
+  * @param  pdata: payload
+  * @param  Reqlen : requested Data length.
+  * @param  ReadData : pointer to received data length.
+  * @retval Operation Status.
+  */
+static ES_WIFI_Status_t AT_RequestReceiveData(ES_WIFIObject_t *Obj, uint8_t* cmd, char *pdata, uint16_t Reqlen, uint16_t *ReadData)
+{
+#if (ES_WIFI_USE_STATS == 1)
+  uint32_t start = SPI_WIFI_GetTimeUs();
+  ES_WIFI_Status_t ret = AT_RequestReceiveDataIO(Obj, cmd, pdata, Reqlen, ReadData);
+
+  if (ret == ES_WIFI_STATUS_OK)
+  {
+    Obj->Stats.BytesIn += *ReadData;
+  }
+  return AT_RecordCommand(Obj, ES_WIFI_CMD_RECEIVE, start, ret);
+#else
+  return AT_RequestReceiveDataIO(Obj, cmd, pdata, Reqlen, ReadData);
+#endif
+}
+
 /**
   * @brief  Initialize WIFI module.
   * @param  Obj: pointer to module handle
@@ -891,6 +1249,7 @@ ES_WIFI_Status_t  ES_WIFI_Init(ES_WIFIObject_t *Obj)
   LOCK_WIFI();
 
   Obj->Timeout = ES_WIFI_TIMEOUT;
+  Obj->CredsLoaded = 0;
 
   if (Obj->fops.IO_Init(ES_WIFI_INIT) == 0)
   {
@@ -987,9 +1346,10 @@ ES_WIFI_Status_t  ES_WIFI_RegisterBusIO(ES_WIFIObject_t *Obj, IO_Init_Func IO_In
                                                               IO_DeInit_Func  IO_DeInit,
                                                               IO_Delay_Func   IO_Delay,
                                                               IO_Send_Func    IO_Send,
-                                                              IO_Receive_Func  IO_Receive)
+                                                              IO_Receive_Func  IO_Receive,
+                                                              IO_ReceivePayload_Func IO_ReceivePayload)
 {
-  if(!Obj || !IO_Init || !IO_DeInit || !IO_Send || !IO_Receive)
+  if(!Obj || !IO_Init || !IO_DeInit || !IO_Send || !IO_Receive || !IO_ReceivePayload)
   {
     return ES_WIFI_STATUS_ERROR;
   }
@@ -998,6 +1358,7 @@ ES_WIFI_Status_t  ES_WIFI_RegisterBusIO(ES_WIFIObject_t *Obj, IO_Init_Func IO_In
   Obj->fops.IO_DeInit = IO_DeInit;
   Obj->fops.IO_Send = IO_Send;
   Obj->fops.IO_Receive = IO_Receive;
+  Obj->fops.IO_ReceivePayload = IO_ReceivePayload;
   Obj->fops.IO_Delay = IO_Delay;
 
   return ES_WIFI_STATUS_OK;
@@ -1017,19 +1378,28 @@ ES_WIFI_Status_t  ES_WIFI_SetTimeout(ES_WIFIObject_t *Obj, uint32_t Timeout)
 
 /**
   * @brief  List all detected APs.
+  * @note   Firmware older than UPDATED_SCAN_PARAMETERS_FW_REV answers F0 with
+  *         every access point in one reply, about 70 bytes each, which does
+  *         not fit CmdData: it is read into pdata like a socket payload.
+  *         Newer firmware sends one access point per reply and leaves pdata
+  *         alone.
   * @param  Obj: pointer to module handle
   * @param  APs: pointer Access points structure
+  * @param  pdata: buffer for a whole scan reply, NULL fails the scan on older
+  *         firmware
+  * @param  len: its size
   * @retval Operation Status.
   */
-ES_WIFI_Status_t  ES_WIFI_ListAccessPoints(ES_WIFIObject_t *Obj, ES_WIFI_APs_t *APs)
+ES_WIFI_Status_t  ES_WIFI_ListAccessPoints(ES_WIFIObject_t *Obj, ES_WIFI_APs_t *APs, uint8_t *pdata, uint16_t len)
 {
   ES_WIFI_Status_t ret;
   int send_len;
   int16_t recv_len = 0;
+  uint16_t read_len = 0;
   uint8_t version[4] = { 0 };
   LOCK_WIFI();
 
-  sprintf((char*)Obj->CmdData, (char*)Obj->FW_Rev);
+  FMT_Str((char*)Obj->CmdData, (char*)Obj->FW_Rev);
 
   AT_ParseFWRev((char*)Obj->CmdData, version);
 
@@ -1037,7 +1407,7 @@ ES_WIFI_Status_t  ES_WIFI_ListAccessPoints(ES_WIFIObject_t *Obj, ES_WIFI_APs_t *
   {
     APs->nbr = 0;
 
-    sprintf((char*)Obj->CmdData,"F0=2\r");
+    AT_SetCommand(Obj, "F0=2\r");
 
     send_len = Obj->fops.IO_Send(Obj->CmdData, strlen((char*)Obj->CmdData), Obj->Timeout);
 
@@ -1045,18 +1415,19 @@ ES_WIFI_Status_t  ES_WIFI_ListAccessPoints(ES_WIFIObject_t *Obj, ES_WIFI_APs_t *
     {
   	  do
 	  {
-	    recv_len = Obj->fops.IO_Receive(Obj->CmdData, ES_WIFI_DATA_SIZE, Obj->Timeout);
+	    recv_len = Obj->fops.IO_Receive(Obj->CmdData, ES_WIFI_CMD_SIZE - 1, Obj->Timeout);
 
-        if((recv_len > 0) && (recv_len < ES_WIFI_DATA_SIZE))
+        if((recv_len > 0) && (recv_len < ES_WIFI_CMD_SIZE))
 	    {
           *(Obj->CmdData + recv_len) = 0;
 
-	      if(strstr((char *)Obj->CmdData, AT_OK_STRING))
+	      ret = AT_ParseResponse(Obj->CmdData, recv_len, NULL, NULL);
+	      if(ret == ES_WIFI_STATUS_OK)
           {
 		    UNLOCK_WIFI();
 		    return ES_WIFI_STATUS_OK;
 	      }
-	      else if(strstr((char *)Obj->CmdData, AT_ERROR_STRING))
+	      else if(ret == ES_WIFI_STATUS_ERROR)
 	      {
             UNLOCK_WIFI();
             return ES_WIFI_STATUS_UNEXPECTED_CLOSED_SOCKET;
@@ -1074,7 +1445,7 @@ ES_WIFI_Status_t  ES_WIFI_ListAccessPoints(ES_WIFIObject_t *Obj, ES_WIFI_APs_t *
           APs->nbr++;
         }
 
-        sprintf((char*)Obj->CmdData,"MR\r");
+        AT_SetCommand(Obj, "MR\r");
 
         send_len = Obj->fops.IO_Send(Obj->CmdData, strlen((char*)Obj->CmdData), Obj->Timeout);
 	  } while (send_len == 3);
@@ -1085,10 +1456,19 @@ ES_WIFI_Status_t  ES_WIFI_ListAccessPoints(ES_WIFIObject_t *Obj, ES_WIFI_APs_t *
   }
   else
   {
-    ret = AT_ExecuteCommand(Obj,(uint8_t*)"F0\r", Obj->CmdData);
+    APs->nbr = 0;
+    if ((pdata == NULL) || (len < 2))
+    {
+      UNLOCK_WIFI();
+      return ES_WIFI_STATUS_ERROR;
+    }
+
+    AT_SetCommand(Obj, "F0\r");
+    ret = AT_RequestReceiveDataIO(Obj, Obj->CmdData, (char *)pdata, len - 1, &read_len);
     if(ret == ES_WIFI_STATUS_OK)
     {
-      AT_ParseAP((char *)Obj->CmdData, APs);
+      pdata[read_len] = 0;
+      AT_ParseAP((char *)pdata, APs);
     }
     UNLOCK_WIFI();
     return ret;
@@ -1110,22 +1490,24 @@ ES_WIFI_Status_t ES_WIFI_Connect(ES_WIFIObject_t *Obj, const char* SSID,
   ES_WIFI_Status_t ret;
   LOCK_WIFI();
 
-  sprintf((char*)Obj->CmdData,"C1=%s\r", SSID);
+  Obj->CredsLoaded = 0;
+  AT_SetCommandStr(Obj, "C1=", SSID);
   ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
   if(ret == ES_WIFI_STATUS_OK)
   {
-    sprintf((char*)Obj->CmdData,"C2=%s\r", Password);
+    AT_SetCommandStr(Obj, "C2=", Password);
     ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
 
     if(ret == ES_WIFI_STATUS_OK)
     {
       Obj->Security = SecType;
-      sprintf((char*)Obj->CmdData,"C3=%d\r", (uint8_t)SecType);
+      AT_SetCommandNum(Obj, "C3=", (uint8_t)SecType);
       ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
 
       if(ret == ES_WIFI_STATUS_OK)
       {
-        sprintf((char*)Obj->CmdData,"C0\r");
+        Obj->CredsLoaded = 1;
+        AT_SetCommand(Obj, "C0\r");
         ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
         if(ret == ES_WIFI_STATUS_OK)
         {
@@ -1147,7 +1529,7 @@ uint8_t ES_WIFI_IsConnected(ES_WIFIObject_t *Obj)
   ES_WIFI_Status_t ret ;
   LOCK_WIFI();
 
-  sprintf((char*)Obj->CmdData,"CS\r");
+  AT_SetCommand(Obj, "CS\r");
   ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
   if(ret == ES_WIFI_STATUS_OK)
   {
@@ -1156,6 +1538,27 @@ uint8_t ES_WIFI_IsConnected(ES_WIFIObject_t *Obj)
   UNLOCK_WIFI();
   return Obj->NetSettings.IsConnected;
 }
+
+/**
+  * @brief  Get the signal strength of the current association.
+  * @param  Obj: pointer to module handle
+  * @param  rssi: (OUT) signal strength in dBm
+  * @retval Operation Status, an error when not associated.
+  */
+ES_WIFI_Status_t ES_WIFI_GetRSSI(ES_WIFIObject_t *Obj, int16_t *rssi)
+{
+  ES_WIFI_Status_t ret;
+  LOCK_WIFI();
+
+  AT_SetCommand(Obj, "CR\r");
+  ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+  if(ret == ES_WIFI_STATUS_OK)
+  {
+    *rssi = (int16_t)ParseNumber((char *)Obj->CmdData + 2, NULL);
+  }
+  UNLOCK_WIFI();
+  return ret;
+}
 /**
   * @brief  Disconnect from a network.
   * @param  Obj: pointer to module handle
@@ -1165,7 +1568,7 @@ ES_WIFI_Status_t ES_WIFI_Disconnect(ES_WIFIObject_t *Obj)
 {
    ES_WIFI_Status_t ret;
    LOCK_WIFI();
-   sprintf((char*)Obj->CmdData,"CD\r");
+   AT_SetCommand(Obj, "CD\r");
    ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
    UNLOCK_WIFI();
    return  ret;
@@ -1181,7 +1584,7 @@ ES_WIFI_Status_t ES_WIFI_GetNetworkSettings(ES_WIFIObject_t *Obj)
   ES_WIFI_Status_t ret;
   LOCK_WIFI();
 
-  sprintf((char*)Obj->CmdData,"C?\r");
+  AT_SetCommand(Obj, "C?\r");
   ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
 
   if(ret == ES_WIFI_STATUS_OK)
@@ -1193,6 +1596,71 @@ ES_WIFI_Status_t ES_WIFI_GetNetworkSettings(ES_WIFIObject_t *Obj)
   return ret;
 }
 
+/**
+  * @brief  Select how the next join gets its IP settings.
+  * @param  Obj: pointer to module handle
+  * @param  NetSettings: DHCP_IsEnabled, and when it is 0 the IP_Addr,
+  *         IP_Mask, Gateway_Addr and DNS1 to configure
+  * @retval Operation Status.
+  */
+ES_WIFI_Status_t ES_WIFI_SetNetworkSettings(ES_WIFIObject_t *Obj, ES_WIFI_Network_t *NetSettings)
+{
+  ES_WIFI_Status_t ret;
+  LOCK_WIFI();
+
+  AT_SetCommandNum(Obj, "C4=", NetSettings->DHCP_IsEnabled ? 1 : 0);
+  ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+
+  if((ret == ES_WIFI_STATUS_OK) && !NetSettings->DHCP_IsEnabled)
+  {
+    AT_SetCommandIP(Obj, "C6=", NetSettings->IP_Addr);
+    ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+  }
+  if((ret == ES_WIFI_STATUS_OK) && !NetSettings->DHCP_IsEnabled)
+  {
+    AT_SetCommandIP(Obj, "C7=", NetSettings->IP_Mask);
+    ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+  }
+  if((ret == ES_WIFI_STATUS_OK) && !NetSettings->DHCP_IsEnabled)
+  {
+    AT_SetCommandIP(Obj, "C8=", NetSettings->Gateway_Addr);
+    ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+  }
+  if((ret == ES_WIFI_STATUS_OK) && !NetSettings->DHCP_IsEnabled)
+  {
+    AT_SetCommandIP(Obj, "C9=", NetSettings->DNS1);
+    ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+  }
+
+  if(ret == ES_WIFI_STATUS_OK)
+  {
+    Obj->NetSettings.DHCP_IsEnabled = NetSettings->DHCP_IsEnabled ? 1 : 0;
+  }
+
+  UNLOCK_WIFI();
+  return ret;
+}
+
+/**
+  * @brief  Join again the access point configured by the last ES_WIFI_Connect.
+  *         SSID, password and security are still held by the module, so
+  *         only the join itself (C0) is issued.
+  * @param  Obj: pointer to module handle
+  * @retval Operation Status.
+  */
+ES_WIFI_Status_t ES_WIFI_Reconnect(ES_WIFIObject_t *Obj)
+{
+  ES_WIFI_Status_t ret;
+  LOCK_WIFI();
+
+  AT_SetCommand(Obj, "C0\r");
+  ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+  Obj->NetSettings.IsConnected = (ret == ES_WIFI_STATUS_OK) ? 1 : 0;
+
+  UNLOCK_WIFI();
+  return ret;
+}
+
 /**
   * @brief  Configure and activate SoftAP.
   * @param  Obj: pointer to module handle
@@ -1206,31 +1674,31 @@ ES_WIFI_Status_t ES_WIFI_ActivateAP(ES_WIFIObject_t *Obj, ES_WIFI_APConfig_t *Ap
   ES_WIFI_Status_t ret;
   LOCK_WIFI();
 
-  sprintf((char*)Obj->CmdData,"AS=0,%s\r", ApConfig->SSID);
+  AT_SetCommandStr(Obj, "AS=0,", (char *)ApConfig->SSID);
   ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
   if(ret == ES_WIFI_STATUS_OK)
   {
 
-    sprintf((char*)Obj->CmdData,"A1=%c\r", (int)ApConfig->Security + '0');
+    AT_SetCommandNum(Obj, "A1=", ApConfig->Security);
     ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
     if(ret == ES_WIFI_STATUS_OK)
     {
 
-      sprintf((char*)Obj->CmdData,"A2=%s\r", ApConfig->Pass);
+      AT_SetCommandStr(Obj, "A2=", (char *)ApConfig->Pass);
       ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
       if(ret == ES_WIFI_STATUS_OK)
       {
 
-        sprintf((char*)Obj->CmdData,"AC=%d\r", ApConfig->Channel);
+        AT_SetCommandNum(Obj, "AC=", ApConfig->Channel);
         ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
         if(ret == ES_WIFI_STATUS_OK)
         {
 
-          sprintf((char*)Obj->CmdData,"AT=%d\r", ApConfig->MaxConnections);
+          AT_SetCommandNum(Obj, "AT=", ApConfig->MaxConnections);
           ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
           if(ret == ES_WIFI_STATUS_OK)
           {
-            sprintf((char*)Obj->CmdData,"A0\r");
+            AT_SetCommand(Obj, "A0\r");
             ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
             if(ret == ES_WIFI_STATUS_OK)
             {
@@ -1262,7 +1730,7 @@ ES_WIFI_APState_t ES_WIFI_WaitAPStateChange(ES_WIFIObject_t *Obj)
   LOCK_WIFI();
 
  #if (ES_WIFI_USE_UART == 1)
-  if(Obj->fops.IO_Receive(Obj->CmdData, 0, Obj->Timeout) > 0)
+  if(AT_ReceiveReply(Obj, Obj->Timeout) > 0)
   {
     if(strstr((char *)Obj->CmdData, AT_ERROR_STRING))
     {
@@ -1272,7 +1740,7 @@ ES_WIFI_APState_t ES_WIFI_WaitAPStateChange(ES_WIFIObject_t *Obj)
 #else
     do
     {
-      sprintf((char*)Obj->CmdData,"MR\r");
+      AT_SetCommand(Obj, "MR\r");
       if(AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData) != ES_WIFI_STATUS_OK)
       {
         UNLOCK_WIFI();
@@ -1329,7 +1797,7 @@ ES_WIFI_Status_t ES_WIFI_GetMACAddress(ES_WIFIObject_t *Obj, uint8_t *mac)
   char *ptr;
   LOCK_WIFI();
 
-  sprintf((char*)Obj->CmdData,"Z5\r");
+  AT_SetCommand(Obj, "Z5\r");
   ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
   if(ret == ES_WIFI_STATUS_OK)
   {
@@ -1361,13 +1829,20 @@ ES_WIFI_Status_t ES_WIFI_GetIPAddress(ES_WIFIObject_t *Obj, uint8_t *ipaddr)
 ES_WIFI_Status_t ES_WIFI_SetMACAddress(ES_WIFIObject_t *Obj, uint8_t *mac)
 {
   ES_WIFI_Status_t ret ;
+  char *p = (char *)Obj->CmdData;
+  uint8_t i;
   LOCK_WIFI();
 
-  sprintf((char*)Obj->CmdData,"Z4=%X:%X:%X:%X:%X:%X\r",mac[0],mac[1],mac[2],mac[3],mac[4],mac[5] );
+  p += FMT_Str(p, "Z4=");
+  for (i = 0; i < 6; i++)
+  {
+    p += FMT_Hex(p, mac[i]);
+    p += FMT_Str(p, (i < 5) ? ":" : "\r");
+  }
   ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
   if(ret == ES_WIFI_STATUS_OK)
   {
-    sprintf((char*)Obj->CmdData,"Z1\r");
+    AT_SetCommand(Obj, "Z1\r");
     ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
   }
   UNLOCK_WIFI();
@@ -1383,7 +1858,7 @@ ES_WIFI_Status_t ES_WIFI_ResetToFactoryDefault(ES_WIFIObject_t *Obj)
 {
   ES_WIFI_Status_t ret ;
   LOCK_WIFI();
-  sprintf((char*)Obj->CmdData,"Z0\r");
+  AT_SetCommand(Obj, "Z0\r");
   ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
   UNLOCK_WIFI();
   return ret;
@@ -1399,14 +1874,17 @@ ES_WIFI_Status_t ES_WIFI_ResetModule(ES_WIFIObject_t *Obj)
   int ret;
   LOCK_WIFI();
 
-  sprintf((char*)Obj->CmdData,"ZR\r");
+  AT_SetCommand(Obj, "ZR\r");
   ret = Obj->fops.IO_Send(Obj->CmdData, strlen((char*)Obj->CmdData), Obj->Timeout);
 #if (ES_WIFI_USE_UART == 0)
  if (ret==3)
   {
     // Fake received needed in case of SPI to unlock SPI and deselect NSS
-     Obj->fops.IO_Receive(Obj->CmdData, 0, 1);
+     AT_ReceiveReply(Obj, 1);
   }
+#endif
+#if (ES_WIFI_USE_STATS == 1)
+  Obj->Stats.Resets++;
 #endif
   UNLOCK_WIFI();
   return (ret > 0) ? ES_WIFI_STATUS_OK : ES_WIFI_STATUS_ERROR;
@@ -1423,6 +1901,9 @@ ES_WIFI_Status_t ES_WIFI_HardResetModule(ES_WIFIObject_t *Obj)
   int ret;
   LOCK_WIFI();
   ret = Obj->fops.IO_Init(ES_WIFI_RESET);
+#if (ES_WIFI_USE_STATS == 1)
+  Obj->Stats.Resets++;
+#endif
   UNLOCK_WIFI();
   return (ret > 0) ? ES_WIFI_STATUS_OK : ES_WIFI_STATUS_ERROR;
 }
@@ -1438,11 +1919,11 @@ ES_WIFI_Status_t ES_WIFI_SetProductName(ES_WIFIObject_t *Obj, uint8_t *ProductNa
   ES_WIFI_Status_t ret ;
   LOCK_WIFI();
 
-  sprintf((char*)Obj->CmdData,"ZN=%s\r",ProductName);
+  AT_SetCommandStr(Obj, "ZN=", (char *)ProductName);
   ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
   if(ret == ES_WIFI_STATUS_OK)
   {
-    sprintf((char*)Obj->CmdData,"Z1\r");
+    AT_SetCommand(Obj, "Z1\r");
     ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
   }
   UNLOCK_WIFI();
@@ -1461,7 +1942,8 @@ ES_WIFI_Status_t ES_WIFI_OTA_Upgrade(ES_WIFIObject_t *Obj, uint8_t *link)
   ES_WIFI_Status_t ret ;
   LOCK_WIFI();
 
-  sprintf((char*)Obj->CmdData,"Z0=%d\r%s",strlen((char *)link), (char *)link);
+  AT_SetCommandNum(Obj, "Z0=", strlen((char *)link));
+  strcat((char *)Obj->CmdData, (char *)link);
   ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
   UNLOCK_WIFI();
   return ret;
@@ -1479,11 +1961,11 @@ ES_WIFI_Status_t ES_WIFI_SetUARTBaudRate(ES_WIFIObject_t *Obj, uint16_t BaudRate
   ES_WIFI_Status_t ret ;
   LOCK_WIFI();
 
-  sprintf((char*)Obj->CmdData,"U2=%d\r", BaudRate);
+  AT_SetCommandNum(Obj, "U2=", BaudRate);
   ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
   if(ret == ES_WIFI_STATUS_OK)
   {
-    sprintf((char*)Obj->CmdData,"U0\r");
+    AT_SetCommand(Obj, "U0\r");
     ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
   }
   UNLOCK_WIFI();
@@ -1501,7 +1983,7 @@ ES_WIFI_Status_t ES_WIFI_GetUARTConfig(ES_WIFIObject_t *Obj, ES_WIFI_UARTConfig_
   ES_WIFI_Status_t ret ;
   LOCK_WIFI();
 
-  sprintf((char*)Obj->CmdData,"U?\r");
+  AT_SetCommand(Obj, "U?\r");
   ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
   if(ret == ES_WIFI_STATUS_OK)
   {
@@ -1523,7 +2005,7 @@ ES_WIFI_Status_t ES_WIFI_GetSystemConfig(ES_WIFIObject_t *Obj, ES_WIFI_SystemCon
   ES_WIFI_Status_t ret ;
   LOCK_WIFI();
 
-  sprintf((char*)Obj->CmdData,"Z?\r");
+  AT_SetCommand(Obj, "Z?\r");
   ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
   if(ret == ES_WIFI_STATUS_OK)
   {
@@ -1533,6 +2015,56 @@ ES_WIFI_Status_t ES_WIFI_GetSystemConfig(ES_WIFIObject_t *Obj, ES_WIFI_SystemCon
   return ret;
 }
 
+/**
+  * @brief  Put the module to sleep.
+  * @note   The association is kept. The module wakes up on its own after
+  *         Duration, or earlier on a rising edge of its WAKEUP pin, and
+  *         answers no command in between: the caller has to wake it first.
+  * @param  Obj: pointer to module handle
+  * @param  Duration: sleep time in ms.
+  * @retval Operation Status.
+  */
+ES_WIFI_Status_t ES_WIFI_EnterSleepMode(ES_WIFIObject_t *Obj, uint32_t Duration)
+{
+  ES_WIFI_Status_t ret ;
+  LOCK_WIFI();
+
+  AT_SetCommandNum(Obj, "MS=", Duration);
+  ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+
+  UNLOCK_WIFI();
+  return ret;
+}
+
+#if (ES_WIFI_USE_STATS == 1)
+/**
+  * @brief  Get the transport statistics.
+  * @param  Obj: pointer to module handle
+  * @param  Stats: pointer to the statistics copy.
+  * @retval Operation Status.
+  */
+ES_WIFI_Status_t ES_WIFI_GetStats(ES_WIFIObject_t *Obj, ES_WIFI_Stats_t *Stats)
+{
+  LOCK_WIFI();
+  *Stats = Obj->Stats;
+  UNLOCK_WIFI();
+  return ES_WIFI_STATUS_OK;
+}
+
+/**
+  * @brief  Clear the transport statistics.
+  * @param  Obj: pointer to module handle
+  * @retval Operation Status.
+  */
+ES_WIFI_Status_t ES_WIFI_ResetStats(ES_WIFIObject_t *Obj)
+{
+  LOCK_WIFI();
+  memset(&Obj->Stats, 0, sizeof(Obj->Stats));
+  UNLOCK_WIFI();
+  return ES_WIFI_STATUS_OK;
+}
+#endif
+
 #if (ES_WIFI_USE_PING == 1)
 /**
   * @brief  Ping an IP address.
@@ -1546,24 +2078,23 @@ ES_WIFI_Status_t ES_WIFI_Ping(ES_WIFIObject_t *Obj, uint8_t *address, uint16_t c
   LOCK_WIFI();
 
   memset(result,-1,sizeof(int)*count);
-  sprintf((char*)Obj->CmdData,"T1=%d.%d.%d.%d\r", address[0],address[1],
-          address[2],address[3]);
+  AT_SetCommandIP(Obj, "T1=", address);
   ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
 
   if(ret == ES_WIFI_STATUS_OK)
   {
 
-    sprintf((char*)Obj->CmdData,"T2=%d\r", count);
+    AT_SetCommandNum(Obj, "T2=", count);
     ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
 
     if(ret == ES_WIFI_STATUS_OK)
     {
-      sprintf((char*)Obj->CmdData,"T3=%d\r", interval_ms);
+      AT_SetCommandNum(Obj, "T3=", interval_ms);
       ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
 
       if(ret == ES_WIFI_STATUS_OK)
       {
-        sprintf((char*)Obj->CmdData,"T0=\r");
+        AT_SetCommand(Obj, "T0=\r");
         ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
         if (ret == ES_WIFI_STATUS_OK)
         {
@@ -1589,7 +2120,7 @@ ES_WIFI_Status_t ES_WIFI_DNS_LookUp(ES_WIFIObject_t *Obj, const char *url, uint8
   char *ptr;
   LOCK_WIFI();
 
-  sprintf((char*)Obj->CmdData,"D0=%s\r", url);
+  AT_SetCommandStr(Obj, "D0=", url);
   ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
 
   if(ret == ES_WIFI_STATUS_OK)
@@ -1616,43 +2147,42 @@ ES_WIFI_Status_t ES_WIFI_StartClientConnection(ES_WIFIObject_t *Obj, ES_WIFI_Con
 
   LOCK_WIFI();
 
-  sprintf((char*)Obj->CmdData,"P0=%d\r", conn->Number);
+  AT_SetCommandNum(Obj, "P0=", conn->Number);
   ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
 
   if (ret == ES_WIFI_STATUS_OK)
   {
-    sprintf((char*)Obj->CmdData,"P1=%d\r", conn->Type);
+    AT_SetCommandNum(Obj, "P1=", conn->Type);
     ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
   }
 
   if (ret == ES_WIFI_STATUS_OK)
   {
-    sprintf((char*)Obj->CmdData,"P2=%d\r", conn->LocalPort);
+    AT_SetCommandNum(Obj, "P2=", conn->LocalPort);
     ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
   }
 
   if ((ret == ES_WIFI_STATUS_OK)&& ((conn->Type == ES_WIFI_TCP_CONNECTION) || (conn->Type == ES_WIFI_TCP_SSL_CONNECTION)))
   {
-    sprintf((char*)Obj->CmdData,"P4=%d\r", conn->RemotePort);
+    AT_SetCommandNum(Obj, "P4=", conn->RemotePort);
     ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
   }
 
   if ((ret == ES_WIFI_STATUS_OK) && ((conn->Type == ES_WIFI_TCP_CONNECTION) || (conn->Type == ES_WIFI_TCP_SSL_CONNECTION)))
   {
-    sprintf((char*)Obj->CmdData,"P3=%d.%d.%d.%d\r", conn->RemoteIP[0],conn->RemoteIP[1],
-            conn->RemoteIP[2],conn->RemoteIP[3]);
+    AT_SetCommandIP(Obj, "P3=", conn->RemoteIP);
     ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
   }
 
   if ((ret == ES_WIFI_STATUS_OK) && (conn->Type == ES_WIFI_TCP_SSL_CONNECTION))
   {
-    sprintf((char*)Obj->CmdData,"P9=2\r");
+    AT_SetCommand(Obj, "P9=2\r");
     ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
   }
 
   if (ret == ES_WIFI_STATUS_OK)
   {
-    sprintf((char*)Obj->CmdData,"P6=1\r");
+    AT_SetCommand(Obj, "P6=1\r");
     ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
   }
 
@@ -1671,12 +2201,12 @@ ES_WIFI_Status_t ES_WIFI_StopClientConnection(ES_WIFIObject_t *Obj, ES_WIFI_Conn
   ES_WIFI_Status_t ret;
   LOCK_WIFI();
 
-  sprintf((char*)Obj->CmdData,"P0=%d\r", conn->Number);
+  AT_SetCommandNum(Obj, "P0=", conn->Number);
   ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
 
   if (ret == ES_WIFI_STATUS_OK)
   {
-    sprintf((char*)Obj->CmdData,"P6=0\r");
+    AT_SetCommand(Obj, "P6=0\r");
     ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
   }
   UNLOCK_WIFI();
@@ -1696,44 +2226,44 @@ ES_WIFI_Status_t ES_WIFI_StartAWSClientConnection(ES_WIFIObject_t *Obj, ES_WIFI_
   ES_WIFI_Status_t ret;
   LOCK_WIFI();
 
-  sprintf((char*)Obj->CmdData,"P0=%d\r", conn->Number);
+  AT_SetCommandNum(Obj, "P0=", conn->Number);
   ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
 
   if(ret == ES_WIFI_STATUS_OK)
   {
-    sprintf((char*)Obj->CmdData,"P1=%d\r", conn->Type);
+    AT_SetCommandNum(Obj, "P1=", conn->Type);
     ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
     if(ret == ES_WIFI_STATUS_OK)
     {
-      sprintf((char*)Obj->CmdData,"P4=%d\r", conn->RemotePort);
+      AT_SetCommandNum(Obj, "P4=", conn->RemotePort);
       ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
 
       if(ret == ES_WIFI_STATUS_OK)
       {
-        sprintf((char*)Obj->CmdData,"PM=0,%s\r", conn->PublishTopic);
+        AT_SetCommandStr(Obj, "PM=0,", (char *)conn->PublishTopic);
         ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
         if(ret == ES_WIFI_STATUS_OK)
         {
           if(ret == ES_WIFI_STATUS_OK)
           {
-            sprintf((char*)Obj->CmdData,"PM=1,%s\r", conn->SubscribeTopic);
+            AT_SetCommandStr(Obj, "PM=1,", (char *)conn->SubscribeTopic);
             ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
             if(ret == ES_WIFI_STATUS_OK)
             {
 
-              sprintf((char*)Obj->CmdData,"PM=2,%d\r", conn->MQTTMode);
+              AT_SetCommandNum(Obj, "PM=2,", conn->MQTTMode);
               ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
               if(ret == ES_WIFI_STATUS_OK)
               {
-                sprintf((char*)Obj->CmdData,"PM=5,%s\r", conn->ClientID);
+                AT_SetCommandStr(Obj, "PM=5,", (char *)conn->ClientID);
                 ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
                 if(ret == ES_WIFI_STATUS_OK)
                 {
-                  sprintf((char*)Obj->CmdData,"PM\r");
+                  AT_SetCommand(Obj, "PM\r");
                   ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
                   if(ret == ES_WIFI_STATUS_OK)
                   {
-                    sprintf((char*)Obj->CmdData,"P6=1\r");
+                    AT_SetCommand(Obj, "P6=1\r");
                     ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
                   }
                 }
@@ -1757,9 +2287,12 @@ ES_WIFI_Status_t ES_WIFI_StartAWSClientConnection(ES_WIFIObject_t *Obj, ES_WIFI_
 ES_WIFI_Status_t ES_WIFI_StartServerSingleConn(ES_WIFIObject_t *Obj, ES_WIFI_Conn_t *conn)
 {
   ES_WIFI_Status_t ret = ES_WIFI_STATUS_OK;
+#if (ES_WIFI_USE_UART == 1)
+  char *ptr;
+#endif
   LOCK_WIFI();
 
-  sprintf((char*)Obj->CmdData,"P0=%d\r", conn->Number);
+  AT_SetCommandNum(Obj, "P0=", conn->Number);
   ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
   if(ret != ES_WIFI_STATUS_OK)
   {
@@ -1769,31 +2302,31 @@ ES_WIFI_Status_t ES_WIFI_StartServerSingleConn(ES_WIFIObject_t *Obj, ES_WIFI_Con
 
   if ((conn->Type != ES_WIFI_UDP_CONNECTION) && (conn->Type != ES_WIFI_UDP_LITE_CONNECTION))
   {
-    sprintf((char*)Obj->CmdData,"PK=1,3000\r");
+    AT_SetCommand(Obj, "PK=1,3000\r");
     ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
   }
 
   if(ret == ES_WIFI_STATUS_OK)
   {
-      sprintf((char*)Obj->CmdData,"P1=%d\r", conn->Type);
+      AT_SetCommandNum(Obj, "P1=", conn->Type);
       ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
       if(ret == ES_WIFI_STATUS_OK)
       {
-        sprintf((char*)Obj->CmdData,"P8=%d\r", conn->Backlog);
+        AT_SetCommandNum(Obj, "P8=", conn->Backlog);
         ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
         if (ret == ES_WIFI_STATUS_OK)
 		    {
-		      sprintf((char*)Obj->CmdData,"P2=%d\r", conn->LocalPort);
+		      AT_SetCommandNum(Obj, "P2=", conn->LocalPort);
           ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
           if (ret == ES_WIFI_STATUS_OK)
           {
             // multi accept mode
-            sprintf((char*)Obj->CmdData,"P5=11\r");
+            AT_SetCommand(Obj, "P5=11\r");
             ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
 
  #if (ES_WIFI_USE_UART == 1)
             // should normally send out of the band
-            if(Obj->fops.IO_Receive(Obj->CmdData, 0, Obj->Timeout) > 0)
+            if(AT_ReceiveReply(Obj, Obj->Timeout) > 0)
             {
               if(strstr((char *)Obj->CmdData, "Accepted"))
               {
@@ -1826,8 +2359,18 @@ ES_WIFI_Status_t  ES_WIFI_WaitServerConnection(ES_WIFIObject_t *Obj,uint32_t tim
   uint32_t      t;
   uint32_t      tlast;
   uint32_t      tstart;
+  uint32_t      delay;
+  uint8_t       activity;
+  uint8_t       query;
   char          *ptr;
 
+  if (Obj->AcceptPollDelay < ES_WIFI_ACCEPT_POLL_MIN_MS)
+  {
+    Obj->AcceptPollDelay = ES_WIFI_ACCEPT_POLL_MIN_MS;
+  }
+  /* P? on the first pass, a client announced before the call is not lost */
+  query = 1;
+
   tstart=HAL_GetTick();
   tlast=tstart+timeout;
   if (tlast < tstart )
@@ -1839,17 +2382,18 @@ ES_WIFI_Status_t  ES_WIFI_WaitServerConnection(ES_WIFIObject_t *Obj,uint32_t tim
   do
   {
 #if (ES_WIFI_USE_UART == 0)
+    activity = 0;
     // mandatory to flush MR async messages
     memset(Obj->CmdData,0,sizeof(Obj->CmdData));
-    sprintf((char*)Obj->CmdData,"MR\r");
-    ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+    AT_SetCommand(Obj, "MR\r");
+    ret = AT_ExecuteCommandAs(Obj, ES_WIFI_CMD_ACCEPT, Obj->CmdData, Obj->CmdData);
     if(ret == ES_WIFI_STATUS_OK)
     {
       if((strstr((char *)Obj->CmdData, "[SOMA]")) && (strstr((char *)Obj->CmdData, "[EOMA]")))
       {
         if(strstr((char *)Obj->CmdData, "Accepted"))
         {
-         //printf("SOMA Accepted\n");
+          activity = 1;
         }
         else if(!strstr((char *)Obj->CmdData,"[SOMA][EOMA]"))
         {
@@ -1865,37 +2409,72 @@ ES_WIFI_Status_t  ES_WIFI_WaitServerConnection(ES_WIFIObject_t *Obj,uint32_t tim
       UNLOCK_WIFI();
       return ES_WIFI_STATUS_ERROR;
     }
+
+    /* A new client is announced by MR, P? is only needed then, on the pass
+       right after it and on the first pass of the call. An idle server
+       backs off on MR alone. */
+    query |= activity;
+#else
+    activity = 0;
+    query = 1;
 #endif
 
-    memset(Obj->CmdData,0,sizeof(Obj->CmdData));
-    sprintf((char*)Obj->CmdData,"P?\r");
-    ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
-    if(ret == ES_WIFI_STATUS_OK)
+    if (query)
     {
-      if (strncmp((char *)Obj->CmdData, "\r\n0,0.0.0.0,",12)!=0)
+      memset(Obj->CmdData,0,sizeof(Obj->CmdData));
+      AT_SetCommand(Obj, "P?\r");
+      ret = AT_ExecuteCommandAs(Obj, ES_WIFI_CMD_ACCEPT, Obj->CmdData, Obj->CmdData);
+      if(ret == ES_WIFI_STATUS_OK)
+      {
+        if (strncmp((char *)Obj->CmdData, "\r\n0,0.0.0.0,",12)!=0)
+        {
+          ptr = strtok((char *)Obj->CmdData + 2, ",");
+          ptr = strtok(0, ","); //port
+          ParseIP((char *)ptr, conn->RemoteIP);
+          ptr = strtok(0, ","); //port
+          conn->LocalPort=ParseNumber(ptr,0);
+          ptr = strtok(0, ","); //ip
+          ptr = strtok(0, ","); //remote port
+          conn->RemotePort=ParseNumber(ptr,0);
+          Obj->AcceptPollDelay = ES_WIFI_ACCEPT_POLL_MIN_MS;
+          UNLOCK_WIFI();
+          return ES_WIFI_STATUS_OK;
+        }
+      }
+      else
       {
-        ptr = strtok((char *)Obj->CmdData + 2, ",");
-        ptr = strtok(0, ","); //port
-        ParseIP((char *)ptr, conn->RemoteIP);
-        ptr = strtok(0, ","); //port
-        conn->LocalPort=ParseNumber(ptr,0);
-        ptr = strtok(0, ","); //ip
-        ptr = strtok(0, ","); //remote port
-        conn->RemotePort=ParseNumber(ptr,0);
+        DEBUG("P? command failed %s\n", Obj->CmdData);
         UNLOCK_WIFI();
-        return ES_WIFI_STATUS_OK;
+        return ES_WIFI_STATUS_ERROR;
       }
     }
+
+    if (activity)
+    {
+      /* the client may not be visible in P? yet: re-check at once */
+      Obj->AcceptPollDelay = ES_WIFI_ACCEPT_POLL_MIN_MS;
+      delay = 0;
+    }
     else
     {
-      DEBUG("P? command failed %s\n", Obj->CmdData);
-      UNLOCK_WIFI();
-      return ES_WIFI_STATUS_ERROR;
+      delay = Obj->AcceptPollDelay;
+      Obj->AcceptPollDelay = MIN(2 * Obj->AcceptPollDelay, ES_WIFI_ACCEPT_POLL_MAX_MS);
     }
+#if (ES_WIFI_USE_UART == 0)
+    query = activity;
+#endif
 
-    UNLOCK_WIFI();
-    Obj->fops.IO_Delay(100);
-    LOCK_WIFI();
+    t = HAL_GetTick();
+    if ((timeout != 0) && (tlast > t) && (delay > tlast - t))
+    {
+      delay = tlast - t;
+    }
+    if (delay)
+    {
+      UNLOCK_WIFI();
+      Obj->fops.IO_Delay(delay);
+      LOCK_WIFI();
+    }
     t = HAL_GetTick();
   }
   while ((timeout==0) ||((t < tlast) || (t < tstart)));
@@ -1912,7 +2491,7 @@ ES_WIFI_Status_t ES_WIFI_CloseServerConnection(ES_WIFIObject_t *Obj, int socket)
 {
   ES_WIFI_Status_t ret;
   LOCK_WIFI();
-  sprintf((char*)Obj->CmdData,"P0=%d\r", socket);
+  AT_SetCommandNum(Obj, "P0=", socket);
   ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
   if(ret != ES_WIFI_STATUS_OK)
   {
@@ -1921,7 +2500,7 @@ ES_WIFI_Status_t ES_WIFI_CloseServerConnection(ES_WIFIObject_t *Obj, int socket)
     return ret;
   }
 
-  sprintf((char*)Obj->CmdData,"P5=10\r");
+  AT_SetCommand(Obj, "P5=10\r");
   ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
   if(ret != ES_WIFI_STATUS_OK)
   {
@@ -1943,7 +2522,7 @@ ES_WIFI_Status_t ES_WIFI_StopServerSingleConn(ES_WIFIObject_t *Obj, int socket)
 {
   ES_WIFI_Status_t ret;
   LOCK_WIFI();
-  sprintf((char*)Obj->CmdData,"P0=%d\r", socket);
+  AT_SetCommandNum(Obj, "P0=", socket);
   ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
   if(ret != ES_WIFI_STATUS_OK)
   {
@@ -1952,7 +2531,7 @@ ES_WIFI_Status_t ES_WIFI_StopServerSingleConn(ES_WIFIObject_t *Obj, int socket)
     return ret;
   }
 
-  sprintf((char*)Obj->CmdData,"P5=0\r");
+  AT_SetCommand(Obj, "P5=0\r");
   ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
   if(ret != ES_WIFI_STATUS_OK)
   {
@@ -1977,34 +2556,34 @@ ES_WIFI_Status_t ES_WIFI_StartServerMultiConn(ES_WIFIObject_t *Obj, ES_WIFI_Conn
   ES_WIFI_Status_t ret = ES_WIFI_STATUS_ERROR;
   LOCK_WIFI();
 
-  sprintf((char*)Obj->CmdData,"PK=1,3000\r");
+  AT_SetCommand(Obj, "PK=1,3000\r");
   ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
   if(ret == ES_WIFI_STATUS_OK)
   {
-    sprintf((char*)Obj->CmdData,"P0=%d\r", conn->Number);
+    AT_SetCommandNum(Obj, "P0=", conn->Number);
     ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
     if(ret == ES_WIFI_STATUS_OK)
     {
-      sprintf((char*)Obj->CmdData,"P1=%d\r", conn->Type);
+      AT_SetCommandNum(Obj, "P1=", conn->Type);
       ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
       if(ret == ES_WIFI_STATUS_OK)
       {
-        sprintf((char*)Obj->CmdData,"P2=%d\r", conn->LocalPort);
+        AT_SetCommandNum(Obj, "P2=", conn->LocalPort);
         ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
         if(ret == ES_WIFI_STATUS_OK)
         {
-          sprintf((char*)Obj->CmdData,"P8=6\r");
+          AT_SetCommand(Obj, "P8=6\r");
           ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
 
           if(ret == ES_WIFI_STATUS_OK)
           {
-            sprintf((char*)Obj->CmdData,"P5=1\r");
+            AT_SetCommand(Obj, "P5=1\r");
             ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
 
             if(ret == ES_WIFI_STATUS_OK)
             {
 #if (ES_WIFI_USE_UART == 1)
-              if(Obj->fops.IO_Receive(Obj->CmdData, 0, Obj->Timeout) > 0)
+              if(AT_ReceiveReply(Obj, Obj->Timeout) > 0)
               {
                 if(strstr((char *)Obj->CmdData, "Accepted"))
                 {
@@ -2015,7 +2594,7 @@ ES_WIFI_Status_t ES_WIFI_StartServerMultiConn(ES_WIFIObject_t *Obj, ES_WIFI_Conn
             }
             if(ret == ES_WIFI_STATUS_OK)
             {
-              sprintf((char*)Obj->CmdData,"P7=1\r");
+              AT_SetCommand(Obj, "P7=1\r");
               ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
 
             }
@@ -2038,7 +2617,7 @@ ES_WIFI_Status_t ES_WIFI_StopServerMultiConn(ES_WIFIObject_t *Obj, ES_WIFI_Conn_
   ES_WIFI_Status_t ret = ES_WIFI_STATUS_OK;
   LOCK_WIFI();
 
-  sprintf((char*)Obj->CmdData,"P0=%d\r", conn->Number);
+  AT_SetCommandNum(Obj, "P0=", conn->Number);
   ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
   if(ret != ES_WIFI_STATUS_OK)
   {
@@ -2047,18 +2626,18 @@ ES_WIFI_Status_t ES_WIFI_StopServerMultiConn(ES_WIFIObject_t *Obj, ES_WIFI_Conn_
   }
 
   /* close the socket handle for the current request. */
-  sprintf((char*)Obj->CmdData,"P7=2\r");
+  AT_SetCommand(Obj, "P7=2\r");
   ret =  AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
 
   if(ret == ES_WIFI_STATUS_OK)
   {
     /*Get the next request out of the queue */
-    sprintf((char*)Obj->CmdData,"P7=3\r");
+    AT_SetCommand(Obj, "P7=3\r");
     ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
     if(ret == ES_WIFI_STATUS_OK)
     {
 #if (ES_WIFI_USE_UART == 1)
-        if(Obj->fops.IO_Receive(Obj->CmdData, 0, Obj->Timeout) > 0)
+        if(AT_ReceiveReply(Obj, Obj->Timeout) > 0)
 		{
 			if(strstr((char *)Obj->CmdData, "Accepted"))
 			{
@@ -2068,7 +2647,7 @@ ES_WIFI_Status_t ES_WIFI_StopServerMultiConn(ES_WIFIObject_t *Obj, ES_WIFI_Conn_
 #else
 		do
 		{
-			sprintf((char*)Obj->CmdData,"MR\r");
+			AT_SetCommand(Obj, "MR\r");
 			if(AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData) == ES_WIFI_STATUS_OK)
 			{
 				if(strstr((char *)Obj->CmdData, "Accepted"))
@@ -2120,16 +2699,16 @@ ES_WIFI_Status_t ES_WIFI_SendData(ES_WIFIObject_t *Obj, uint8_t Socket, uint8_t
   if(Reqlen >= ES_WIFI_PAYLOAD_SIZE ) Reqlen= ES_WIFI_PAYLOAD_SIZE;
 
   *SentLen = Reqlen;
-  sprintf((char*)Obj->CmdData,"P0=%d\r", Socket);
+  AT_SetCommandNum(Obj, "P0=", Socket);
   ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
   if(ret == ES_WIFI_STATUS_OK)
   {
-    sprintf((char*)Obj->CmdData,"S2=%lu\r",wkgTimeOut);
+    AT_SetCommandNum(Obj, "S2=", wkgTimeOut);
     ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
 
     if(ret == ES_WIFI_STATUS_OK)
     {
-      sprintf((char *)Obj->CmdData,"S3=%04d\r",Reqlen);
+      AT_SetCommandLen(Obj, "S3=", Reqlen);
       ret = AT_RequestSendData(Obj, Obj->CmdData, pdata, Reqlen, Obj->CmdData);
 
       if(ret == ES_WIFI_STATUS_OK)
@@ -2180,25 +2759,25 @@ ES_WIFI_Status_t  ES_WIFI_SendDataTo(ES_WIFIObject_t *Obj, uint8_t Socket, uint8
 
   LOCK_WIFI();
 
-  sprintf((char*)Obj->CmdData,"P0=%d\r", Socket);
+  AT_SetCommandNum(Obj, "P0=", Socket);
   ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
 
   if (ret == ES_WIFI_STATUS_OK)
   {
-    sprintf((char*)Obj->CmdData,"P2=%d\r", /*LocalPort*/ 56830 ); // WARN: Does not work!
+    AT_SetCommandNum(Obj, "P2=", /*LocalPort*/ 56830); // WARN: Does not work!
     ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
   }
 
   // ? Are we sure that the Firmware can change the packet destination without stopping the socket?
   if (ret == ES_WIFI_STATUS_OK)
   {
-    sprintf((char*)Obj->CmdData,"P4=%d\r", Port);
+    AT_SetCommandNum(Obj, "P4=", Port);
     ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
   }
 
   if (ret == ES_WIFI_STATUS_OK)
   {
-    sprintf((char*)Obj->CmdData,"P3=%d.%d.%d.%d\r", IPaddr[0], IPaddr[1], IPaddr[2], IPaddr[3]);
+    AT_SetCommandIP(Obj, "P3=", IPaddr);
     ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
   }
 
@@ -2212,13 +2791,13 @@ ES_WIFI_Status_t  ES_WIFI_SendDataTo(ES_WIFIObject_t *Obj, uint8_t Socket, uint8
 
   if(ret == ES_WIFI_STATUS_OK)
   {
-    sprintf((char*)Obj->CmdData, "S2=%lu\r", wkgTimeOut);
+    AT_SetCommandNum(Obj, "S2=", wkgTimeOut);
     ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
   }
 
   if(ret == ES_WIFI_STATUS_OK)
   {
-    sprintf((char *)Obj->CmdData, "S3=%04d\r", Reqlen);
+    AT_SetCommandLen(Obj, "S3=", Reqlen);
     ret = AT_RequestSendData(Obj, Obj->CmdData, pdata, Reqlen, Obj->CmdData);
   }
 
@@ -2280,20 +2859,20 @@ ES_WIFI_Status_t ES_WIFI_ReceiveData(ES_WIFIObject_t *Obj, uint8_t Socket, uint8
 
   if(Reqlen <= ES_WIFI_PAYLOAD_SIZE )
   {
-    sprintf((char*)Obj->CmdData,"P0=%d\r", Socket);
+    AT_SetCommandNum(Obj, "P0=", Socket);
     ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
 
     if(ret == ES_WIFI_STATUS_OK)
     {
-      sprintf((char*)Obj->CmdData,"R1=%d\r", Reqlen);
+      AT_SetCommandNum(Obj, "R1=", Reqlen);
       ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
       if(ret == ES_WIFI_STATUS_OK)
       {
-        sprintf((char*)Obj->CmdData,"R2=%lu\r", wkgTimeOut);
+        AT_SetCommandNum(Obj, "R2=", wkgTimeOut);
         ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
         if(ret == ES_WIFI_STATUS_OK)
         {
-          sprintf((char*)Obj->CmdData,"R0\r");
+          AT_SetCommand(Obj, "R0\r");
           ret = AT_RequestReceiveData(Obj, Obj->CmdData, (char *)pdata, Reqlen, Receivedlen);
           if (ret != ES_WIFI_STATUS_OK)
           {
@@ -2343,13 +2922,13 @@ ES_WIFI_Status_t  ES_WIFI_ReceiveDataFrom(ES_WIFIObject_t *Obj, uint8_t Socket,
 
   if (Reqlen <= ES_WIFI_PAYLOAD_SIZE )
   {
-    sprintf((char*)Obj->CmdData, "P0=%d\r", Socket);
+    AT_SetCommandNum(Obj, "P0=", Socket);
     ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
   }
 
   if(ret == ES_WIFI_STATUS_OK)
   {
-    sprintf((char*)Obj->CmdData,"R1=%d\r", Reqlen);
+    AT_SetCommandNum(Obj, "R1=", Reqlen);
     ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
   }
   else
@@ -2359,7 +2938,7 @@ ES_WIFI_Status_t  ES_WIFI_ReceiveDataFrom(ES_WIFIObject_t *Obj, uint8_t Socket,
 
   if(ret == ES_WIFI_STATUS_OK)
   {
-    sprintf((char*)Obj->CmdData,"R2=%lu\r", wkgTimeOut);
+    AT_SetCommandNum(Obj, "R2=", wkgTimeOut);
     ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
   }
   else
@@ -2369,7 +2948,7 @@ ES_WIFI_Status_t  ES_WIFI_ReceiveDataFrom(ES_WIFIObject_t *Obj, uint8_t Socket,
 
   if(ret == ES_WIFI_STATUS_OK)
   {
-    sprintf((char*)Obj->CmdData,"R0\r");
+    AT_SetCommand(Obj, "R0\r");
     ret = AT_RequestReceiveData(Obj, Obj->CmdData, (char *)pdata, Reqlen, Receivedlen);
   }
   else
@@ -2389,7 +2968,7 @@ ES_WIFI_Status_t  ES_WIFI_ReceiveDataFrom(ES_WIFIObject_t *Obj, uint8_t Socket,
       if (*Receivedlen > 0)
       {
         /* Get the peer addr */
-        sprintf((char*)Obj->CmdData,"P?\r");
+        AT_SetCommand(Obj, "P?\r");
         ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
 
         if (ret == ES_WIFI_STATUS_OK)
@@ -2423,25 +3002,25 @@ ES_WIFI_Status_t  ES_WIFI_StoreCreds( ES_WIFIObject_t *Obj,
   LOCK_WIFI();
 
   /* Set the credential set to use. */
-  sprintf( ( char* )( Obj->CmdData ),"PF=%d,%d\r", credsFunction, credSet );
+  AT_SetCredsFunction( Obj, credsFunction, credSet );
   ret = AT_ExecuteCommand( Obj, Obj->CmdData, Obj->CmdData );
 
   if( ret == ES_WIFI_STATUS_OK )
   {
     /* Store rootCA. */
-    sprintf( ( char* )( Obj->CmdData ),"PG=%d,0,%04d\r", credSet, caLength );
+    AT_SetCredsLength( Obj, credSet, 0, caLength );
     ret = AT_RequestSendData( Obj, Obj->CmdData, ( uint8_t* ) ca, caLength, Obj->CmdData );
 
     if( ret == ES_WIFI_STATUS_OK )
     {
       /* Store device certificate. */
-      sprintf( ( char* )( Obj->CmdData ),"PG=%d,1,%04d\r", credSet, certificateLength );
+      AT_SetCredsLength( Obj, credSet, 1, certificateLength );
       ret = AT_RequestSendData( Obj, Obj->CmdData, certificate, certificateLength, Obj->CmdData );
 
       if( ret == ES_WIFI_STATUS_OK )
       {
         /* Store device key. */
-        sprintf( ( char* )( Obj->CmdData ),"PG=%d,2,%04d\r", credSet, keyLength );
+        AT_SetCredsLength( Obj, credSet, 2, keyLength );
         ret = AT_RequestSendData( Obj, Obj->CmdData, key, keyLength, Obj->CmdData );
       }
     }
@@ -2461,13 +3040,13 @@ ES_WIFI_Status_t  ES_WIFI_StoreCA( ES_WIFIObject_t *Obj,
   LOCK_WIFI();
 
   /* Set the credential set to use. */
-  sprintf( ( char* )( Obj->CmdData ),"PF=%d,%d\r", credsFunction, credSet );
+  AT_SetCredsFunction( Obj, credsFunction, credSet );
   ret = AT_ExecuteCommand( Obj, Obj->CmdData, Obj->CmdData );
 
   if( ret == ES_WIFI_STATUS_OK )
   {
     /* Store CA. */
-    sprintf( ( char* )( Obj->CmdData ),"PG=%d,0,%04d\r", credSet, caLength );
+    AT_SetCredsLength( Obj, credSet, 0, caLength );
     ret = AT_RequestSendData( Obj, Obj->CmdData, ca, caLength, Obj->CmdData );
   }
 
@@ -2485,13 +3064,13 @@ ES_WIFI_Status_t  ES_WIFI_StoreCertificate( ES_WIFIObject_t *Obj,
   LOCK_WIFI();
 
   /* Set the credential set to use. */
-  sprintf( ( char* )( Obj->CmdData ),"PF=%d,%d\r", credsFunction, credSet );
+  AT_SetCredsFunction( Obj, credsFunction, credSet );
   ret = AT_ExecuteCommand( Obj, Obj->CmdData, Obj->CmdData );
 
   if( ret == ES_WIFI_STATUS_OK )
   {
     /* Store certificate. */
-    sprintf( ( char* )( Obj->CmdData ),"PG=%d,1,%04d\r", credSet, certificateLength );
+    AT_SetCredsLength( Obj, credSet, 1, certificateLength );
     ret = AT_RequestSendData( Obj, Obj->CmdData, certificate, certificateLength, Obj->CmdData );
   }
 
@@ -2509,13 +3088,13 @@ ES_WIFI_Status_t  ES_WIFI_StoreKey( ES_WIFIObject_t *Obj,
   LOCK_WIFI();
 
   /* Set the credential set to use. */
-  sprintf( ( char* )( Obj->CmdData ),"PF=%d,%d\r", credsFunction, credSet );
+  AT_SetCredsFunction( Obj, credsFunction, credSet );
   ret = AT_ExecuteCommand( Obj, Obj->CmdData, Obj->CmdData );
 
   if( ret == ES_WIFI_STATUS_OK )
   {
     /* Store device key. */
-    sprintf( ( char* )( Obj->CmdData ),"PG=%d,2,%04d\r", credSet, keyLength );
+    AT_SetCredsLength( Obj, credSet, 2, keyLength );
     ret = AT_RequestSendData( Obj, Obj->CmdData, key, keyLength, Obj->CmdData );
   }
 
@@ -28,8 +28,23 @@
 
 /* Private define ------------------------------------------------------------*/
 #define MIN(a, b)  ((a) < (b) ? (a) : (b))
+
+#define SPI_WIFI_PRESCALER_LOW_SPEED    SPI_BAUDRATEPRESCALER_8  /* 80/8= 10MHz */
+#define SPI_WIFI_PRESCALER_HIGH_SPEED   SPI_BAUDRATEPRESCALER_4  /* 80/4= 20MHz, module maximum */
+#define SPI_WIFI_SELFTEST_CMD           "I?\r"
+#define SPI_WIFI_SELFTEST_REPLY_SIZE    192
+#define SPI_WIFI_SELFTEST_TIMEOUT       1000
 /* Private typedef -----------------------------------------------------------*/
 /* Private macro -------------------------------------------------------------*/
+#if (ES_WIFI_USE_SLEEP_WAIT == 1)
+/* Sleep until the next interrupt while cond still holds. cond is re-checked
+   with interrupts masked: an interrupt that fires in between stays pending
+   and makes WFI return at once, so no wake-up is lost. SysTick keeps running
+   and bounds the sleep to 1 ms, which is the timeout backstop. */
+#define WAIT_FOR_EVENT(cond)    do { __disable_irq(); if (cond) { __WFI(); } __enable_irq(); } while (0)
+#else
+#define WAIT_FOR_EVENT(cond)
+#endif
 /* Private variables ---------------------------------------------------------*/
 SPI_HandleTypeDef hspi;
 static  int volatile spi_rx_event = 0;
@@ -61,6 +76,9 @@ static  int wait_cmddata_rdy_rising_event(int timeout);
 static  int wait_spi_tx_event(int timeout);
 static  int wait_spi_rx_event(int timeout);
 static  void SPI_WIFI_DelayUs(uint32_t);
+#if (ES_WIFI_SPI_HIGH_SPEED == 1)
+static  void SPI_WIFI_SelectBaudRate(void);
+#endif
 /* Private functions ---------------------------------------------------------*/
 /*******************************************************************************
                        COM Driver Interface (SPI)
@@ -157,7 +175,7 @@ int8_t SPI_WIFI_Init(uint16_t mode)
     hspi.Init.CLKPolarity       = SPI_POLARITY_LOW;
     hspi.Init.CLKPhase          = SPI_PHASE_1EDGE;
     hspi.Init.NSS               = SPI_NSS_SOFT;
-    hspi.Init.BaudRatePrescaler = SPI_BAUDRATEPRESCALER_8; /* 80/8= 10MHz (Inventek WIFI module supports up to 20MHz)*/
+    hspi.Init.BaudRatePrescaler = SPI_WIFI_PRESCALER_LOW_SPEED; /* (Inventek WIFI module supports up to 20MHz)*/
     hspi.Init.FirstBit          = SPI_FIRSTBIT_MSB;
     hspi.Init.TIMode            = SPI_TIMODE_DISABLE;
     hspi.Init.CRCCalculation    = SPI_CRCCALCULATION_DISABLE;
@@ -195,9 +213,132 @@ int8_t SPI_WIFI_Init(uint16_t mode)
   
   rc= SPI_WIFI_ResetModule();
 
+#if (ES_WIFI_SPI_HIGH_SPEED == 1)
+  if ((rc == 0) && (mode == ES_WIFI_INIT))
+  {
+    SPI_WIFI_SelectBaudRate();
+  }
+#endif
   return rc;
 }
 
+#if (ES_WIFI_SPI_HIGH_SPEED == 1)
+/**
+  * @brief  Send one query and read back its complete reply
+  * @param  pdata : reply buffer, SPI_WIFI_SELFTEST_REPLY_SIZE bytes
+  * @retval Length of the reply, -1 if it is not terminated by the OK prompt
+  */
+static int16_t SPI_WIFI_Query(uint8_t *pdata)
+{
+  int16_t len;
+
+  if (SPI_WIFI_SendData((uint8_t *)SPI_WIFI_SELFTEST_CMD, strlen(SPI_WIFI_SELFTEST_CMD), SPI_WIFI_SELFTEST_TIMEOUT) < 0)
+  {
+    return -1;
+  }
+  len = SPI_WIFI_ReceiveData(pdata, SPI_WIFI_SELFTEST_REPLY_SIZE, SPI_WIFI_SELFTEST_TIMEOUT);
+  if ((len <= 0) || (len >= SPI_WIFI_SELFTEST_REPLY_SIZE))
+  {
+    return -1;
+  }
+  while ((len > 0) && (pdata[len - 1] == 0x15))
+  {
+    len--;
+  }
+  if ((len < 8) || (memcmp(&pdata[len - 8], "\r\nOK\r\n> ", 8) != 0))
+  {
+    return -1;
+  }
+  return len;
+}
+
+/**
+  * @brief  Switch the link to 20 MHz if it proves reliable.
+  *         A reference reply to the version query is captured at 10 MHz, then
+  *         the same query is repeated at 20 MHz and every reply must match
+  *         the reference byte for byte. On any failure the link goes back to
+  *         10 MHz and the module is reset so no partial reply is left pending.
+  * @param  None
+  * @retval None
+  */
+static void SPI_WIFI_SelectBaudRate(void)
+{
+  static uint8_t reference[SPI_WIFI_SELFTEST_REPLY_SIZE];
+  static uint8_t reply[SPI_WIFI_SELFTEST_REPLY_SIZE];
+  int16_t ref_len;
+  int i;
+
+  ref_len = SPI_WIFI_Query(reference);
+  if (ref_len < 0)
+  {
+    return;
+  }
+
+  hspi.Init.BaudRatePrescaler = SPI_WIFI_PRESCALER_HIGH_SPEED;
+  if (HAL_SPI_Init(&hspi) == HAL_OK)
+  {
+    for (i = 0; i < ES_WIFI_SPI_SELFTEST_ROUNDS; i++)
+    {
+      if ((SPI_WIFI_Query(reply) != ref_len) || (memcmp(reply, reference, ref_len) != 0))
+      {
+        break;
+      }
+    }
+    if (i == ES_WIFI_SPI_SELFTEST_ROUNDS)
+    {
+      return;
+    }
+  }
+
+  hspi.Init.BaudRatePrescaler = SPI_WIFI_PRESCALER_LOW_SPEED;
+  HAL_SPI_Init(&hspi);
+  SPI_WIFI_ResetModule();
+}
+#endif
+
+/**
+  * @brief  Get the SPI clock the module link runs at
+  * @param  None
+  * @retval SPI clock in Hz
+  */
+uint32_t SPI_WIFI_GetClock(void)
+{
+  /* SPI3 is on APB1, prescaler field BR[2:0] divides by 2^(BR+1) */
+  return HAL_RCC_GetPCLK1Freq() >> (((hspi.Init.BaudRatePrescaler & SPI_CR1_BR) >> SPI_CR1_BR_Pos) + 1);
+}
+
+/**
+  * @brief  Microsecond time base of the driver statistics
+  * @note   Built on the DWT cycle counter, started on the first call. The
+  *         counter wraps every 2^32 cycles (53 s at 80 MHz), so the elapsed
+  *         cycles are folded into a running count at each call: differences
+  *         stay exact for intervals shorter than one wrap.
+  * @param  None
+  * @retval Time in us
+  */
+uint32_t SPI_WIFI_GetTimeUs(void)
+{
+  static uint32_t last_cycles;
+  static uint32_t rest_cycles;
+  static uint32_t time_us;
+  uint32_t cycles_per_us = SystemCoreClock / 1000000UL;
+  uint32_t now, elapsed;
+
+  if ((DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk) == 0)
+  {
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    last_cycles = DWT->CYCCNT;
+  }
+
+  now = DWT->CYCCNT;
+  elapsed = (now - last_cycles) + rest_cycles;
+  last_cycles = now;
+  time_us += elapsed / cycles_per_us;
+  rest_cycles = elapsed % cycles_per_us;
+  return time_us;
+}
+
 
 int8_t SPI_WIFI_ResetModule(void)
 {
@@ -230,6 +371,23 @@ int8_t SPI_WIFI_ResetModule(void)
   return 0;
 }
 
+/**
+  * @brief  Wake the module up from ES_WIFI_EnterSleepMode
+  * @note   A rising edge on WAKEUP ends the sleep, the module is back once
+  *         it raises CMD/DATA READY. Harmless on a module that is awake.
+  * @param  timeout : time to wait for CMD/DATA READY in ms
+  * @retval 0 when the module is ready, -1 on timeout
+  */
+int8_t SPI_WIFI_WakeUp(uint32_t timeout)
+{
+  int ret;
+
+  HAL_GPIO_WritePin(GPIOB, GPIO_PIN_13, GPIO_PIN_SET);
+  ret = wait_cmddata_rdy_high(timeout);
+  HAL_GPIO_WritePin(GPIOB, GPIO_PIN_13, GPIO_PIN_RESET);
+  return (ret < 0) ? -1 : 0;
+}
+
 /**
   * @brief  DeInitialize the SPI
   * @param  None
@@ -267,6 +425,8 @@ int wait_cmddata_rdy_high(int timeout)
     {
       return -1;
     }
+    /* DRDY rising edge raises EXTI1 and wakes the core */
+    WAIT_FOR_EVENT(WIFI_IS_CMDDATA_READY()==0);
   }
   return 0;
 }
@@ -285,6 +445,7 @@ int wait_cmddata_rdy_rising_event(int timeout)
     {
       return -1;
     }
+    WAIT_FOR_EVENT(cmddata_rdy_rising_event==1);
   }
   return 0;
 #endif
@@ -302,6 +463,7 @@ int wait_spi_rx_event(int timeout)
     {
       return -1;
     }
+    WAIT_FOR_EVENT(spi_rx_event==1);
   }
   return 0;
 #endif
@@ -319,6 +481,7 @@ int wait_spi_tx_event(int timeout)
     {
       return -1;
     }
+    WAIT_FOR_EVENT(spi_tx_event==1);
   }
   return 0;
 #endif
@@ -326,11 +489,24 @@ int wait_spi_tx_event(int timeout)
 
 
 
-int16_t SPI_WIFI_ReceiveData(uint8_t *pData, uint16_t len, uint32_t timeout)
+/**
+  * @brief  Receive one module reply into up to three buffers, filled in turn.
+  *         The whole reply is always read, bytes beyond the last buffer are
+  *         dropped, so the module never keeps a partial reply pending.
+  * @param  seg : the buffers
+  * @param  seg_len : their sizes in bytes, 0 for an unused one
+  * @param  timeout : timeout in mS
+  * @retval Number of bytes stored, or a negative ES_WIFI_ERROR_* code
+  */
+static int16_t SPI_WIFI_ReceiveSegments(uint8_t *seg[3], uint16_t seg_len[3], uint32_t timeout)
 {
-  int16_t length = 0;
-  uint8_t tmp[2];
-  
+  int16_t  length = 0;
+  uint16_t total = 0;
+  uint16_t pos = 0;
+  uint8_t  s = 0;
+  uint8_t  tmp[2];
+  uint8_t  i;
+
   WIFI_DISABLE_NSS();
   UNLOCK_SPI();
   SPI_WIFI_DelayUs(3);
@@ -346,38 +522,80 @@ int16_t SPI_WIFI_ReceiveData(uint8_t *pData, uint16_t len, uint32_t timeout)
   SPI_WIFI_DelayUs(15);
   while (WIFI_IS_CMDDATA_READY())
   {
-    if((length < len) || (!len))
+    spi_rx_event=1;
+    if (HAL_SPI_Receive_IT(&hspi, tmp, 1) != HAL_OK) {
+      WIFI_DISABLE_NSS();
+      UNLOCK_SPI();
+      return ES_WIFI_ERROR_SPI_FAILED;
+    }
+
+    wait_spi_rx_event(timeout);
+
+    /* a frame may straddle two buffers when a size is odd */
+    for (i = 0; i < 2; i++)
     {
-      spi_rx_event=1;
-      if (HAL_SPI_Receive_IT(&hspi, tmp, 1) != HAL_OK) {
-        WIFI_DISABLE_NSS();
-        UNLOCK_SPI();
-        return ES_WIFI_ERROR_SPI_FAILED;
+      while ((s < 3) && (pos >= seg_len[s]))
+      {
+        s++;
+        pos = 0;
+      }
+      if (s < 3)
+      {
+        seg[s][pos++] = tmp[i];
+        length++;
       }
-  
-      wait_spi_rx_event(timeout);
-
-      pData[0] = tmp[0];
-      pData[1] = tmp[1];
-      length += 2;
-      pData  += 2;
-      
-      if (length >= ES_WIFI_DATA_SIZE) {
-        WIFI_DISABLE_NSS();
-        SPI_WIFI_ResetModule();
-        UNLOCK_SPI();
-        return ES_WIFI_ERROR_STUFFING_FOREVER;
-      }     
     }
-    else
-    {
-      break;
+    total += 2;
+
+    if (total >= ES_WIFI_DATA_SIZE) {
+      WIFI_DISABLE_NSS();
+      SPI_WIFI_ResetModule();
+      UNLOCK_SPI();
+      return ES_WIFI_ERROR_STUFFING_FOREVER;
     }
   }
   WIFI_DISABLE_NSS();
   UNLOCK_SPI();
   return length;
 }
+
+/**
+  * @brief  Receive wifi Data from SPI
+  * @param  pData : pointer to data
+  * @param  len : buffer size, the rest of a longer reply is dropped
+  * @param  timeout : timeout in mS
+  * @retval Length of received data
+  */
+int16_t SPI_WIFI_ReceiveData(uint8_t *pData, uint16_t len, uint32_t timeout)
+{
+  uint8_t  *seg[3]     = { pData, NULL, NULL };
+  uint16_t seg_len[3]  = { len, 0, 0 };
+
+  return SPI_WIFI_ReceiveSegments(seg, seg_len, timeout);
+}
+
+/**
+  * @brief  Receive a socket read reply: its first bytes into pHead, the
+  *         payload straight into the caller's pData and what follows it into
+  *         pTail. With a payload shorter than len the trailer ends up in pData.
+  * @param  pHead : header buffer
+  * @param  head_len : header size, 2 for the leading "\r\n"
+  * @param  pData : payload buffer
+  * @param  len : payload buffer size
+  * @param  pTail : trailer buffer
+  * @param  tail_len : trailer buffer size
+  * @param  timeout : timeout in mS
+  * @retval Length of received data, all buffers together
+  */
+int16_t SPI_WIFI_ReceivePayload(uint8_t *pHead, uint16_t head_len, uint8_t *pData, uint16_t len,
+                                uint8_t *pTail, uint16_t tail_len, uint32_t timeout)
+{
+  uint8_t  *seg[3]     = { pHead, pData, pTail };
+  uint16_t seg_len[3]  = { head_len, len, tail_len };
+
+  return SPI_WIFI_ReceiveSegments(seg, seg_len, timeout);
+}
+
 /**
   * @brief  Send wifi Data thru SPI
   * @param  pdata : pointer to data
@@ -514,6 +732,390 @@ void    SPI_WIFI_ISR(void)
      cmddata_rdy_rising_event = 0;
    }
 }
+
+#if (ES_WIFI_USE_UART == 1)
+/*******************************************************************************
+                       COM Driver Interface (UART)
+*******************************************************************************/
+/* The module is on UART4, PA0 TX / PA1 RX (Arduino D1/D0), with the same
+   reset and wake-up lines as on SPI. Reception runs all the time: DMA2
+   channel 5 fills a circular buffer and the IDLE line interrupt records
+   where the last burst ended. A reply is complete once it ends with the
+   "\r\n> " prompt and the line went idle right after it, so a prompt-like
+   sequence inside socket data does not cut a reply short. Transmission is
+   a DMA2 channel 3 transfer. */
+#define UART_WIFI_PROMPT                0x0D0A3E20UL    /* "\r\n> ", last four bytes of a reply */
+#define UART_WIFI_REPLY_ENDED(total, last) \
+  (((total) >= 4) && ((last) == UART_WIFI_PROMPT) && (uart_idle_pos == uart_rx_tail))
+
+UART_HandleTypeDef huart_wifi;
+static DMA_HandleTypeDef hdma_uart_wifi_rx;
+static DMA_HandleTypeDef hdma_uart_wifi_tx;
+static uint8_t  uart_rx_ring[ES_WIFI_UART_RX_RING_SIZE];
+static uint16_t uart_rx_tail;
+static uint16_t volatile uart_idle_pos;
+static int volatile uart_tx_event = 0;
+
+/**
+  * @brief  Initialize UART MSP
+  * @param  huart: UART handle
+  * @retval None
+  */
+void UART_WIFI_MspInit(UART_HandleTypeDef* huart)
+{
+  GPIO_InitTypeDef GPIO_Init;
+
+  __HAL_RCC_UART4_CLK_ENABLE();
+  __HAL_RCC_DMA2_CLK_ENABLE();
+  __HAL_RCC_GPIOA_CLK_ENABLE();
+  __HAL_RCC_GPIOB_CLK_ENABLE();
+  __HAL_RCC_GPIOE_CLK_ENABLE();
+
+  /* configure Wake up pin */
+  HAL_GPIO_WritePin(GPIOB,GPIO_PIN_13, GPIO_PIN_RESET );
+  GPIO_Init.Pin       = GPIO_PIN_13;
+  GPIO_Init.Mode      = GPIO_MODE_OUTPUT_PP;
+  GPIO_Init.Pull      = GPIO_NOPULL;
+  GPIO_Init.Speed     = GPIO_SPEED_FREQ_LOW;
+  HAL_GPIO_Init(GPIOB, &GPIO_Init );
+
+  /* configure Reset pin */
+  GPIO_Init.Pin       = GPIO_PIN_8;
+  GPIO_Init.Mode      = GPIO_MODE_OUTPUT_PP;
+  GPIO_Init.Pull      = GPIO_NOPULL;
+  GPIO_Init.Speed     = GPIO_SPEED_FREQ_LOW;
+  GPIO_Init.Alternate = 0;
+  HAL_GPIO_Init(GPIOE, &GPIO_Init );
+
+  /* configure UART TX and RX pins */
+  GPIO_Init.Pin       = GPIO_PIN_0 | GPIO_PIN_1;
+  GPIO_Init.Mode      = GPIO_MODE_AF_PP;
+  GPIO_Init.Pull      = GPIO_PULLUP;
+  GPIO_Init.Speed     = GPIO_SPEED_FREQ_VERY_HIGH;
+  GPIO_Init.Alternate = GPIO_AF8_UART4;
+  HAL_GPIO_Init(GPIOA, &GPIO_Init );
+
+  /* RX: circular, never stopped while the link is up */
+  hdma_uart_wifi_rx.Instance                 = DMA2_Channel5;
+  hdma_uart_wifi_rx.Init.Request             = DMA_REQUEST_2;
+  hdma_uart_wifi_rx.Init.Direction           = DMA_PERIPH_TO_MEMORY;
+  hdma_uart_wifi_rx.Init.PeriphInc           = DMA_PINC_DISABLE;
+  hdma_uart_wifi_rx.Init.MemInc              = DMA_MINC_ENABLE;
+  hdma_uart_wifi_rx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+  hdma_uart_wifi_rx.Init.MemDataAlignment    = DMA_MDATAALIGN_BYTE;
+  hdma_uart_wifi_rx.Init.Mode                = DMA_CIRCULAR;
+  hdma_uart_wifi_rx.Init.Priority            = DMA_PRIORITY_HIGH;
+  HAL_DMA_Init(&hdma_uart_wifi_rx);
+  __HAL_LINKDMA(huart, hdmarx, hdma_uart_wifi_rx);
+
+  hdma_uart_wifi_tx.Instance                 = DMA2_Channel3;
+  hdma_uart_wifi_tx.Init.Request             = DMA_REQUEST_2;
+  hdma_uart_wifi_tx.Init.Direction           = DMA_MEMORY_TO_PERIPH;
+  hdma_uart_wifi_tx.Init.PeriphInc           = DMA_PINC_DISABLE;
+  hdma_uart_wifi_tx.Init.MemInc              = DMA_MINC_ENABLE;
+  hdma_uart_wifi_tx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+  hdma_uart_wifi_tx.Init.MemDataAlignment    = DMA_MDATAALIGN_BYTE;
+  hdma_uart_wifi_tx.Init.Mode                = DMA_NORMAL;
+  hdma_uart_wifi_tx.Init.Priority            = DMA_PRIORITY_MEDIUM;
+  HAL_DMA_Init(&hdma_uart_wifi_tx);
+  __HAL_LINKDMA(huart, hdmatx, hdma_uart_wifi_tx);
+}
+
+/**
+  * @brief  Write position of the receive DMA in the circular buffer
+  * @param  None
+  * @retval Index of the next byte the DMA will write
+  */
+static uint16_t UART_WIFI_RxHead(void)
+{
+  return (ES_WIFI_UART_RX_RING_SIZE - __HAL_DMA_GET_COUNTER(&hdma_uart_wifi_rx)) % ES_WIFI_UART_RX_RING_SIZE;
+}
+
+/**
+  * @brief  Drop whatever was received and not read yet
+  * @param  None
+  * @retval None
+  */
+static void UART_WIFI_Flush(void)
+{
+  uart_rx_tail = UART_WIFI_RxHead();
+}
+
+/**
+  * @brief  Initialize the UART, start reception and reset the module
+  * @param  mode : ES_WIFI_INIT or ES_WIFI_RESET
+  * @retval 0 on success, -1 otherwise
+  */
+int8_t UART_WIFI_Init(uint16_t mode)
+{
+  if (mode == ES_WIFI_INIT)
+  {
+    huart_wifi.Instance                    = UART4;
+    huart_wifi.Init.BaudRate               = ES_WIFI_UART_BAUDRATE;
+    huart_wifi.Init.WordLength             = UART_WORDLENGTH_8B;
+    huart_wifi.Init.StopBits               = UART_STOPBITS_1;
+    huart_wifi.Init.Parity                 = UART_PARITY_NONE;
+    huart_wifi.Init.Mode                   = UART_MODE_TX_RX;
+    huart_wifi.Init.HwFlowCtl              = UART_HWCONTROL_NONE;
+    huart_wifi.Init.OverSampling           = UART_OVERSAMPLING_16;
+    huart_wifi.Init.OneBitSampling         = UART_ONE_BIT_SAMPLE_DISABLE;
+    /* an overrun or a framing error must not stop the circular reception */
+    huart_wifi.AdvancedInit.AdvFeatureInit = UART_ADVFEATURE_RXOVERRUNDISABLE_INIT | UART_ADVFEATURE_DMADISABLEONERROR_INIT;
+    huart_wifi.AdvancedInit.OverrunDisable = UART_ADVFEATURE_OVERRUN_DISABLE;
+    huart_wifi.AdvancedInit.DMADisableonRxError = UART_ADVFEATURE_DMA_DISABLEONRXERROR;
+    UART_WIFI_MspInit(&huart_wifi);
+
+    if (HAL_UART_Init(&huart_wifi) != HAL_OK)
+    {
+      return -1;
+    }
+
+    HAL_NVIC_SetPriority((IRQn_Type)DMA2_Channel3_IRQn, SPI_INTERFACE_PRIO, 0);
+    HAL_NVIC_EnableIRQ((IRQn_Type)DMA2_Channel3_IRQn);
+    HAL_NVIC_SetPriority((IRQn_Type)DMA2_Channel5_IRQn, SPI_INTERFACE_PRIO, 0);
+    HAL_NVIC_EnableIRQ((IRQn_Type)DMA2_Channel5_IRQn);
+    HAL_NVIC_SetPriority((IRQn_Type)UART4_IRQn, SPI_INTERFACE_PRIO, 0);
+    HAL_NVIC_EnableIRQ((IRQn_Type)UART4_IRQn);
+
+    uart_rx_tail  = 0;
+    uart_idle_pos = 0;
+    if (HAL_UART_Receive_DMA(&huart_wifi, uart_rx_ring, ES_WIFI_UART_RX_RING_SIZE) != HAL_OK)
+    {
+      return -1;
+    }
+    __HAL_UART_CLEAR_IDLEFLAG(&huart_wifi);
+    __HAL_UART_ENABLE_IT(&huart_wifi, UART_IT_IDLE);
+  }
+
+  return UART_WIFI_ResetModule();
+}
+
+/**
+  * @brief  Reset the module and wait for its first prompt
+  * @param  None
+  * @retval 0 on success, -1 otherwise
+  */
+int8_t UART_WIFI_ResetModule(void)
+{
+  uint8_t Prompt[16];
+  int16_t len;
+
+  UART_WIFI_Flush();
+  WIFI_RESET_MODULE();
+  len = UART_WIFI_ReceiveData(Prompt, sizeof(Prompt), ES_WIFI_UART_BOOT_TIMEOUT);
+  return ((len >= 2) && (Prompt[len - 2] == '>') && (Prompt[len - 1] == ' ')) ? 0 : -1;
+}
+
+/**
+  * @brief  DeInitialize the UART
+  * @param  None
+  * @retval None
+  */
+int8_t UART_WIFI_DeInit(void)
+{
+  __HAL_UART_DISABLE_IT(&huart_wifi, UART_IT_IDLE);
+  HAL_UART_DMAStop(&huart_wifi);
+  HAL_UART_DeInit(&huart_wifi);
+  HAL_DMA_DeInit(&hdma_uart_wifi_rx);
+  HAL_DMA_DeInit(&hdma_uart_wifi_tx);
+  return 0;
+}
+
+/**
+  * @brief  Receive one module reply into up to three buffers, filled in turn,
+  *         same contract as the SPI version.
+  * @param  seg : the buffers
+  * @param  seg_len : their sizes in bytes, 0 for an unused one
+  * @param  timeout : timeout in mS
+  * @retval Number of bytes stored, or a negative ES_WIFI_ERROR_* code
+  */
+static int16_t UART_WIFI_ReceiveSegments(uint8_t *seg[3], uint16_t seg_len[3], uint32_t timeout)
+{
+  uint32_t tickstart = HAL_GetTick();
+  uint32_t last = 0;
+  int16_t  length = 0;
+  uint16_t total = 0;
+  uint16_t pos = 0;
+  uint16_t head;
+  uint8_t  s = 0;
+  uint8_t  c;
+
+  while (1)
+  {
+    head = UART_WIFI_RxHead();
+    while (uart_rx_tail != head)
+    {
+      c = uart_rx_ring[uart_rx_tail];
+      uart_rx_tail = (uart_rx_tail + 1) % ES_WIFI_UART_RX_RING_SIZE;
+      last = (last << 8) | c;
+
+      while ((s < 3) && (pos >= seg_len[s]))
+      {
+        s++;
+        pos = 0;
+      }
+      if (s < 3)
+      {
+        seg[s][pos++] = c;
+        length++;
+      }
+
+      if (++total >= ES_WIFI_DATA_SIZE)
+      {
+        UART_WIFI_ResetModule();
+        return ES_WIFI_ERROR_STUFFING_FOREVER;
+      }
+    }
+
+    /* the prompt ends the reply only if the line went quiet right after it */
+    if (UART_WIFI_REPLY_ENDED(total, last))
+    {
+      return length;
+    }
+
+    if ((HAL_GetTick() - tickstart) > timeout)
+    {
+      return ES_WIFI_ERROR_WAITING_DRDY_FALLING;
+    }
+    /* sleep until more bytes come in. The DMA does not interrupt per byte,
+       the IDLE interrupt that ends every burst wakes the core; one that came
+       since the check above ends the reply without a sleep */
+    WAIT_FOR_EVENT((UART_WIFI_RxHead() == uart_rx_tail) && !UART_WIFI_REPLY_ENDED(total, last));
+  }
+}
+
+/**
+  * @brief  Receive wifi Data from UART
+  * @param  pData : pointer to data
+  * @param  len : buffer size, the rest of a longer reply is dropped
+  * @param  timeout : timeout in mS
+  * @retval Length of received data
+  */
+int16_t UART_WIFI_ReceiveData(uint8_t *pData, uint16_t len, uint32_t timeout)
+{
+  uint8_t  *seg[3]     = { pData, NULL, NULL };
+  uint16_t seg_len[3]  = { len, 0, 0 };
+
+  return UART_WIFI_ReceiveSegments(seg, seg_len, timeout);
+}
+
+/**
+  * @brief  Receive a socket read reply, see SPI_WIFI_ReceivePayload
+  * @param  pHead : header buffer
+  * @param  head_len : header size
+  * @param  pData : payload buffer
+  * @param  len : payload buffer size
+  * @param  pTail : trailer buffer
+  * @param  tail_len : trailer buffer size
+  * @param  timeout : timeout in mS
+  * @retval Length of received data, all buffers together
+  */
+int16_t UART_WIFI_ReceivePayload(uint8_t *pHead, uint16_t head_len, uint8_t *pData, uint16_t len,
+                                 uint8_t *pTail, uint16_t tail_len, uint32_t timeout)
+{
+  uint8_t  *seg[3]     = { pHead, pData, pTail };
+  uint16_t seg_len[3]  = { head_len, len, tail_len };
+
+  return UART_WIFI_ReceiveSegments(seg, seg_len, timeout);
+}
+
+/**
+  * @brief  Send wifi Data thru UART
+  * @param  pdata : pointer to data
+  * @param  len : Data length
+  * @param  timeout : send timeout in mS
+  * @retval Length of sent data
+  */
+int16_t UART_WIFI_SendData(uint8_t *pdata, uint16_t len, uint32_t timeout)
+{
+  uint32_t tickstart = HAL_GetTick();
+
+  /* anything still in the buffer belongs to no command */
+  UART_WIFI_Flush();
+
+  uart_tx_event = 1;
+  if (HAL_UART_Transmit_DMA(&huart_wifi, pdata, len) != HAL_OK)
+  {
+    uart_tx_event = 0;
+    return ES_WIFI_ERROR_SPI_FAILED;
+  }
+  while (uart_tx_event == 1)
+  {
+    if ((HAL_GetTick() - tickstart) > timeout)
+    {
+      HAL_UART_AbortTransmit(&huart_wifi);
+      uart_tx_event = 0;
+      return ES_WIFI_ERROR_SPI_FAILED;
+    }
+    WAIT_FOR_EVENT(uart_tx_event == 1);
+  }
+  return len;
+}
+
+/**
+  * @brief  Delay
+  * @param  Delay in ms
+  * @retval None
+  */
+void UART_WIFI_Delay(uint32_t Delay)
+{
+  HAL_Delay(Delay);
+}
+
+/**
+  * @brief  Wake the module up from ES_WIFI_EnterSleepMode
+  * @note   There is no ready line on UART: the module is given
+  *         ES_WIFI_UART_WAKE_DELAY after the WAKEUP edge.
+  * @param  timeout : unused
+  * @retval 0
+  */
+int8_t UART_WIFI_WakeUp(uint32_t timeout)
+{
+  (void)timeout;
+  HAL_GPIO_WritePin(GPIOB, GPIO_PIN_13, GPIO_PIN_SET);
+  HAL_Delay(ES_WIFI_UART_WAKE_DELAY);
+  HAL_GPIO_WritePin(GPIOB, GPIO_PIN_13, GPIO_PIN_RESET);
+  return 0;
+}
+
+/**
+  * @brief  Baud rate the module link runs at
+  * @param  None
+  * @retval Baud rate
+  */
+uint32_t UART_WIFI_GetBaudRate(void)
+{
+  return huart_wifi.Init.BaudRate;
+}
+
+/**
+  * @brief Tx Transfer completed callback.
+  * @param  huart: UART handle
+  * @retval None
+  */
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
+{
+  if ((huart == &huart_wifi) && uart_tx_event)
+  {
+    uart_tx_event = 0;
+  }
+}
+
+/**
+  * @brief  UART4 interrupt: IDLE line, then the HAL (DMA transmit end, errors)
+  * @param  None
+  * @retval None
+  */
+void UART_WIFI_ISR(void)
+{
+  if (__HAL_UART_GET_FLAG(&huart_wifi, UART_FLAG_IDLE))
+  {
+    __HAL_UART_CLEAR_IDLEFLAG(&huart_wifi);
+    uart_idle_pos = UART_WIFI_RxHead();
+  }
+  HAL_UART_IRQHandler(&huart_wifi);
+}
+#endif /* ES_WIFI_USE_UART */
 /**
   * @}
   */ 
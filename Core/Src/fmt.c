@@ -0,0 +1,175 @@
+/**
+  ******************************************************************************
+  * @file    fmt.c
+  * @brief   Text formatting without sprintf: digits come out two at a time
+  *          from a table, one division per pair instead of a varargs parse
+  *          and one division per digit.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "fmt.h"
+
+/* Private variables ---------------------------------------------------------*/
+static const char Pairs[200] =
+  "00010203040506070809"
+  "10111213141516171819"
+  "20212223242526272829"
+  "30313233343536373839"
+  "40414243444546474849"
+  "50515253545556575859"
+  "60616263646566676869"
+  "70717273747576777879"
+  "80818283848586878889"
+  "90919293949596979899";
+
+static const char HexDigits[16] = "0123456789ABCDEF";
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  Write the digits of a value backwards from the end of a scratch
+  * @param  end : one past the last digit
+  * @param  value : value to convert
+  * @retval Pointer to the first digit
+  */
+static char *Digits(char *end, uint32_t value)
+{
+  const char *pair;
+
+  while (value >= 100)
+  {
+    pair   = &Pairs[(value % 100) * 2];
+    value /= 100;
+    *--end = pair[1];
+    *--end = pair[0];
+  }
+  if (value >= 10)
+  {
+    pair   = &Pairs[value * 2];
+    *--end = pair[1];
+    *--end = pair[0];
+  }
+  else
+  {
+    *--end = (char)('0' + value);
+  }
+  return end;
+}
+
+/**
+  * @brief  Copy a string
+  * @param  buf : destination
+  * @param  s : string to copy
+  * @retval Characters written
+  */
+uint16_t FMT_Str(char *buf, const char *s)
+{
+  char *p = buf;
+
+  while (*s != 0)
+  {
+    *p++ = *s++;
+  }
+  *p = 0;
+  return (uint16_t)(p - buf);
+}
+
+/**
+  * @brief  Write an unsigned value in decimal
+  * @param  buf : destination, FMT_UINT_MAX + 1 bytes at least
+  * @param  value : value to write
+  * @retval Characters written
+  */
+uint16_t FMT_Uint(char *buf, uint32_t value)
+{
+  return FMT_UintPad(buf, value, 0, '0');
+}
+
+/**
+  * @brief  Write an unsigned value in decimal, right aligned on a width
+  * @param  buf : destination
+  * @param  value : value to write
+  * @param  width : minimum number of characters, longer values are not cut
+  * @param  pad : fill character, '0' as with %04u or ' ' as with %4u
+  * @retval Characters written
+  */
+uint16_t FMT_UintPad(char *buf, uint32_t value, uint8_t width, char pad)
+{
+  char scratch[FMT_UINT_MAX];
+  char *end = scratch + sizeof(scratch);
+  char *first = Digits(end, value);
+  uint16_t len = (uint16_t)(end - first);
+  uint16_t n = 0;
+
+  while ((len + n) < width)
+  {
+    buf[n++] = pad;
+  }
+  while (first < end)
+  {
+    buf[n++] = *first++;
+  }
+  buf[n] = 0;
+  return n;
+}
+
+/**
+  * @brief  Write a signed value in decimal
+  * @param  buf : destination, FMT_INT_MAX + 1 bytes at least
+  * @param  value : value to write
+  * @retval Characters written
+  */
+uint16_t FMT_Int(char *buf, int32_t value)
+{
+  if (value < 0)
+  {
+    *buf = '-';
+    /* negated as unsigned, INT32_MIN has no positive counterpart */
+    return 1 + FMT_Uint(buf + 1, 0u - (uint32_t)value);
+  }
+  return FMT_Uint(buf, (uint32_t)value);
+}
+
+/**
+  * @brief  Write a value in upper case hexadecimal without leading zeros
+  * @param  buf : destination, FMT_HEX_MAX + 1 bytes at least
+  * @param  value : value to write
+  * @retval Characters written
+  */
+uint16_t FMT_Hex(char *buf, uint32_t value)
+{
+  uint16_t n = 0;
+  int8_t shift = 28;
+
+  while ((shift > 0) && ((value >> shift) == 0))
+  {
+    shift -= 4;
+  }
+  for (; shift >= 0; shift -= 4)
+  {
+    buf[n++] = HexDigits[(value >> shift) & 0x0F];
+  }
+  buf[n] = 0;
+  return n;
+}
+
+/**
+  * @brief  Write an IPv4 address in dotted decimal
+  * @param  buf : destination, FMT_IP_MAX + 1 bytes at least
+  * @param  ip : address, 4 bytes
+  * @retval Characters written
+  */
+uint16_t FMT_IP(char *buf, const uint8_t *ip)
+{
+  uint16_t n = 0;
+  uint8_t i;
+
+  for (i = 0; i < 4; i++)
+  {
+    if (i > 0)
+    {
+      buf[n++] = '.';
+    }
+    n += FMT_Uint(buf + n, ip[i]);
+  }
+  return n;
+}
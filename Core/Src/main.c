@@ -40,18 +40,21 @@
   ******************************************************************************
   */
 #include "main.h"
+#include "telemetry.h"
+#include "mqtt_client.h"
+#include "wifi_supervisor.h"
+#include "buffer_pool.h"
+#include "wifi_powersave.h"
+#include "wifi_linkmon.h"
+#include "fmt.h"
+#include "vl53l0x_proximity.h"
+#include "tof_calib.h"
+#include "range_filter.h"
 #include <stdbool.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
 
-extern I2C_HandleTypeDef hI2cHandler;
-VL53L0X_Dev_t Dev =
-{
-  .I2cHandle = &hI2cHandler,
-  .I2cDevAddr = PROXIMITY_I2C_ADDRESS
-};
-
 // WIFI SSID and Password
 #define SSID     "SSID_GOES_HERE"
 #define PASSWORD "SSID_PASSWORD_GOES_HERE"
@@ -61,20 +64,74 @@ VL53L0X_Dev_t Dev =
 #define WIFI_READ_TIMEOUT  10000
 #define SOCKET                 0
 
-// The entire HTML webpage is stored in this char array,
-// better make it big
-static  uint8_t http[16384];
+// UDP telemetry: every sensor sample is batched and sent to a collector
+// (datagram format in telemetry.h). Set TELEMETRY_COLLECTOR to your collector
+// and TELEMETRY_ENABLE to 1 to turn it on.
+#define TELEMETRY_ENABLE       0
+#define TELEMETRY_COLLECTOR    {192, 168, 1, 100}
+#define TELEMETRY_PORT         5005
+
+// MQTT: alarm transitions are published right away (QoS 1, retained), the
+// sensor values whenever they change. Set MQTT_BROKER to your broker and
+// MQTT_ENABLE to 1 to turn it on.
+#define MQTT_ENABLE            0
+#define MQTT_BROKER            {192, 168, 1, 100}
+#define MQTT_PORT              1883
+#define MQTT_CLIENT_ID         "security-system"
+#define MQTT_TOPIC             "security/board1"
+#define MQTT_KEEPALIVE         60
+// Changes smaller than this are noise and are not published (in mm)
+#define MQTT_DIST_DEADBAND     10
+
+// WiFi power save: the module sleeps once nothing happened on the network for
+// WIFI_IDLE_MS, and wakes up at the end of WIFI_SLEEP_MS or right away when the
+// alarm has to go out. Web clients wait up to WIFI_SLEEP_MS to be served.
+// Set WIFI_POWERSAVE to 1 on battery.
+#define WIFI_POWERSAVE         0
+#define WIFI_IDLE_MS           200
+#define WIFI_SLEEP_MS          1000
+
+// Link quality: the RSSI is sampled every few seconds (shown on /stats and
+// sent with the telemetry) and the board moves to a stronger access point of
+// the same SSID when the link stays weak. Set WIFI_LINKMON to 0 to turn it off.
+#define WIFI_LINKMON           1
+
+// How long to wait for a web client between two sensor reads (in ms).
+// The ToF sensors range on their own and queue every sample, so this only
+// sets how often the queue is drained.
+#define SAMPLE_PERIOD          1000
+
+// Pages are no longer built whole: they go out one WiFi payload at a time
+// from a pool block, see pageBegin/pageAppend/pageEnd
+static  uint8_t *pageBuf;
+static  uint16_t pageLen;
+static  WIFI_Status_t pageStatus;
 static  uint8_t  IP_Addr[4];
 
+// Kept by the supervisor events, nothing goes out on the network while false
+static bool wifiLinkUp = false;
+
 static uint8_t  currentTemp = 0;
-static uint16_t currentDist = 0;
+static uint16_t currentDist = 0;   // closest of the ToF sensors
 
 // Experimentally-determined calibration value (in mm)
 // to be subtracted from the proximity readings
 const uint16_t calibrationValue = 50;
-static int alarmDist = 70;
+#define ALARM_DIST_DEFAULT     70
+#define ALARM_DIST_MAX         999   // largest fence taken from the web page (in mm)
+static int alarmDist[PROXIMITY_SENSORS];   // one fence per ToF sensor
 static bool alarm = false;
 
+// Every range goes through one of these before the fence check, a single
+// short reading no longer sets off the alarm
+static RANGE_Filter_t rangeFilter[PROXIMITY_SENSORS];
+static uint16_t sensorDist[PROXIMITY_SENSORS];
+
+// A fence interrupt only sets off the alarm when another one came in this
+// long before it, two samples in a row inside the fence (covers the 200 ms
+// high accuracy budget)
+#define FENCE_CONFIRM_MS       250
+
 // Handles for the UART and Timer 16
 UART_HandleTypeDef huart1;
 TIM_HandleTypeDef htim16;
@@ -86,25 +143,31 @@ void serialPrint(char buffer[]);
 
 // Updates the sensor values
 void checkSensors();
+static void setFence(uint8_t sensor);
+static void mqttPublishState(void);
 
 static void MX_GPIO_Init(void);
 static void MX_TIM16_Init(void);
 static void MX_USART1_UART_Init(void);
 
 
-// TOF pin configuration
-static void VL53L0X_PROXIMITY_MspInit(void);
-
-// Function declarations for VL53L0X init and range measurements
-static void VL53L0X_PROXIMITY_Init(void);
-static uint16_t VL53L0X_PROXIMITY_GetDistance(void);
-
 // All wifi-related functions
 static  WIFI_Status_t SendWebPage( uint8_t temperature, uint16_t proxData);
+#if (ES_WIFI_USE_STATS == 1)
+static  WIFI_Status_t SendStatsPage(void);
+#endif
 static  int wifi_server(void);
-static  int wifi_start(void);
-static  int wifi_connect(void);
+static  void wifi_link_up(void);
+static  bool wifiAsleep(void);
+static  bool wifiReady(void);
+static  void wifiWake(void);
 static  bool WebServerProcess(void);
+static  WIFI_Status_t pageBegin(void);
+static  void pageFlush(void);
+static  void pageAppend(const char *text);
+static  void pageAppendUint(uint32_t value);
+static  void pageAppendInt(int32_t value);
+static  WIFI_Status_t pageEnd(void);
 
 int main(void)
 {
@@ -121,14 +184,31 @@ int main(void)
   // Initialize the UART for serial communication 
   MX_USART1_UART_Init();
 
-  // Initialize the ToF sensor
-  VL53L0X_PROXIMITY_Init();
+  // Holding the blue button through a reset forgets the stored ToF calibration
+  // (new sensor or cover glass), the sensor is then calibrated again below
+  if (HAL_GPIO_ReadPin(BUTTON_EXTI13_GPIO_Port, BUTTON_EXTI13_Pin) == GPIO_PIN_RESET) {
+	  TOF_CALIB_Erase();
+	  serialPrint("> ToF calibration erased\n\r");
+  }
+
+  // Use the BSP library to initialize the temperature sensor. This goes
+  // first, its init resets the I2C bus the ToF sensor then ranges on
+  BSP_TSENSOR_Init();
+
+  // Initialize the ToF sensors, they range on their own from here on and
+  // every sample comes in through their GPIO1 interrupts
+  if (VL53L0X_PROXIMITY_Init() != VL53L0X_ERROR_NONE) {
+	  serialPrint("ERROR : ToF sensor did not start ranging\n\r");
+  }
+  for (uint8_t i = 0; i < PROXIMITY_SENSORS; i++) {
+	  alarmDist[i] = ALARM_DIST_DEFAULT;
+	  sensorDist[i] = 0xFFFF;
+	  setFence(i);
+	  RANGE_FILTER_Init(&rangeFilter[i]);
+  }
 
   // Use the BSP library to initialize LED2
   BSP_LED_Init(LED2);
-  
-  // Use the BSP library to initialize the temperature sensor
-  BSP_TSENSOR_Init();
 
   // Initialize timer 16 (used for blinking the LED)
   // Currently set to blink once per 2s
@@ -152,80 +232,135 @@ int main(void)
 * @retval None
 */
 
-static int wifi_start(void)
+// Called every time the supervisor gets the board (back) on the network.
+// Whatever the module had open is gone after a rejoin, so the web server
+// and telemetry sockets are opened again here. MQTT notices on its own and
+// reconnects through MQTT_Process.
+static void wifi_link_up(void)
 {
+static bool macShown = false;
 uint8_t  MAC_Addr[6];
+uint8_t  mask[4], gateway[4], dns[4];
 
-/*Initialize and use WIFI module */
-if(WIFI_Init() ==  WIFI_STATUS_OK)
+if (!macShown)
 {
-  serialPrint("ES-WIFI Initialized.\n\r");
+#if (ES_WIFI_USE_UART == 1)
+  char spiMes[60] = {0};
+  char *p = spiMes;
+  p += FMT_Str(p, "> es-wifi UART baud rate : ");
+  p += FMT_Uint(p, UART_WIFI_GetBaudRate());
+  FMT_Str(p, "\n\r");
+  serialPrint(spiMes);
+#else
+  // The driver tries 20MHz SPI at init and drops back to 10MHz if the link self-test fails
+  char spiMes[60] = {0};
+  char *p = spiMes;
+  p += FMT_Str(p, "> es-wifi SPI clock : ");
+  p += FMT_Uint(p, SPI_WIFI_GetClock());
+  FMT_Str(p, " Hz\n\r");
+  serialPrint(spiMes);
+#endif
+
   if(WIFI_GetMAC_Address(MAC_Addr) == WIFI_STATUS_OK)
   {
 
     char macAdd[60] = {0};
-    sprintf(macAdd,"> es-wifi module MAC Address : %X:%X:%X:%X:%X:%X\n\r",
-            MAC_Addr[0],
-            MAC_Addr[1],
-            MAC_Addr[2],
-            MAC_Addr[3],
-            MAC_Addr[4],
-            MAC_Addr[5]);
+    char *p = macAdd + FMT_Str(macAdd, "> es-wifi module MAC Address : ");
+    for (int i = 0; i < 6; i++)
+    {
+      p += FMT_Hex(p, MAC_Addr[i]);
+      p += FMT_Str(p, (i < 5) ? ":" : "\n\r");
+    }
 
     serialPrint(macAdd);
+    macShown = true;
 
   }
   else
   {
     serialPrint("> ERROR : CANNOT get MAC address\n\r");
-    return -1;
   }
 }
-else
+
+// Read back from the join itself, no need to ask the module again
+if(WIFI_GetNetworkSettings(IP_Addr, mask, gateway, dns) == WIFI_STATUS_OK)
 {
-  return -1;
-}
-return 0;
-}
 
+  char connectMes[100] = {0};
+  char *p = connectMes;
+  p += FMT_Str(p, "> es-wifi module connected: got IP Address : ");
+  p += FMT_IP(p, IP_Addr);
+  p += FMT_Str(p, " (rejoins: ");
+  p += FMT_Uint(p, SUPERVISOR_GetRejoins());
+  FMT_Str(p, ")\n\r");
 
-int wifi_connect(void)
-{
+  serialPrint(connectMes);
 
-wifi_start();
+}
 
-char connecting[100] = {0};
-sprintf(connecting,"\nConnecting to %s , %s\n\r",SSID,PASSWORD);
+if (WIFI_STATUS_OK!=WIFI_StartServer(SOCKET, WIFI_TCP_PROTOCOL, 1, "", PORT))
+{
+  serialPrint("ERROR: Cannot start server.\n\r");
+}
 
+#if TELEMETRY_ENABLE
+uint8_t collector[4] = TELEMETRY_COLLECTOR;
 
-serialPrint(connecting);
-if( WIFI_Connect(SSID, PASSWORD, WIFI_ECN_WPA2_PSK) == WIFI_STATUS_OK)
+if (TELEMETRY_Init(collector, TELEMETRY_PORT) == WIFI_STATUS_OK)
 {
-  if(WIFI_GetIP_Address(IP_Addr) == WIFI_STATUS_OK)
-  {
+  char telMes[100] = {0};
+  char *p = telMes;
+  p += FMT_Str(p, "Telemetry to ");
+  p += FMT_IP(p, collector);
+  p += FMT_Str(p, ":");
+  p += FMT_Uint(p, TELEMETRY_PORT);
+  FMT_Str(p, "\n\r");
+  serialPrint(telMes);
+}
+else
+{
+  serialPrint("ERROR: Cannot open telemetry socket.\n\r");
+}
+#endif
 
-    char connectMes[100] = {0};
-    sprintf(connectMes,"> es-wifi module connected: got IP Address : %d.%d.%d.%d\n\r",
-            IP_Addr[0],
-            IP_Addr[1],
-            IP_Addr[2],
-            IP_Addr[3]);
+#if WIFI_POWERSAVE
+// Stay awake for a full idle window after every (re)join
+POWERSAVE_Touch();
+#endif
 
-    serialPrint(connectMes);
+char logMes[100] = {0};
+char *p = logMes;
+p += FMT_Str(p, "Server is running and waiting for an HTTP  Client connection to ");
+p += FMT_IP(p, IP_Addr);
+FMT_Str(p, "\n\r");
+serialPrint(logMes);
+}
 
-  }
-  else
-  {
-		  serialPrint(" ERROR : es-wifi module CANNOT get IP address\n\r");
-    return -1;
-  }
+// True while power save has the module asleep, no WiFi call may be made then
+static bool wifiAsleep(void)
+{
+#if WIFI_POWERSAVE
+return POWERSAVE_IsAsleep();
+#else
+return false;
+#endif
 }
-else
+
+// The module can be talked to: joined and awake
+static bool wifiReady(void)
 {
-		 serialPrint("ERROR : es-wifi module NOT connected\n\r");
-   return -1;
+return wifiLinkUp && !wifiAsleep();
 }
-return 0;
+
+// For outbound traffic that cannot wait for the next wake window
+static void wifiWake(void)
+{
+#if WIFI_POWERSAVE
+if (wifiLinkUp && POWERSAVE_WakeUp() != WIFI_STATUS_OK)
+{
+  SUPERVISOR_ReportFailure();
+}
+#endif
 }
 
 int wifi_server(void)
@@ -233,44 +368,138 @@ int wifi_server(void)
 bool StopServer = false;
 
 serialPrint("\nRunning HTML Server test\n\r");
-if (wifi_connect()!=0) return -1;
 
+char connecting[100] = {0};
+char *p = connecting;
+p += FMT_Str(p, "\nConnecting to ");
+p += FMT_Str(p, SSID);
+p += FMT_Str(p, " , ");
+p += FMT_Str(p, PASSWORD);
+FMT_Str(p, "\n\r");
+serialPrint(connecting);
 
-if (WIFI_STATUS_OK!=WIFI_StartServer(SOCKET, WIFI_TCP_PROTOCOL, 1, "", PORT))
-{
-  serialPrint("ERROR: Cannot start server.\n\r");
-}
+// The supervisor makes the first join as well as every rejoin, the loop
+// below keeps ranging and checking the alarm whether the link is up or not
+SUPERVISOR_Init(SSID, PASSWORD, WIFI_ECN_WPA2_PSK);
 
-char logMes[100] = {0};
-sprintf(logMes,"Server is running and waiting for an HTTP  Client connection to %d.%d.%d.%d\n\r",IP_Addr[0],IP_Addr[1],IP_Addr[2],IP_Addr[3]);
-serialPrint(logMes);
+#if WIFI_POWERSAVE
+POWERSAVE_Init(WIFI_IDLE_MS, WIFI_SLEEP_MS);
+#endif
+
+#if WIFI_LINKMON
+LINKMON_Init(SSID);
+#endif
+
+#if MQTT_ENABLE
+uint8_t broker[4] = MQTT_BROKER;
+
+// The connection itself is made (and remade) by MQTT_Process
+MQTT_Init(broker, MQTT_PORT, MQTT_CLIENT_ID, MQTT_KEEPALIVE);
+#endif
 
 do
 {
   uint8_t RemoteIP[4];
   uint16_t RemotePort;
+  uint32_t lastWaitMes = 0;
 
 
-  while (WIFI_STATUS_OK != WIFI_WaitServerConnection(SOCKET,1000,RemoteIP,&RemotePort))
+  while (!wifiReady() || WIFI_STATUS_OK != WIFI_WaitServerConnection(SOCKET,SAMPLE_PERIOD,RemoteIP,&RemotePort))
   {
 
-  	char waitMes[100] = {0};
-  	sprintf(waitMes,"Waiting for a connection to  %d.%d.%d.%d\n\r",IP_Addr[0],IP_Addr[1],IP_Addr[2],IP_Addr[3]);
-  	serialPrint(waitMes);
+#if WIFI_POWERSAVE
+  	// A module that does not come back counts as a failed socket operation
+  	if (wifiLinkUp && POWERSAVE_Process() != WIFI_STATUS_OK)
+  	{
+  		SUPERVISOR_ReportFailure();
+  	}
+#endif
+
+  	// The link is checked in the wake windows, a sleeping module answers nothing
+  	SUPERVISOR_Event_t event = wifiAsleep() ? SUPERVISOR_EVENT_NONE : SUPERVISOR_Process();
+
+  	switch (event)
+  	{
+  		case SUPERVISOR_EVENT_LINK_UP:
+  			wifiLinkUp = true;
+  			wifi_link_up();
+#if WIFI_LINKMON
+  			LINKMON_LinkUp();
+#endif
+  			break;
+
+  		case SUPERVISOR_EVENT_LINK_LOST:
+  			wifiLinkUp = false;
+  			serialPrint("ERROR : es-wifi link lost, reconnecting\n\r");
+  			break;
+
+  		default:
+  			break;
+  	}
+
+#if WIFI_LINKMON
+  	// A roam is a rejoin as far as the sockets are concerned
+  	if (wifiReady())
+  	{
+  		switch (LINKMON_Process())
+  		{
+  			case LINKMON_EVENT_ROAMED:
+  				serialPrint("> es-wifi moved to a stronger access point\n\r");
+  				wifi_link_up();
+  				break;
+
+  			case LINKMON_EVENT_ROAM_FAILED:
+  				// The supervisor finds the link down at its next check
+  				serialPrint("ERROR : es-wifi roam failed\n\r");
+  				break;
+
+  			default:
+  				break;
+  		}
+  	}
+#endif
+
+  	if (!wifiReady())
+  	{
+  		// Nothing to wait on, keep the sample period some other way
+  		HAL_Delay(SAMPLE_PERIOD);
+  	}
+  	// Keep the log at one line per second, however fast we sample
+  	else if (HAL_GetTick() - lastWaitMes >= 1000)
+  	{
+  		char waitMes[100] = {0};
+  		p = waitMes;
+  		p += FMT_Str(p, "Waiting for a connection to  ");
+  		p += FMT_IP(p, IP_Addr);
+  		FMT_Str(p, "\n\r");
+  		serialPrint(waitMes);
+  		lastWaitMes = HAL_GetTick();
+  	}
   	checkSensors();
 
   }
 
   char conMes[100] = {0};
-  sprintf(conMes,"Client connected %d.%d.%d.%d:%d\n\r",RemoteIP[0],RemoteIP[1],RemoteIP[2],RemoteIP[3],RemotePort);
+  p = conMes;
+  p += FMT_Str(p, "Client connected ");
+  p += FMT_IP(p, RemoteIP);
+  p += FMT_Str(p, ":");
+  p += FMT_Uint(p, RemotePort);
+  FMT_Str(p, "\n\r");
   serialPrint(conMes);
 
   StopServer=WebServerProcess();
 
+#if WIFI_POWERSAVE
+  POWERSAVE_Touch();
+#endif
+
+  // A failure here is no reason to give up any more, the supervisor
+  // decides whether the link needs to be rebuilt
   if(WIFI_CloseServerConnection(SOCKET) != WIFI_STATUS_OK)
   {
     serialPrint("ERROR: failed to close current Server connection\n\r");
-    return -1;
+    SUPERVISOR_ReportFailure();
   }
 }
 while(StopServer == false);
@@ -289,24 +518,42 @@ static bool WebServerProcess(void)
 
 uint16_t  respLen;
 
-static   uint8_t resp[1024];
+uint8_t *resp = POOL_Alloc();
 bool    stopserver=false;
 
-if (WIFI_STATUS_OK == WIFI_ReceiveData(SOCKET, resp, 1000, &respLen, WIFI_READ_TIMEOUT))
+if (resp == NULL)
 {
+  serialPrint("> ERROR : no buffer for the request\n\r");
+  return false;
+}
 
- char getByte[40] = {0};
- sprintf(getByte, "get %d byte(s) from server\n\r",respLen);
+// One byte is kept for the terminating zero, so strstr never runs past
+// what was actually received
+if (WIFI_STATUS_OK == WIFI_ReceiveData(SOCKET, resp, POOL_BLOCK_SIZE - 1, &respLen, WIFI_READ_TIMEOUT))
+{
+ resp[respLen] = 0;
 
 
  if( respLen > 0)
  {
+#if (ES_WIFI_USE_STATS == 1)
+    if(strstr((char *)resp, "GET /stats")) /* GET /stats: WiFi driver statistics */
+    {
+      if(SendStatsPage() != WIFI_STATUS_OK)
+      {
+        serialPrint("> ERROR : Cannot send stats page\n\r");
+        SUPERVISOR_ReportFailure();
+      }
+    }
+    else
+#endif
     if(strstr((char *)resp, "GET")) /* GET: put web page */
     {
 
       if(SendWebPage( currentTemp, currentDist) != WIFI_STATUS_OK)
       {
         serialPrint("> ERROR : Cannot send web page\n\r");
+        SUPERVISOR_ReportFailure();
       }
       else
       {
@@ -317,106 +564,52 @@ if (WIFI_STATUS_OK == WIFI_ReceiveData(SOCKET, resp, 1000, &respLen, WIFI_READ_T
      {
        serialPrint("Post request\n\r");
 
-       int numEqs = 0;
-
-       char fenceNum[3] = "000";
-
-       // Everything inside this for loop is dedicated to
-       // the traversal of the response from the end user
-       // in order to find the desired fence number input
-       // (The new proximity fence value)
-       //
-       // As the response is a char array of length 1024, the
-       // for loop iterates a maximum of 1024 times to find what
-       // we are looking for
-       //
-       // As it turns out, traversing a huge char array is challenging,
-       // especially since the input could be a 2-digit or a 3-digit number
-       // So, instead of looking for the number, we just look for the 7th '='.
-       //
-       // After studying the response after clicking the 'submit' button,
-       // the desired input was alwas after the 7th '=' in the whole response.
-       // So, it logically follows that the next 2 (or 3) characters in the
-       // array following the 7th '=' will be the number we are looking for.
-       //
-       // After finding this number, some extra stuff is done in order to account for
-       // 2 digit fence numbers as well as 3 digit ones. This was somewhat challenging,
-       // as the webserver doesn't overwrite the entire response, just what gets sent each time,
-       // so if a 2 digit fence value followed a 3 digit fence value, the loop would
-       // slurp in the next digit, and the fence value would be corrupted
-       //
-       // To fix this, if the 3rd digit is a number, the loop stores it and then replaces that value with an
-       // asterisk. If a 2 digit input follows a 3 digit input, the asterisk will not be overwritten,
-       // and so if this happens, we know for sure that a 2-digit input was entered, and the loop accounts for this.
-
-      for (int i=0; i<1024; i++) {
-
-    	  // Searching and counting the '='
-    	  if (resp[i] == '=') {
-
-    		  numEqs++;
-
-    	  }
-
-    	  // If the 7th '=' was found, the next few entries are the new fence input
-    	  if (numEqs == 7) {
-
-    		  // Check the 3rd digit. If it's a number, then a 3-digit input has been
-    		  // entered
-    		  //
-    		  // AS mentioned above, always write an asterisk after, if another
-    		  // 3-digit input is entered this will get overwritten, and if a
-    		  // 2-digit number gets entered, this if statement will not get executed,
-    		  // as the condition simply checks that the 3rd digit is actually a number
-    		  // (remember since the response is in char form, and so we check for numbers
-    		  // based on their ASCII representation
-    		  if ((resp[i+3] >= 48) && (resp[i+3] <= 57)) {
-
-    			  // Store the 3rd digit, it's important
-    		      fenceNum[2] = resp[i+3];
-
-    		      resp[i+3] = '*';
-
-    		      // Check if the first digit is a number and
-    		      // store it if it is.
-    		      if ((resp[i+1] >= 48) && (resp[i+1]<= 57)) {
-
-    		          fenceNum[0] = resp[i+1];
-
-    		      }
+       // The form also carries the ranging profile, so a submit that only
+       // changes the profile leaves the fence field empty. The fence is only
+       // taken when a number was actually typed in, and one the sensors can
+       // see.
+       char *field = strstr((char *)resp, "fenceNum=");
+       bool newFence = (field != NULL) && (field[9] >= '0') && (field[9] <= '9');
+       int fence = newFence ? atoi(field + 9) : 0;
+
+       if (newFence && (fence > ALARM_DIST_MAX)) {
+    	  serialPrint("ERROR : Proximity fence out of range\n\r");
+    	  newFence = false;
+       }
 
-    		      // Same for the 2nd digit
-    		      if ((resp[i+2] >= 48) && (resp[i+2]<= 57)) {
+      if (newFence) {
 
-    		          fenceNum[1] = resp[i+2];
+    	  // No sensor picked means all of them
+    	  uint8_t first = 0;
+    	  uint8_t last = PROXIMITY_SENSORS - 1;
 
-    		      }
+    	  field = strstr((char *)resp, "sensor=");
+    	  if ((field != NULL) && (field[7] >= '0') && (field[7] < '0' + PROXIMITY_SENSORS)) {
+    		  first = last = field[7] - '0';
+    	  }
 
-    		  }
+    	  for (uint8_t n = first; n <= last; n++) {
 
-    		  else {
+    		  // Sets the new alarm distance
+    		  alarmDist[n] = fence;
 
-    			  // If the above condition fails, the input is clearly  a 2-digit number,
-    			  // and so we adjust the placement of the digits to include a leading 0,
-    			  // which won't affect the conversion we will run later
-    		      fenceNum[0] = '0';
-    		      fenceNum[1] = resp[i+1];
-    		      fenceNum[2] = resp[i+2];
+    		  // And hands it to the sensor right away
+    		  setFence(n);
 
-    		      break;
+    	  }
 
-    		  }
+      }
 
-    		  // Break out of the loop, we're done!
-    		  break;
+      // Ranging profile picked from the list, a single digit
+      field = strstr((char *)resp, "profile=");
+      if ((field != NULL) && (field[8] >= '0') && (field[8] <= '9')) {
 
+    	  if (VL53L0X_PROXIMITY_SetProfile((PROXIMITY_Profile_t)(field[8] - '0')) != VL53L0X_ERROR_NONE) {
+    		  serialPrint("ERROR : ToF sensor did not take the ranging profile\n\r");
     	  }
 
       }
 
-      // Sets the new alarm distance by converting a string to a number
-      alarmDist = atoi(fenceNum);
-
        if(strstr((char *)resp, "stop_server"))
        {
          if(strstr((char *)resp, "stop_server=0"))
@@ -432,6 +625,7 @@ if (WIFI_STATUS_OK == WIFI_ReceiveData(SOCKET, resp, 1000, &respLen, WIFI_READ_T
        if(SendWebPage( currentTemp, currentDist) != WIFI_STATUS_OK)
        {
          serialPrint("> ERROR : Cannot send web page\n\r");
+         SUPERVISOR_ReportFailure();
        }
        else
        {
@@ -444,36 +638,212 @@ else
 {
   serialPrint("Client close connection\n\r");
 }
+POOL_Free(resp);
 return stopserver;
 
 }
 
-static WIFI_Status_t SendWebPage( uint8_t temperature, uint16_t proxData)
+#if (ES_WIFI_USE_STATS == 1)
+// Plain-text dump of the WiFi driver statistics, served on GET /stats.
+// One line per AT command class with its latency histogram (times in us,
+// each column counts the commands faster than its heading), then the totals.
+static WIFI_Status_t SendStatsPage(void)
 {
-uint8_t  temp[50];
-char proxMes[50] = {0};
-char fenceMes[50] = {0};
+static const char *className[ES_WIFI_CMD_CLASSES] = { "control", "send", "receive", "accept" };
+ES_WIFI_Stats_t stats;
+char line[128];
 
-uint16_t SentDataLength;
-WIFI_Status_t ret;
+if ((WIFI_GetStats(&stats) != WIFI_STATUS_OK) || (pageBegin() != WIFI_STATUS_OK))
+{
+  return WIFI_STATUS_ERROR;
+}
+
+pageAppend("HTTP/1.0 200 OK\r\nContent-Type: text/plain\r\nPragma: no-cache\r\n\r\n");
+pageAppend("class      count errors  avg_us  max_us |");
+for (int b = 0; b < ES_WIFI_STATS_BUCKETS - 1; b++)
+{
+  FMT_Str(line, " <");
+  FMT_Uint(line + 2, ES_WIFI_STATS_BUCKET_US(b));
+  pageAppend(line);
+}
+pageAppend(" more\r\n");
+
+for (int c = 0; c < ES_WIFI_CMD_CLASSES; c++)
+{
+  ES_WIFI_CmdStats_t *cmd = &stats.Cmd[c];
+
+  char *p = line + FMT_Str(line, className[c]);
+  while (p < line + 8)
+  {
+    *p++ = ' ';
+  }
+  *p++ = ' ';
+  p += FMT_UintPad(p, cmd->Count, 7, ' ');
+  *p++ = ' ';
+  p += FMT_UintPad(p, cmd->Errors, 6, ' ');
+  *p++ = ' ';
+  p += FMT_UintPad(p, cmd->Count ? (cmd->TotalUs / cmd->Count) : 0, 7, ' ');
+  *p++ = ' ';
+  p += FMT_UintPad(p, cmd->MaxUs, 7, ' ');
+  FMT_Str(p, " |");
+  pageAppend(line);
+  for (int b = 0; b < ES_WIFI_STATS_BUCKETS; b++)
+  {
+    FMT_Str(line, " ");
+    FMT_Uint(line + 1, cmd->Histogram[b]);
+    pageAppend(line);
+  }
+  pageAppend("\r\n");
+}
+
+pageAppend("\r\nbytes out ");
+pageAppendUint(stats.BytesOut);
+pageAppend(", bytes in ");
+pageAppendUint(stats.BytesIn);
+pageAppend("\r\ntimeouts ");
+pageAppendUint(stats.Timeouts);
+pageAppend(", module crashes ");
+pageAppendUint(stats.Crashes);
+pageAppend(", resets ");
+pageAppendUint(stats.Resets);
+pageAppend("\r\nbuffer pool ");
+pageAppendUint(POOL_GetHighWater());
+pageAppend(" of ");
+pageAppendUint(POOL_BLOCKS);
+pageAppend(" blocks at most\r\n");
+
+PROXIMITY_Stats_t tof;
+
+VL53L0X_PROXIMITY_GetStats(&tof);
+pageAppend("\r\ntof samples ");
+pageAppendUint(tof.Samples);
+pageAppend(", ");
+pageAppendUint(tof.Deferred);
+pageAppend(" left to the main loop, ");
+pageAppendUint(tof.Missed);
+pageAppend(" missed edges, ");
+pageAppendUint(tof.Overruns);
+pageAppend(" dropped, ");
+pageAppendUint(tof.Errors);
+pageAppend(" i2c errors, ");
+pageAppendUint(tof.FenceEvents);
+pageAppend(" fence interrupts\r\ntof sensors ");
+pageAppendUint(tof.Sensors);
+pageAppend(" of ");
+pageAppendUint(PROXIMITY_SENSORS);
+pageAppend(" ranging, profile ");
+pageAppend(VL53L0X_PROXIMITY_ProfileName(VL53L0X_PROXIMITY_GetProfile()));
+pageAppend("\r\ntof calibration ");
+pageAppendUint(tof.CalibRestored);
+pageAppend(" restored from flash, init ");
+pageAppendUint(tof.InitMs);
+pageAppend(" ms, ");
+pageAppendUint(tof.ShadowHits);
+pageAppend(" register reads from the shadow\r\n");
+for (uint8_t i = 0; i < PROXIMITY_SENSORS; i++) {
+
+	pageAppend("tof ");
+	pageAppendUint(i);
+	pageAppend(": fence in the sensor ");
+	pageAppendUint(VL53L0X_PROXIMITY_GetFence(i));
+	pageAppend(" mm (0 = software only), range filter ");
+	pageAppendUint(RANGE_FILTER_GetDistance(&rangeFilter[i]));
+	pageAppend(" mm, ");
+	pageAppendInt(RANGE_FILTER_GetVelocity(&rangeFilter[i]));
+	pageAppend(" mm/s, ");
+	pageAppendUint(rangeFilter[i].Spikes);
+	pageAppend(" spikes rejected, ");
+	pageAppendUint(rangeFilter[i].Steps);
+	pageAppend(" steps of ");
+	pageAppendUint(rangeFilter[i].Samples);
+	pageAppend(" samples\r\n");
 
-// construct web page content
-strcpy((char *)http, (char *)"HTTP/1.0 200 OK\r\nContent-Type: text/html\r\nPragma: no-cache\r\n\r\n");
-strcat((char *)http, (char *)"<html>\r\n<body>\r\n");
+}
+
+#if WIFI_LINKMON
+LINKMON_Stats_t lq;
+
+LINKMON_GetStats(&lq);
+pageAppend("\r\nrssi dBm: last ");
+pageAppendInt(lq.Rssi);
+pageAppend(", avg ");
+pageAppendInt(lq.Samples ? (lq.TotalRssi / (int32_t)lq.Samples) : 0);
+pageAppend(", min ");
+pageAppendInt(lq.MinRssi);
+pageAppend(", max ");
+pageAppendInt(lq.MaxRssi);
+pageAppend(", ");
+pageAppendUint(lq.WeakSamples);
+pageAppend(" of ");
+pageAppendUint(lq.Samples);
+pageAppend(" samples weak\r\nscans ");
+pageAppendUint(lq.Scans);
+pageAppend(" (");
+pageAppendUint(lq.ScanFailures);
+pageAppend(" failed), roams ");
+pageAppendUint(lq.Roams);
+pageAppend(" (");
+pageAppendUint(lq.RoamFailures);
+pageAppend(" failed, ");
+pageAppendUint(lq.NoCandidate);
+pageAppend(" with no better access point)\r\nlast scan: ");
+pageAppendUint(lq.ScanAPs);
+pageAppend(" access point(s) of the network, best ");
+pageAppendInt(lq.ScanBestRssi);
+pageAppend(" dBm\r\n");
+#endif
+
+#if WIFI_POWERSAVE
+POWERSAVE_Stats_t ps;
+
+POWERSAVE_GetStats(&ps);
+pageAppend("\r\nsleeps ");
+pageAppendUint(ps.Sleeps);
+pageAppend(", ");
+pageAppendUint(ps.AsleepMs);
+pageAppend(" ms asleep, wakes ");
+pageAppendUint(ps.TimerWakes);
+pageAppend(" on timer, ");
+pageAppendUint(ps.PinWakes);
+pageAppend(" on pin, ");
+pageAppendUint(ps.WakeFailures);
+pageAppend(" failed\r\nwake latency us: last ");
+pageAppendUint(ps.LastWakeUs);
+pageAppend(", avg ");
+pageAppendUint(ps.PinWakes ? (ps.TotalWakeUs / ps.PinWakes) : 0);
+pageAppend(", max ");
+pageAppendUint(ps.MaxWakeUs);
+pageAppend("\r\n");
+#endif
+
+return pageEnd();
+}
+#endif
+
+static WIFI_Status_t SendWebPage( uint8_t temperature, uint16_t proxData)
+{
+
+// construct web page content, it is sent as it fills up
+if (pageBegin() != WIFI_STATUS_OK)
+{
+  return WIFI_STATUS_ERROR;
+}
+pageAppend((char *)"HTTP/1.0 200 OK\r\nContent-Type: text/html\r\nPragma: no-cache\r\n\r\n");
+pageAppend((char *)"<html>\r\n<body>\r\n");
 
 // Set up automatic refresh. This is so the newest values for temperature and
 // proximity are (at least somewhat) recent
-strcat((char *)http, (char *)"<meta http-equiv=\"refresh\" content=\"5\">");
+pageAppend((char *)"<meta http-equiv=\"refresh\" content=\"5\">");
 
 // Center the text for heading 2 (h2) and 3 (h3)
-strcat((char *)http, (char *)"<style>");
-strcat((char *)http, (char *)"h2 {text-align: center;}");
-strcat((char *)http, (char *)"h3 {text-align: center;}");
-strcat((char *)http, (char *)"</style>");
+pageAppend((char *)"<style>");
+pageAppend((char *)"h2 {text-align: center;}");
+pageAppend((char *)"h3 {text-align: center;}");
+pageAppend((char *)"</style>");
 
 // The title of the webpage and a nice strong header
-strcat((char *)http, (char *)"<title>Proximity Security System</title>\r\n");
-strcat((char *)http, (char *)"<h2>STM32 Proximity Security System Control Panel</h2>\r\n");
+pageAppend((char *)"<title>Proximity Security System</title>\r\n");
+pageAppend((char *)"<h2>STM32 Proximity Security System Control Panel</h2>\r\n");
 
 // Checks the alarm has been triggered and if it has, adds a scary-looking warning
 // that alerts the user about the triggered alarm
@@ -483,31 +853,31 @@ strcat((char *)http, (char *)"<h2>STM32 Proximity Security System Control Panel<
 // If this check fails, set the  background to a professional-gray
 if (alarm == true) {
 
-	strcat((char *)http, (char *)"<h3>WARNING!!! ALARM HAS BEEN TRIGGERED!</h3>\r\n");
-	strcat((char *)http, (char *)"<body style=\"background-color:red;\">");
+	pageAppend((char *)"<h3>WARNING!!! ALARM HAS BEEN TRIGGERED!</h3>\r\n");
+	pageAppend((char *)"<body style=\"background-color:red;\">");
 }
 
 else {
 
-	strcat((char *)http, (char *)"<body style=\"background-color:grey;\">");
+	pageAppend((char *)"<body style=\"background-color:grey;\">");
 
 }
 
 
-strcat((char *)http, (char *)"<br /><hr>\r\n");
+pageAppend((char *)"<br /><hr>\r\n");
 
 // Nice header for the live readings
-strcat((char *)http, (char *)"<p style=\"text-decoration: underline;\"><strong>Live Readings</strong></p>");
+pageAppend((char *)"<p style=\"text-decoration: underline;\"><strong>Live Readings</strong></p>");
 
 /*
 if (alarm == true) {
 
-	strcat((char *)http, (char *)"<body style=\"background-color:red;\">");
+	pageAppend((char *)"<body style=\"background-color:red;\">");
 }
 
 else {
 
-	strcat((char *)http, (char *)"<body style=\"background-color:grey;\">");
+	pageAppend((char *)"<body style=\"background-color:grey;\">");
 
 }
 
@@ -515,104 +885,162 @@ else {
 
 // Printing the temperature, use an input form for the text display as it ensures a white background for the
 // readings, which won't be affected by background color changes
-strcat((char *)http, (char *)"<p><form method=\"POST\"><strong>Current Temperature: <input type=\"text\" value=\"");
-sprintf((char *)temp, "%d", temperature);
-strcat((char *)http, (char *)temp);
-strcat((char *)http, (char *)"\"> <sup>O</sup>F");
+pageAppend((char *)"<p><form method=\"POST\"><strong>Current Temperature: <input type=\"text\" value=\"");
+pageAppendUint(temperature);
+pageAppend((char *)"\"> <sup>O</sup>F");
 
 // Object too far to measure accurately, say that there is no object
 if (proxData > 2000) {
 
-	  strcat((char *)http, (char *)"<p><form method=\"POST\"><strong>Object Distance: <input type=\"text\" value=\"No Object Detected!\"");
+	  pageAppend((char *)"<p><form method=\"POST\"><strong>Object Distance: <input type=\"text\" value=\"No Object Detected!\"");
 
 }
 
 else {
 
 	  // Otherwise, display the current proximity data
-	  strcat((char *)http, (char *)"<p><form method=\"POST\"><strong>Object Distance: <input type=\"text\" value=\"");
-	  sprintf((char *)proxMes, "%d", proxData);
-	  strcat((char *)http, (char *)proxMes);
-	  strcat((char *)http, (char *)"\"> mm");
+	  pageAppend((char *)"<p><form method=\"POST\"><strong>Object Distance: <input type=\"text\" value=\"");
+	  pageAppendUint(proxData);
+	  pageAppend((char *)"\"> mm");
 
 }
 
 // Nice header for the security settings
-strcat((char *)http, (char *)"<p> </p>");
-strcat((char *)http, (char *)"<p style=\"text-decoration: underline;\"><strong>Security Settings</strong></p>");
-strcat((char *)http, (char *)"<p> </p>");
+pageAppend((char *)"<p> </p>");
+pageAppend((char *)"<p style=\"text-decoration: underline;\"><strong>Security Settings</strong></p>");
+pageAppend((char *)"<p> </p>");
 
-// Input form for the new proximity distance
-strcat((char *)http, (char *)"<p><form method=\"POST\"><strong>Current Proximity Fence: <input type=\"text\" value=\"");
-sprintf((char *)fenceMes, "%d", alarmDist);
-strcat((char *)http, (char *)fenceMes);
-strcat((char *)http, (char *)"\"> mm");
+// Input form for the new proximity distance, one fence per sensor
+pageAppend((char *)"<p><form method=\"POST\"><strong>Current Proximity Fence: <input type=\"text\" value=\"");
+for (int i = 0; i < PROXIMITY_SENSORS; i++) {
+
+	  if (i > 0) {
+		  pageAppend((char *)" / ");
+	  }
+	  pageAppendInt(alarmDist[i]);
+
+}
+pageAppend((char *)"\"> mm");
 
 // Just a nice separator
-strcat((char *)http, (char *)"<p> </p>");
+pageAppend((char *)"<p> </p>");
 
 // Input for the new fence number
-strcat((char *)http, (char *)"<label for=\"fenceNum\"><strong>New Proximity Fence: </strong></label>");
-strcat((char *)http, (char *)"<input type=\"text\" id=\"fenceNum\" name=\"fenceNum\"><br><br>");
+pageAppend((char *)"<label for=\"fenceNum\"><strong>New Proximity Fence: </strong></label>");
+pageAppend((char *)"<input type=\"text\" id=\"fenceNum\" name=\"fenceNum\"><br><br>");
+
+// Ranging profile list, the one in use comes selected so a fence change keeps it
+pageAppend((char *)"<label for=\"profile\"><strong>Ranging Profile: </strong></label>");
+pageAppend((char *)"<select id=\"profile\" name=\"profile\">");
+for (int i = 0; i < PROXIMITY_PROFILE_COUNT; i++) {
+
+	  pageAppend((char *)"<option value=\"");
+	  pageAppendUint(i);
+	  pageAppend((i == VL53L0X_PROXIMITY_GetProfile()) ? (char *)"\" selected>" : (char *)"\">");
+	  pageAppend((char *)VL53L0X_PROXIMITY_ProfileName((PROXIMITY_Profile_t)i));
+	  pageAppend((char *)"</option>");
+
+}
+pageAppend((char *)"</select><br><br>");
+
+#if PROXIMITY_SENSORS > 1
+// Which sensor the new fence goes to
+pageAppend((char *)"<label for=\"sensor\"><strong>Fence For: </strong></label>");
+pageAppend((char *)"<select id=\"sensor\" name=\"sensor\"><option value=\"all\">All sensors</option>");
+for (int i = 0; i < PROXIMITY_SENSORS; i++) {
+
+	  pageAppend((char *)"<option value=\"");
+	  pageAppendUint(i);
+	  pageAppend((char *)"\">Sensor ");
+	  pageAppendUint(i);
+	  pageAppend((char *)"</option>");
+
+}
+pageAppend((char *)"</select><br><br>");
+#endif
 
 // Submit button
-strcat((char *)http, (char *)"</strong><p><input type=\"submit\"></form></span>");
+pageAppend((char *)"</strong><p><input type=\"submit\"></form></span>");
 
 // End the page
-strcat((char *)http, (char *)"</body>\r\n</html>\r\n");
+pageAppend((char *)"</body>\r\n</html>\r\n");
 
-// Send the page off
-ret = WIFI_SendData(0, (uint8_t *)http, strlen((char *)http), &SentDataLength, WIFI_WRITE_TIMEOUT);
+// Send what is left of the page
+return pageEnd();
+}
 
-if((ret == WIFI_STATUS_OK) && (SentDataLength != strlen((char *)http)))
+// Page output: text is copied into a pool block, which is sent every time it
+// holds a full WiFi payload. The first failed send is kept and reported by
+// pageEnd, later text is dropped.
+static WIFI_Status_t pageBegin(void)
 {
-  ret = WIFI_STATUS_ERROR;
+pageBuf = POOL_Alloc();
+pageLen = 0;
+pageStatus = (pageBuf != NULL) ? WIFI_STATUS_OK : WIFI_STATUS_ERROR;
+return pageStatus;
 }
 
-return ret;
-}
+static void pageFlush(void)
+{
+uint16_t SentDataLength;
 
-static void VL53L0X_PROXIMITY_Init(void)
+if ((pageStatus == WIFI_STATUS_OK) && (pageLen > 0))
 {
+  pageStatus = WIFI_SendData(SOCKET, pageBuf, pageLen, &SentDataLength, WIFI_WRITE_TIMEOUT);
 
-// Initialize I2C interface
-SENSOR_IO_Init();
+  if((pageStatus == WIFI_STATUS_OK) && (SentDataLength != pageLen))
+  {
+    pageStatus = WIFI_STATUS_ERROR;
+  }
+}
+pageLen = 0;
+}
 
-	// Initialize pins for TOF
-VL53L0X_PROXIMITY_MspInit();
+static void pageAppend(const char *text)
+{
+while ((pageStatus == WIFI_STATUS_OK) && (*text != 0))
+{
+  uint16_t n = strlen(text);
 
-// One-time TOF device initialization
-VL53L0X_DataInit(&Dev);
+  if (n > POOL_BLOCK_SIZE - pageLen)
+  {
+    n = POOL_BLOCK_SIZE - pageLen;
+  }
+  memcpy(pageBuf + pageLen, text, n);
+  pageLen += n;
+  text += n;
 
+  if (pageLen == POOL_BLOCK_SIZE)
+  {
+    pageFlush();
+  }
+}
 }
 
-
-static uint16_t VL53L0X_PROXIMITY_GetDistance(void)
+// Numbers go through a scratch on the stack, they are too short to be worth
+// writing straight into the block across a flush
+static void pageAppendUint(uint32_t value)
 {
-VL53L0X_RangingMeasurementData_t RangingMeasurementData;
+char digits[FMT_UINT_MAX + 1];
 
-VL53L0X_PerformSingleRangingMeasurement(&Dev, &RangingMeasurementData);
-
-return RangingMeasurementData.RangeMilliMeter;
+FMT_Uint(digits, value);
+pageAppend(digits);
 }
 
-/**
-* @brief  VL53L0X proximity sensor Msp Initialization.
-*/
-static void VL53L0X_PROXIMITY_MspInit(void)
+static void pageAppendInt(int32_t value)
 {
-GPIO_InitTypeDef GPIO_InitStruct;
-
-// Configure GPIO pin : VL53L0X_XSHUT_Pin
-GPIO_InitStruct.Pin = VL53L0X_XSHUT_Pin;
-GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
-GPIO_InitStruct.Pull = GPIO_PULLUP;
-GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_HIGH;
-HAL_GPIO_Init(VL53L0X_XSHUT_GPIO_Port, &GPIO_InitStruct);
+char digits[FMT_INT_MAX + 1];
 
-HAL_GPIO_WritePin(VL53L0X_XSHUT_GPIO_Port, VL53L0X_XSHUT_Pin, GPIO_PIN_SET);
+FMT_Int(digits, value);
+pageAppend(digits);
+}
 
-HAL_Delay(1000);
+static WIFI_Status_t pageEnd(void)
+{
+pageFlush();
+POOL_Free(pageBuf);
+pageBuf = NULL;
+return pageStatus;
 }
 
 void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
@@ -632,10 +1060,32 @@ switch (GPIO_Pin)
   	{
 
       	alarm = false;
+      	break;
 
   	}
+
+  // Anything else may be the GPIO1 of a ToF sensor: a new sample is
+  // ready, or with the fence in the sensor something came inside it.
+  // On the second time in a row from the same sensor the alarm goes
+  // off right here, whatever the main loop is busy with. A lone one
+  // is left to the filter in checkSensors.
   default:
   {
+    static uint32_t lastFenceTick[PROXIMITY_SENSORS];
+    static bool fenceSeen[PROXIMITY_SENSORS];
+    uint8_t sensor = 0;
+
+    if (VL53L0X_PROXIMITY_ISR(GPIO_Pin, &sensor) == PROXIMITY_EVENT_FENCE)
+    {
+      uint32_t now = HAL_GetTick();
+
+      if (fenceSeen[sensor] && (now - lastFenceTick[sensor] <= FENCE_CONFIRM_MS))
+      {
+        alarm = true;
+      }
+      fenceSeen[sensor] = true;
+      lastFenceTick[sensor] = now;
+    }
     break;
   }
 }
@@ -651,6 +1101,38 @@ void SPI3_IRQHandler(void)
 HAL_SPI_IRQHandler(&hspi);
 }
 
+#if (ES_WIFI_USE_UART == 1)
+/**
+* @brief  UART4 (es-wifi on UART): IDLE line and transmit end
+* @param  None
+* @retval None
+*/
+void UART4_IRQHandler(void)
+{
+UART_WIFI_ISR();
+}
+
+/**
+* @brief  DMA2 channel 3: es-wifi UART transmit
+* @param  None
+* @retval None
+*/
+void DMA2_Channel3_IRQHandler(void)
+{
+HAL_DMA_IRQHandler(huart_wifi.hdmatx);
+}
+
+/**
+* @brief  DMA2 channel 5: es-wifi UART circular receive
+* @param  None
+* @retval None
+*/
+void DMA2_Channel5_IRQHandler(void)
+{
+HAL_DMA_IRQHandler(huart_wifi.hdmarx);
+}
+#endif
+
 /**
   * @brief System Clock Configuration
   * @retval None
@@ -1039,26 +1521,156 @@ void serialPrint(char buffer[]) {
 // proximity sensor, converting and calibrating the values as necessary
 void checkSensors() {
 
-	// Read and then convert the temperature to farenheit
-	currentTemp = BSP_TSENSOR_ReadTemp();
+	// Read and then convert the temperature to farenheit. The ToF sensor
+	// reads its results on interrupts, it is kept off the shared I2C bus
+	// for the blocking temperature read
+	VL53L0X_PROXIMITY_LockBus();
+	float tempC = BSP_TSENSOR_ReadTemp();
+	VL53L0X_PROXIMITY_UnlockBus();
+	currentTemp = tempC;
 	currentTemp = (currentTemp*1.8)+32;
 
 
-	// Calibrate the ToF sensor with an experimentally-determined value
-	currentDist = VL53L0X_PROXIMITY_GetDistance();
-	currentDist = currentDist-calibrationValue;
+	// The ToF sensors range continuously, every sample since the last call
+	// is waiting in the queue. Pick up one the interrupt had to leave behind.
+	VL53L0X_PROXIMITY_Process();
 
-	// Also checks whether the new proximity value violates the established proximity fence
-	//
-	// If it does, activate the alarm
-	if (currentDist <= alarmDist) {
+	PROXIMITY_Sample_t sample;
+	while (VL53L0X_PROXIMITY_GetSample(&sample)) {
 
-		alarm = true;
+		uint8_t n = sample.Sensor;
+
+		// Median and alpha-beta filter of that sensor first, a spike never
+		// reaches the fence check. Then calibrate with an experimentally-determined value,
+		// a range under it is 0 rather than wrapping around to a far one.
+		uint16_t filtered = RANGE_FILTER_Update(&rangeFilter[n], sample.Tick, sample.RangeMilliMeter, sample.RangeStatus);
+		sensorDist[n] = (filtered > calibrationValue) ? filtered - calibrationValue : 0;
+
+#if TELEMETRY_ENABLE
+		// Telemetry gets the raw range (no calibration offset) and the temperature
+		// in Celsius, the collector does its own conversions. Each record
+		// carries the index of its sensor.
+		TELEMETRY_AddSample(n, sample.Tick, sample.RangeMilliMeter, sample.SignalRateRtnMegaCps, tempC);
+#endif
+
+		// Also checks whether the new proximity value violates the fence of that sensor
+		//
+		// If it does, activate the alarm. With the fence in the sensor the interrupt
+		// may have done it already, this catches a target that stays inside
+		// between interrupts and a sensor that could not take the fence.
+		if (sensorDist[n] <= alarmDist[n]) {
+
+			alarm = true;
+
+		}
+
+	}
+
+	// The web page and MQTT show the closest thing any of the sensors sees
+	currentDist = sensorDist[0];
+	for (uint8_t i = 1; i < PROXIMITY_SENSORS; i++) {
+
+		if (sensorDist[i] < currentDist) {
+			currentDist = sensorDist[i];
+		}
+
+	}
+
+#if TELEMETRY_ENABLE
+#if WIFI_LINKMON
+	TELEMETRY_SetLinkQuality(LINKMON_GetRssi());
+#endif
+	// Batches wait for the next wake window when the module sleeps
+	if (wifiReady()) {
+		TELEMETRY_Process();
+	}
+#endif
+
+#if MQTT_ENABLE
+	mqttPublishState();
+#endif
+
+}
+
+// Pushes the proximity fence of one sensor down into it, which then raises its
+// interrupt only for something inside it. The sensor sees raw ranges, so the
+// calibration offset is added back. The software check in checkSensors stays
+// as the fallback if the sensor does not take it.
+static void setFence(uint8_t sensor) {
+
+	int fence = alarmDist[sensor] + calibrationValue;
+
+	if (fence < 1) {
+		fence = 1;
+	}
+
+	if (VL53L0X_PROXIMITY_SetFence(sensor, (uint16_t)fence) != VL53L0X_ERROR_NONE) {
+		serialPrint("ERROR : ToF sensor did not take the fence, checking it in software\n\r");
+	}
+
+}
+
+// Publishes whatever changed since the last call to the MQTT broker. The
+// messages are packed together and go out with a single send.
+static void mqttPublishState(void) {
+
+	static int8_t   lastAlarm = -1;
+	static uint8_t  lastTemp = 0;
+	static uint16_t lastDist = 0;
+	static bool     sensorsSent = false;
+	char payload[16];
+
+	// The alarm also gets reset from the button interrupt, so it is compared
+	// against what was last published rather than tracked where it changes
+	if (lastAlarm != alarm) {
+
+		const char *state = alarm ? "TRIGGERED" : "CLEAR";
+
+		// The alarm is worth waking the module up for
+		wifiWake();
+
+		if (MQTT_Publish(MQTT_TOPIC "/alarm", (const uint8_t *)state, strlen(state), MQTT_QOS1, 1) == WIFI_STATUS_OK) {
+			lastAlarm = alarm;
+			MQTT_Flush();
+		}
+
+	}
+
+	if (MQTT_GetState() == MQTT_STATE_CONNECTED) {
+
+		// While the module sleeps, sensor values wait for the next wake window
+		// and only the latest ones go out
+		if (wifiReady()) {
+
+			if (!sensorsSent || abs((int)currentDist - (int)lastDist) >= MQTT_DIST_DEADBAND) {
+				FMT_Uint(payload, currentDist);
+				MQTT_Publish(MQTT_TOPIC "/distance", (const uint8_t *)payload, strlen(payload), MQTT_QOS0, 1);
+				lastDist = currentDist;
+			}
+
+			if (!sensorsSent || currentTemp != lastTemp) {
+				FMT_Uint(payload, currentTemp);
+				MQTT_Publish(MQTT_TOPIC "/temperature", (const uint8_t *)payload, strlen(payload), MQTT_QOS0, 1);
+				lastTemp = currentTemp;
+			}
+
+			sensorsSent = true;
+
+		}
 
 	}
 
 	else {
 
+		// Everything is published again once the broker is back
+		sensorsSent = false;
+
+	}
+
+	// The alarm stays queued while the link is down, it goes out once
+	// the supervisor has the board back on the network
+	if (wifiReady()) {
+		MQTT_Process();
 	}
 
 }
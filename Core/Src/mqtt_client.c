@@ -0,0 +1,496 @@
+/**
+  ******************************************************************************
+  * @file    mqtt_client.c
+  * @brief   Minimal MQTT 3.1.1 publisher: one TCP connection to the broker on
+  *          MQTT_SOCKET, publishes packed into a single transmit buffer, QoS 1
+  *          retries and keep-alive driven from MQTT_Process. The socket is only
+  *          read while an acknowledgement is expected, so an idle connection
+  *          costs no AT traffic between two PINGREQs.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "mqtt_client.h"
+
+/* Private define ------------------------------------------------------------*/
+#define MQTT_CONNECT                0x10
+#define MQTT_CONNACK                0x20
+#define MQTT_PUBLISH                0x30
+#define MQTT_PUBACK                 0x40
+#define MQTT_PINGREQ                0xC0
+#define MQTT_PINGRESP               0xD0
+#define MQTT_DISCONNECT             0xE0
+#define MQTT_FLAG_DUP               0x08
+#define MQTT_PROTOCOL_LEVEL         4       /* 3.1.1 */
+#define MQTT_CONNECT_CLEAN_SESSION  0x02
+#define MQTT_READ_TIMEOUT           1       /* ms, R2 of a poll */
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  uint16_t PacketId;                        /* 0: slot free */
+  uint16_t Len;
+  uint32_t SentAt;
+  uint8_t  Packet[MQTT_MAX_PACKET];
+} MQTT_Inflight_t;
+
+/* Private variables ---------------------------------------------------------*/
+static uint8_t         BrokerIP[4];
+static uint16_t        BrokerPort;
+static char            ClientId[MQTT_MAX_CLIENT_ID + 1];
+static uint16_t        KeepAlive;
+static MQTT_State_t    State;
+static uint32_t        StateTick;
+static uint32_t        LastSend;
+static uint8_t         PingPending;
+static uint32_t        PingSentAt;
+static uint16_t        NextPacketId;
+static uint8_t         TxBuffer[MQTT_TX_BUFFER_SIZE];
+static uint16_t        TxLen;
+static uint8_t         RxBuffer[MQTT_RX_BUFFER_SIZE];
+static uint16_t        RxLen;
+static MQTT_Inflight_t Inflight[MQTT_MAX_INFLIGHT];
+
+/* Private functions ---------------------------------------------------------*/
+static uint8_t EncodeLength(uint8_t *p, uint32_t len)
+{
+  uint8_t n = 0;
+
+  do
+  {
+    p[n] = len % 128;
+    len /= 128;
+    if (len > 0)
+    {
+      p[n] |= 0x80;
+    }
+    n++;
+  } while (len > 0);
+  return n;
+}
+
+static uint16_t PutString(uint8_t *p, const char *s, uint16_t len)
+{
+  p[0] = (uint8_t)(len >> 8);
+  p[1] = (uint8_t)len;
+  memcpy(p + 2, s, len);
+  return len + 2;
+}
+
+static void Close(void)
+{
+  uint8_t i;
+
+  WIFI_CloseClientConnection(MQTT_SOCKET);
+  State       = MQTT_STATE_DISCONNECTED;
+  StateTick   = HAL_GetTick();
+  TxLen       = 0;
+  RxLen       = 0;
+  PingPending = 0;
+
+  /* QoS 1 messages survive, they go out again after the next CONNACK */
+  for (i = 0; i < MQTT_MAX_INFLIGHT; i++)
+  {
+    Inflight[i].SentAt = 0;
+  }
+}
+
+static WIFI_Status_t Queue(const uint8_t *data, uint16_t len)
+{
+  if ((TxLen + len > MQTT_TX_BUFFER_SIZE) && (MQTT_Flush() != WIFI_STATUS_OK))
+  {
+    return WIFI_STATUS_ERROR;
+  }
+  if (TxLen + len > MQTT_TX_BUFFER_SIZE)
+  {
+    return WIFI_STATUS_ERROR;
+  }
+  memcpy(&TxBuffer[TxLen], data, len);
+  TxLen += len;
+  return WIFI_STATUS_OK;
+}
+
+static void QueueInflight(MQTT_Inflight_t *msg)
+{
+  if (Queue(msg->Packet, msg->Len) == WIFI_STATUS_OK)
+  {
+    msg->SentAt = HAL_GetTick();
+    /* any later copy of this message is a redelivery */
+    msg->Packet[0] |= MQTT_FLAG_DUP;
+  }
+}
+
+static WIFI_Status_t Connect(void)
+{
+  uint8_t  packet[16 + MQTT_MAX_CLIENT_ID];
+  uint16_t idlen = strlen(ClientId);
+  uint16_t n;
+
+  StateTick = HAL_GetTick();
+  if (WIFI_OpenClientConnection(MQTT_SOCKET, WIFI_TCP_PROTOCOL, "", BrokerIP, BrokerPort, 0) != WIFI_STATUS_OK)
+  {
+    return WIFI_STATUS_ERROR;
+  }
+
+  packet[0] = MQTT_CONNECT;
+  n = 1 + EncodeLength(&packet[1], 10 + 2 + idlen);
+  n += PutString(&packet[n], "MQTT", 4);
+  packet[n++] = MQTT_PROTOCOL_LEVEL;
+  packet[n++] = MQTT_CONNECT_CLEAN_SESSION;
+  packet[n++] = (uint8_t)(KeepAlive >> 8);
+  packet[n++] = (uint8_t)KeepAlive;
+  n += PutString(&packet[n], ClientId, idlen);
+
+  State = MQTT_STATE_CONNECTING;
+  TxLen = 0;
+  RxLen = 0;
+  Queue(packet, n);
+  return MQTT_Flush();
+}
+
+static void HandlePacket(const uint8_t *p, uint32_t len)
+{
+  uint16_t id;
+  uint8_t  i;
+
+  switch (p[0] & 0xF0)
+  {
+    case MQTT_CONNACK:
+      if ((State == MQTT_STATE_CONNECTING) && (len >= 3))
+      {
+        if (p[len - 1] != 0)
+        {
+          /* refused: protocol, client id, credentials... retried later */
+          Close();
+          break;
+        }
+        State    = MQTT_STATE_CONNECTED;
+        LastSend = HAL_GetTick();
+        for (i = 0; i < MQTT_MAX_INFLIGHT; i++)
+        {
+          if (Inflight[i].PacketId != 0)
+          {
+            QueueInflight(&Inflight[i]);
+          }
+        }
+      }
+      break;
+
+    case MQTT_PUBACK:
+      if (len >= 3)
+      {
+        id = ((uint16_t)p[len - 2] << 8) | p[len - 1];
+        for (i = 0; i < MQTT_MAX_INFLIGHT; i++)
+        {
+          if (Inflight[i].PacketId == id)
+          {
+            Inflight[i].PacketId = 0;
+          }
+        }
+      }
+      break;
+
+    case MQTT_PINGRESP:
+      PingPending = 0;
+      break;
+
+    default:
+      break;
+  }
+}
+
+static WIFI_Status_t Poll(void)
+{
+  uint16_t len = 0;
+  uint32_t remaining, multiplier;
+  uint16_t pos, hdr;
+
+  if (WIFI_ReceiveData(MQTT_SOCKET, &RxBuffer[RxLen], MQTT_RX_BUFFER_SIZE - RxLen, &len, MQTT_READ_TIMEOUT) != WIFI_STATUS_OK)
+  {
+    Close();
+    return WIFI_STATUS_ERROR;
+  }
+  RxLen += len;
+
+  while ((RxLen >= 2) && (State != MQTT_STATE_DISCONNECTED))
+  {
+    remaining  = 0;
+    multiplier = 1;
+    hdr = 1;
+    do
+    {
+      if (hdr >= RxLen)
+      {
+        return WIFI_STATUS_OK;
+      }
+      remaining += (RxBuffer[hdr] & 0x7F) * multiplier;
+      multiplier *= 128;
+    } while ((RxBuffer[hdr++] & 0x80) && (hdr < 5));
+
+    if (hdr + remaining > MQTT_RX_BUFFER_SIZE)
+    {
+      /* nothing that large is expected from the broker for a publisher */
+      Close();
+      return WIFI_STATUS_ERROR;
+    }
+    if (hdr + remaining > RxLen)
+    {
+      break;
+    }
+
+    /* variable header and payload only, fixed header byte passed along */
+    RxBuffer[hdr - 1] = RxBuffer[0];
+    HandlePacket(&RxBuffer[hdr - 1], remaining + 1);
+    pos = hdr + remaining;
+    if (State == MQTT_STATE_DISCONNECTED)
+    {
+      break;
+    }
+    memmove(RxBuffer, &RxBuffer[pos], RxLen - pos);
+    RxLen -= pos;
+  }
+  return WIFI_STATUS_OK;
+}
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  Configure the client, the connection is made by MQTT_Process
+  * @param  broker_ip : broker IPv4 address
+  * @param  broker_port : broker TCP port, usually 1883
+  * @param  client_id : client identifier, at most MQTT_MAX_CLIENT_ID chars
+  * @param  keepalive : keep-alive interval in seconds, 0 to disable
+  * @retval None
+  */
+void MQTT_Init(uint8_t *broker_ip, uint16_t broker_port, const char *client_id, uint16_t keepalive)
+{
+  memcpy(BrokerIP, broker_ip, sizeof(BrokerIP));
+  BrokerPort = broker_port;
+  strncpy(ClientId, client_id, MQTT_MAX_CLIENT_ID);
+  ClientId[MQTT_MAX_CLIENT_ID] = '\0';
+  KeepAlive    = keepalive;
+  NextPacketId = 1;
+  TxLen        = 0;
+  RxLen        = 0;
+  PingPending  = 0;
+  memset(Inflight, 0, sizeof(Inflight));
+
+  /* first attempt on the next MQTT_Process */
+  State     = MQTT_STATE_DISCONNECTED;
+  StateTick = HAL_GetTick() - MQTT_RECONNECT_DELAY;
+}
+
+/**
+  * @brief  Queue a message, it is sent by the next MQTT_Flush or MQTT_Process
+  * @param  topic : topic name
+  * @param  payload : message content
+  * @param  len : message length
+  * @param  qos : MQTT_QOS0 messages are dropped while disconnected,
+  *               MQTT_QOS1 ones are kept until the broker acknowledges them
+  * @param  retain : non-zero to set the RETAIN flag
+  * @retval Operation status
+  */
+WIFI_Status_t MQTT_Publish(const char *topic, const uint8_t *payload, uint16_t len, MQTT_QoS_t qos, uint8_t retain)
+{
+  uint8_t  header[5];
+  uint16_t tlen = strlen(topic);
+  uint32_t remaining = 2 + tlen + ((qos == MQTT_QOS1) ? 2 : 0) + len;
+  uint16_t n, total;
+  MQTT_Inflight_t *msg = NULL;
+  uint8_t  i;
+
+  header[0] = MQTT_PUBLISH | (qos << 1) | (retain ? 1 : 0);
+  n = 1 + EncodeLength(&header[1], remaining);
+  total = n + remaining;
+
+  if (qos == MQTT_QOS0)
+  {
+    if ((State != MQTT_STATE_CONNECTED) || (total > MQTT_TX_BUFFER_SIZE))
+    {
+      return WIFI_STATUS_ERROR;
+    }
+    if ((TxLen + total > MQTT_TX_BUFFER_SIZE) && (MQTT_Flush() != WIFI_STATUS_OK))
+    {
+      return WIFI_STATUS_ERROR;
+    }
+    memcpy(&TxBuffer[TxLen], header, n);
+    n = TxLen + n;
+    n += PutString(&TxBuffer[n], topic, tlen);
+    memcpy(&TxBuffer[n], payload, len);
+    TxLen = n + len;
+    return WIFI_STATUS_OK;
+  }
+
+  for (i = 0; i < MQTT_MAX_INFLIGHT; i++)
+  {
+    if (Inflight[i].PacketId == 0)
+    {
+      msg = &Inflight[i];
+      break;
+    }
+  }
+  if ((msg == NULL) || (total > MQTT_MAX_PACKET))
+  {
+    return WIFI_STATUS_ERROR;
+  }
+
+  msg->PacketId = NextPacketId++;
+  if (NextPacketId == 0)
+  {
+    NextPacketId = 1;
+  }
+  memcpy(msg->Packet, header, n);
+  n += PutString(&msg->Packet[n], topic, tlen);
+  msg->Packet[n++] = (uint8_t)(msg->PacketId >> 8);
+  msg->Packet[n++] = (uint8_t)msg->PacketId;
+  memcpy(&msg->Packet[n], payload, len);
+  msg->Len = total;
+
+  if (State == MQTT_STATE_CONNECTED)
+  {
+    QueueInflight(msg);
+  }
+  return WIFI_STATUS_OK;
+}
+
+/**
+  * @brief  Send everything queued so far in one ES_WIFI_SendData
+  * @param  None
+  * @retval Operation status, the connection is dropped on a failed send
+  */
+WIFI_Status_t MQTT_Flush(void)
+{
+  uint16_t sent = 0;
+
+  if (TxLen == 0)
+  {
+    return WIFI_STATUS_OK;
+  }
+  if (State == MQTT_STATE_DISCONNECTED)
+  {
+    TxLen = 0;
+    return WIFI_STATUS_ERROR;
+  }
+  if ((WIFI_SendData(MQTT_SOCKET, TxBuffer, TxLen, &sent, MQTT_SEND_TIMEOUT) != WIFI_STATUS_OK) ||
+      (sent != TxLen))
+  {
+    /* a partial packet leaves the stream unusable */
+    Close();
+    return WIFI_STATUS_ERROR;
+  }
+  TxLen    = 0;
+  LastSend = HAL_GetTick();
+  return WIFI_STATUS_OK;
+}
+
+/**
+  * @brief  Run the client: (re)connection, QoS 1 retries, keep-alive,
+  *         acknowledgements and sending what is queued. Call it regularly.
+  * @param  None
+  * @retval WIFI_STATUS_OK while connected
+  */
+WIFI_Status_t MQTT_Process(void)
+{
+  uint32_t now = HAL_GetTick();
+  uint8_t  ping[2] = { MQTT_PINGREQ, 0 };
+  uint8_t  i;
+
+  switch (State)
+  {
+    case MQTT_STATE_DISCONNECTED:
+      if ((now - StateTick) >= MQTT_RECONNECT_DELAY)
+      {
+        Connect();
+      }
+      break;
+
+    case MQTT_STATE_CONNECTING:
+      Poll();
+      if ((State == MQTT_STATE_CONNECTING) && ((now - StateTick) >= MQTT_ACK_TIMEOUT))
+      {
+        Close();
+      }
+      break;
+
+    case MQTT_STATE_CONNECTED:
+      for (i = 0; i < MQTT_MAX_INFLIGHT; i++)
+      {
+        if ((Inflight[i].PacketId != 0) && ((now - Inflight[i].SentAt) >= MQTT_ACK_TIMEOUT))
+        {
+          QueueInflight(&Inflight[i]);
+        }
+      }
+      if ((KeepAlive != 0) && !PingPending && ((now - LastSend) >= (KeepAlive * 1000UL) / 2))
+      {
+        if (Queue(ping, sizeof(ping)) == WIFI_STATUS_OK)
+        {
+          PingPending = 1;
+          PingSentAt  = now;
+        }
+      }
+      if (MQTT_Flush() != WIFI_STATUS_OK)
+      {
+        break;
+      }
+      if (PingPending || (MQTT_GetPending() != 0))
+      {
+        Poll();
+      }
+      if ((State == MQTT_STATE_CONNECTED) && PingPending && ((now - PingSentAt) >= MQTT_ACK_TIMEOUT))
+      {
+        Close();
+      }
+      break;
+
+    default:
+      break;
+  }
+  return (State == MQTT_STATE_CONNECTED) ? WIFI_STATUS_OK : WIFI_STATUS_ERROR;
+}
+
+/**
+  * @brief  Send DISCONNECT and close the socket
+  * @param  None
+  * @retval None
+  */
+void MQTT_Disconnect(void)
+{
+  uint8_t packet[2] = { MQTT_DISCONNECT, 0 };
+
+  if (State == MQTT_STATE_CONNECTED)
+  {
+    Queue(packet, sizeof(packet));
+    MQTT_Flush();
+  }
+  if (State != MQTT_STATE_DISCONNECTED)
+  {
+    Close();
+  }
+}
+
+/**
+  * @brief  Connection state
+  * @param  None
+  * @retval MQTT_State_t
+  */
+MQTT_State_t MQTT_GetState(void)
+{
+  return State;
+}
+
+/**
+  * @brief  Number of QoS 1 messages not acknowledged yet
+  * @param  None
+  * @retval Message count
+  */
+uint8_t MQTT_GetPending(void)
+{
+  uint8_t i, n = 0;
+
+  for (i = 0; i < MQTT_MAX_INFLIGHT; i++)
+  {
+    if (Inflight[i].PacketId != 0)
+    {
+      n++;
+    }
+  }
+  return n;
+}
@@ -0,0 +1,155 @@
+/**
+  ******************************************************************************
+  * @file    range_filter.c
+  * @brief   Fixed-point median + alpha-beta filter for ToF ranges.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "range_filter.h"
+
+/* Private define ------------------------------------------------------------*/
+#define RANGE_FILTER_ONE            256     /* 1.0 in 24.8 */
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  Median of the window
+  * @note   Sorts a copy, RANGE_FILTER_WINDOW is small and fixed so the cost is
+  *         the same for every sample.
+  * @param  filter : filter
+  * @retval Median range in mm
+  */
+static uint16_t Median(const RANGE_Filter_t *filter)
+{
+  uint16_t sorted[RANGE_FILTER_WINDOW];
+  uint16_t v;
+  uint8_t  i, j;
+
+  for (i = 0; i < RANGE_FILTER_WINDOW; i++)
+  {
+    v = filter->Window[i];
+    for (j = i; (j > 0) && (sorted[j - 1] > v); j--)
+    {
+      sorted[j] = sorted[j - 1];
+    }
+    sorted[j] = v;
+  }
+  return sorted[RANGE_FILTER_WINDOW / 2];
+}
+
+static int32_t Clamp(int32_t v, int32_t min, int32_t max)
+{
+  return (v < min) ? min : ((v > max) ? max : v);
+}
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  Reset a filter, the next sample starts it again
+  * @param  filter : filter
+  * @retval None
+  */
+void RANGE_FILTER_Init(RANGE_Filter_t *filter)
+{
+  uint8_t i;
+
+  for (i = 0; i < RANGE_FILTER_WINDOW; i++)
+  {
+    filter->Window[i] = RANGE_FILTER_FAR_MM;
+  }
+  filter->Next     = 0;
+  filter->Primed   = 0;
+  filter->LastTick = 0;
+  filter->Position = RANGE_FILTER_FAR_MM * RANGE_FILTER_ONE;
+  filter->Velocity = 0;
+  filter->Samples  = 0;
+  filter->Spikes   = 0;
+  filter->Steps    = 0;
+}
+
+/**
+  * @brief  Feed one sample
+  * @param  filter : filter
+  * @param  tick : HAL_GetTick when the sample was taken
+  * @param  mm : range
+  * @param  status : range status, 0 when the range is valid
+  * @retval Filtered range in mm
+  */
+uint16_t RANGE_FILTER_Update(RANGE_Filter_t *filter, uint32_t tick, uint16_t mm, uint8_t status)
+{
+  int32_t  dt, predicted, residual;
+  uint16_t median;
+  uint8_t  i;
+
+  if ((status != 0) || (mm > RANGE_FILTER_FAR_MM))
+  {
+    mm = RANGE_FILTER_FAR_MM;
+  }
+  filter->Samples++;
+
+  /* the first sample fills the window, there is nothing to track yet */
+  if (!filter->Primed)
+  {
+    for (i = 0; i < RANGE_FILTER_WINDOW; i++)
+    {
+      filter->Window[i] = mm;
+    }
+    filter->Next     = 0;
+    filter->Primed   = 1;
+    filter->LastTick = tick;
+    filter->Position = (int32_t)mm * RANGE_FILTER_ONE;
+    filter->Velocity = 0;
+    return mm;
+  }
+
+  filter->Window[filter->Next] = mm;
+  filter->Next = (filter->Next + 1) % RANGE_FILTER_WINDOW;
+  median = Median(filter);
+  if (((int32_t)mm - median > RANGE_FILTER_GATE_MM) || (median - (int32_t)mm > RANGE_FILTER_GATE_MM))
+  {
+    filter->Spikes++;
+  }
+
+  /* the bounds keep every product below in 32 bits */
+  dt = Clamp((int32_t)(tick - filter->LastTick), 1, RANGE_FILTER_MAX_DT_MS);
+  filter->LastTick = tick;
+
+  predicted = filter->Position + ((filter->Velocity * dt) / 1000);
+  residual  = ((int32_t)median * RANGE_FILTER_ONE) - predicted;
+
+  if ((residual > RANGE_FILTER_GATE_MM * RANGE_FILTER_ONE) ||
+      (residual < -RANGE_FILTER_GATE_MM * RANGE_FILTER_ONE))
+  {
+    filter->Position = (int32_t)median * RANGE_FILTER_ONE;
+    filter->Velocity = 0;
+    filter->Steps++;
+  }
+  else
+  {
+    filter->Position = predicted + ((RANGE_FILTER_ALPHA * residual) / RANGE_FILTER_ONE);
+    filter->Velocity += (((RANGE_FILTER_BETA * residual) / RANGE_FILTER_ONE) * 1000) / dt;
+    filter->Velocity  = Clamp(filter->Velocity, -RANGE_FILTER_MAX_SPEED * RANGE_FILTER_ONE,
+                              RANGE_FILTER_MAX_SPEED * RANGE_FILTER_ONE);
+  }
+
+  return RANGE_FILTER_GetDistance(filter);
+}
+
+/**
+  * @brief  Filtered range
+  * @param  filter : filter
+  * @retval Range in mm, RANGE_FILTER_FAR_MM before the first sample
+  */
+uint16_t RANGE_FILTER_GetDistance(const RANGE_Filter_t *filter)
+{
+  return (uint16_t)Clamp((filter->Position + (RANGE_FILTER_ONE / 2)) / RANGE_FILTER_ONE,
+                         0, RANGE_FILTER_FAR_MM);
+}
+
+/**
+  * @brief  Estimated velocity
+  * @param  filter : filter
+  * @retval mm/s, negative when the target closes in
+  */
+int32_t RANGE_FILTER_GetVelocity(const RANGE_Filter_t *filter)
+{
+  return filter->Velocity / RANGE_FILTER_ONE;
+}
@@ -0,0 +1,172 @@
+/**
+  ******************************************************************************
+  * @file    telemetry.c
+  * @brief   UDP telemetry: every sensor sample is kept and sent to a collector
+  *          in packed batches, one datagram per TELEMETRY_BATCH_MS. A batch
+  *          costs one ES_WIFI_SendDataTo (six AT commands) whatever the
+  *          sample rate, so the WiFi load stays bounded.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "telemetry.h"
+
+/* Private define ------------------------------------------------------------*/
+#define TELEMETRY_MAGIC_0           'T'
+#define TELEMETRY_MAGIC_1           'L'
+
+/* Private variables ---------------------------------------------------------*/
+static uint8_t  Datagram[TELEMETRY_DATAGRAM_SIZE];
+static uint8_t  CollectorIP[4];
+static uint16_t CollectorPort;
+static uint32_t Sequence;
+static uint32_t BatchStart;
+static uint8_t  SampleCount;
+static uint16_t Dropped;
+static uint8_t  Enabled;
+static int8_t   LinkRssi;
+
+/* Private functions ---------------------------------------------------------*/
+static void PutU16(uint8_t *p, uint16_t v)
+{
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+}
+
+static void PutU32(uint8_t *p, uint32_t v)
+{
+  PutU16(p, (uint16_t)v);
+  PutU16(p + 2, (uint16_t)(v >> 16));
+}
+
+/**
+  * @brief  Open the telemetry socket
+  * @param  collector_ip : collector IPv4 address
+  * @param  collector_port : collector UDP port
+  * @retval Operation status, samples are ignored until it succeeds
+  */
+WIFI_Status_t TELEMETRY_Init(uint8_t *collector_ip, uint16_t collector_port)
+{
+  memcpy(CollectorIP, collector_ip, sizeof(CollectorIP));
+  CollectorPort = collector_port;
+  Sequence      = 0;
+  SampleCount   = 0;
+  Dropped       = 0;
+
+  Enabled = (WIFI_OpenClientConnection(TELEMETRY_SOCKET, WIFI_UDP_PROTOCOL, "",
+                                       CollectorIP, CollectorPort, 0) == WIFI_STATUS_OK);
+  return Enabled ? WIFI_STATUS_OK : WIFI_STATUS_ERROR;
+}
+
+/**
+  * @brief  Add one sample to the current batch
+  * @param  sensor : index of the sensor that took it
+  * @param  tick : HAL_GetTick when the sample was taken
+  * @param  distance : range in mm
+  * @param  signal_rate : return signal rate, MCPS in 16.16 fixed point
+  * @param  temperature : temperature in degC
+  * @retval None
+  */
+void TELEMETRY_AddSample(uint8_t sensor, uint32_t tick, uint16_t distance, uint32_t signal_rate, float temperature)
+{
+  int32_t  centi;
+  uint8_t  *p;
+
+  if (!Enabled)
+  {
+    return;
+  }
+  if (SampleCount == 0)
+  {
+    BatchStart = tick;
+  }
+
+  /* batch full, or its 16-bit time offset would wrap: counted as dropped */
+  if ((SampleCount == TELEMETRY_MAX_SAMPLES) || ((tick - BatchStart) > 0xFFFF))
+  {
+    if (Dropped < 0xFFFF)
+    {
+      Dropped++;
+    }
+    return;
+  }
+
+  signal_rate >>= 8;
+  if (signal_rate > 0xFFFF)
+  {
+    signal_rate = 0xFFFF;
+  }
+  centi = (int32_t)(temperature * 100.0f + ((temperature < 0) ? -0.5f : 0.5f));
+  if (centi > INT16_MAX)
+  {
+    centi = INT16_MAX;
+  }
+  else if (centi < INT16_MIN)
+  {
+    centi = INT16_MIN;
+  }
+
+  p = &Datagram[TELEMETRY_HEADER_SIZE + (SampleCount * TELEMETRY_SAMPLE_SIZE)];
+  PutU16(p,     (uint16_t)(tick - BatchStart));
+  PutU16(p + 2, distance);
+  PutU16(p + 4, (uint16_t)signal_rate);
+  PutU16(p + 6, (uint16_t)(int16_t)centi);
+  p[8] = sensor;
+  p[9] = 0;
+  SampleCount++;
+}
+
+/**
+  * @brief  Set the link RSSI sent with the next datagrams, so that late or
+  *         lost ones can be put next to the radio conditions
+  * @param  rssi : signal strength in dBm, 0 when unknown
+  * @retval None
+  */
+void TELEMETRY_SetLinkQuality(int16_t rssi)
+{
+  LinkRssi = (rssi < INT8_MIN) ? INT8_MIN : (int8_t)rssi;
+}
+
+/**
+  * @brief  Send the current batch once the batch interval is over or it is full
+  * @param  None
+  * @retval Operation status of the send, WIFI_STATUS_OK when nothing was due
+  */
+WIFI_Status_t TELEMETRY_Process(void)
+{
+  WIFI_Status_t ret;
+  uint16_t len;
+  uint16_t sent = 0;
+
+  if (!Enabled || (SampleCount == 0))
+  {
+    return WIFI_STATUS_OK;
+  }
+  if ((SampleCount < TELEMETRY_MAX_SAMPLES) && ((HAL_GetTick() - BatchStart) < TELEMETRY_BATCH_MS))
+  {
+    return WIFI_STATUS_OK;
+  }
+
+  Datagram[0] = TELEMETRY_MAGIC_0;
+  Datagram[1] = TELEMETRY_MAGIC_1;
+  Datagram[2] = TELEMETRY_VERSION;
+  Datagram[3] = SampleCount;
+  PutU32(&Datagram[4], Sequence);
+  PutU32(&Datagram[8], BatchStart);
+  PutU16(&Datagram[12], Dropped);
+  Datagram[14] = (uint8_t)LinkRssi;
+  Datagram[15] = 0;
+  len = TELEMETRY_HEADER_SIZE + (SampleCount * TELEMETRY_SAMPLE_SIZE);
+
+  ret = WIFI_SendDataTo(TELEMETRY_SOCKET, Datagram, len, &sent, TELEMETRY_SEND_TIMEOUT,
+                        CollectorIP, CollectorPort);
+  if ((ret == WIFI_STATUS_OK) && (sent != len))
+  {
+    ret = WIFI_STATUS_ERROR;
+  }
+
+  /* the sequence number moves on either way, so the collector sees the loss */
+  Sequence++;
+  SampleCount = 0;
+  Dropped     = 0;
+  return ret;
+}
@@ -0,0 +1,170 @@
+/**
+  ******************************************************************************
+  * @file    tof_calib.c
+  * @brief   VL53L0X reference calibration kept in the last flash page.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "tof_calib.h"
+#include <stddef.h>
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+#define TOF_CALIB_MAGIC             0x43464F54  /* "TOFC" */
+#define TOF_CALIB_VERSION           1
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  uint32_t    Magic;
+  uint16_t    Version;
+  uint16_t    Size;                 /* of this structure, catches a layout change */
+  TOF_Calib_t Sensor[TOF_CALIB_SENSORS];
+  uint32_t    Crc;                  /* over everything above */
+} TOF_CalibPage_t;
+
+/* flash is programmed 64 bits at a time */
+typedef union
+{
+  TOF_CalibPage_t Page;
+  uint64_t        Words[(sizeof(TOF_CalibPage_t) + 7) / 8];
+} TOF_CalibImage_t;
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  CRC-32 (IEEE, reflected) of a block
+  * @param  data : block
+  * @param  len : length in bytes
+  * @retval CRC
+  */
+static uint32_t Crc32(const uint8_t *data, uint32_t len)
+{
+  uint32_t crc = 0xFFFFFFFF;
+  uint8_t  bit;
+
+  while (len--)
+  {
+    crc ^= *data++;
+    for (bit = 0; bit < 8; bit++)
+    {
+      crc = (crc >> 1) ^ (0xEDB88320 & (0u - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
+
+/**
+  * @brief  Check the page in flash
+  * @param  None
+  * @retval The page, NULL when it was never written or does not match
+  */
+static const TOF_CalibPage_t *ValidPage(void)
+{
+  const TOF_CalibPage_t *page = (const TOF_CalibPage_t *)TOF_CALIB_ADDRESS;
+
+  if ((page->Magic != TOF_CALIB_MAGIC) || (page->Version != TOF_CALIB_VERSION) ||
+      (page->Size != sizeof(TOF_CalibPage_t)) ||
+      (page->Crc != Crc32((const uint8_t *)page, offsetof(TOF_CalibPage_t, Crc))))
+  {
+    return NULL;
+  }
+  return page;
+}
+
+/**
+  * @brief  Erase the calibration page
+  * @note   Flash must be unlocked.
+  * @param  None
+  * @retval HAL status
+  */
+static HAL_StatusTypeDef ErasePage(void)
+{
+  FLASH_EraseInitTypeDef erase;
+  uint32_t offset = TOF_CALIB_ADDRESS - FLASH_BASE;
+  uint32_t error;
+
+  /* no bank swap in this firmware, bank 2 is the upper half */
+  erase.TypeErase = FLASH_TYPEERASE_PAGES;
+  erase.Banks     = (offset >= FLASH_BANK_SIZE) ? FLASH_BANK_2 : FLASH_BANK_1;
+  erase.Page      = (offset % FLASH_BANK_SIZE) / FLASH_PAGE_SIZE;
+  erase.NbPages   = 1;
+
+  __HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_ALL_ERRORS);
+  return HAL_FLASHEx_Erase(&erase, &error);
+}
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  Get the stored calibration of a sensor
+  * @param  sensor : sensor index, below TOF_CALIB_SENSORS
+  * @param  calib : (OUT) calibration
+  * @retval HAL_OK when one was stored, HAL_ERROR when the sensor has to be
+  *         calibrated
+  */
+HAL_StatusTypeDef TOF_CALIB_Load(uint8_t sensor, TOF_Calib_t *calib)
+{
+  const TOF_CalibPage_t *page = ValidPage();
+
+  if ((sensor >= TOF_CALIB_SENSORS) || (page == NULL) || (page->Sensor[sensor].Valid != 1))
+  {
+    return HAL_ERROR;
+  }
+  *calib = page->Sensor[sensor];
+  return HAL_OK;
+}
+
+/**
+  * @brief  Store the calibration of a sensor, the other records are kept
+  * @param  sensor : sensor index, below TOF_CALIB_SENSORS
+  * @param  calib : calibration
+  * @retval HAL status
+  */
+HAL_StatusTypeDef TOF_CALIB_Save(uint8_t sensor, const TOF_Calib_t *calib)
+{
+  const TOF_CalibPage_t *page = ValidPage();
+  TOF_CalibImage_t image;
+  HAL_StatusTypeDef status;
+  uint32_t i;
+
+  if (sensor >= TOF_CALIB_SENSORS)
+  {
+    return HAL_ERROR;
+  }
+
+  memset(&image, 0, sizeof(image));
+  if (page != NULL)
+  {
+    image.Page = *page;
+  }
+  image.Page.Magic          = TOF_CALIB_MAGIC;
+  image.Page.Version        = TOF_CALIB_VERSION;
+  image.Page.Size           = sizeof(TOF_CalibPage_t);
+  image.Page.Sensor[sensor] = *calib;
+  image.Page.Sensor[sensor].Valid = 1;
+  image.Page.Crc = Crc32((const uint8_t *)&image.Page, offsetof(TOF_CalibPage_t, Crc));
+
+  HAL_FLASH_Unlock();
+  status = ErasePage();
+  for (i = 0; (status == HAL_OK) && (i < sizeof(image.Words) / sizeof(image.Words[0])); i++)
+  {
+    status = HAL_FLASH_Program(FLASH_TYPEPROGRAM_DOUBLEWORD, TOF_CALIB_ADDRESS + (i * 8), image.Words[i]);
+  }
+  HAL_FLASH_Lock();
+  return status;
+}
+
+/**
+  * @brief  Forget every stored calibration, the sensors are calibrated again
+  *         at the next boot
+  * @param  None
+  * @retval HAL status
+  */
+HAL_StatusTypeDef TOF_CALIB_Erase(void)
+{
+  HAL_StatusTypeDef status;
+
+  HAL_FLASH_Unlock();
+  status = ErasePage();
+  HAL_FLASH_Lock();
+  return status;
+}
@@ -2324,6 +2324,48 @@ VL53L0X_Error VL53L0X_WaitDeviceReadyForNewMeasurement(VL53L0X_DEV Dev,
 
 VL53L0X_Error VL53L0X_GetRangingMeasurementData(VL53L0X_DEV Dev,
 	VL53L0X_RangingMeasurementData_t *pRangingMeasurementData)
+{
+	VL53L0X_Error Status = VL53L0X_ERROR_NONE;
+	uint16_t tmpWord = 0;
+	uint8_t localBuffer[12];
+
+	LOG_FUNCTION_START("");
+
+	/*
+	 * use multi read even if some registers are not useful, result will
+	 * be more efficient
+	 * start reading at 0x14 dec20
+	 * end reading at 0x21 dec33 total 14 bytes to read
+	 */
+	Status = VL53L0X_ReadMulti(Dev, 0x14, localBuffer, 12);
+
+	/* LastSignalRefMcps */
+	if (Status == VL53L0X_ERROR_NONE)
+		Status = VL53L0X_WrByte(Dev, 0xFF, 0x01);
+
+	if (Status == VL53L0X_ERROR_NONE)
+		Status = VL53L0X_RdWord(Dev,
+			VL53L0X_REG_RESULT_PEAK_SIGNAL_RATE_REF,
+			&tmpWord);
+
+	if (Status == VL53L0X_ERROR_NONE)
+		Status = VL53L0X_WrByte(Dev, 0xFF, 0x00);
+
+	if (Status == VL53L0X_ERROR_NONE) {
+		PALDevDataSet(Dev, LastSignalRefMcps,
+			VL53L0X_FIXPOINT97TOFIXPOINT1616(tmpWord));
+
+		Status = VL53L0X_DecodeRangingMeasurementData(Dev, localBuffer,
+			pRangingMeasurementData);
+	}
+
+	LOG_FUNCTION_END(Status);
+	return Status;
+}
+
+VL53L0X_Error VL53L0X_DecodeRangingMeasurementData(VL53L0X_DEV Dev,
+	uint8_t *pResultBuffer,
+	VL53L0X_RangingMeasurementData_t *pRangingMeasurementData)
 {
 	VL53L0X_Error Status = VL53L0X_ERROR_NONE;
 	uint8_t DeviceRangeStatus;
@@ -2337,19 +2379,11 @@ VL53L0X_Error VL53L0X_GetRangingMeasurementData(VL53L0X_DEV Dev,
 	uint16_t tmpuint16;
 	uint16_t XtalkRangeMilliMeter;
 	uint16_t LinearityCorrectiveGain;
-	uint8_t localBuffer[12];
+	uint8_t *localBuffer = pResultBuffer;
 	VL53L0X_RangingMeasurementData_t LastRangeDataBuffer;
 
 	LOG_FUNCTION_START("");
 
-	/*
-	 * use multi read even if some registers are not useful, result will
-	 * be more efficient
-	 * start reading at 0x14 dec20
-	 * end reading at 0x21 dec33 total 14 bytes to read
-	 */
-	Status = VL53L0X_ReadMulti(Dev, 0x14, localBuffer, 12);
-
 	if (Status == VL53L0X_ERROR_NONE) {
 
 		pRangingMeasurementData->ZoneId = 0; /* Only one zone */
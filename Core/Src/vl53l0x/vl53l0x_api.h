@@ -1488,6 +1488,28 @@ VL53L0X_API VL53L0X_Error VL53L0X_GetMeasurementRefSignal(VL53L0X_DEV Dev,
 VL53L0X_API VL53L0X_Error VL53L0X_GetRangingMeasurementData(VL53L0X_DEV Dev,
 	VL53L0X_RangingMeasurementData_t *pRangingMeasurementData);
 
+/**
+ * @brief Decode a ranging result read from the device
+ *
+ * @par Function Description
+ * Second half of @a VL53L0X_GetRangingMeasurementData(), for a host that
+ * reads the result registers itself, for example with an interrupt driven
+ * transfer. The Reference Signal of the previous
+ * @a VL53L0X_GetRangingMeasurementData() is used, so the Signal Ref Clip
+ * check should be disabled.
+ *
+ * @note This function doesn't Access to the device
+ *
+ * @param   Dev                      Device Handle
+ * @param   pResultBuffer            The 12 bytes read from register 0x14.
+ * @param   pRangingMeasurementData  Pointer to the data structure to fill up.
+ * @return  VL53L0X_ERROR_NONE        Success
+ * @return  "Other error code"       See ::VL53L0X_Error
+ */
+VL53L0X_API VL53L0X_Error VL53L0X_DecodeRangingMeasurementData(VL53L0X_DEV Dev,
+	uint8_t *pResultBuffer,
+	VL53L0X_RangingMeasurementData_t *pRangingMeasurementData);
+
 /**
  * @brief Retrieve the measurements from device for a given setup
  *
@@ -2031,7 +2031,6 @@ VL53L0X_Error VL53L0X_get_pal_range_status(VL53L0X_DEV Dev,
 	FixPoint1616_t RangeIgnoreThresholdValue;
 	FixPoint1616_t SignalRatePerSpad;
 	uint8_t DeviceRangeStatusInternal = 0;
-	uint16_t tmpWord = 0;
 	uint8_t Temp8;
 	uint32_t Dmax_mm = 0;
 	FixPoint1616_t LastSignalRefMcps;
@@ -2062,21 +2061,8 @@ VL53L0X_Error VL53L0X_get_pal_range_status(VL53L0X_DEV Dev,
 		NoneFlag = 0;
 	}
 
-	/* LastSignalRefMcps */
-	if (Status == VL53L0X_ERROR_NONE)
-		Status = VL53L0X_WrByte(Dev, 0xFF, 0x01);
-
-	if (Status == VL53L0X_ERROR_NONE)
-		Status = VL53L0X_RdWord(Dev,
-			VL53L0X_REG_RESULT_PEAK_SIGNAL_RATE_REF,
-			&tmpWord);
-
-	LastSignalRefMcps = VL53L0X_FIXPOINT97TOFIXPOINT1616(tmpWord);
-
-	if (Status == VL53L0X_ERROR_NONE)
-		Status = VL53L0X_WrByte(Dev, 0xFF, 0x00);
-
-	PALDevDataSet(Dev, LastSignalRefMcps, LastSignalRefMcps);
+	/* LastSignalRefMcps, read by the caller with the range result */
+	LastSignalRefMcps = PALDevDataGet(Dev, LastSignalRefMcps);
 
 	/*
 	 * Check if Sigma limit is enabled, if yes then do comparison with limit
@@ -30,11 +30,192 @@
 #define I2C_TIME_OUT_BASE   10
 #define I2C_TIME_OUT_BYTE   1
 
-#define VL53L0X_OsDelay(...) HAL_Delay(2)
+/* VL53L0X_PollingDelay: the API polls up to VL53L0X_DEFAULT_MAX_LOOP times, a
+   step of 1/32 of the timing budget still lets a poll wait 6 budgets */
+#define POLLING_STEPS       32
+#define POLLING_MIN_US      100
+#define POLLING_MAX_US      2000    /* what HAL_Delay(2) gave */
+#define POLLING_EDGE_STEPS  4       /* longest wait for the GPIO1 edge */
+
+#define SHADOW_PAGE_REG     0xFF
+#define SHADOW_PAGE_UNKNOWN 0xFF    /* a page select failed */
     
 /* Private macro -------------------------------------------------------------*/
+#if (VL53L0X_SHADOW == 0)
+#define ShadowGet(Dev, index, pdata, count)             0
+#define ShadowPut(Dev, index, pdata, count)             (void)0
+#define ShadowWrite(Dev, index, pdata, count, status)   (void)0
+#endif
+
 /* Private variables ---------------------------------------------------------*/
+static VL53L0X_DEV volatile     AsyncDev;     /* device of the transfer in progress */
+static VL53L0X_AsyncCallback_t  AsyncDone;
+static uint8_t                  AsyncData;    /* byte being written */
+
+#if VL53L0X_SHADOW
+/* Page 0 registers that only change when the host writes them, so a read
+   gives back the last write. Results, interrupt status, SYSRANGE_START and
+   anything on another page change under the host and are never shadowed;
+   neither are the VHV/phase results the calibrations leave behind. */
+static const uint8_t ShadowRegs[] = {
+    VL53L0X_REG_SYSTEM_SEQUENCE_CONFIG,
+    VL53L0X_REG_SYSTEM_RANGE_CONFIG,
+    VL53L0X_REG_SYSTEM_INTERRUPT_CONFIG_GPIO,
+    VL53L0X_REG_SYSTEM_THRESH_HIGH, VL53L0X_REG_SYSTEM_THRESH_HIGH + 1,
+    VL53L0X_REG_SYSTEM_THRESH_LOW, VL53L0X_REG_SYSTEM_THRESH_LOW + 1,
+    VL53L0X_REG_FINAL_RANGE_CONFIG_MIN_COUNT_RATE_RTN_LIMIT,
+    VL53L0X_REG_FINAL_RANGE_CONFIG_MIN_COUNT_RATE_RTN_LIMIT + 1,
+    VL53L0X_REG_MSRC_CONFIG_TIMEOUT_MACROP,
+    VL53L0X_REG_PRE_RANGE_CONFIG_VCSEL_PERIOD,
+    VL53L0X_REG_PRE_RANGE_CONFIG_TIMEOUT_MACROP_HI,
+    VL53L0X_REG_PRE_RANGE_CONFIG_TIMEOUT_MACROP_LO,
+    VL53L0X_REG_MSRC_CONFIG_CONTROL,
+    VL53L0X_REG_FINAL_RANGE_CONFIG_VCSEL_PERIOD,
+    VL53L0X_REG_FINAL_RANGE_CONFIG_TIMEOUT_MACROP_HI,
+    VL53L0X_REG_FINAL_RANGE_CONFIG_TIMEOUT_MACROP_LO,
+    VL53L0X_REG_GPIO_HV_MUX_ACTIVE_HIGH,
+    VL53L0X_REG_OSC_CALIBRATE_VAL, VL53L0X_REG_OSC_CALIBRATE_VAL + 1,   /* factory value */
+};
+
+/* one slot of VL53L0X_Dev_t::ShadowData per register */
+typedef char ShadowRegsCheck[(sizeof(ShadowRegs) == VL53L0X_SHADOW_REGS) ? 1 : -1];
+#endif
+
 /* Private function prototypes -----------------------------------------------*/
+/* Private functions ---------------------------------------------------------*/
+#if VL53L0X_SHADOW
+/**
+  * @brief  Shadow slot of a register
+  * @param  reg : register index
+  * @retval Slot, -1 when the register is not shadowed
+  */
+static int ShadowSlot(uint8_t reg)
+{
+    int slot;
+
+    for (slot = 0; slot < VL53L0X_SHADOW_REGS; slot++) {
+        if (ShadowRegs[slot] == reg) {
+            return slot;
+        }
+    }
+    return -1;
+}
+
+/**
+  * @brief  Read registers from the shadow
+  * @param  Dev : device
+  * @param  index : first register
+  * @param  pdata : (OUT) register values
+  * @param  count : number of registers
+  * @retval 1 when they all were in it, 0 when the device has to be read
+  */
+static uint8_t ShadowGet(VL53L0X_DEV Dev, uint8_t index, uint8_t *pdata, uint32_t count)
+{
+    uint32_t i;
+    int slot;
+
+    if (Dev->ShadowPage != 0) {
+        return 0;
+    }
+    for (i = 0; i < count; i++) {
+        slot = ShadowSlot((uint8_t)(index + i));
+        if ((slot < 0) || !(Dev->ShadowValid & (1UL << slot))) {
+            return 0;
+        }
+    }
+    for (i = 0; i < count; i++) {
+        pdata[i] = Dev->ShadowData[ShadowSlot((uint8_t)(index + i))];
+    }
+    Dev->ShadowHits++;
+    return 1;
+}
+
+/**
+  * @brief  Keep registers just read from the device
+  * @param  Dev : device
+  * @param  index : first register
+  * @param  pdata : register values
+  * @param  count : number of registers
+  * @retval None
+  */
+static void ShadowPut(VL53L0X_DEV Dev, uint8_t index, const uint8_t *pdata, uint32_t count)
+{
+    uint32_t i;
+    int slot;
+
+    if (Dev->ShadowPage != 0) {
+        return;
+    }
+    for (i = 0; i < count; i++) {
+        slot = ShadowSlot((uint8_t)(index + i));
+        if (slot >= 0) {
+            Dev->ShadowData[slot] = pdata[i];
+            Dev->ShadowValid |= 1UL << slot;
+        }
+    }
+}
+
+/**
+  * @brief  Follow a register write: shadowed registers take the new value,
+  *         page selects and soft resets are tracked
+  * @param  Dev : device
+  * @param  index : first register
+  * @param  pdata : values written
+  * @param  count : number of registers
+  * @param  status : outcome of the write, on an error the registers are
+  *         forgotten (the device may or may not have them)
+  * @retval None
+  */
+static void ShadowWrite(VL53L0X_DEV Dev, uint8_t index, const uint8_t *pdata, uint32_t count, VL53L0X_Error status)
+{
+    uint32_t i;
+    uint8_t reg;
+    int slot;
+
+    for (i = 0; i < count; i++) {
+        reg = (uint8_t)(index + i);
+        if (reg == SHADOW_PAGE_REG) {
+            if (status == VL53L0X_ERROR_NONE) {
+                Dev->ShadowPage = pdata[i];
+            } else {
+                Dev->ShadowPage = SHADOW_PAGE_UNKNOWN;
+                Dev->ShadowValid = 0;
+            }
+        } else if (Dev->ShadowPage != 0) {
+            continue;
+        } else if (reg == VL53L0X_REG_SOFT_RESET_GO2_SOFT_RESET_N) {
+            /* the registers go back to their defaults */
+            Dev->ShadowValid = 0;
+        } else if ((slot = ShadowSlot(reg)) >= 0) {
+            if (status == VL53L0X_ERROR_NONE) {
+                Dev->ShadowData[slot] = pdata[i];
+                Dev->ShadowValid |= 1UL << slot;
+            } else {
+                Dev->ShadowValid &= ~(1UL << slot);
+            }
+        }
+    }
+}
+#endif
+
+/**
+  * @brief  End of an interrupt driven transfer, hand it to its callback
+  * @param  hi2c : bus that completed
+  * @param  status : transfer status
+  * @retval None
+  */
+static void AsyncComplete(I2C_HandleTypeDef *hi2c, VL53L0X_Error status)
+{
+    VL53L0X_DEV dev = AsyncDev;
+
+    if ((dev == NULL) || (dev->I2cHandle != hi2c)) {
+        return;
+    }
+    /* free before the callback, it may start the next transfer */
+    AsyncDev = NULL;
+    AsyncDone(dev, status);
+}
+
 /* Exported functions --------------------------------------------------------*/
     
 int _I2CWrite(VL53L0X_DEV Dev, uint8_t *pdata, uint32_t count) {
@@ -59,6 +240,10 @@ VL53L0X_Error VL53L0X_RdByte(VL53L0X_DEV Dev, uint8_t index, uint8_t *data) {
     VL53L0X_Error Status = VL53L0X_ERROR_NONE;
     int32_t status_int;
 
+    if (ShadowGet(Dev, index, data, 1)) {
+        goto done;
+    }
+
     status_int = _I2CWrite(Dev, &index, 1);
     
     if( status_int ){
@@ -70,6 +255,8 @@ VL53L0X_Error VL53L0X_RdByte(VL53L0X_DEV Dev, uint8_t index, uint8_t *data) {
     
     if (status_int != 0) {
         Status = VL53L0X_ERROR_CONTROL_INTERFACE;
+    } else {
+        ShadowPut(Dev, index, data, 1);
     }
 done:
     return Status;
@@ -95,6 +282,7 @@ VL53L0X_Error VL53L0X_WriteMulti(VL53L0X_DEV Dev, uint8_t index, uint8_t *pdata,
     if (status_int != 0) {
         Status = VL53L0X_ERROR_CONTROL_INTERFACE;
     }
+    ShadowWrite(Dev, index, pdata, count, Status);
     
     return Status;
 }
@@ -104,6 +292,10 @@ VL53L0X_Error VL53L0X_ReadMulti(VL53L0X_DEV Dev, uint8_t index, uint8_t *pdata,
     VL53L0X_Error Status = VL53L0X_ERROR_NONE;
     int32_t status_int;
     
+    if (ShadowGet(Dev, index, pdata, count)) {
+        goto done;
+    }
+
     status_int = _I2CWrite(Dev, &index, 1);
     
     if (status_int != 0) {
@@ -115,6 +307,8 @@ VL53L0X_Error VL53L0X_ReadMulti(VL53L0X_DEV Dev, uint8_t index, uint8_t *pdata,
     
     if (status_int != 0) {
         Status = VL53L0X_ERROR_CONTROL_INTERFACE;
+    } else {
+        ShadowPut(Dev, index, pdata, count);
     }
 done:
     return Status;
@@ -125,6 +319,10 @@ VL53L0X_Error VL53L0X_RdWord(VL53L0X_DEV Dev, uint8_t index, uint16_t *data) {
     VL53L0X_Error Status = VL53L0X_ERROR_NONE;
     int32_t status_int;
 
+    if (ShadowGet(Dev, index, _I2CBuffer, 2)) {
+        goto decode;
+    }
+
     status_int = _I2CWrite(Dev, &index, 1);
 
     if( status_int ){
@@ -138,7 +336,9 @@ VL53L0X_Error VL53L0X_RdWord(VL53L0X_DEV Dev, uint8_t index, uint16_t *data) {
         Status = VL53L0X_ERROR_CONTROL_INTERFACE;
         goto done;
     }
+    ShadowPut(Dev, index, _I2CBuffer, 2);
 
+decode:
     *data = ((uint16_t)_I2CBuffer[0]<<8) + (uint16_t)_I2CBuffer[1];
 done:
     return Status;
@@ -148,6 +348,10 @@ VL53L0X_Error VL53L0X_RdDWord(VL53L0X_DEV Dev, uint8_t index, uint32_t *data) {
     VL53L0X_Error Status = VL53L0X_ERROR_NONE;
     int32_t status_int;
 
+    if (ShadowGet(Dev, index, _I2CBuffer, 4)) {
+        goto decode;
+    }
+
     status_int = _I2CWrite(Dev, &index, 1);
     
     if (status_int != 0) {
@@ -161,7 +365,9 @@ VL53L0X_Error VL53L0X_RdDWord(VL53L0X_DEV Dev, uint8_t index, uint32_t *data) {
         Status = VL53L0X_ERROR_CONTROL_INTERFACE;
         goto done;
     }
+    ShadowPut(Dev, index, _I2CBuffer, 4);
 
+decode:
     *data = ((uint32_t)_I2CBuffer[0]<<24) + ((uint32_t)_I2CBuffer[1]<<16) + ((uint32_t)_I2CBuffer[2]<<8) + (uint32_t)_I2CBuffer[3];
 
 done:
@@ -180,6 +386,7 @@ VL53L0X_Error VL53L0X_WrByte(VL53L0X_DEV Dev, uint8_t index, uint8_t data) {
     if (status_int != 0) {
         Status = VL53L0X_ERROR_CONTROL_INTERFACE;
     }
+    ShadowWrite(Dev, index, &_I2CBuffer[1], 1, Status);
     
     return Status;
 }
@@ -197,6 +404,7 @@ VL53L0X_Error VL53L0X_WrWord(VL53L0X_DEV Dev, uint8_t index, uint16_t data) {
     if (status_int != 0) {
         Status = VL53L0X_ERROR_CONTROL_INTERFACE;
     }
+    ShadowWrite(Dev, index, &_I2CBuffer[1], 2, Status);
     
     return Status;
 }
@@ -230,15 +438,120 @@ VL53L0X_Error VL53L0X_WrDWord(VL53L0X_DEV Dev, uint8_t index, uint32_t data) {
     if (status_int != 0) {
         Status = VL53L0X_ERROR_CONTROL_INTERFACE;
     }
+    ShadowWrite(Dev, index, &_I2CBuffer[1], 4, Status);
 
     return Status;
 }
 
+void VL53L0X_ShadowReset(VL53L0X_DEV Dev) {
+#if VL53L0X_SHADOW
+    Dev->ShadowValid = 0;
+    Dev->ShadowPage = 0;
+#else
+    (void)Dev;
+#endif
+}
+
+VL53L0X_Error VL53L0X_ReadMulti_IT(VL53L0X_DEV Dev, uint8_t index, uint8_t *pdata, uint32_t count, VL53L0X_AsyncCallback_t done) {
+    if (AsyncDev != NULL) {
+        return VL53L0X_ERROR_CONTROL_INTERFACE;
+    }
+
+    AsyncDev = Dev;
+    AsyncDone = done;
+    /* the register index goes out with a timeout, the data on the interrupt */
+    if (HAL_I2C_Mem_Read_IT(Dev->I2cHandle, Dev->I2cDevAddr, index, I2C_MEMADD_SIZE_8BIT, pdata, count) != HAL_OK) {
+        AsyncDev = NULL;
+        return VL53L0X_ERROR_CONTROL_INTERFACE;
+    }
+    return VL53L0X_ERROR_NONE;
+}
+
+VL53L0X_Error VL53L0X_WrByte_IT(VL53L0X_DEV Dev, uint8_t index, uint8_t data, VL53L0X_AsyncCallback_t done) {
+    if (AsyncDev != NULL) {
+        return VL53L0X_ERROR_CONTROL_INTERFACE;
+    }
+
+    AsyncDev = Dev;
+    AsyncDone = done;
+    AsyncData = data;
+    /* the outcome is only known in the callback, forget the register */
+    ShadowWrite(Dev, index, &AsyncData, 1, VL53L0X_ERROR_CONTROL_INTERFACE);
+    if (HAL_I2C_Mem_Write_IT(Dev->I2cHandle, Dev->I2cDevAddr, index, I2C_MEMADD_SIZE_8BIT, &AsyncData, 1) != HAL_OK) {
+        AsyncDev = NULL;
+        return VL53L0X_ERROR_CONTROL_INTERFACE;
+    }
+    return VL53L0X_ERROR_NONE;
+}
+
+uint8_t VL53L0X_AsyncBusy(void) {
+    return AsyncDev != NULL;
+}
+
+/**
+  * @brief  Memory read completed, HAL I2C interrupt callback
+  * @param  hi2c : I2C handle
+  * @retval None
+  */
+void HAL_I2C_MemRxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+    AsyncComplete(hi2c, VL53L0X_ERROR_NONE);
+}
+
+/**
+  * @brief  Memory write completed, HAL I2C interrupt callback
+  * @param  hi2c : I2C handle
+  * @retval None
+  */
+void HAL_I2C_MemTxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+    AsyncComplete(hi2c, VL53L0X_ERROR_NONE);
+}
+
+/**
+  * @brief  Transfer failed (NACK, bus error...), HAL I2C interrupt callback
+  * @param  hi2c : I2C handle
+  * @retval None
+  */
+void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c)
+{
+    AsyncComplete(hi2c, VL53L0X_ERROR_CONTROL_INTERFACE);
+}
+
 VL53L0X_Error VL53L0X_PollingDelay(VL53L0X_DEV Dev) {
     VL53L0X_Error status = VL53L0X_ERROR_NONE;
+    uint32_t step_us = PALDevDataGet(Dev, CurrentParameters.MeasurementTimingBudgetMicroSeconds) / POLLING_STEPS;
+    uint32_t cycles;
+    uint32_t start;
+    uint8_t edge;
+
+    if (step_us < POLLING_MIN_US) {
+        step_us = POLLING_MIN_US;
+    } else if (step_us > POLLING_MAX_US) {
+        step_us = POLLING_MAX_US;
+    }
+
+    /* GPIO1 only tells about new samples with that function, and its EXTI
+       line only latches the edge while unmasked */
+    edge = (Dev->Gpio1Port != NULL) && READ_BIT(EXTI->IMR1, Dev->Gpio1Pin) &&
+           (PALDevDataGet(Dev, DeviceSpecificParameters.Pin0GpioFunctionality) == VL53L0X_GPIOFUNCTIONALITY_NEW_MEASURE_READY);
+    if (edge) {
+        step_us *= POLLING_EDGE_STEPS;
+    }
 
-    // do nothing
-    VL53L0X_OsDelay();
+    if ((DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk) == 0) {
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    }
+    cycles = step_us * (SystemCoreClock / 1000000UL);
+    start = DWT->CYCCNT;
+    while ((DWT->CYCCNT - start) < cycles) {
+        if (edge && __HAL_GPIO_EXTI_GET_IT(Dev->Gpio1Pin)) {
+            /* the caller polls the device right away */
+            __HAL_GPIO_EXTI_CLEAR_IT(Dev->Gpio1Pin);
+            break;
+        }
+    }
     return status;
 }
 
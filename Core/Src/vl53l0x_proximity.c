@@ -0,0 +1,1145 @@
+/**
+  ******************************************************************************
+  * @file    vl53l0x_proximity.c
+  * @brief   VL53L0X time-of-flight sensors in continuous ranging, samples read
+  *          on the GPIO1 new-sample-ready interrupts and the I2C interrupts
+  *          they start.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "vl53l0x_proximity.h"
+#include "tof_calib.h"
+
+/* Private define ------------------------------------------------------------*/
+#if (PROXIMITY_INTER_MEASUREMENT_MS > 0)
+#define PROXIMITY_DEVICE_MODE   VL53L0X_DEVICEMODE_CONTINUOUS_TIMED_RANGING
+#else
+#define PROXIMITY_DEVICE_MODE   VL53L0X_DEVICEMODE_CONTINUOUS_RANGING
+#endif
+
+#define PROXIMITY_RESULT_REG    0x14    /* range status to range, what the API reads */
+#define PROXIMITY_RESULT_SIZE   12
+
+#if (PROXIMITY_SENSORS > PROXIMITY_MAX_SENSORS) || (PROXIMITY_SENSORS > TOF_CALIB_SENSORS)
+#error "PROXIMITY_SENSORS: more sensors than pins in SensorPins or calibration records"
+#endif
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  const char     *Name;
+  uint32_t       TimingBudgetUs;
+  uint8_t        PreRangeVcselPeriod;   /* PCLKs */
+  uint8_t        FinalRangeVcselPeriod;
+  FixPoint1616_t SignalLimit;           /* MCps */
+  FixPoint1616_t SigmaLimit;            /* mm */
+} PROXIMITY_ProfileSettings_t;
+
+typedef struct
+{
+  GPIO_TypeDef *XshutPort;
+  uint16_t     XshutPin;
+  GPIO_TypeDef *Gpio1Port;              /* rising edge interrupt */
+  uint16_t     Gpio1Pin;
+  IRQn_Type    Gpio1IRQn;
+  uint8_t      SharedIRQ;               /* vector of other devices too, left as it is */
+} PROXIMITY_SensorPins_t;
+
+typedef struct
+{
+  VL53L0X_Dev_t     Dev;                /* first, the I2C callbacks only get its address */
+  volatile uint8_t  Running;            /* ranging started, the interrupt may read */
+  volatile uint8_t  Pending;            /* a sample is ready and was not read */
+  volatile uint16_t LastRange;
+  uint16_t          Fence;              /* mm, 0 = every sample interrupts */
+  volatile uint32_t PollTick;           /* last sample queued */
+} PROXIMITY_Sensor_t;
+
+/* Private constants ---------------------------------------------------------*/
+/* ST ranging profiles (UM2039), in PROXIMITY_Profile_t order */
+static const PROXIMITY_ProfileSettings_t Profiles[PROXIMITY_PROFILE_COUNT] =
+{
+  { "default",       33000,  14, 10, (FixPoint1616_t)(0.25 * 65536), (FixPoint1616_t)(18 * 65536) },
+  { "high speed",    20000,  14, 10, (FixPoint1616_t)(0.25 * 65536), (FixPoint1616_t)(32 * 65536) },
+  { "high accuracy", 200000, 14, 10, (FixPoint1616_t)(0.25 * 65536), (FixPoint1616_t)(18 * 65536) },
+  { "long range",    33000,  18, 14, (FixPoint1616_t)(0.1 * 65536),  (FixPoint1616_t)(60 * 65536) },
+};
+
+/* Sensor n is brought up n-th. Every GPIO1 needs an EXTI line of its own,
+   passed on to VL53L0X_PROXIMITY_ISR by HAL_GPIO_EXTI_Callback, and is
+   masked on that line alone. A vector the module owns is moved below
+   SysTick and its interrupt reads the sample; on a SharedIRQ one the
+   interrupt runs at the priority main.c gave it, too high for the I2C
+   timeouts, and only flags the sample for the I2C interrupt or the main
+   loop to read. */
+static const PROXIMITY_SensorPins_t SensorPins[PROXIMITY_MAX_SENSORS] =
+{
+  /* on the board, nothing else on EXTI9_5 is used */
+  { VL53L0X_XSHUT_GPIO_Port, VL53L0X_XSHUT_Pin,
+    VL53L0X_GPIO1_EXTI7_GPIO_Port, VL53L0X_GPIO1_EXTI7_Pin, VL53L0X_GPIO1_EXTI7_EXTI_IRQn, 0 },
+  /* Arduino connector: XSHUT on D7, GPIO1 on D2 (EXTI14). EXTI15_10 also
+     serves the user button, which resets the alarm, and the LPS22HB,
+     LSM6DSL and HTS221 */
+  { ARD_D7_GPIO_Port, ARD_D7_Pin,
+    ARD_D2_GPIO_Port, ARD_D2_Pin, EXTI15_10_IRQn, 1 },
+};
+
+/* Private variables ---------------------------------------------------------*/
+extern I2C_HandleTypeDef hI2cHandler;
+
+static PROXIMITY_Sensor_t Sensors[PROXIMITY_SENSORS];
+
+static PROXIMITY_Sample_t Fifo[PROXIMITY_FIFO_SIZE];
+static volatile uint8_t   FifoHead;     /* next sample to hand out */
+static volatile uint8_t   FifoCount;
+static volatile uint8_t   Async;        /* interrupt driven result fetch on the bus */
+static volatile uint8_t   Held;         /* the main loop wants the bus, no fetch starts */
+static uint8_t            AsyncFetch;   /* fetch on the I2C interrupt, else blocking */
+static uint8_t            Result[PROXIMITY_RESULT_SIZE];
+static PROXIMITY_Profile_t Profile;
+static uint32_t           PollMs;       /* range read with a fence set, at most once a sample */
+static PROXIMITY_Stats_t  Stats;
+
+/* Private function prototypes -----------------------------------------------*/
+static void FetchAsync(PROXIMITY_Sensor_t *s);
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  VL53L0X proximity sensors Msp Initialization, every sensor is
+  *         left in reset
+  * @param  None
+  * @retval None
+  */
+static void VL53L0X_PROXIMITY_MspInit(void)
+{
+  GPIO_InitTypeDef GPIO_InitStruct;
+  uint8_t i;
+
+  for (i = 0; i < PROXIMITY_SENSORS; i++)
+  {
+    /* Configure GPIO pin : XSHUT, low holds the sensor in reset */
+    HAL_GPIO_WritePin(SensorPins[i].XshutPort, SensorPins[i].XshutPin, GPIO_PIN_RESET);
+    GPIO_InitStruct.Pin = SensorPins[i].XshutPin;
+    GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
+    GPIO_InitStruct.Pull = GPIO_PULLUP;
+    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_HIGH;
+    HAL_GPIO_Init(SensorPins[i].XshutPort, &GPIO_InitStruct);
+
+    /* Configure GPIO pin : GPIO1, open drain on the sensor */
+    GPIO_InitStruct.Pin = SensorPins[i].Gpio1Pin;
+    GPIO_InitStruct.Mode = GPIO_MODE_IT_RISING;
+    GPIO_InitStruct.Pull = GPIO_PULLUP;
+    HAL_GPIO_Init(SensorPins[i].Gpio1Port, &GPIO_InitStruct);
+  }
+
+  /* every sensor off the bus before the first one boots */
+  HAL_Delay(PROXIMITY_BOOT_MS);
+}
+
+/**
+  * @brief  Take a sensor out of reset and move it off the boot address,
+  *         sensor n goes to PROXIMITY_I2C_ADDRESS + 2 * (n + 1)
+  * @param  s : sensor
+  * @retval VL53L0X status, the sensor is held in reset again on an error
+  */
+static VL53L0X_Error PowerUp(PROXIMITY_Sensor_t *s)
+{
+  const PROXIMITY_SensorPins_t *pins = &SensorPins[s - Sensors];
+  uint8_t address = PROXIMITY_I2C_ADDRESS + (2 * ((s - Sensors) + 1));
+  VL53L0X_Error status;
+
+  s->Dev.I2cHandle  = &hI2cHandler;
+  s->Dev.I2cDevAddr = PROXIMITY_I2C_ADDRESS;
+  s->Dev.Gpio1Port  = pins->Gpio1Port;
+  s->Dev.Gpio1Pin   = pins->Gpio1Pin;
+
+  HAL_GPIO_WritePin(pins->XshutPort, pins->XshutPin, GPIO_PIN_SET);
+
+  /* firmware boot of the sensor */
+  HAL_Delay(PROXIMITY_BOOT_MS);
+  VL53L0X_ShadowReset(&s->Dev);
+
+  /* the next sensor boots on the same address; a sensor that resets later
+     comes back there and stays out of the way */
+  status = VL53L0X_SetDeviceAddress(&s->Dev, address);
+  if (status == VL53L0X_ERROR_NONE)
+  {
+    s->Dev.I2cDevAddr = address;
+  }
+  else
+  {
+    HAL_GPIO_WritePin(pins->XshutPort, pins->XshutPin, GPIO_PIN_RESET);
+  }
+  return status;
+}
+
+/**
+  * @brief  Reference SPADs and VHV/phase calibration: from flash when this
+  *         sensor was calibrated before, measured and stored otherwise
+  * @note   Needs VL53L0X_StaticInit first.
+  * @param  s : sensor, its index is the calibration record
+  * @retval VL53L0X status
+  */
+static VL53L0X_Error Calibrate(PROXIMITY_Sensor_t *s)
+{
+  uint8_t index = s - Sensors;
+  VL53L0X_Error status;
+  TOF_Calib_t calib;
+
+  if (TOF_CALIB_Load(index, &calib) == HAL_OK)
+  {
+    status = VL53L0X_SetReferenceSpads(&s->Dev, calib.RefSpadCount, calib.IsApertureSpads);
+    if (status == VL53L0X_ERROR_NONE)
+    {
+      status = VL53L0X_SetRefCalibration(&s->Dev, calib.VhvSettings, calib.PhaseCal);
+    }
+    if (status == VL53L0X_ERROR_NONE)
+    {
+      Stats.CalibRestored++;
+      return status;
+    }
+  }
+
+  /* SPADs first, the reference calibration runs with the selected ones */
+  status = VL53L0X_PerformRefSpadManagement(&s->Dev, &calib.RefSpadCount, &calib.IsApertureSpads);
+  if (status == VL53L0X_ERROR_NONE)
+  {
+    status = VL53L0X_PerformRefCalibration(&s->Dev, &calib.VhvSettings, &calib.PhaseCal);
+  }
+  if (status == VL53L0X_ERROR_NONE)
+  {
+    /* a failed write only costs the calibration at the next boot */
+    TOF_CALIB_Save(index, &calib);
+  }
+  return status;
+}
+
+/**
+  * @brief  Mask the GPIO1 interrupts of every sensor, on their EXTI lines so
+  *         the rest of a shared vector still interrupts
+  * @note   A masked line does not latch its edges.
+  * @param  None
+  * @retval None
+  */
+static void MaskGpio1(void)
+{
+  uint8_t i;
+
+  for (i = 0; i < PROXIMITY_SENSORS; i++)
+  {
+    CLEAR_BIT(EXTI->IMR1, SensorPins[i].Gpio1Pin);
+  }
+}
+
+/**
+  * @brief  Undo MaskGpio1, unless the main loop holds the bus
+  * @note   GPIO1 stays high until the sample is read: one still high raises
+  *         its lost edge again, unless it is the sample being fetched.
+  * @param  None
+  * @retval None
+  */
+static void UnmaskGpio1(void)
+{
+  uint8_t i;
+
+  if (Held)
+  {
+    return;
+  }
+  for (i = 0; i < PROXIMITY_SENSORS; i++)
+  {
+    SET_BIT(EXTI->IMR1, SensorPins[i].Gpio1Pin);
+    if (Sensors[i].Running && !Sensors[i].Pending && !Async &&
+        (HAL_GPIO_ReadPin(SensorPins[i].Gpio1Port, SensorPins[i].Gpio1Pin) == GPIO_PIN_SET))
+    {
+      WRITE_REG(EXTI->SWIER1, SensorPins[i].Gpio1Pin);
+    }
+  }
+}
+
+/**
+  * @brief  Mask the interrupts that queue samples, GPIO1 and the end of an
+  *         interrupt driven fetch
+  * @param  None
+  * @retval None
+  */
+static void Lock(void)
+{
+  MaskGpio1();
+  HAL_NVIC_DisableIRQ(DISCOVERY_I2Cx_EV_IRQn);
+  HAL_NVIC_DisableIRQ(DISCOVERY_I2Cx_ER_IRQn);
+}
+
+/**
+  * @brief  Undo Lock
+  * @param  None
+  * @retval None
+  */
+static void Unlock(void)
+{
+  HAL_NVIC_EnableIRQ(DISCOVERY_I2Cx_ER_IRQn);
+  HAL_NVIC_EnableIRQ(DISCOVERY_I2Cx_EV_IRQn);
+  UnmaskGpio1();
+}
+
+/**
+  * @brief  Wait for an interrupt driven fetch to end
+  * @note   GPIO1 must be masked and Held set so no other one starts, the
+  *         I2C interrupts must not.
+  * @param  None
+  * @retval VL53L0X_ERROR_NONE when the bus is free
+  */
+static VL53L0X_Error WaitAsync(void)
+{
+  uint32_t start = HAL_GetTick();
+
+  while (Async)
+  {
+    if ((HAL_GetTick() - start) >= PROXIMITY_ASYNC_TIMEOUT_MS)
+    {
+      return VL53L0X_ERROR_TIME_OUT;
+    }
+  }
+  return VL53L0X_ERROR_NONE;
+}
+
+/**
+  * @brief  Keep every fetch off the bus, for blocking transfers from the
+  *         main loop
+  * @param  None
+  * @retval VL53L0X_ERROR_NONE when the bus is free
+  */
+static VL53L0X_Error Hold(void)
+{
+  Held = 1;
+  MaskGpio1();
+  return WaitAsync();
+}
+
+/**
+  * @brief  Undo Hold
+  * @param  None
+  * @retval None
+  */
+static void Release(void)
+{
+  Held = 0;
+  UnmaskGpio1();
+}
+
+/**
+  * @brief  Set a VCSEL period when it changes
+  * @note   The API runs the phase calibration on every set, which would
+  *         replace the one restored from flash.
+  * @param  s : sensor
+  * @param  type : pre-range or final range
+  * @param  period : PCLKs
+  * @retval VL53L0X status
+  */
+static VL53L0X_Error SetVcselPeriod(PROXIMITY_Sensor_t *s, VL53L0X_VcselPeriod type, uint8_t period)
+{
+  VL53L0X_Error status;
+  uint8_t current;
+
+  status = VL53L0X_GetVcselPulsePeriod(&s->Dev, type, &current);
+  if ((status == VL53L0X_ERROR_NONE) && (current != period))
+  {
+    status = VL53L0X_SetVcselPulsePeriod(&s->Dev, type, period);
+  }
+  return status;
+}
+
+/**
+  * @brief  Program the timing budget, VCSEL periods and limit checks of a
+  *         ranging profile
+  * @note   Ranging must be stopped. A VCSEL period change runs the phase
+  *         calibration again for the new period.
+  * @param  s : sensor
+  * @param  profile : profile to apply
+  * @retval VL53L0X status
+  */
+static VL53L0X_Error ApplyProfile(PROXIMITY_Sensor_t *s, PROXIMITY_Profile_t profile)
+{
+  const PROXIMITY_ProfileSettings_t *settings = &Profiles[profile];
+  VL53L0X_Error status;
+
+  status = VL53L0X_SetLimitCheckEnable(&s->Dev, VL53L0X_CHECKENABLE_SIGMA_FINAL_RANGE, 1);
+  if (status == VL53L0X_ERROR_NONE)
+  {
+    status = VL53L0X_SetLimitCheckEnable(&s->Dev, VL53L0X_CHECKENABLE_SIGNAL_RATE_FINAL_RANGE, 1);
+  }
+  if (status == VL53L0X_ERROR_NONE)
+  {
+    status = VL53L0X_SetLimitCheckValue(&s->Dev, VL53L0X_CHECKENABLE_SIGNAL_RATE_FINAL_RANGE, settings->SignalLimit);
+  }
+  if (status == VL53L0X_ERROR_NONE)
+  {
+    status = VL53L0X_SetLimitCheckValue(&s->Dev, VL53L0X_CHECKENABLE_SIGMA_FINAL_RANGE, settings->SigmaLimit);
+  }
+  if (status == VL53L0X_ERROR_NONE)
+  {
+    status = VL53L0X_SetMeasurementTimingBudgetMicroSeconds(&s->Dev, settings->TimingBudgetUs);
+  }
+  if (status == VL53L0X_ERROR_NONE)
+  {
+    status = SetVcselPeriod(s, VL53L0X_VCSEL_PERIOD_PRE_RANGE, settings->PreRangeVcselPeriod);
+  }
+  if (status == VL53L0X_ERROR_NONE)
+  {
+    status = SetVcselPeriod(s, VL53L0X_VCSEL_PERIOD_FINAL_RANGE, settings->FinalRangeVcselPeriod);
+  }
+  return status;
+}
+
+/**
+  * @brief  Record the profile every sensor now runs
+  * @param  profile : profile
+  * @retval None
+  */
+static void SetProfileInUse(PROXIMITY_Profile_t profile)
+{
+  Profile = profile;
+  PollMs  = Profiles[profile].TimingBudgetUs / 1000;
+  if (PollMs < PROXIMITY_INTER_MEASUREMENT_MS)
+  {
+    PollMs = PROXIMITY_INTER_MEASUREMENT_MS;
+  }
+  if (PollMs < PROXIMITY_POLL_MS)
+  {
+    PollMs = PROXIMITY_POLL_MS;
+  }
+}
+
+/**
+  * @brief  Stop ranging for a change of the sensor settings, the bus is held
+  *         until Restart
+  * @param  s : sensor
+  * @retval VL53L0X status
+  */
+static VL53L0X_Error Stop(PROXIMITY_Sensor_t *s)
+{
+  VL53L0X_Error status;
+  uint32_t stopped = 1;
+  uint32_t start;
+
+  status = Hold();
+  if (status == VL53L0X_ERROR_NONE)
+  {
+    status = VL53L0X_StopMeasurement(&s->Dev);
+  }
+  start = HAL_GetTick();
+  while ((status == VL53L0X_ERROR_NONE) && (stopped != 0) &&
+         ((HAL_GetTick() - start) < PROXIMITY_STOP_TIMEOUT_MS))
+  {
+    status = VL53L0X_GetStopCompletedStatus(&s->Dev, &stopped);
+  }
+  return status;
+}
+
+/**
+  * @brief  Start ranging, the GPIO1 interrupts stay as they are
+  * @param  s : sensor
+  * @param  status : status of what came before
+  * @retval status, or an error when ranging did not start
+  */
+static VL53L0X_Error Start(PROXIMITY_Sensor_t *s, VL53L0X_Error status)
+{
+  s->Pending = 0;
+  if (VL53L0X_StartMeasurement(&s->Dev) != VL53L0X_ERROR_NONE)
+  {
+    s->Running = 0;
+    status = VL53L0X_ERROR_UNDEFINED;
+  }
+  /* this sensor's line only, an edge of another one is still to be read */
+  __HAL_GPIO_EXTI_CLEAR_IT(s->Dev.Gpio1Pin);
+  return status;
+}
+
+/**
+  * @brief  Start ranging again after Stop whatever happened in between, the
+  *         caller still has the samples
+  * @param  s : sensor
+  * @param  status : status of the change
+  * @retval status, or an error when ranging did not start
+  */
+static VL53L0X_Error Restart(PROXIMITY_Sensor_t *s, VL53L0X_Error status)
+{
+  status = Start(s, status);
+  Release();
+  return status;
+}
+
+/**
+  * @brief  Queue a range
+  * @param  s : sensor it comes from
+  * @param  data : range read from the sensor
+  * @retval None
+  */
+static void Queue(PROXIMITY_Sensor_t *s, const VL53L0X_RangingMeasurementData_t *data)
+{
+  PROXIMITY_Sample_t *sample;
+
+  Stats.Samples++;
+
+  if (FifoCount == PROXIMITY_FIFO_SIZE)
+  {
+    /* the newest range is what the alarm needs, drop the oldest */
+    FifoHead = (FifoHead + 1) % PROXIMITY_FIFO_SIZE;
+    FifoCount--;
+    Stats.Overruns++;
+  }
+  sample = &Fifo[(FifoHead + FifoCount) % PROXIMITY_FIFO_SIZE];
+  sample->Tick                 = HAL_GetTick();
+  sample->Sensor               = s - Sensors;
+  sample->RangeMilliMeter      = data->RangeMilliMeter;
+  sample->RangeStatus          = data->RangeStatus;
+  sample->SignalRateRtnMegaCps = data->SignalRateRtnMegaCps;
+  FifoCount++;
+  s->LastRange = data->RangeMilliMeter;
+  /* the result registers hold a sample until the next measurement ends,
+     no poll before then */
+  s->PollTick  = sample->Tick;
+}
+
+/**
+  * @brief  Read the last range and queue it, and clear the sensor interrupt
+  * @note   Blocking. Runs with the GPIO1 interrupts unable to preempt it:
+  *         from the interrupt itself or from the main loop with them masked.
+  * @param  s : sensor
+  * @param  clear : 1 for a sample that raised GPIO1, 0 for a poll
+  * @retval None
+  */
+static void Fetch(PROXIMITY_Sensor_t *s, uint8_t clear)
+{
+  VL53L0X_RangingMeasurementData_t data;
+
+  if ((VL53L0X_GetRangingMeasurementData(&s->Dev, &data) != VL53L0X_ERROR_NONE) ||
+      (clear && (VL53L0X_ClearInterruptMask(&s->Dev, 0) != VL53L0X_ERROR_NONE)))
+  {
+    /* GPIO1 stays high without a clear, the main loop tries again */
+    Stats.Errors++;
+    s->Pending |= clear;
+    return;
+  }
+  if (clear)
+  {
+    s->Pending = 0;
+  }
+  else if (HAL_GPIO_ReadPin(s->Dev.Gpio1Port, s->Dev.Gpio1Pin) == GPIO_PIN_SET)
+  {
+    /* the poll read the sample that raised GPIO1 under it. Cleared here, or
+       unmasking the line would raise its edge again and the range filter
+       would get the sample twice, a lone spike passing for a step */
+    if (VL53L0X_ClearInterruptMask(&s->Dev, 0) != VL53L0X_ERROR_NONE)
+    {
+      Stats.Errors++;
+    }
+    __HAL_GPIO_EXTI_CLEAR_IT(s->Dev.Gpio1Pin);
+  }
+  Queue(s, &data);
+}
+
+/**
+  * @brief  Start the fetch of a sensor whose edge came while the bus was
+  *         busy, the sensors take turns from the one just read
+  * @param  s : sensor just read
+  * @retval None
+  */
+static void FetchNext(PROXIMITY_Sensor_t *s)
+{
+  uint8_t i, n;
+
+  if (Held)
+  {
+    return;
+  }
+  for (i = 1; i <= PROXIMITY_SENSORS; i++)
+  {
+    n = ((s - Sensors) + i) % PROXIMITY_SENSORS;
+    if (Sensors[n].Running && Sensors[n].Pending)
+    {
+      FetchAsync(&Sensors[n]);
+      return;
+    }
+  }
+}
+
+/**
+  * @brief  A step of the interrupt driven fetch failed, the main loop reads
+  *         the sample again the blocking way
+  * @param  s : sensor
+  * @retval None
+  */
+static void FetchFailed(PROXIMITY_Sensor_t *s)
+{
+  Stats.Errors++;
+  s->Pending = 1;
+  Async = 0;
+}
+
+/**
+  * @brief  Interrupt driven fetch, last step: interrupt cleared, decode and
+  *         queue the range, then go on with the next sensor waiting
+  * @param  dev : device
+  * @param  status : transfer status
+  * @retval None
+  */
+static void FetchCleared(VL53L0X_DEV dev, VL53L0X_Error status)
+{
+  PROXIMITY_Sensor_t *s = (PROXIMITY_Sensor_t *)dev;
+  VL53L0X_RangingMeasurementData_t data;
+
+  if (status == VL53L0X_ERROR_NONE)
+  {
+    status = VL53L0X_DecodeRangingMeasurementData(dev, Result, &data);
+  }
+  if (status != VL53L0X_ERROR_NONE)
+  {
+    FetchFailed(s);
+    return;
+  }
+  s->Pending = 0;
+  Async      = 0;
+  Queue(s, &data);
+  FetchNext(s);
+}
+
+/**
+  * @brief  Interrupt driven fetch: interrupt clear set, release it
+  * @param  dev : device
+  * @param  status : transfer status
+  * @retval None
+  */
+static void FetchClear(VL53L0X_DEV dev, VL53L0X_Error status)
+{
+  if (status == VL53L0X_ERROR_NONE)
+  {
+    status = VL53L0X_WrByte_IT(dev, VL53L0X_REG_SYSTEM_INTERRUPT_CLEAR, 0x00, FetchCleared);
+  }
+  if (status != VL53L0X_ERROR_NONE)
+  {
+    FetchFailed((PROXIMITY_Sensor_t *)dev);
+  }
+}
+
+/**
+  * @brief  Interrupt driven fetch: result read, clear the sensor interrupt.
+  *         VL53L0X_ClearInterruptMask also reads the clear back, a clear that
+  *         did not take leaves GPIO1 high for the main loop to see.
+  * @param  dev : device
+  * @param  status : transfer status
+  * @retval None
+  */
+static void FetchResult(VL53L0X_DEV dev, VL53L0X_Error status)
+{
+  if (status == VL53L0X_ERROR_NONE)
+  {
+    status = VL53L0X_WrByte_IT(dev, VL53L0X_REG_SYSTEM_INTERRUPT_CLEAR, 0x01, FetchClear);
+  }
+  if (status != VL53L0X_ERROR_NONE)
+  {
+    FetchFailed((PROXIMITY_Sensor_t *)dev);
+  }
+}
+
+/**
+  * @brief  Start the interrupt driven fetch of a sample that raised GPIO1,
+  *         the range result is read and the interrupt cleared while the CPU
+  *         gets back to what it was doing
+  * @param  s : sensor
+  * @retval None
+  */
+static void FetchAsync(PROXIMITY_Sensor_t *s)
+{
+  Async = 1;
+  if (VL53L0X_ReadMulti_IT(&s->Dev, PROXIMITY_RESULT_REG, Result, PROXIMITY_RESULT_SIZE, FetchResult) != VL53L0X_ERROR_NONE)
+  {
+    Async = 0;
+    Stats.Deferred++;
+    s->Pending = 1;
+  }
+}
+
+/**
+  * @brief  Bring up a sensor, out of reset to ready to range
+  * @param  s : sensor
+  * @retval VL53L0X status
+  */
+static VL53L0X_Error InitSensor(PROXIMITY_Sensor_t *s)
+{
+  VL53L0X_Error status;
+
+  status = PowerUp(s);
+
+  /* One-time device initialization, then the reference calibrations that
+     single measurements used to skip */
+  if (status == VL53L0X_ERROR_NONE)
+  {
+    status = VL53L0X_DataInit(&s->Dev);
+  }
+  if (status == VL53L0X_ERROR_NONE)
+  {
+    status = VL53L0X_StaticInit(&s->Dev);
+  }
+
+  /* GPIO1 goes high on a new sample, its EXTI line is set up for the rising
+     edge. Set before the calibrations so their measurements raise it too */
+  if (status == VL53L0X_ERROR_NONE)
+  {
+    status = VL53L0X_SetGpioConfig(&s->Dev, 0, PROXIMITY_DEVICE_MODE,
+                                   VL53L0X_GPIOFUNCTIONALITY_NEW_MEASURE_READY,
+                                   VL53L0X_INTERRUPTPOLARITY_HIGH);
+  }
+  if (status == VL53L0X_ERROR_NONE)
+  {
+    status = Calibrate(s);
+  }
+  if (status == VL53L0X_ERROR_NONE)
+  {
+    status = VL53L0X_SetDeviceMode(&s->Dev, PROXIMITY_DEVICE_MODE);
+  }
+  if (status == VL53L0X_ERROR_NONE)
+  {
+    status = ApplyProfile(s, PROXIMITY_PROFILE);
+  }
+#if (PROXIMITY_INTER_MEASUREMENT_MS > 0)
+  if (status == VL53L0X_ERROR_NONE)
+  {
+    status = VL53L0X_SetInterMeasurementPeriodMilliSeconds(&s->Dev, PROXIMITY_INTER_MEASUREMENT_MS);
+  }
+#endif
+
+  if (status == VL53L0X_ERROR_NONE)
+  {
+    status = VL53L0X_ClearInterruptMask(&s->Dev, 0);
+  }
+  return status;
+}
+
+/**
+  * @brief  Sensor on a GPIO1 line
+  * @param  pin : EXTI line
+  * @retval Sensor, NULL when none is on it
+  */
+static PROXIMITY_Sensor_t *SensorOfPin(uint16_t pin)
+{
+  uint8_t i;
+
+  for (i = 0; i < PROXIMITY_SENSORS; i++)
+  {
+    if (SensorPins[i].Gpio1Pin == pin)
+    {
+      return &Sensors[i];
+    }
+  }
+  return NULL;
+}
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  Initialize the sensors one at a time and start continuous ranging
+  *         on all of them
+  * @note   A sensor that fails is left out, the others range.
+  * @param  None
+  * @retval VL53L0X_ERROR_NONE when every sensor ranges, else the first error
+  */
+VL53L0X_Error VL53L0X_PROXIMITY_Init(void)
+{
+  VL53L0X_Error status = VL53L0X_ERROR_NONE;
+  VL53L0X_Error sensorStatus;
+  uint32_t start;
+  uint8_t i;
+
+  for (i = 0; i < PROXIMITY_SENSORS; i++)
+  {
+    Sensors[i].Running = 0;
+    Sensors[i].Pending = 0;
+    Sensors[i].Fence   = 0;
+  }
+  Async     = 0;
+  FifoHead  = 0;
+  FifoCount = 0;
+
+  /* Initialize I2C interface */
+  SENSOR_IO_Init();
+
+  /* until ranging starts the GPIO1 pending flags are the API's data ready
+     edges (VL53L0X_PollingDelay), the interrupts must not take them. Only
+     an unmasked line latches them, so a vector of the module's own is
+     disabled instead; on a shared one the API polls without the edge */
+  Held = 1;
+  for (i = 0; i < PROXIMITY_SENSORS; i++)
+  {
+    if (!SensorPins[i].SharedIRQ)
+    {
+      HAL_NVIC_DisableIRQ(SensorPins[i].Gpio1IRQn);
+    }
+  }
+
+  /* Initialize pins for TOF, that unmasks the GPIO1 lines */
+  start = HAL_GetTick();
+  VL53L0X_PROXIMITY_MspInit();
+  for (i = 0; i < PROXIMITY_SENSORS; i++)
+  {
+    if (SensorPins[i].SharedIRQ)
+    {
+      CLEAR_BIT(EXTI->IMR1, SensorPins[i].Gpio1Pin);
+    }
+  }
+
+  for (i = 0; i < PROXIMITY_SENSORS; i++)
+  {
+    sensorStatus = InitSensor(&Sensors[i]);
+    if (sensorStatus == VL53L0X_ERROR_NONE)
+    {
+      Sensors[i].Running = 1;
+    }
+    else if (status == VL53L0X_ERROR_NONE)
+    {
+      status = sensorStatus;
+    }
+  }
+  SetProfileInUse(PROXIMITY_PROFILE);
+
+  /* the interrupt driven fetch decodes with the reference signal of the
+     last blocking read, which only the signal ref clip check uses. The
+     sensors all have the same checks */
+  AsyncFetch = 0;
+#if (PROXIMITY_ASYNC_FETCH == 1)
+  for (i = 0; i < PROXIMITY_SENSORS; i++)
+  {
+    uint8_t refClip = 1;
+
+    if (Sensors[i].Running)
+    {
+      VL53L0X_GetLimitCheckEnable(&Sensors[i].Dev, VL53L0X_CHECKENABLE_SIGNAL_REF_CLIP, &refClip);
+      AsyncFetch = (refClip == 0);
+      break;
+    }
+  }
+#endif
+
+  /* the interrupt reads over I2C, the HAL timeouts need SysTick above it.
+     The I2C interrupts end the fetch it starts, same level so neither
+     preempts the other. From here on the lines are masked one by one, the
+     vectors stay on */
+  MaskGpio1();
+  for (i = 0; i < PROXIMITY_SENSORS; i++)
+  {
+    __HAL_GPIO_EXTI_CLEAR_IT(SensorPins[i].Gpio1Pin);
+    if (!SensorPins[i].SharedIRQ)
+    {
+      HAL_NVIC_SetPriority(SensorPins[i].Gpio1IRQn, PROXIMITY_IRQ_PRIORITY, 0);
+      HAL_NVIC_EnableIRQ(SensorPins[i].Gpio1IRQn);
+    }
+  }
+  HAL_NVIC_SetPriority(DISCOVERY_I2Cx_EV_IRQn, PROXIMITY_IRQ_PRIORITY, 0);
+  HAL_NVIC_SetPriority(DISCOVERY_I2Cx_ER_IRQn, PROXIMITY_IRQ_PRIORITY, 0);
+
+  /* every sensor ranges on its own from here on, the interrupts are taken
+     once they all run */
+  for (i = 0; i < PROXIMITY_SENSORS; i++)
+  {
+    if (Sensors[i].Running)
+    {
+      sensorStatus = Start(&Sensors[i], VL53L0X_ERROR_NONE);
+      if ((sensorStatus != VL53L0X_ERROR_NONE) && (status == VL53L0X_ERROR_NONE))
+      {
+        status = sensorStatus;
+      }
+    }
+    Stats.Sensors += Sensors[i].Running;
+  }
+  Release();
+  Stats.InitMs = HAL_GetTick() - start;
+  return status;
+}
+
+/**
+  * @brief  Set the proximity fence a sensor checks by itself
+  * @note   Ranging is stopped for the change, the interrupt settings of the
+  *         sensor are only loaded on a start.
+  * @param  sensor : sensor index
+  * @param  mm : raw range at or below which GPIO1 rises, 0 to go back to an
+  *              interrupt for every sample
+  * @retval VL53L0X_ERROR_NONE when the sensor enforces the fence
+  */
+VL53L0X_Error VL53L0X_PROXIMITY_SetFence(uint8_t sensor, uint16_t mm)
+{
+  PROXIMITY_Sensor_t *s;
+  VL53L0X_Error status;
+
+  if (sensor >= PROXIMITY_SENSORS)
+  {
+    return VL53L0X_ERROR_INVALID_PARAMS;
+  }
+  s = &Sensors[sensor];
+  if (!s->Running)
+  {
+    return VL53L0X_ERROR_UNDEFINED;
+  }
+  if (mm == s->Fence)
+  {
+    return VL53L0X_ERROR_NONE;
+  }
+
+  status = Stop(s);
+
+  /* the sensor compares with "below", the fence includes its distance */
+  if (status == VL53L0X_ERROR_NONE)
+  {
+    status = VL53L0X_SetInterruptThresholds(&s->Dev, PROXIMITY_DEVICE_MODE,
+                                            (FixPoint1616_t)(mm + 1) << 16,
+                                            (FixPoint1616_t)(mm + 1) << 16);
+  }
+  if (status == VL53L0X_ERROR_NONE)
+  {
+    status = VL53L0X_SetGpioConfig(&s->Dev, 0, PROXIMITY_DEVICE_MODE,
+                                   (mm != 0) ? VL53L0X_GPIOFUNCTIONALITY_THRESHOLD_CROSSED_LOW :
+                                               VL53L0X_GPIOFUNCTIONALITY_NEW_MEASURE_READY,
+                                   VL53L0X_INTERRUPTPOLARITY_HIGH);
+  }
+  s->Fence = (status == VL53L0X_ERROR_NONE) ? mm : 0;
+  return Restart(s, status);
+}
+
+/**
+  * @brief  Fence a sensor enforces
+  * @param  sensor : sensor index
+  * @retval Raw range in mm, 0 when none
+  */
+uint16_t VL53L0X_PROXIMITY_GetFence(uint8_t sensor)
+{
+  return (sensor < PROXIMITY_SENSORS) ? Sensors[sensor].Fence : 0;
+}
+
+/**
+  * @brief  Switch the ranging profile of every sensor while ranging
+  * @note   Ranging is stopped for the change, one sensor at a time; the
+  *         fences are kept.
+  * @param  profile : new profile
+  * @retval VL53L0X_ERROR_NONE when the sensors run the profile; on an error
+  *         they may be left between two profiles, set it again
+  */
+VL53L0X_Error VL53L0X_PROXIMITY_SetProfile(PROXIMITY_Profile_t profile)
+{
+  VL53L0X_Error status = VL53L0X_ERROR_NONE;
+  uint8_t i;
+
+  if ((unsigned)profile >= PROXIMITY_PROFILE_COUNT)
+  {
+    return VL53L0X_ERROR_INVALID_PARAMS;
+  }
+  if (Stats.Sensors == 0)
+  {
+    return VL53L0X_ERROR_UNDEFINED;
+  }
+  if (profile == Profile)
+  {
+    return VL53L0X_ERROR_NONE;
+  }
+
+  for (i = 0; (i < PROXIMITY_SENSORS) && (status == VL53L0X_ERROR_NONE); i++)
+  {
+    if (Sensors[i].Running)
+    {
+      status = Restart(&Sensors[i], (Stop(&Sensors[i]) == VL53L0X_ERROR_NONE) ?
+                                    ApplyProfile(&Sensors[i], profile) : VL53L0X_ERROR_UNDEFINED);
+    }
+  }
+  if (status == VL53L0X_ERROR_NONE)
+  {
+    SetProfileInUse(profile);
+  }
+  return status;
+}
+
+/**
+  * @brief  Ranging profile in use
+  * @param  None
+  * @retval Profile
+  */
+PROXIMITY_Profile_t VL53L0X_PROXIMITY_GetProfile(void)
+{
+  return Profile;
+}
+
+/**
+  * @brief  Name of a ranging profile, for the web page
+  * @param  profile : profile
+  * @retval Name, "?" for an unknown profile
+  */
+const char *VL53L0X_PROXIMITY_ProfileName(PROXIMITY_Profile_t profile)
+{
+  return ((unsigned)profile < PROXIMITY_PROFILE_COUNT) ? Profiles[profile].Name : "?";
+}
+
+/**
+  * @brief  GPIO1 rising edge, called from HAL_GPIO_EXTI_Callback
+  * @param  pin : EXTI line that fired
+  * @param  sensor : (OUT) index of the sensor on that line
+  * @retval PROXIMITY_EVENT_FENCE when the sensor has a fence set, the edge is
+  *         enough to know something is inside it; PROXIMITY_EVENT_NONE when
+  *         no running sensor is on the line
+  */
+PROXIMITY_Event_t VL53L0X_PROXIMITY_ISR(uint16_t pin, uint8_t *sensor)
+{
+  PROXIMITY_Sensor_t *s = SensorOfPin(pin);
+  PROXIMITY_Event_t event = PROXIMITY_EVENT_SAMPLE;
+
+  if ((s == NULL) || !s->Running)
+  {
+    return PROXIMITY_EVENT_NONE;
+  }
+  *sensor = s - Sensors;
+  if (s->Fence != 0)
+  {
+    Stats.FenceEvents++;
+    event = PROXIMITY_EVENT_FENCE;
+  }
+
+  /* the interrupted code may be in the middle of a transfer to another
+     device on the same bus. The end of an interrupt driven fetch goes on
+     with this sensor, else the main loop does. So does it for a sensor on
+     a shared vector, above SysTick and the I2C interrupts */
+  if (SensorPins[*sensor].SharedIRQ ||
+      Async || (hI2cHandler.State != HAL_I2C_STATE_READY) || (hI2cHandler.Lock == HAL_LOCKED))
+  {
+    Stats.Deferred++;
+    s->Pending = 1;
+    return event;
+  }
+  if (AsyncFetch)
+  {
+    FetchAsync(s);
+  }
+  else
+  {
+    Fetch(s, 1);
+  }
+  return event;
+}
+
+/**
+  * @brief  Read the samples the interrupts could not, and with a fence set
+  *         the current ranges when they are due, call from the main loop
+  * @param  None
+  * @retval None
+  */
+void VL53L0X_PROXIMITY_Process(void)
+{
+  PROXIMITY_Sensor_t *s;
+  uint8_t missed;
+  uint8_t i;
+
+  Lock();
+  if (Async)
+  {
+    /* an interrupt driven fetch is still on the bus, next time */
+    Unlock();
+    return;
+  }
+  for (i = 0; i < PROXIMITY_SENSORS; i++)
+  {
+    s = &Sensors[i];
+    if (!s->Running)
+    {
+      continue;
+    }
+    /* a sample that came while the interrupt was masked has no edge left */
+    missed = !s->Pending &&
+             (HAL_GPIO_ReadPin(SensorPins[i].Gpio1Port, SensorPins[i].Gpio1Pin) == GPIO_PIN_SET);
+    if (s->Pending || missed)
+    {
+      if (missed)
+      {
+        Stats.Missed++;
+      }
+      Fetch(s, 1);
+      s->PollTick = HAL_GetTick();
+    }
+#if (PROXIMITY_POLL_MS > 0)
+    else if ((s->Fence != 0) && ((HAL_GetTick() - s->PollTick) >= PollMs))
+    {
+      Fetch(s, 0);
+      s->PollTick = HAL_GetTick();
+    }
+#endif
+  }
+  Unlock();
+}
+
+/**
+  * @brief  Keep the sensors off the bus, for a blocking transfer to another
+  *         device from the main loop; a sample that comes meanwhile is read
+  *         by VL53L0X_PROXIMITY_Process
+  * @param  None
+  * @retval None
+  */
+void VL53L0X_PROXIMITY_LockBus(void)
+{
+  if (Hold() != VL53L0X_ERROR_NONE)
+  {
+    Stats.Errors++;
+  }
+}
+
+/**
+  * @brief  Undo VL53L0X_PROXIMITY_LockBus
+  * @param  None
+  * @retval None
+  */
+void VL53L0X_PROXIMITY_UnlockBus(void)
+{
+  Release();
+}
+
+/**
+  * @brief  Take the oldest queued sample, from whichever sensor
+  * @param  sample : (OUT) the sample
+  * @retval 1 when a sample was returned, 0 when the queue is empty
+  */
+uint8_t VL53L0X_PROXIMITY_GetSample(PROXIMITY_Sample_t *sample)
+{
+  uint8_t ret = 0;
+
+  Lock();
+  if (FifoCount > 0)
+  {
+    *sample   = Fifo[FifoHead];
+    FifoHead  = (FifoHead + 1) % PROXIMITY_FIFO_SIZE;
+    FifoCount--;
+    ret = 1;
+  }
+  Unlock();
+  return ret;
+}
+
+/**
+  * @brief  Latest range of a sensor, whether or not it was taken from the
+  *         queue
+  * @param  sensor : sensor index
+  * @retval Distance in mm, 0 before the first sample
+  */
+uint16_t VL53L0X_PROXIMITY_GetDistance(uint8_t sensor)
+{
+  return (sensor < PROXIMITY_SENSORS) ? Sensors[sensor].LastRange : 0;
+}
+
+/**
+  * @brief  Get the ranging counters, all sensors together
+  * @param  stats : (OUT) copy of the counters
+  * @retval None
+  */
+void VL53L0X_PROXIMITY_GetStats(PROXIMITY_Stats_t *stats)
+{
+  Lock();
+  *stats = Stats;
+#if VL53L0X_SHADOW
+  for (uint8_t i = 0; i < PROXIMITY_SENSORS; i++)
+  {
+    stats->ShadowHits += Sensors[i].Dev.ShadowHits;
+  }
+#endif
+  Unlock();
+}
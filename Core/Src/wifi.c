@@ -18,12 +18,79 @@
   */
 /* Includes ------------------------------------------------------------------*/
 #include "wifi.h"
+#include "buffer_pool.h"
 
 /* Private define ------------------------------------------------------------*/
+/* Private typedef -----------------------------------------------------------*/
+/* Receive read-ahead of a TCP socket: every module read asks for a whole
+   payload, smaller application reads are served from here. The buffer is
+   only refilled once drained, so it never wraps. */
+typedef struct {
+  uint8_t  Data[ES_WIFI_PAYLOAD_SIZE];
+  uint16_t Head;                        /* next byte for the application */
+  uint16_t Count;                       /* bytes buffered from Head */
+  uint8_t  Stream;                      /* TCP, datagrams are never merged */
+} WIFI_ReadAhead_t;
+
 /* Private variables ---------------------------------------------------------*/
 ES_WIFIObject_t    EsWifiObj;
+#if (WIFI_READAHEAD_SOCKETS > 0)
+static WIFI_ReadAhead_t     ReadAhead[WIFI_READAHEAD_SOCKETS];
+#endif
+static WIFI_ReadAheadStats_t ReadAheadStats;
 
 /* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  Forget what is buffered for a socket, its connection ended
+  * @param  socket : socket
+  * @retval None
+  */
+static void ReadAheadDrop(uint32_t socket)
+{
+#if (WIFI_READAHEAD_SOCKETS > 0)
+  if (socket < WIFI_READAHEAD_SOCKETS)
+  {
+    ReadAheadStats.Dropped += ReadAhead[socket].Count;
+    ReadAhead[socket].Head  = 0;
+    ReadAhead[socket].Count = 0;
+  }
+#endif
+}
+
+/**
+  * @brief  Forget what is buffered for every socket, the module lost them
+  * @param  None
+  * @retval None
+  */
+static void ReadAheadDropAll(void)
+{
+#if (WIFI_READAHEAD_SOCKETS > 0)
+  uint32_t socket;
+
+  for (socket = 0; socket < WIFI_READAHEAD_SOCKETS; socket++)
+  {
+    ReadAheadDrop(socket);
+  }
+#endif
+}
+
+/**
+  * @brief  Set whether a socket reads ahead, when it is opened
+  * @param  socket : socket
+  * @param  protocol : TCP reads ahead, UDP does not
+  * @retval None
+  */
+static void ReadAheadOpen(uint32_t socket, WIFI_Protocol_t protocol)
+{
+  ReadAheadDrop(socket);
+#if (WIFI_READAHEAD_SOCKETS > 0)
+  if (socket < WIFI_READAHEAD_SOCKETS)
+  {
+    ReadAhead[socket].Stream = (protocol == WIFI_TCP_PROTOCOL);
+  }
+#endif
+}
+
 /**
   * @brief  Initialize the WIFI core
   * @param  None
@@ -33,13 +100,25 @@ WIFI_Status_t WIFI_Init(void)
 {
   WIFI_Status_t ret = WIFI_STATUS_ERROR;
   
+#if (ES_WIFI_USE_UART == 1)
+  if(ES_WIFI_RegisterBusIO(&EsWifiObj,
+                           UART_WIFI_Init,
+                           UART_WIFI_DeInit,
+                           UART_WIFI_Delay,
+                           UART_WIFI_SendData,
+                           UART_WIFI_ReceiveData,
+                           UART_WIFI_ReceivePayload) == ES_WIFI_STATUS_OK)
+#else
   if(ES_WIFI_RegisterBusIO(&EsWifiObj,
                            SPI_WIFI_Init,
                            SPI_WIFI_DeInit,
                            SPI_WIFI_Delay,
                            SPI_WIFI_SendData,
-                           SPI_WIFI_ReceiveData) == ES_WIFI_STATUS_OK)
+                           SPI_WIFI_ReceiveData,
+                           SPI_WIFI_ReceivePayload) == ES_WIFI_STATUS_OK)
+#endif
   {
+    ReadAheadDropAll();
     if(ES_WIFI_Init(&EsWifiObj) == ES_WIFI_STATUS_OK)
     {
       ret = WIFI_STATUS_OK;
@@ -59,8 +138,13 @@ WIFI_Status_t WIFI_ListAccessPoints(WIFI_APs_t *APs, uint8_t AP_MaxNbr)
   uint8_t APCount;
   WIFI_Status_t ret = WIFI_STATUS_ERROR;
   ES_WIFI_APs_t esWifiAPs;
-  
-  if(ES_WIFI_ListAccessPoints(&EsWifiObj, &esWifiAPs) == ES_WIFI_STATUS_OK)
+  uint8_t *scan = POOL_Alloc();
+  ES_WIFI_Status_t status;
+
+  /* older module firmware sends the whole scan in one reply */
+  status = ES_WIFI_ListAccessPoints(&EsWifiObj, &esWifiAPs, scan, scan ? POOL_BLOCK_SIZE : 0);
+  POOL_Free(scan);
+  if(status == ES_WIFI_STATUS_OK)
   {
     if(esWifiAPs.nbr > 0)
     {
@@ -79,6 +163,23 @@ WIFI_Status_t WIFI_ListAccessPoints(WIFI_APs_t *APs, uint8_t AP_MaxNbr)
   return ret;
 }
 
+/**
+  * @brief  List the access points in range as the driver parsed them, the
+  *         SSIDs stay at their AT size instead of being copied to WIFI_APs_t
+  * @param  APs : (OUT) access points, at most ES_WIFI_MAX_DETECTED_AP
+  * @retval Operation status
+  */
+WIFI_Status_t WIFI_ScanAccessPoints(ES_WIFI_APs_t *APs)
+{
+  uint8_t *scan = POOL_Alloc();
+  ES_WIFI_Status_t status;
+
+  APs->nbr = 0;
+  status = ES_WIFI_ListAccessPoints(&EsWifiObj, APs, scan, scan ? POOL_BLOCK_SIZE : 0);
+  POOL_Free(scan);
+  return (status == ES_WIFI_STATUS_OK) ? WIFI_STATUS_OK : WIFI_STATUS_ERROR;
+}
+
 /**
   * @brief  Join an Access Point
   * @param  SSID : SSID string
@@ -107,6 +208,156 @@ WIFI_Status_t WIFI_Connect(
   return ret;
 }
 
+/**
+  * @brief  Join again the last access point, with the credentials already
+  *         stored in the module
+  * @retval Operation Status.
+  */
+WIFI_Status_t WIFI_Reconnect(void)
+{
+  WIFI_Status_t ret = WIFI_STATUS_ERROR;
+
+  ReadAheadDropAll();
+  if(ES_WIFI_Reconnect(&EsWifiObj) == ES_WIFI_STATUS_OK)
+  {
+    if(ES_WIFI_GetNetworkSettings(&EsWifiObj) == ES_WIFI_STATUS_OK)
+    {
+       ret = WIFI_STATUS_OK;
+    }
+  }
+  return ret;
+}
+
+/**
+  * @brief  Check whether the module holds the credentials of the last
+  *         WIFI_Connect, whether or not it joined
+  * @retval 1 when WIFI_Reconnect can be used, 0 otherwise.
+  */
+uint8_t WIFI_HasCredentials(void)
+{
+  return EsWifiObj.CredsLoaded;
+}
+
+/**
+  * @brief  Check the association with the access point
+  * @retval 1 when associated, 0 otherwise.
+  */
+uint8_t WIFI_IsConnected(void)
+{
+  return ES_WIFI_IsConnected(&EsWifiObj);
+}
+
+/**
+  * @brief  Get the signal strength of the current association
+  * @param  rssi : (OUT) signal strength in dBm
+  * @retval Operation Status.
+  */
+WIFI_Status_t WIFI_GetRSSI(int16_t *rssi)
+{
+  return (ES_WIFI_GetRSSI(&EsWifiObj, rssi) == ES_WIFI_STATUS_OK) ? WIFI_STATUS_OK : WIFI_STATUS_ERROR;
+}
+
+/**
+  * @brief  Get the IP settings of the current association, as read at join
+  * @param  ipaddr, mask, gateway, dns : 4-byte buffers for the settings
+  * @retval Operation Status.
+  */
+WIFI_Status_t WIFI_GetNetworkSettings(uint8_t *ipaddr, uint8_t *mask, uint8_t *gateway, uint8_t *dns)
+{
+  WIFI_Status_t ret = WIFI_STATUS_ERROR;
+
+  if (EsWifiObj.NetSettings.IsConnected == 1)
+  {
+    memcpy(ipaddr,  EsWifiObj.NetSettings.IP_Addr, 4);
+    memcpy(mask,    EsWifiObj.NetSettings.IP_Mask, 4);
+    memcpy(gateway, EsWifiObj.NetSettings.Gateway_Addr, 4);
+    memcpy(dns,     EsWifiObj.NetSettings.DNS1, 4);
+    ret = WIFI_STATUS_OK;
+  }
+  return ret;
+}
+
+/**
+  * @brief  Use static IP settings for the next joins, which then skip DHCP
+  * @param  ipaddr, mask, gateway, dns : the settings to use
+  * @retval Operation Status.
+  */
+WIFI_Status_t WIFI_SetStaticIP(uint8_t *ipaddr, uint8_t *mask, uint8_t *gateway, uint8_t *dns)
+{
+  WIFI_Status_t ret = WIFI_STATUS_ERROR;
+  ES_WIFI_Network_t settings;
+
+  memset(&settings, 0, sizeof(settings));
+  memcpy(settings.IP_Addr, ipaddr, 4);
+  memcpy(settings.IP_Mask, mask, 4);
+  memcpy(settings.Gateway_Addr, gateway, 4);
+  memcpy(settings.DNS1, dns, 4);
+
+  if(ES_WIFI_SetNetworkSettings(&EsWifiObj, &settings) == ES_WIFI_STATUS_OK)
+  {
+    ret = WIFI_STATUS_OK;
+  }
+  return ret;
+}
+
+/**
+  * @brief  Get the IP settings from DHCP for the next joins
+  * @retval Operation Status.
+  */
+WIFI_Status_t WIFI_EnableDHCP(void)
+{
+  WIFI_Status_t ret = WIFI_STATUS_ERROR;
+  ES_WIFI_Network_t settings;
+
+  memset(&settings, 0, sizeof(settings));
+  settings.DHCP_IsEnabled = 1;
+
+  if(ES_WIFI_SetNetworkSettings(&EsWifiObj, &settings) == ES_WIFI_STATUS_OK)
+  {
+    ret = WIFI_STATUS_OK;
+  }
+  return ret;
+}
+
+/**
+  * @brief  Put the module to sleep, the association is kept
+  * @param  duration : sleep time in ms, the module wakes up on its own after it
+  * @retval Operation Status.
+  */
+WIFI_Status_t WIFI_Sleep(uint32_t duration)
+{
+  WIFI_Status_t ret = WIFI_STATUS_ERROR;
+
+  if(ES_WIFI_EnterSleepMode(&EsWifiObj, duration) == ES_WIFI_STATUS_OK)
+  {
+    ret = WIFI_STATUS_OK;
+  }
+  return ret;
+}
+
+/**
+  * @brief  Wake the module up through its WAKEUP pin
+  * @param  Timeout : time to wait for the module in ms
+  * @param  latency : (OUT) time it took the module to get ready, in us
+  * @retval Operation Status.
+  */
+WIFI_Status_t WIFI_WakeUp(uint32_t Timeout, uint32_t *latency)
+{
+  WIFI_Status_t ret = WIFI_STATUS_ERROR;
+  uint32_t start = SPI_WIFI_GetTimeUs();
+
+#if (ES_WIFI_USE_UART == 1)
+  if(UART_WIFI_WakeUp(Timeout) == 0)
+#else
+  if(SPI_WIFI_WakeUp(Timeout) == 0)
+#endif
+  {
+    ret = WIFI_STATUS_OK;
+  }
+  *latency = SPI_WIFI_GetTimeUs() - start;
+  return ret;
+}
+
 /**
   * @brief  This function retrieves the WiFi interface's MAC address.
   * @retval Operation Status.
@@ -146,6 +397,8 @@ WIFI_Status_t WIFI_GetIP_Address (uint8_t  *ipaddr)
 WIFI_Status_t WIFI_Disconnect(void)
 {
   WIFI_Status_t ret = WIFI_STATUS_ERROR;
+
+  ReadAheadDropAll();
   if( ES_WIFI_Disconnect(&EsWifiObj)== ES_WIFI_STATUS_OK)
   {
     ret = WIFI_STATUS_OK;
@@ -274,6 +527,7 @@ WIFI_Status_t WIFI_OpenClientConnection(uint32_t socket, WIFI_Protocol_t type, c
   conn.RemoteIP[1] = ipaddr[1];
   conn.RemoteIP[2] = ipaddr[2];
   conn.RemoteIP[3] = ipaddr[3];
+  ReadAheadOpen(socket, type);
   if(ES_WIFI_StartClientConnection(&EsWifiObj, &conn)== ES_WIFI_STATUS_OK)
   {
     ret = WIFI_STATUS_OK;
@@ -291,6 +545,7 @@ WIFI_Status_t WIFI_CloseClientConnection(uint32_t socket)
   ES_WIFI_Conn_t conn;
   conn.Number = socket;
   
+  ReadAheadDrop(socket);
   if(ES_WIFI_StopClientConnection(&EsWifiObj, &conn)== ES_WIFI_STATUS_OK)
   {
     ret = WIFI_STATUS_OK;
@@ -313,6 +568,7 @@ WIFI_Status_t WIFI_StartServer(uint32_t socket, WIFI_Protocol_t protocol, uint16
   conn.LocalPort = port;
   conn.Type = (protocol == WIFI_TCP_PROTOCOL)? ES_WIFI_TCP_CONNECTION : ES_WIFI_UDP_CONNECTION;
   conn.Backlog = backlog;
+  ReadAheadOpen(socket, protocol);
   if(ES_WIFI_StartServerSingleConn(&EsWifiObj, &conn)== ES_WIFI_STATUS_OK)
   {
     ret = WIFI_STATUS_OK;
@@ -336,6 +592,8 @@ WIFI_Status_t WIFI_WaitServerConnection(int socket,uint32_t Timeout,uint8_t *Rem
 
   if (ES_WIFI_STATUS_OK == ret)
   {
+    /* a new client, nothing of the previous one is left */
+    ReadAheadDrop(socket);
     if (RemotePort) *RemotePort=conn.RemotePort;
     if (RemoteIp)
     {
@@ -364,6 +622,8 @@ WIFI_Status_t WIFI_WaitServerConnection(int socket,uint32_t Timeout,uint8_t *Rem
 WIFI_Status_t WIFI_CloseServerConnection(int socket)
 {
   WIFI_Status_t ret = WIFI_STATUS_ERROR;
+
+  ReadAheadDrop(socket);
   if (ES_WIFI_STATUS_OK == ES_WIFI_CloseServerConnection(&EsWifiObj,socket))
   {
     ret = WIFI_STATUS_OK;
@@ -380,6 +640,7 @@ WIFI_Status_t WIFI_StopServer(uint32_t socket)
 {
   WIFI_Status_t ret = WIFI_STATUS_ERROR;
   
+  ReadAheadDrop(socket);
   if(ES_WIFI_StopServerSingleConn(&EsWifiObj,socket)== ES_WIFI_STATUS_OK)
   {
     ret = WIFI_STATUS_OK;
@@ -431,15 +692,58 @@ WIFI_Status_t WIFI_SendDataTo(uint8_t socket, uint8_t *pdata, uint16_t Reqlen, u
 
 /**
   * @brief  Receive Data from a socket
+  *         On a TCP socket below WIFI_READAHEAD_SOCKETS the module is asked
+  *         for a whole payload and what the caller has no room for is kept
+  *         for its next reads, which then cost no AT command. The call
+  *         returns what is buffered without waiting for more.
   * @param  pdata : pointer to Rx buffer
   * @param  Reqlen : maximum length of the data to be received
   * @param  RcvDatalen : (OUT) length of the data actually received
-  * @param  Timeout : Socket read timeout (ms)
+  * @param  Timeout : Socket read timeout (ms), when nothing is buffered
   * @retval Operation status
   */
 WIFI_Status_t WIFI_ReceiveData(uint8_t socket, uint8_t *pdata, uint16_t Reqlen, uint16_t *RcvDatalen, uint32_t Timeout)
 {
   WIFI_Status_t ret = WIFI_STATUS_ERROR;
+#if (WIFI_READAHEAD_SOCKETS > 0)
+  WIFI_ReadAhead_t *ra;
+  uint16_t len;
+
+  if ((socket < WIFI_READAHEAD_SOCKETS) && ReadAhead[socket].Stream)
+  {
+    ra = &ReadAhead[socket];
+    ReadAheadStats.Reads++;
+    if ((ra->Count == 0) && (Reqlen < ES_WIFI_PAYLOAD_SIZE))
+    {
+      ReadAheadStats.ModuleReads++;
+      ra->Head = 0;
+      if (ES_WIFI_ReceiveData(&EsWifiObj, socket, ra->Data, ES_WIFI_PAYLOAD_SIZE, &ra->Count, Timeout) != ES_WIFI_STATUS_OK)
+      {
+        ra->Count = 0;
+        *RcvDatalen = 0;
+        return WIFI_STATUS_ERROR;
+      }
+    }
+    if (ra->Count > 0)
+    {
+      len = (Reqlen < ra->Count) ? Reqlen : ra->Count;
+      memcpy(pdata, &ra->Data[ra->Head], len);
+      ra->Head   += len;
+      ra->Count  -= len;
+      *RcvDatalen = len;
+      return WIFI_STATUS_OK;
+    }
+    if (Reqlen < ES_WIFI_PAYLOAD_SIZE)
+    {
+      /* the module had nothing within the timeout */
+      *RcvDatalen = 0;
+      return WIFI_STATUS_OK;
+    }
+    /* nothing buffered and room for a whole payload: no copy */
+    ReadAheadStats.ModuleReads++;
+    ReadAheadStats.Direct++;
+  }
+#endif
 
   if(ES_WIFI_ReceiveData(&EsWifiObj, socket, pdata, Reqlen, RcvDatalen, Timeout) == ES_WIFI_STATUS_OK)
   {
@@ -448,6 +752,33 @@ WIFI_Status_t WIFI_ReceiveData(uint8_t socket, uint8_t *pdata, uint16_t Reqlen,
   return ret;
 }
 
+/**
+  * @brief  Bytes already received for a socket, that WIFI_ReceiveData
+  *         returns without an AT command
+  * @param  socket : socket
+  * @retval Buffered length
+  */
+uint16_t WIFI_ReceivePending(uint8_t socket)
+{
+#if (WIFI_READAHEAD_SOCKETS > 0)
+  if (socket < WIFI_READAHEAD_SOCKETS)
+  {
+    return ReadAhead[socket].Count;
+  }
+#endif
+  return 0;
+}
+
+/**
+  * @brief  Get the read-ahead counters
+  * @param  stats : (OUT) copy of the counters
+  * @retval None
+  */
+void WIFI_GetReadAheadStats(WIFI_ReadAheadStats_t *stats)
+{
+  *stats = ReadAheadStats;
+}
+
 /**
   * @brief  Receive Data from a socket
   * @param  pdata : pointer to Rx buffer
@@ -497,6 +828,7 @@ WIFI_Status_t WIFI_ResetModule(void)
 {
   WIFI_Status_t ret = WIFI_STATUS_ERROR;
   
+  ReadAheadDropAll();
   if(ES_WIFI_ResetModule(&EsWifiObj) == ES_WIFI_STATUS_OK)
   {
       ret = WIFI_STATUS_OK;
@@ -580,4 +912,38 @@ WIFI_Status_t WIFI_GetModuleName(char *ModuleName)
   }
   return ret;
 }
+
+#if (ES_WIFI_USE_STATS == 1)
+/**
+  * @brief  Get the driver transport statistics
+  * @param  stats : (OUT) counters and latency histograms per AT command class
+  * @retval Operation status
+  */
+WIFI_Status_t WIFI_GetStats(ES_WIFI_Stats_t *stats)
+{
+  WIFI_Status_t ret = WIFI_STATUS_ERROR;
+
+  if(ES_WIFI_GetStats(&EsWifiObj, stats) == ES_WIFI_STATUS_OK)
+  {
+    ret = WIFI_STATUS_OK;
+  }
+  return ret;
+}
+
+/**
+  * @brief  Clear the driver transport statistics
+  * @param  None
+  * @retval Operation status
+  */
+WIFI_Status_t WIFI_ResetStats(void)
+{
+  WIFI_Status_t ret = WIFI_STATUS_ERROR;
+
+  if(ES_WIFI_ResetStats(&EsWifiObj) == ES_WIFI_STATUS_OK)
+  {
+    ret = WIFI_STATUS_OK;
+  }
+  return ret;
+}
+#endif
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
@@ -0,0 +1,220 @@
+/**
+  ******************************************************************************
+  * @file    wifi_linkmon.c
+  * @brief   WiFi link quality monitor: RSSI sampling, cached access point
+  *          scan and roaming to a stronger access point of the same SSID.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "wifi_linkmon.h"
+#include <string.h>
+
+/* Private variables ---------------------------------------------------------*/
+static const char   *Ssid;
+static ES_WIFI_APs_t Scan;
+static uint8_t       ScanValid;
+static uint32_t      ScanTick;
+static uint32_t      SampleTick;
+static uint32_t      RoamTick;
+static uint8_t       RoamTried;     /* RoamTick is meaningful */
+static uint8_t       WeakRun;       /* weak samples in a row */
+static LINKMON_Stats_t Stats;
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  Refresh the cached scan
+  * @param  None
+  * @retval Operation status, the cache is empty after a failure
+  */
+static WIFI_Status_t Rescan(void)
+{
+  uint8_t i;
+
+  Stats.Scans++;
+  ScanValid = (WIFI_ScanAccessPoints(&Scan) == WIFI_STATUS_OK);
+  ScanTick  = HAL_GetTick();
+  if (!ScanValid)
+  {
+    Stats.ScanFailures++;
+    return WIFI_STATUS_ERROR;
+  }
+
+  /* the associated access point is in the scan too */
+  Stats.ScanAPs      = 0;
+  Stats.ScanBestRssi = 0;
+  for (i = 0; i < Scan.nbr; i++)
+  {
+    if (strcmp((char *)Scan.AP[i].SSID, Ssid) == 0)
+    {
+      if ((Stats.ScanAPs == 0) || (Scan.AP[i].RSSI > Stats.ScanBestRssi))
+      {
+        Stats.ScanBestRssi = Scan.AP[i].RSSI;
+      }
+      Stats.ScanAPs++;
+    }
+  }
+  return WIFI_STATUS_OK;
+}
+
+/**
+  * @brief  Leave the access point for a stronger one if the scan has one
+  * @param  None
+  * @retval LINKMON_EVENT_NONE when staying
+  */
+static LINKMON_Event_t Roam(void)
+{
+  RoamTick  = HAL_GetTick();
+  RoamTried = 1;
+  WeakRun   = 0;
+
+  if (!ScanValid || ((RoamTick - ScanTick) >= LINKMON_SCAN_MAX_AGE))
+  {
+    if (Rescan() != WIFI_STATUS_OK)
+    {
+      return LINKMON_EVENT_NONE;
+    }
+  }
+
+  /* a scan that saw nothing but the current access point fails here too */
+  if ((Stats.ScanAPs == 0) || (Stats.ScanBestRssi < (Stats.Rssi + LINKMON_ROAM_MARGIN)))
+  {
+    Stats.NoCandidate++;
+    return LINKMON_EVENT_NONE;
+  }
+
+  /* the module does not join while associated */
+  WIFI_Disconnect();
+  if (WIFI_Reconnect() != WIFI_STATUS_OK)
+  {
+    Stats.RoamFailures++;
+    return LINKMON_EVENT_ROAM_FAILED;
+  }
+  Stats.Roams++;
+  SampleTick = HAL_GetTick() - LINKMON_SAMPLE_PERIOD;
+  return LINKMON_EVENT_ROAMED;
+}
+
+/**
+  * @brief  Set up the monitor, nothing is sent until LINKMON_Process
+  * @param  ssid : network name, roaming stays within it
+  * @retval None
+  */
+void LINKMON_Init(const char *ssid)
+{
+  Ssid       = ssid;
+  ScanValid  = 0;
+  RoamTried  = 0;
+  WeakRun    = 0;
+  SampleTick = HAL_GetTick() - LINKMON_SAMPLE_PERIOD;
+  ScanTick   = HAL_GetTick() - LINKMON_SCAN_PERIOD;
+  memset(&Stats, 0, sizeof(Stats));
+}
+
+/**
+  * @brief  Tell the monitor the link came back, it samples again at once and
+  *         starts counting weak samples from zero
+  * @param  None
+  * @retval None
+  */
+void LINKMON_LinkUp(void)
+{
+  WeakRun    = 0;
+  SampleTick = HAL_GetTick() - LINKMON_SAMPLE_PERIOD;
+}
+
+/**
+  * @brief  Sample the link, refresh the scan or roam, whichever is due
+  * @param  None
+  * @retval LINKMON_EVENT_ROAMED after a move to another access point
+  */
+LINKMON_Event_t LINKMON_Process(void)
+{
+  uint32_t now = HAL_GetTick();
+  int16_t  rssi;
+
+  if ((now - SampleTick) < LINKMON_SAMPLE_PERIOD)
+  {
+    return LINKMON_EVENT_NONE;
+  }
+  SampleTick = now;
+
+  if (WIFI_GetRSSI(&rssi) != WIFI_STATUS_OK)
+  {
+    /* not associated any more, that is the supervisor's business */
+    Stats.SampleFailures++;
+    WeakRun = 0;
+    return LINKMON_EVENT_NONE;
+  }
+
+  if ((Stats.Samples == 0) || (rssi < Stats.MinRssi))
+  {
+    Stats.MinRssi = rssi;
+  }
+  if ((Stats.Samples == 0) || (rssi > Stats.MaxRssi))
+  {
+    Stats.MaxRssi = rssi;
+  }
+  Stats.Rssi        = rssi;
+  Stats.TotalRssi  += rssi;
+  Stats.Samples++;
+
+  if (rssi >= LINKMON_WEAK_RSSI)
+  {
+    WeakRun = 0;
+    if ((now - ScanTick) >= LINKMON_SCAN_PERIOD)
+    {
+      Rescan();
+    }
+    return LINKMON_EVENT_NONE;
+  }
+
+  Stats.WeakSamples++;
+  if (WeakRun < 0xFF)
+  {
+    WeakRun++;
+  }
+  if ((WeakRun < LINKMON_WEAK_SAMPLES) ||
+      (RoamTried && ((now - RoamTick) < LINKMON_ROAM_HOLDOFF)))
+  {
+    return LINKMON_EVENT_NONE;
+  }
+  return Roam();
+}
+
+/**
+  * @brief  Last RSSI sample
+  * @param  None
+  * @retval Signal strength in dBm, 0 before the first sample
+  */
+int16_t LINKMON_GetRssi(void)
+{
+  return Stats.Rssi;
+}
+
+/**
+  * @brief  Get the cached access point scan
+  * @param  age : (OUT) time since the scan (ms), may be NULL
+  * @retval Scan, NULL before the first successful one
+  */
+const ES_WIFI_APs_t *LINKMON_GetScan(uint32_t *age)
+{
+  if (!ScanValid)
+  {
+    return NULL;
+  }
+  if (age != NULL)
+  {
+    *age = HAL_GetTick() - ScanTick;
+  }
+  return &Scan;
+}
+
+/**
+  * @brief  Get the link quality counters
+  * @param  stats : (OUT) copy of the counters
+  * @retval None
+  */
+void LINKMON_GetStats(LINKMON_Stats_t *stats)
+{
+  *stats = Stats;
+}
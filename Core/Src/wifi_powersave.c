@@ -0,0 +1,158 @@
+/**
+  ******************************************************************************
+  * @file    wifi_powersave.c
+  * @brief   WiFi module power save: sleep over idle windows, wake-up on the
+  *          window end or on outbound traffic, wake latency measurement.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "wifi_powersave.h"
+#include <string.h>
+
+/* Private variables ---------------------------------------------------------*/
+static uint32_t IdleMs;
+static uint32_t SleepMs;
+static uint8_t  Asleep;
+static uint32_t SleepTick;
+static uint32_t ActivityTick;
+static POWERSAVE_Stats_t Stats;
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  Bring the module back, early or at the end of its sleep window
+  * @param  early : 1 when woken for outbound traffic, the latency is recorded
+  * @retval Operation status
+  */
+static WIFI_Status_t Wake(uint8_t early)
+{
+  WIFI_Status_t ret;
+  uint32_t latency;
+
+  /* the pin edge is harmless if the module already woke up on its own */
+  ret = WIFI_WakeUp(POWERSAVE_WAKE_TIMEOUT, &latency);
+
+  Asleep        = 0;
+  ActivityTick  = HAL_GetTick();
+  Stats.AsleepMs += ActivityTick - SleepTick;
+
+  if (ret != WIFI_STATUS_OK)
+  {
+    Stats.WakeFailures++;
+  }
+  else if (early)
+  {
+    Stats.PinWakes++;
+    Stats.LastWakeUs   = latency;
+    Stats.TotalWakeUs += latency;
+    if (latency > Stats.MaxWakeUs)
+    {
+      Stats.MaxWakeUs = latency;
+    }
+  }
+  else
+  {
+    Stats.TimerWakes++;
+  }
+  return ret;
+}
+
+/**
+  * @brief  Set up power save, the module is taken as awake
+  * @param  idle_ms : time without activity before the module is put to sleep
+  * @param  sleep_ms : sleep window, the module wakes up on its own after it
+  * @retval None
+  */
+void POWERSAVE_Init(uint32_t idle_ms, uint32_t sleep_ms)
+{
+  IdleMs       = idle_ms;
+  SleepMs      = sleep_ms;
+  Asleep       = 0;
+  ActivityTick = HAL_GetTick();
+  memset(&Stats, 0, sizeof(Stats));
+}
+
+/**
+  * @brief  Put the module to sleep or take it out of it, whichever is due
+  * @param  None
+  * @retval WIFI_STATUS_ERROR when the module failed to go to sleep or to
+  *         come back, it is then taken as awake
+  */
+WIFI_Status_t POWERSAVE_Process(void)
+{
+  uint32_t now = HAL_GetTick();
+
+  if (Asleep)
+  {
+    if ((now - SleepTick) < SleepMs)
+    {
+      return WIFI_STATUS_OK;
+    }
+    return Wake(0);
+  }
+
+  if ((now - ActivityTick) < IdleMs)
+  {
+    return WIFI_STATUS_OK;
+  }
+
+  if (WIFI_Sleep(SleepMs) != WIFI_STATUS_OK)
+  {
+    /* try again after another idle window */
+    ActivityTick = now;
+    return WIFI_STATUS_ERROR;
+  }
+  Asleep    = 1;
+  SleepTick = HAL_GetTick();
+  Stats.Sleeps++;
+  return WIFI_STATUS_OK;
+}
+
+/**
+  * @brief  Make sure the module is awake before something goes out, and
+  *         restart the idle window
+  * @param  None
+  * @retval Operation status
+  */
+WIFI_Status_t POWERSAVE_WakeUp(void)
+{
+  if (Asleep)
+  {
+    return Wake(1);
+  }
+  ActivityTick = HAL_GetTick();
+  return WIFI_STATUS_OK;
+}
+
+/**
+  * @brief  Report network activity, the idle window starts again
+  * @param  None
+  * @retval None
+  */
+void POWERSAVE_Touch(void)
+{
+  ActivityTick = HAL_GetTick();
+}
+
+/**
+  * @brief  Module state as of the last power save call
+  * @param  None
+  * @retval 1 when asleep
+  */
+uint8_t POWERSAVE_IsAsleep(void)
+{
+  return Asleep;
+}
+
+/**
+  * @brief  Get the sleep and wake-up counters
+  * @param  stats : (OUT) copy of the counters
+  * @retval None
+  */
+void POWERSAVE_GetStats(POWERSAVE_Stats_t *stats)
+{
+  *stats = Stats;
+  if (Asleep)
+  {
+    stats->AsleepMs += HAL_GetTick() - SleepTick;
+  }
+}
@@ -0,0 +1,210 @@
+/**
+  ******************************************************************************
+  * @file    wifi_supervisor.c
+  * @brief   WiFi link supervisor: first join, association checks and rejoins
+  *          with exponential backoff, reusing what the last join left behind
+  *          (credentials in the module, IP settings of the DHCP lease).
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "wifi_supervisor.h"
+
+/* Private variables ---------------------------------------------------------*/
+static const char *Ssid;
+static const char *Password;
+static WIFI_Ecn_t  Ecn;
+
+static uint8_t  LinkUp;
+static uint8_t  EverUp;
+static uint8_t  Configured;     /* credentials loaded in the module */
+static uint8_t  StaticActive;   /* module set to the cached static settings */
+static uint8_t  CacheValid;
+static uint8_t  CacheIP[4];
+static uint8_t  CacheMask[4];
+static uint8_t  CacheGateway[4];
+static uint8_t  CacheDNS[4];
+
+static uint8_t  Attempts;       /* failed joins since the link was lost */
+static uint8_t  Failures;
+static uint32_t Backoff;
+static uint32_t RetryTick;
+static uint32_t RetryDelay;
+static uint32_t CheckTick;
+static uint32_t Rejoins;
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  One join attempt, the path depends on how many failed before
+  * @param  None
+  * @retval Operation status
+  */
+static WIFI_Status_t Join(void)
+{
+  WIFI_Status_t ret = WIFI_STATUS_OK;
+
+  if (Configured && (Attempts < SUPERVISOR_FAST_ATTEMPTS))
+  {
+    /* the cached settings first, DHCP if they did not do it */
+    if ((Attempts == 0) && CacheValid)
+    {
+      if (!StaticActive)
+      {
+        ret = WIFI_SetStaticIP(CacheIP, CacheMask, CacheGateway, CacheDNS);
+        StaticActive = (ret == WIFI_STATUS_OK);
+      }
+    }
+    else if (StaticActive)
+    {
+      ret = WIFI_EnableDHCP();
+      StaticActive = (ret != WIFI_STATUS_OK);
+    }
+
+    if (ret == WIFI_STATUS_OK)
+    {
+      ret = WIFI_Reconnect();
+    }
+  }
+  else
+  {
+    /* the module comes out of reset with DHCP on and no credentials */
+    Configured   = 0;
+    StaticActive = 0;
+    if (WIFI_Init() != WIFI_STATUS_OK)
+    {
+      return WIFI_STATUS_ERROR;
+    }
+    ret = WIFI_Connect(Ssid, Password, Ecn);
+    /* a failed join still leaves them in the module, a failed C1-C3 does not */
+    Configured = WIFI_HasCredentials();
+  }
+
+  /* a DHCP join refreshes the cache, a static one has nothing new */
+  if ((ret == WIFI_STATUS_OK) && !StaticActive)
+  {
+    CacheValid = (WIFI_GetNetworkSettings(CacheIP, CacheMask, CacheGateway, CacheDNS) == WIFI_STATUS_OK);
+  }
+  return ret;
+}
+
+/**
+  * @brief  Set up the supervisor, the first join is made by SUPERVISOR_Process
+  * @param  ssid : access point name
+  * @param  password : access point password
+  * @param  ecn : security type
+  * @retval None
+  */
+void SUPERVISOR_Init(const char *ssid, const char *password, WIFI_Ecn_t ecn)
+{
+  Ssid         = ssid;
+  Password     = password;
+  Ecn          = ecn;
+  LinkUp       = 0;
+  EverUp       = 0;
+  Configured   = 0;
+  StaticActive = 0;
+  CacheValid   = 0;
+  Attempts     = 0;
+  Failures     = 0;
+  Backoff      = SUPERVISOR_BACKOFF_MIN;
+  RetryTick    = HAL_GetTick();
+  RetryDelay   = 0;
+  Rejoins      = 0;
+}
+
+/**
+  * @brief  Check the link or work on getting it back, whichever is due
+  * @param  None
+  * @retval SUPERVISOR_EVENT_LINK_UP once after every successful join,
+  *         SUPERVISOR_EVENT_LINK_LOST once when the link is found down
+  */
+SUPERVISOR_Event_t SUPERVISOR_Process(void)
+{
+  uint32_t now = HAL_GetTick();
+
+  if (LinkUp)
+  {
+    if ((Failures < SUPERVISOR_MAX_FAILURES) && ((now - CheckTick) < SUPERVISOR_CHECK_PERIOD))
+    {
+      return SUPERVISOR_EVENT_NONE;
+    }
+    CheckTick = now;
+
+    /* the CS reply is not trusted once the application keeps failing */
+    if ((Failures < SUPERVISOR_MAX_FAILURES) && WIFI_IsConnected())
+    {
+      Failures = 0;
+      return SUPERVISOR_EVENT_NONE;
+    }
+
+    /* straight to the full join if the module itself looks unwell */
+    Attempts   = (Failures >= SUPERVISOR_MAX_FAILURES) ? SUPERVISOR_FAST_ATTEMPTS : 0;
+    Failures   = 0;
+    LinkUp     = 0;
+    Backoff    = SUPERVISOR_BACKOFF_MIN;
+    RetryTick  = now;
+    RetryDelay = 0;
+    return SUPERVISOR_EVENT_LINK_LOST;
+  }
+
+  if ((now - RetryTick) < RetryDelay)
+  {
+    return SUPERVISOR_EVENT_NONE;
+  }
+
+  if (Join() != WIFI_STATUS_OK)
+  {
+    if (Attempts < 0xFF)
+    {
+      Attempts++;
+    }
+    RetryTick  = HAL_GetTick();
+    RetryDelay = Backoff;
+    Backoff    = (Backoff >= (SUPERVISOR_BACKOFF_MAX / 2)) ? SUPERVISOR_BACKOFF_MAX : (Backoff * 2);
+    return SUPERVISOR_EVENT_NONE;
+  }
+
+  if (EverUp)
+  {
+    Rejoins++;
+  }
+  EverUp    = 1;
+  LinkUp    = 1;
+  Attempts  = 0;
+  Failures  = 0;
+  CheckTick = HAL_GetTick();
+  return SUPERVISOR_EVENT_LINK_UP;
+}
+
+/**
+  * @brief  Tell the supervisor a socket operation failed, enough of them
+  *         between two association checks and the link is taken as lost
+  * @param  None
+  * @retval None
+  */
+void SUPERVISOR_ReportFailure(void)
+{
+  if (Failures < SUPERVISOR_MAX_FAILURES)
+  {
+    Failures++;
+  }
+}
+
+/**
+  * @brief  Link state as of the last SUPERVISOR_Process
+  * @param  None
+  * @retval 1 when up
+  */
+uint8_t SUPERVISOR_IsLinkUp(void)
+{
+  return LinkUp;
+}
+
+/**
+  * @brief  Number of successful joins after a link loss
+  * @param  None
+  * @retval Rejoin count
+  */
+uint32_t SUPERVISOR_GetRejoins(void)
+{
+  return Rejoins;
+}
@@ -0,0 +1,92 @@
+/**
+  ******************************************************************************
+  * @file    es_wifi_sim.h
+  * @brief   Host-side simulator of the Inventek ISM43362 (ES-WiFi) module.
+  *          The unmodified driver (es_wifi.c, es_wifi_io.c, wifi.c) is linked
+  *          against a HAL stand-in whose SPI3 and control pins talk to a
+  *          model of the module: DRDY handshake, 16-bit frames, 0x15 padding
+  *          and the "> " prompt, with the AT command set used by the driver
+  *          served on top of real host sockets. Time is virtual and advances
+  *          with SPI transfers, module latencies and driver delays, so the
+  *          figures reported are what the target would see, not host timing.
+  ******************************************************************************
+  */
+#ifndef ES_WIFI_SIM_H
+#define ES_WIFI_SIM_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define SIM_MAX_CMD_KINDS       48
+
+typedef struct
+{
+  uint32_t    CmdLatencyUs;     /*!< module processing time of a plain command   */
+  uint32_t    NetLatencyUs;     /*!< extra time of S3/R0 when data moves         */
+  uint32_t    JoinLatencyMs;    /*!< C0 duration                                 */
+  uint32_t    BootMs;           /*!< reset release to prompt                     */
+  uint16_t    PortOffset;       /*!< host port = module server port + offset     */
+  const char *Ssid;             /*!< only this SSID joins, NULL accepts any      */
+  int8_t      Rssi;             /*!< access point joined by default, CR and F0   */
+  int8_t      RoamRssi;         /*!< second access point of the SSID, 0 = none   */
+  int         OldFirmware;      /*!< before C3.5.2.5: the whole F0 in one reply  */
+  double      ErrorRate;        /*!< reply "ERROR" instead of running a command  */
+  double      CorruptRate;      /*!< flip one byte of a reply                    */
+  double      StallRate;        /*!< never answer, DRDY comes back after StallMs */
+  double      StuffingRate;     /*!< answer with endless 0x15 padding            */
+  uint32_t    StallMs;
+  uint32_t    WakeUs;           /*!< end of MS sleep or WAKEUP edge to DRDY high */
+  uint32_t    Seed;
+  int         Verbose;          /*!< trace commands and replies on stderr        */
+  int         RealTime;         /*!< honour R2 timeouts and delays in host time  */
+} SIM_Config_t;
+
+typedef struct
+{
+  uint32_t Commands;
+  uint32_t Frames;              /*!< 16-bit SPI frames in both directions        */
+  uint64_t BytesToModule;
+  uint64_t BytesFromModule;
+  uint64_t SpiBusyNs;
+  uint64_t PayloadSent;         /*!< socket bytes pushed to the network by S3    */
+  uint64_t PayloadReceived;     /*!< socket bytes handed to the driver by R0     */
+  uint32_t Faults;
+  uint32_t Resets;
+  uint32_t Sleeps;              /*!< MS sleeps entered                           */
+  uint64_t SleepNs;             /*!< time spent in them                          */
+  uint32_t Kinds;
+  char     KindName[SIM_MAX_CMD_KINDS][3];
+  uint32_t KindCount[SIM_MAX_CMD_KINDS];
+} SIM_Stats_t;
+
+/* Public API ----------------------------------------------------------------*/
+void     SIM_DefaultConfig(SIM_Config_t *cfg);
+void     SIM_Init(const SIM_Config_t *cfg);
+void     SIM_Shutdown(void);
+uint64_t SIM_NowNs(void);
+void     SIM_GetStats(SIM_Stats_t *stats);
+void     SIM_ResetStats(void);
+void     SIM_PrintStats(FILE *out, const SIM_Stats_t *stats);
+void     SIM_DropLink(int refusals);
+void     SIM_SetRssi(int8_t rssi, int8_t roam_rssi);
+
+/* Simulator internals (sim_hal.c <-> sim_module.c) --------------------------*/
+typedef void (*SIM_EventFn)(int arg);
+
+void     SIM_Schedule(uint64_t at_ns, SIM_EventFn fn, int arg);
+void     SIM_Cancel(SIM_EventFn fn);
+void     SIM_AdvanceTo(uint64_t t_ns);
+double   SIM_Random(void);
+
+void     SIM_Module_Init(const SIM_Config_t *cfg);
+void     SIM_Module_Shutdown(void);
+void     SIM_Module_SetNss(int level);
+void     SIM_Module_SetReset(int level);
+void     SIM_Module_SetWakeup(int level);
+int      SIM_Module_GetDrdy(void);
+void     SIM_Module_Write(const uint8_t *data, int len);
+void     SIM_Module_Read(uint8_t *data, int len, uint64_t done_ns);
+
+extern SIM_Stats_t SIM_Stats;
+
+#endif /* ES_WIFI_SIM_H */
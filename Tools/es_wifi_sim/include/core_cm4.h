@@ -0,0 +1,48 @@
+/**
+  ******************************************************************************
+  * @file    core_cm4.h
+  * @brief   Host stand-in for the Cortex-M4 intrinsics used by the ES-WiFi
+  *          driver. WFI lets the simulator run virtual time up to the next
+  *          event; interrupts are only delivered from the simulator's own
+  *          scheduling points, so masking them is a no-op. The DWT cycle
+  *          counter follows the virtual clock.
+  ******************************************************************************
+  */
+#ifndef SIM_CORE_CM4_H
+#define SIM_CORE_CM4_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#include <stdint.h>
+
+typedef struct
+{
+  uint32_t CTRL;
+  uint32_t CYCCNT;
+} DWT_Type;
+
+typedef struct
+{
+  uint32_t DEMCR;
+} CoreDebug_Type;
+
+void      SIM_WaitForInterrupt(void);
+DWT_Type *SIM_Dwt(void);
+extern CoreDebug_Type SIM_CoreDebug;
+
+#define DWT                         SIM_Dwt()
+#define CoreDebug                   (&SIM_CoreDebug)
+#define DWT_CTRL_CYCCNTENA_Msk      (1UL << 0)
+#define CoreDebug_DEMCR_TRCENA_Msk  (1UL << 24)
+
+#define __disable_irq()         do { } while (0)
+#define __enable_irq()          do { } while (0)
+#define __WFI()                 SIM_WaitForInterrupt()
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SIM_CORE_CM4_H */
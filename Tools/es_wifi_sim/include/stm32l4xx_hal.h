@@ -0,0 +1,163 @@
+/**
+  ******************************************************************************
+  * @file    stm32l4xx_hal.h
+  * @brief   Host stand-in for the subset of the STM32L4 HAL used by the
+  *          ES-WiFi driver (es_wifi.c, es_wifi_io.c, wifi.c). Everything that
+  *          touches SPI3 or the module control pins is routed to the
+  *          simulated module, time is the simulator's virtual clock.
+  ******************************************************************************
+  */
+#ifndef SIM_STM32L4XX_HAL_H
+#define SIM_STM32L4XX_HAL_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef enum
+{
+  HAL_OK       = 0x00,
+  HAL_ERROR    = 0x01,
+  HAL_BUSY     = 0x02,
+  HAL_TIMEOUT  = 0x03
+} HAL_StatusTypeDef;
+
+typedef enum
+{
+  EXTI1_IRQn   = 7,
+  SPI3_IRQn    = 51
+} IRQn_Type;
+
+/* GPIO ----------------------------------------------------------------------*/
+typedef struct
+{
+  uint32_t Port;
+} GPIO_TypeDef;
+
+typedef struct
+{
+  uint32_t Pin;
+  uint32_t Mode;
+  uint32_t Pull;
+  uint32_t Speed;
+  uint32_t Alternate;
+} GPIO_InitTypeDef;
+
+typedef enum
+{
+  GPIO_PIN_RESET = 0,
+  GPIO_PIN_SET
+} GPIO_PinState;
+
+extern GPIO_TypeDef SIM_GPIO[5];
+#define GPIOA                   (&SIM_GPIO[0])
+#define GPIOB                   (&SIM_GPIO[1])
+#define GPIOC                   (&SIM_GPIO[2])
+#define GPIOD                   (&SIM_GPIO[3])
+#define GPIOE                   (&SIM_GPIO[4])
+
+#define GPIO_PIN_0              ((uint16_t)0x0001)
+#define GPIO_PIN_1              ((uint16_t)0x0002)
+#define GPIO_PIN_2              ((uint16_t)0x0004)
+#define GPIO_PIN_3              ((uint16_t)0x0008)
+#define GPIO_PIN_4              ((uint16_t)0x0010)
+#define GPIO_PIN_5              ((uint16_t)0x0020)
+#define GPIO_PIN_6              ((uint16_t)0x0040)
+#define GPIO_PIN_7              ((uint16_t)0x0080)
+#define GPIO_PIN_8              ((uint16_t)0x0100)
+#define GPIO_PIN_9              ((uint16_t)0x0200)
+#define GPIO_PIN_10             ((uint16_t)0x0400)
+#define GPIO_PIN_11             ((uint16_t)0x0800)
+#define GPIO_PIN_12             ((uint16_t)0x1000)
+#define GPIO_PIN_13             ((uint16_t)0x2000)
+#define GPIO_PIN_14             ((uint16_t)0x4000)
+#define GPIO_PIN_15             ((uint16_t)0x8000)
+
+#define GPIO_MODE_INPUT         0x00000000u
+#define GPIO_MODE_OUTPUT_PP     0x00000001u
+#define GPIO_MODE_AF_PP         0x00000002u
+#define GPIO_MODE_IT_RISING     0x10110000u
+#define GPIO_NOPULL             0x00000000u
+#define GPIO_PULLUP             0x00000001u
+#define GPIO_SPEED_FREQ_LOW     0x00000000u
+#define GPIO_SPEED_FREQ_MEDIUM  0x00000001u
+#define GPIO_SPEED_FREQ_HIGH    0x00000002u
+#define GPIO_AF6_SPI3           ((uint8_t)0x06)
+
+void          HAL_GPIO_Init(GPIO_TypeDef *GPIOx, GPIO_InitTypeDef *GPIO_Init);
+void          HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState);
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin);
+
+/* SPI -----------------------------------------------------------------------*/
+#define SPI_CR1_BR_Pos          (3U)
+#define SPI_CR1_BR              (0x7UL << SPI_CR1_BR_Pos)
+
+#define SPI_BAUDRATEPRESCALER_2     (0x00000000U)
+#define SPI_BAUDRATEPRESCALER_4     (0x1UL << SPI_CR1_BR_Pos)
+#define SPI_BAUDRATEPRESCALER_8     (0x2UL << SPI_CR1_BR_Pos)
+#define SPI_BAUDRATEPRESCALER_16    (0x3UL << SPI_CR1_BR_Pos)
+
+#define SPI_MODE_MASTER             1u
+#define SPI_DIRECTION_2LINES        0u
+#define SPI_DATASIZE_16BIT          0x0F00u
+#define SPI_POLARITY_LOW            0u
+#define SPI_PHASE_1EDGE             0u
+#define SPI_NSS_SOFT                0x200u
+#define SPI_FIRSTBIT_MSB            0u
+#define SPI_TIMODE_DISABLE          0u
+#define SPI_CRCCALCULATION_DISABLE  0u
+
+typedef struct
+{
+  uint32_t Mode;
+  uint32_t Direction;
+  uint32_t DataSize;
+  uint32_t CLKPolarity;
+  uint32_t CLKPhase;
+  uint32_t NSS;
+  uint32_t BaudRatePrescaler;
+  uint32_t FirstBit;
+  uint32_t TIMode;
+  uint32_t CRCCalculation;
+  uint32_t CRCPolynomial;
+} SPI_InitTypeDef;
+
+typedef struct
+{
+  void            *Instance;
+  SPI_InitTypeDef  Init;
+} SPI_HandleTypeDef;
+
+#define SPI3                    ((void *)0x40003C00UL)
+
+HAL_StatusTypeDef HAL_SPI_Init(SPI_HandleTypeDef *hspi);
+HAL_StatusTypeDef HAL_SPI_DeInit(SPI_HandleTypeDef *hspi);
+HAL_StatusTypeDef HAL_SPI_Receive(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size, uint32_t Timeout);
+HAL_StatusTypeDef HAL_SPI_Receive_IT(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size);
+HAL_StatusTypeDef HAL_SPI_Transmit_IT(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size);
+void HAL_SPI_RxCpltCallback(SPI_HandleTypeDef *hspi);
+void HAL_SPI_TxCpltCallback(SPI_HandleTypeDef *hspi);
+
+/* RCC / NVIC / time ---------------------------------------------------------*/
+#define __HAL_RCC_SPI3_CLK_ENABLE()   do { } while (0)
+#define __HAL_RCC_GPIOA_CLK_ENABLE()  do { } while (0)
+#define __HAL_RCC_GPIOB_CLK_ENABLE()  do { } while (0)
+#define __HAL_RCC_GPIOC_CLK_ENABLE()  do { } while (0)
+#define __HAL_RCC_GPIOE_CLK_ENABLE()  do { } while (0)
+
+extern uint32_t SystemCoreClock;
+
+uint32_t HAL_RCC_GetPCLK1Freq(void);
+void     HAL_NVIC_SetPriority(IRQn_Type IRQn, uint32_t PreemptPriority, uint32_t SubPriority);
+void     HAL_NVIC_EnableIRQ(IRQn_Type IRQn);
+uint32_t HAL_GetTick(void);
+void     HAL_Delay(uint32_t Delay);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SIM_STM32L4XX_HAL_H */
@@ -0,0 +1,908 @@
+/**
+  ******************************************************************************
+  * @file    sim_bench.c
+  * @brief   Benchmark and regression run of the ES-WiFi driver against the
+  *          simulated module. The scenarios mirror what the firmware does:
+  *           - init + join
+  *           - web server: accept, read the request, send the page, close
+  *           - TCP client: stream to a host listener, replies read back in
+  *             odd sizes and in small reads through the read-ahead
+  *           - UDP: datagrams to a host collector and one reply back
+  *           - MQTT: alarm and sensor publishes through mqtt_client.c, to a
+  *             minimal in-process broker or to a real one (-m)
+  *           - power save: wifi_powersave.c sleeps the module between wake
+  *             windows, an outbound event wakes it early now and then
+  *           - link quality: wifi_linkmon.c samples a weak link, stays
+  *             while the scan has nothing better and roams once a stronger
+  *             access point of the SSID shows up
+  *           - link loss: wifi_supervisor.c rejoins, once on the cached
+  *             settings and once after the access point refused a few joins
+  *          Peers are plain host sockets driven from this process, so every
+  *          figure is reproducible for a given configuration and seed.
+  ******************************************************************************
+  */
+#include <errno.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include "wifi.h"
+#include "mqtt_client.h"
+#include "wifi_supervisor.h"
+#include "wifi_powersave.h"
+#include "wifi_linkmon.h"
+#include "es_wifi_sim.h"
+
+/* Private define ------------------------------------------------------------*/
+#define BENCH_SERVER_PORT       80
+#define BENCH_CHUNK             ES_WIFI_PAYLOAD_SIZE
+#define BENCH_REQUEST           "GET / HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n"
+#define BENCH_UDP_SIZE          64
+#define BENCH_PAGE_MAX          (sizeof(Page) - BENCH_CHUNK)
+#define BENCH_PARSE_SIZE        8192    /* received by a streaming parser ... */
+#define BENCH_PARSE_READ        16      /* ... in reads of this size */
+#define BENCH_MQTT_LOOPS        200     /* MQTT_Process calls before giving up */
+#define BENCH_LOOP_MS           50      /* main loop period, SAMPLE_PERIOD in main.c */
+#define BENCH_REJOIN_LIMIT      300000  /* supervisor time to get the link back (ms) */
+#define BENCH_IDLE_MS           200     /* WIFI_IDLE_MS in main.c */
+#define BENCH_SLEEP_MS          1000    /* WIFI_SLEEP_MS in main.c */
+#define BENCH_EVENT_MS          2300    /* outbound event (alarm) period, off the sleep cycle */
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  int      requests;
+  int      page_size;
+  int      stream_size;
+  int      datagrams;
+  int      publishes;
+  int      broker_port;
+  int      refusals;
+  int      powersave_ms;
+} BENCH_Options_t;
+
+typedef struct
+{
+  int      fd;
+  uint8_t  buf[4096];
+  int      len;
+  int      connects;
+  int      publishes;
+  int      pings;
+} BENCH_Broker_t;
+
+/* Private variables ---------------------------------------------------------*/
+static uint8_t  Page[16384];
+static uint8_t  Buffer[16384];
+static int      Failures;
+
+/* Private functions ---------------------------------------------------------*/
+static void Usage(const char *prog)
+{
+  fprintf(stderr,
+          "usage: %s [options]\n"
+          "  -n N      web requests (default 20)\n"
+          "  -p BYTES  web page size (default 2500)\n"
+          "  -t BYTES  TCP client stream size (default 65536)\n"
+          "  -u N      UDP datagrams (default 50)\n"
+          "  -P N      MQTT sensor updates (default 30)\n"
+          "  -m PORT   use the MQTT broker on 127.0.0.1:PORT (e.g. mosquitto)\n"
+          "  -j N      joins refused after the second link loss (default 3)\n"
+          "  -w MS     power save run length (default 10000)\n"
+          "  -W US     module wake-up latency (default 3000)\n"
+          "  -l US     module command latency (default 300)\n"
+          "  -L US     extra latency of S3/R0 with data (default 1500)\n"
+          "  -o PORT   host port offset for module servers (default 8000)\n"
+          "  -e P      probability of an ERROR reply\n"
+          "  -c P      probability of a corrupted reply\n"
+          "  -s P      probability of a lost reply (stall)\n"
+          "  -x P      probability of endless 0x15 stuffing\n"
+          "  -F        module firmware older than C3.5.2.5 (one-reply scan)\n"
+          "  -S SEED   fault injection seed (default 1)\n"
+          "  -r        honour R2 timeouts and delays in host time\n"
+          "  -v        trace AT traffic on stderr\n", prog);
+}
+
+static void ResetStats(void)
+{
+  SIM_ResetStats();
+  WIFI_ResetStats();
+}
+
+/* the driver's own view (ES_WIFI_GetStats), to cross-check the model's */
+static void PrintDriverStats(void)
+{
+  static const char *name[ES_WIFI_CMD_CLASSES] = { "control", "send", "receive", "accept" };
+  ES_WIFI_Stats_t d;
+  int c;
+
+  WIFI_GetStats(&d);
+  for (c = 0; c < ES_WIFI_CMD_CLASSES; c++)
+  {
+    if (d.Cmd[c].Count)
+    {
+      printf("  %-13s : %u, avg %.1f us, max %u us, %u error(s)\n", name[c], d.Cmd[c].Count,
+             (double)d.Cmd[c].TotalUs / d.Cmd[c].Count, d.Cmd[c].MaxUs, d.Cmd[c].Errors);
+    }
+  }
+  printf("  driver totals : %u bytes out, %u in, %u timeout(s), %u crash(es), %u reset(s)\n",
+         d.BytesOut, d.BytesIn, d.Timeouts, d.Crashes, d.Resets);
+}
+
+static void Report(const char *phase, uint64_t t0)
+{
+  SIM_Stats_t s;
+
+  SIM_GetStats(&s);
+  printf("%s: %.3f ms\n", phase, (SIM_NowNs() - t0) / 1e6);
+  SIM_PrintStats(stdout, &s);
+  PrintDriverStats();
+}
+
+static void Fail(const char *what)
+{
+  printf("  FAIL: %s\n", what);
+  Failures++;
+}
+
+static int TcpConnect(uint16_t port)
+{
+  struct sockaddr_in sa;
+  struct timeval tv = { 2, 0 };
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sin_family = AF_INET;
+  sa.sin_port = htons(port);
+  sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  if (connect(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0)
+  {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static int Listen(int type, uint16_t *port)
+{
+  struct sockaddr_in sa;
+  socklen_t sl = sizeof(sa);
+  int fd = socket(AF_INET, type, 0);
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sin_family = AF_INET;
+  sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if ((bind(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0) ||
+      ((type == SOCK_STREAM) && (listen(fd, 1) < 0)))
+  {
+    close(fd);
+    return -1;
+  }
+  getsockname(fd, (struct sockaddr *)&sa, &sl);
+  *port = ntohs(sa.sin_port);
+  return fd;
+}
+
+/* same read timeout as TcpConnect: a peer lost in a module reset never closes */
+static int Accept(int lfd)
+{
+  struct timeval tv = { 2, 0 };
+  int one = 1;
+  int fd = accept(lfd, NULL, NULL);
+
+  if (fd >= 0)
+  {
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    /* small writes back to the module must not wait for an ACK */
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  }
+  return fd;
+}
+
+static int Drain(int fd, int flags)
+{
+  int total = 0;
+  int n;
+
+  while ((n = recv(fd, Buffer, sizeof(Buffer), flags)) > 0)
+  {
+    total += n;
+  }
+  return total;
+}
+
+/* Page content is repeated for lengths beyond BENCH_PAGE_MAX */
+static int SendAll(uint8_t socket, int len)
+{
+  uint16_t sent;
+  int done = 0;
+
+  while (done < len)
+  {
+    int chunk = (len - done > BENCH_CHUNK) ? BENCH_CHUNK : len - done;
+
+    if ((WIFI_SendData(socket, Page + (done % BENCH_PAGE_MAX), chunk, &sent, 10000) != WIFI_STATUS_OK) || (sent == 0))
+    {
+      return -1;
+    }
+    done += sent;
+  }
+  return done;
+}
+
+static void WebServer(const BENCH_Options_t *opt, uint16_t offset)
+{
+  uint64_t t0 = SIM_NowNs();
+  uint64_t worst = 0;
+  uint8_t  ip[4];
+  uint16_t port, len;
+  int i, fd, got, served = 0;
+
+  ResetStats();
+  if (WIFI_StartServer(0, WIFI_TCP_PROTOCOL, 1, "", BENCH_SERVER_PORT) != WIFI_STATUS_OK)
+  {
+    Fail("start server");
+    return;
+  }
+  for (i = 0; i < opt->requests; i++)
+  {
+    uint64_t t = SIM_NowNs();
+
+    fd = TcpConnect(BENCH_SERVER_PORT + offset);
+    if (fd < 0)
+    {
+      Fail("client connect");
+      break;
+    }
+    send(fd, BENCH_REQUEST, strlen(BENCH_REQUEST), 0);
+
+    if ((WIFI_WaitServerConnection(0, 1000, ip, &port) != WIFI_STATUS_OK) ||
+        (WIFI_ReceiveData(0, Buffer, ES_WIFI_PAYLOAD_SIZE, &len, 1000) != WIFI_STATUS_OK) ||
+        (len != strlen(BENCH_REQUEST)) ||
+        (SendAll(0, opt->page_size) != opt->page_size))
+    {
+      Fail("serve request");
+    }
+    WIFI_CloseServerConnection(0);
+
+    got = Drain(fd, 0);
+    close(fd);
+    if (got == opt->page_size)
+    {
+      served++;
+    }
+    else
+    {
+      printf("  request %d: page %d of %d bytes\n", i, got, opt->page_size);
+    }
+    if (SIM_NowNs() - t > worst)
+    {
+      worst = SIM_NowNs() - t;
+    }
+  }
+  WIFI_StopServer(0);
+
+  Report("web server", t0);
+  printf("  served        : %d/%d, %.3f ms per request (worst %.3f ms)\n", served, opt->requests,
+         opt->requests ? (SIM_NowNs() - t0) / 1e6 / opt->requests : 0.0, worst / 1e6);
+  if (served != opt->requests)
+  {
+    Fail("pages served");
+  }
+}
+
+/* the peer sends back replies of awkward sizes, read with awkward buffer
+   sizes: the payload lands in the caller's buffer, never past Reqlen */
+static int ReceiveBack(int fd)
+{
+  static const uint16_t size[]   = { 1, 2, 9, 64, 65, 1199, 1200, 2500 };
+  static const uint16_t reqlen[] = { 1, 7, 8, 63, 64, 1199, ES_WIFI_PAYLOAD_SIZE, 700 };
+  uint16_t len;
+  int i, got, tries;
+
+  for (i = 0; i < (int)(sizeof(size) / sizeof(size[0])); i++)
+  {
+    send(fd, Page, size[i], 0);
+    for (got = 0, tries = 0; (got < size[i]) && (tries < 4 * size[i]); tries++)
+    {
+      Buffer[got + reqlen[i]] = 0xA5;
+      if (WIFI_ReceiveData(1, Buffer + got, reqlen[i], &len, 100) != WIFI_STATUS_OK)
+      {
+        return -1;
+      }
+      if ((len > reqlen[i]) || (Buffer[got + reqlen[i]] != 0xA5))
+      {
+        printf("  receive       : %u bytes for a %u byte buffer\n", len, reqlen[i]);
+        return -1;
+      }
+      got += len;
+    }
+    if ((got != size[i]) || (memcmp(Buffer, Page, size[i]) != 0))
+    {
+      printf("  receive       : %d of %u bytes, in %u byte reads\n", got, size[i], reqlen[i]);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/* a streaming parser reads a few bytes at a time: the read-ahead keeps the
+   module reads to the bytes received, not to the number of reads */
+static int ParseBack(int fd, WIFI_ReadAheadStats_t *ra)
+{
+  WIFI_ReadAheadStats_t before;
+  uint16_t len;
+  int got, tries;
+
+  WIFI_GetReadAheadStats(&before);
+  send(fd, Page, BENCH_PARSE_SIZE, 0);
+  for (got = 0, tries = 0; (got < BENCH_PARSE_SIZE) && (tries < BENCH_PARSE_SIZE); tries++)
+  {
+    if (WIFI_ReceiveData(1, Buffer + got, BENCH_PARSE_READ, &len, 100) != WIFI_STATUS_OK)
+    {
+      break;
+    }
+    got += len;
+  }
+  WIFI_GetReadAheadStats(ra);
+  ra->Reads       -= before.Reads;
+  ra->ModuleReads -= before.ModuleReads;
+  if ((got != BENCH_PARSE_SIZE) || (memcmp(Buffer, Page, BENCH_PARSE_SIZE) != 0))
+  {
+    printf("  parse         : %d of %d bytes\n", got, BENCH_PARSE_SIZE);
+    return -1;
+  }
+  return 0;
+}
+
+static void TcpClient(const BENCH_Options_t *opt)
+{
+  WIFI_ReadAheadStats_t ra;
+  uint8_t  ip[4] = { 127, 0, 0, 1 };
+  uint64_t t0 = SIM_NowNs();
+  uint16_t port;
+  int lfd, fd, got;
+
+  ResetStats();
+  lfd = Listen(SOCK_STREAM, &port);
+  if (WIFI_OpenClientConnection(1, WIFI_TCP_PROTOCOL, "", ip, port, 0) != WIFI_STATUS_OK)
+  {
+    Fail("open TCP client");
+    close(lfd);
+    return;
+  }
+  fd = Accept(lfd);
+  close(lfd);
+  if (SendAll(1, opt->stream_size) != opt->stream_size)
+  {
+    Fail("stream");
+  }
+  if (ReceiveBack(fd) != 0)
+  {
+    Fail("receive into caller buffers");
+  }
+  if (ParseBack(fd, &ra) != 0)
+  {
+    Fail("receive in small reads");
+  }
+  WIFI_CloseClientConnection(1);
+  got = Drain(fd, 0);
+  close(fd);
+
+  Report("tcp client", t0);
+  printf("  delivered     : %d/%d bytes, %.1f kB/s\n", got, opt->stream_size,
+         got / 1.024 / ((SIM_NowNs() - t0) / 1e6));
+  printf("  read-ahead    : %d bytes in %u reads of %d, %u module read(s)\n",
+         BENCH_PARSE_SIZE, ra.Reads, BENCH_PARSE_READ, ra.ModuleReads);
+  if (ra.ModuleReads > (BENCH_PARSE_SIZE + ES_WIFI_PAYLOAD_SIZE - 1) / ES_WIFI_PAYLOAD_SIZE + 2)
+  {
+    Fail("module reads per byte received");
+  }
+  if (got != opt->stream_size)
+  {
+    Fail("stream delivered");
+  }
+}
+
+static void Udp(const BENCH_Options_t *opt)
+{
+  struct sockaddr_in from;
+  socklen_t sl = sizeof(from);
+  uint8_t  ip[4] = { 127, 0, 0, 1 };
+  uint8_t  peer[4];
+  uint64_t t0 = SIM_NowNs();
+  uint16_t port, peer_port, sent, len = 0;
+  int fd, i, n, got = 0;
+
+  ResetStats();
+  fd = Listen(SOCK_DGRAM, &port);
+  if (WIFI_OpenClientConnection(2, WIFI_UDP_PROTOCOL, "", ip, port, 0) != WIFI_STATUS_OK)
+  {
+    Fail("open UDP socket");
+    close(fd);
+    return;
+  }
+  for (i = 0; i < opt->datagrams; i++)
+  {
+    memset(Buffer, i, BENCH_UDP_SIZE);
+    if ((WIFI_SendDataTo(2, Buffer, BENCH_UDP_SIZE, &sent, 1000, ip, port) != WIFI_STATUS_OK) ||
+        (sent != BENCH_UDP_SIZE))
+    {
+      Fail("datagram send");
+    }
+  }
+  while ((n = recvfrom(fd, Buffer, sizeof(Buffer), MSG_DONTWAIT, (struct sockaddr *)&from, &sl)) > 0)
+  {
+    got++;
+  }
+
+  /* one reply back to the module, read with its sender address */
+  if (got > 0)
+  {
+    sendto(fd, "pong", 4, 0, (struct sockaddr *)&from, sl);
+    if ((WIFI_ReceiveDataFrom(2, Buffer, ES_WIFI_PAYLOAD_SIZE, &len, 100, peer, &peer_port) != WIFI_STATUS_OK) ||
+        (len != 4) || (peer_port != port))
+    {
+      Fail("datagram receive");
+    }
+  }
+  WIFI_CloseClientConnection(2);
+  close(fd);
+
+  Report("udp", t0);
+  printf("  delivered     : %d/%d datagrams, reply %u bytes\n", got, opt->datagrams, len);
+  if (got != opt->datagrams)
+  {
+    Fail("datagrams delivered");
+  }
+}
+
+/* Broker side of the MQTT run: CONNACK, PUBACK and PINGRESP, nothing else */
+static void BrokerPoll(BENCH_Broker_t *b)
+{
+  uint8_t  reply[4];
+  uint32_t remaining, multiplier;
+  int n, hdr, pos, tlen;
+
+  if (b->fd < 0)
+  {
+    return;
+  }
+  while ((n = recv(b->fd, b->buf + b->len, sizeof(b->buf) - b->len, MSG_DONTWAIT)) > 0)
+  {
+    b->len += n;
+  }
+  while (b->len >= 2)
+  {
+    remaining  = 0;
+    multiplier = 1;
+    hdr = 1;
+    do
+    {
+      if (hdr >= b->len)
+      {
+        return;
+      }
+      remaining += (b->buf[hdr] & 0x7F) * multiplier;
+      multiplier *= 128;
+    } while (b->buf[hdr++] & 0x80);
+    if (hdr + (int)remaining > b->len)
+    {
+      return;
+    }
+
+    switch (b->buf[0] >> 4)
+    {
+      case 1:
+        b->connects++;
+        reply[0] = 0x20; reply[1] = 2; reply[2] = 0; reply[3] = 0;
+        send(b->fd, reply, 4, 0);
+        break;
+      case 3:
+        b->publishes++;
+        if (((b->buf[0] >> 1) & 3) == 1)
+        {
+          tlen = (b->buf[hdr] << 8) | b->buf[hdr + 1];
+          reply[0] = 0x40; reply[1] = 2;
+          reply[2] = b->buf[hdr + 2 + tlen];
+          reply[3] = b->buf[hdr + 3 + tlen];
+          send(b->fd, reply, 4, 0);
+        }
+        break;
+      case 12:
+        b->pings++;
+        reply[0] = 0xD0; reply[1] = 0;
+        send(b->fd, reply, 2, 0);
+        break;
+      default:
+        break;
+    }
+    pos = hdr + remaining;
+    memmove(b->buf, b->buf + pos, b->len - pos);
+    b->len -= pos;
+  }
+}
+
+static int MqttWait(BENCH_Broker_t *b, int pings)
+{
+  int i;
+
+  for (i = 0; i < BENCH_MQTT_LOOPS; i++)
+  {
+    BrokerPoll(b);
+    if ((MQTT_GetState() == MQTT_STATE_CONNECTED) && (MQTT_GetPending() == 0) &&
+        ((b->fd < 0) || (b->pings >= pings)))
+    {
+      /* one more pass for a PINGRESP still on its way */
+      MQTT_Process();
+      return 0;
+    }
+    MQTT_Process();
+  }
+  return -1;
+}
+
+static void Mqtt(const BENCH_Options_t *opt)
+{
+  BENCH_Broker_t broker;
+  uint8_t  ip[4] = { 127, 0, 0, 1 };
+  uint64_t t0 = SIM_NowNs();
+  uint16_t port;
+  char     value[16];
+  int lfd = -1, i, sent = 0;
+  SIM_Stats_t s;
+
+  memset(&broker, 0, sizeof(broker));
+  broker.fd = -1;
+  ResetStats();
+  if (opt->broker_port)
+  {
+    port = opt->broker_port;
+  }
+  else
+  {
+    lfd = Listen(SOCK_STREAM, &port);
+  }
+
+  MQTT_Init(ip, port, "es_wifi_bench", 60);
+  MQTT_Process();
+  if (lfd >= 0)
+  {
+    /* nobody to accept if the module could not even open the socket */
+    if (MQTT_GetState() != MQTT_STATE_DISCONNECTED)
+    {
+      broker.fd = Accept(lfd);
+    }
+    close(lfd);
+  }
+  if (MqttWait(&broker, 0) != 0)
+  {
+    Fail("MQTT connect");
+    MQTT_Disconnect();
+    if (broker.fd >= 0)
+    {
+      close(broker.fd);
+    }
+    return;
+  }
+
+  /* alarm transition first, then sensor updates packed two per send */
+  if ((MQTT_Publish("bench/alarm", (const uint8_t *)"TRIGGERED", 9, MQTT_QOS1, 1) == WIFI_STATUS_OK) &&
+      (MQTT_Flush() == WIFI_STATUS_OK))
+  {
+    sent++;
+  }
+  for (i = 0; i < opt->publishes; i++)
+  {
+    snprintf(value, sizeof(value), "%d", 100 + i);
+    sent += (MQTT_Publish("bench/distance", (const uint8_t *)value, strlen(value), MQTT_QOS0, 1) == WIFI_STATUS_OK);
+    sent += (MQTT_Publish("bench/temperature", (const uint8_t *)"72", 2, MQTT_QOS0, 1) == WIFI_STATUS_OK);
+    MQTT_Process();
+    BrokerPoll(&broker);
+  }
+  if (MqttWait(&broker, 0) != 0)
+  {
+    Fail("MQTT PUBACK");
+  }
+
+  /* idle past half the keep-alive: one PINGREQ/PINGRESP */
+  HAL_Delay(31000);
+  MQTT_Process();
+  if ((MqttWait(&broker, 1) != 0) || (MQTT_GetState() != MQTT_STATE_CONNECTED))
+  {
+    Fail("MQTT keep-alive");
+  }
+  MQTT_Disconnect();
+  if (broker.fd >= 0)
+  {
+    close(broker.fd);
+  }
+
+  SIM_GetStats(&s);
+  Report("mqtt", t0);
+  printf("  published     : %d queued", sent);
+  if (broker.fd >= 0)
+  {
+    printf(", %d received by the broker, %d ping(s)", broker.publishes, broker.pings);
+  }
+  printf(", %.2f AT commands per message\n", sent ? (double)s.Commands / sent : 0.0);
+  if ((sent != 1 + 2 * opt->publishes) || ((broker.fd >= 0) && (broker.publishes != sent)))
+  {
+    Fail("MQTT messages delivered");
+  }
+}
+
+/* the main loop with power save on: commands only in the wake windows, an
+   outbound event every BENCH_EVENT_MS wakes the module early */
+static void PowerSave(const BENCH_Options_t *opt)
+{
+  POWERSAVE_Stats_t ps;
+  SIM_Stats_t s;
+  uint64_t t0;
+  uint32_t start, event;
+
+  ResetStats();
+  t0 = SIM_NowNs();
+  POWERSAVE_Init(BENCH_IDLE_MS, BENCH_SLEEP_MS);
+  start = event = HAL_GetTick();
+  while ((HAL_GetTick() - start) < (uint32_t)opt->powersave_ms)
+  {
+    if (POWERSAVE_Process() != WIFI_STATUS_OK)
+    {
+      Fail("power save sleep or timer wake-up");
+    }
+    if ((HAL_GetTick() - event) >= BENCH_EVENT_MS)
+    {
+      event = HAL_GetTick();
+      if ((POWERSAVE_WakeUp() != WIFI_STATUS_OK) || !WIFI_IsConnected())
+      {
+        Fail("command after a pin wake-up");
+      }
+    }
+    else if (!POWERSAVE_IsAsleep() && !WIFI_IsConnected())
+    {
+      Fail("command in a wake window");
+    }
+    HAL_Delay(BENCH_LOOP_MS);
+  }
+  if (POWERSAVE_WakeUp() != WIFI_STATUS_OK)
+  {
+    Fail("final wake-up");
+  }
+  Report("power save", t0);
+
+  POWERSAVE_GetStats(&ps);
+  SIM_GetStats(&s);
+  printf("  power save    : %u sleep(s), asleep %.1f %% of the time, woken %u time(s) on timer, %u on pin\n",
+         ps.Sleeps, 100.0 * s.SleepNs / (double)(SIM_NowNs() - t0), ps.TimerWakes, ps.PinWakes);
+  printf("  wake latency  : avg %.1f us, max %u us (pin edge to module ready)\n",
+         ps.PinWakes ? (double)ps.TotalWakeUs / ps.PinWakes : 0.0, ps.MaxWakeUs);
+  if ((ps.Sleeps == 0) || (ps.TimerWakes == 0) || (ps.PinWakes == 0) || (ps.WakeFailures != 0))
+  {
+    Fail("power save cycle");
+  }
+}
+
+/* runs the link monitor the way the main loop does until it reports event */
+static int LinkMonWait(LINKMON_Event_t event, uint32_t limit_ms)
+{
+  uint32_t start = HAL_GetTick();
+
+  while ((HAL_GetTick() - start) < limit_ms)
+  {
+    if (LINKMON_Process() == event)
+    {
+      return 0;
+    }
+    HAL_Delay(BENCH_LOOP_MS);
+  }
+  return -1;
+}
+
+/* a weak link with nothing better around is left alone, a second access
+   point of the SSID well above it is roamed to */
+static void LinkMonitor(void)
+{
+  LINKMON_Stats_t lm;
+  uint64_t t0;
+  int16_t rssi;
+
+  ResetStats();
+  t0 = SIM_NowNs();
+  LINKMON_Init("sim");
+  SIM_SetRssi(-82, 0);
+  if (LinkMonWait(LINKMON_EVENT_ROAMED, (LINKMON_WEAK_SAMPLES + 1) * LINKMON_SAMPLE_PERIOD) == 0)
+  {
+    Fail("roam without a candidate");
+  }
+
+  SIM_SetRssi(-82, -50);
+  if (LinkMonWait(LINKMON_EVENT_ROAMED, LINKMON_ROAM_HOLDOFF + 2 * LINKMON_SAMPLE_PERIOD) != 0)
+  {
+    Report("link quality", t0);
+    Fail("roam to the stronger access point");
+    return;
+  }
+  Report("link quality", t0);
+
+  LINKMON_GetStats(&lm);
+  printf("  link quality  : %u sample(s), %u weak, %u scan(s), %u without a candidate, %u roam(s)\n",
+         lm.Samples, lm.WeakSamples, lm.Scans, lm.NoCandidate, lm.Roams);
+  if ((WIFI_GetRSSI(&rssi) != WIFI_STATUS_OK) || (rssi != -50))
+  {
+    Fail("signal after the roam");
+  }
+  else
+  {
+    printf("  after roam    : %d dBm, the scan had %u access point(s) of the network\n", rssi, lm.ScanAPs);
+  }
+  if ((lm.NoCandidate == 0) || (lm.Roams != 1) || (lm.ScanAPs != 2))
+  {
+    Fail("link quality counters");
+  }
+
+  /* what main.c does on LINKMON_EVENT_ROAMED */
+  if ((WIFI_StartServer(0, WIFI_TCP_PROTOCOL, 1, "", BENCH_SERVER_PORT) != WIFI_STATUS_OK) ||
+      (WIFI_StopServer(0) != WIFI_STATUS_OK))
+  {
+    Fail("server restart after roam");
+  }
+  SIM_SetRssi(-55, 0);
+}
+
+/* runs the supervisor the way the main loop does until it reports event */
+static int SupervisorWait(SUPERVISOR_Event_t event, uint32_t limit_ms)
+{
+  uint32_t start = HAL_GetTick();
+
+  while ((HAL_GetTick() - start) < limit_ms)
+  {
+    if (SUPERVISOR_Process() == event)
+    {
+      return 0;
+    }
+    HAL_Delay(BENCH_LOOP_MS);
+  }
+  return -1;
+}
+
+static void Rejoin(const char *phase, int refusals)
+{
+  uint64_t t0;
+  uint32_t lost;
+
+  SIM_DropLink(refusals);
+  ResetStats();
+  t0 = SIM_NowNs();
+  if (SupervisorWait(SUPERVISOR_EVENT_LINK_LOST, 2 * SUPERVISOR_CHECK_PERIOD) != 0)
+  {
+    Fail("link loss detected");
+    return;
+  }
+  lost = HAL_GetTick();
+  if (SupervisorWait(SUPERVISOR_EVENT_LINK_UP, BENCH_REJOIN_LIMIT) != 0)
+  {
+    Report(phase, t0);
+    Fail("rejoin");
+    return;
+  }
+  Report(phase, t0);
+  printf("  link back     : %lu ms after the loss was seen\n", (unsigned long)(HAL_GetTick() - lost));
+
+  /* what main.c does on SUPERVISOR_EVENT_LINK_UP */
+  if ((WIFI_StartServer(0, WIFI_TCP_PROTOCOL, 1, "", BENCH_SERVER_PORT) != WIFI_STATUS_OK) ||
+      (WIFI_StopServer(0) != WIFI_STATUS_OK))
+  {
+    Fail("server restart after rejoin");
+  }
+}
+
+static void Supervisor(const BENCH_Options_t *opt)
+{
+  uint64_t t0;
+
+  SUPERVISOR_Init("sim", "simsimsim", WIFI_ECN_WPA2_PSK);
+  ResetStats();
+  t0 = SIM_NowNs();
+  if (SupervisorWait(SUPERVISOR_EVENT_LINK_UP, BENCH_REJOIN_LIMIT) != 0)
+  {
+    Report("supervisor join", t0);
+    Fail("supervisor join");
+    return;
+  }
+  Report("supervisor join", t0);
+
+  Rejoin("rejoin, cached settings", 0);
+  Rejoin("rejoin, after refused joins", opt->refusals);
+  if (SUPERVISOR_GetRejoins() != 2)
+  {
+    Fail("rejoin count");
+  }
+}
+
+/* Exported functions --------------------------------------------------------*/
+int main(int argc, char **argv)
+{
+  BENCH_Options_t opt = { 20, 2500, 65536, 50, 30, 0, 3, 10000 };
+  SIM_Config_t cfg;
+  uint64_t t0;
+  uint8_t ip[4];
+  int c, i;
+
+  SIM_DefaultConfig(&cfg);
+  while ((c = getopt(argc, argv, "n:p:t:u:P:m:j:w:W:l:L:o:e:c:s:x:S:Frvh")) != -1)
+  {
+    switch (c)
+    {
+      case 'n': opt.requests     = atoi(optarg); break;
+      case 'p': opt.page_size    = atoi(optarg); break;
+      case 't': opt.stream_size  = atoi(optarg); break;
+      case 'u': opt.datagrams    = atoi(optarg); break;
+      case 'P': opt.publishes    = atoi(optarg); break;
+      case 'm': opt.broker_port  = atoi(optarg); break;
+      case 'j': opt.refusals     = atoi(optarg); break;
+      case 'w': opt.powersave_ms = atoi(optarg); break;
+      case 'W': cfg.WakeUs       = atoi(optarg); break;
+      case 'l': cfg.CmdLatencyUs = atoi(optarg); break;
+      case 'L': cfg.NetLatencyUs = atoi(optarg); break;
+      case 'o': cfg.PortOffset   = atoi(optarg); break;
+      case 'e': cfg.ErrorRate    = atof(optarg); break;
+      case 'c': cfg.CorruptRate  = atof(optarg); break;
+      case 's': cfg.StallRate    = atof(optarg); break;
+      case 'x': cfg.StuffingRate = atof(optarg); break;
+      case 'S': cfg.Seed         = atoi(optarg); break;
+      case 'F': cfg.OldFirmware  = 1; break;
+      case 'r': cfg.RealTime     = 1; break;
+      case 'v': cfg.Verbose      = 1; break;
+      default:  Usage(argv[0]); return 2;
+    }
+  }
+  if ((opt.page_size <= 0) || (opt.page_size > (int)BENCH_PAGE_MAX) || (opt.stream_size <= 0))
+  {
+    Usage(argv[0]);
+    return 2;
+  }
+  for (i = 0; i < (int)sizeof(Page); i++)
+  {
+    Page[i] = 'a' + (i % 26);
+  }
+
+  SIM_Init(&cfg);
+
+  t0 = SIM_NowNs();
+  if ((WIFI_Init() != WIFI_STATUS_OK) ||
+      (WIFI_Connect("sim", "simsimsim", WIFI_ECN_WPA2_PSK) != WIFI_STATUS_OK) ||
+      (WIFI_GetIP_Address(ip) != WIFI_STATUS_OK))
+  {
+    Report("init", t0);
+    Fail("init/join");
+    SIM_Shutdown();
+    return 1;
+  }
+  Report("init + join", t0);
+  printf("  SPI clock     : %lu Hz, IP %d.%d.%d.%d\n", (unsigned long)SPI_WIFI_GetClock(),
+         ip[0], ip[1], ip[2], ip[3]);
+
+  WebServer(&opt, cfg.PortOffset);
+  TcpClient(&opt);
+  Udp(&opt);
+  Mqtt(&opt);
+  PowerSave(&opt);
+  LinkMonitor();
+  Supervisor(&opt);
+
+  SIM_Shutdown();
+  printf("%s: %d failure(s)\n", Failures ? "FAILED" : "PASSED", Failures);
+
+  /* with faults injected the figures are what matter, not a clean run */
+  if ((cfg.ErrorRate > 0) || (cfg.CorruptRate > 0) || (cfg.StallRate > 0) || (cfg.StuffingRate > 0))
+  {
+    return 0;
+  }
+  return Failures ? 1 : 0;
+}
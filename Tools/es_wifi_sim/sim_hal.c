@@ -0,0 +1,353 @@
+/**
+  ******************************************************************************
+  * @file    sim_hal.c
+  * @brief   HAL stand-in and virtual clock of the ES-WiFi simulator.
+  *          Events (DRDY edges, SPI transfer completions) are kept in a small
+  *          time-ordered queue and run from the points where the firmware
+  *          would notice them: HAL_GetTick, HAL_Delay, WFI and blocking SPI.
+  ******************************************************************************
+  */
+#include <string.h>
+#include <time.h>
+#include "stm32l4xx_hal.h"
+#include "core_cm4.h"
+#include "es_wifi_io.h"
+#include "es_wifi_sim.h"
+
+/* Private define ------------------------------------------------------------*/
+#define SIM_MAX_EVENTS          16
+#define SIM_PCLK1_HZ            80000000UL
+#define SIM_TICK_COST_NS        1000ULL      /* one pass of a polling loop */
+#define NS_PER_MS               1000000ULL
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  uint64_t    at;
+  uint32_t    seq;
+  SIM_EventFn fn;
+  int         arg;
+} SIM_Event_t;
+
+/* Private variables ---------------------------------------------------------*/
+GPIO_TypeDef SIM_GPIO[5];
+uint32_t     SystemCoreClock = 80000000UL;
+SIM_Stats_t  SIM_Stats;
+CoreDebug_Type SIM_CoreDebug;
+
+static SIM_Config_t Config;
+static uint64_t     Now;
+static uint32_t     Seq;
+static SIM_Event_t  Events[SIM_MAX_EVENTS];
+static int          EventCount;
+static uint32_t     RngState;
+static DWT_Type     Dwt;
+
+/* Private functions ---------------------------------------------------------*/
+static void SIM_SleepReal(uint64_t ns)
+{
+  struct timespec ts;
+
+  if (!Config.RealTime || (ns == 0))
+  {
+    return;
+  }
+  ts.tv_sec  = ns / 1000000000ULL;
+  ts.tv_nsec = ns % 1000000000ULL;
+  nanosleep(&ts, NULL);
+}
+
+static int SIM_NextEvent(void)
+{
+  int i, best = -1;
+
+  for (i = 0; i < EventCount; i++)
+  {
+    if ((best < 0) || (Events[i].at < Events[best].at) ||
+        ((Events[i].at == Events[best].at) && (Events[i].seq < Events[best].seq)))
+    {
+      best = i;
+    }
+  }
+  return best;
+}
+
+static void SIM_SpiRxDone(int arg)
+{
+  (void)arg;
+  HAL_SPI_RxCpltCallback(NULL);
+}
+
+static void SIM_SpiTxDone(int arg)
+{
+  (void)arg;
+  HAL_SPI_TxCpltCallback(NULL);
+}
+
+static uint64_t SIM_FrameNs(SPI_HandleTypeDef *h)
+{
+  uint32_t div = 2U << ((h->Init.BaudRatePrescaler & SPI_CR1_BR) >> SPI_CR1_BR_Pos);
+
+  return (16ULL * 1000000000ULL * div) / SIM_PCLK1_HZ;
+}
+
+/* Exported functions: simulator ---------------------------------------------*/
+void SIM_Schedule(uint64_t at_ns, SIM_EventFn fn, int arg)
+{
+  if (EventCount == SIM_MAX_EVENTS)
+  {
+    fprintf(stderr, "sim: event queue full\n");
+    return;
+  }
+  Events[EventCount].at  = (at_ns < Now) ? Now : at_ns;
+  Events[EventCount].seq = Seq++;
+  Events[EventCount].fn  = fn;
+  Events[EventCount].arg = arg;
+  EventCount++;
+}
+
+void SIM_Cancel(SIM_EventFn fn)
+{
+  int i = 0;
+
+  while (i < EventCount)
+  {
+    if (Events[i].fn == fn)
+    {
+      Events[i] = Events[--EventCount];
+    }
+    else
+    {
+      i++;
+    }
+  }
+}
+
+void SIM_AdvanceTo(uint64_t t_ns)
+{
+  int i;
+  SIM_Event_t ev;
+
+  while (((i = SIM_NextEvent()) >= 0) && (Events[i].at <= t_ns))
+  {
+    ev = Events[i];
+    Events[i] = Events[--EventCount];
+    if (ev.at > Now)
+    {
+      Now = ev.at;
+    }
+    ev.fn(ev.arg);
+  }
+  if (t_ns > Now)
+  {
+    Now = t_ns;
+  }
+}
+
+double SIM_Random(void)
+{
+  /* xorshift32, reproducible for a given seed */
+  RngState ^= RngState << 13;
+  RngState ^= RngState >> 17;
+  RngState ^= RngState << 5;
+  return (double)RngState / 4294967296.0;
+}
+
+void SIM_DefaultConfig(SIM_Config_t *cfg)
+{
+  memset(cfg, 0, sizeof(*cfg));
+  cfg->CmdLatencyUs  = 300;
+  cfg->NetLatencyUs  = 1500;
+  cfg->JoinLatencyMs = 1500;
+  cfg->BootMs        = 50;
+  cfg->PortOffset    = 8000;
+  cfg->Rssi          = -55;
+  cfg->RoamRssi      = 0;
+  cfg->StallMs       = 40000;
+  cfg->WakeUs        = 3000;
+  cfg->Seed          = 1;
+}
+
+void SIM_Init(const SIM_Config_t *cfg)
+{
+  Config     = *cfg;
+  Now        = 0;
+  Seq        = 0;
+  EventCount = 0;
+  RngState   = cfg->Seed ? cfg->Seed : 1;
+  memset(&SIM_Stats, 0, sizeof(SIM_Stats));
+  SIM_Module_Init(cfg);
+}
+
+void SIM_Shutdown(void)
+{
+  SIM_Module_Shutdown();
+}
+
+uint64_t SIM_NowNs(void)
+{
+  return Now;
+}
+
+void SIM_GetStats(SIM_Stats_t *stats)
+{
+  *stats = SIM_Stats;
+}
+
+void SIM_ResetStats(void)
+{
+  memset(&SIM_Stats, 0, sizeof(SIM_Stats));
+}
+
+void SIM_PrintStats(FILE *out, const SIM_Stats_t *s)
+{
+  uint32_t i;
+
+  fprintf(out, "  AT commands   : %u\n", s->Commands);
+  fprintf(out, "  SPI frames    : %u (%llu bytes out, %llu bytes in)\n", s->Frames,
+          (unsigned long long)s->BytesToModule, (unsigned long long)s->BytesFromModule);
+  fprintf(out, "  SPI busy      : %.3f ms\n", s->SpiBusyNs / 1e6);
+  fprintf(out, "  socket bytes  : %llu sent, %llu received\n",
+          (unsigned long long)s->PayloadSent, (unsigned long long)s->PayloadReceived);
+  fprintf(out, "  faults/resets : %u/%u\n", s->Faults, s->Resets);
+  if (s->Sleeps)
+  {
+    fprintf(out, "  module sleep  : %u time(s), %.3f ms\n", s->Sleeps, s->SleepNs / 1e6);
+  }
+  fprintf(out, "  per command   :");
+  for (i = 0; i < s->Kinds; i++)
+  {
+    fprintf(out, " %s=%u", s->KindName[i], s->KindCount[i]);
+  }
+  fprintf(out, "\n");
+}
+
+DWT_Type *SIM_Dwt(void)
+{
+  /* CYCCNT is read-only here: it always reflects the virtual clock */
+  Dwt.CYCCNT = (uint32_t)((Now * (SystemCoreClock / 1000000UL)) / 1000ULL);
+  return &Dwt;
+}
+
+void SIM_WaitForInterrupt(void)
+{
+  uint64_t systick = (Now / NS_PER_MS + 1) * NS_PER_MS;
+  uint64_t target  = systick;
+  int i = SIM_NextEvent();
+
+  if ((i >= 0) && (Events[i].at < target))
+  {
+    target = Events[i].at;
+  }
+  SIM_SleepReal(target - Now);
+  SIM_AdvanceTo(target);
+}
+
+/* Exported functions: HAL ---------------------------------------------------*/
+uint32_t HAL_GetTick(void)
+{
+  SIM_AdvanceTo(Now + SIM_TICK_COST_NS);
+  return (uint32_t)(Now / NS_PER_MS);
+}
+
+void HAL_Delay(uint32_t Delay)
+{
+  uint64_t target = Now + (uint64_t)(Delay + 1) * NS_PER_MS;
+
+  SIM_SleepReal(target - Now);
+  SIM_AdvanceTo(target);
+}
+
+uint32_t HAL_RCC_GetPCLK1Freq(void)
+{
+  return SIM_PCLK1_HZ;
+}
+
+void HAL_NVIC_SetPriority(IRQn_Type IRQn, uint32_t PreemptPriority, uint32_t SubPriority)
+{
+  (void)IRQn; (void)PreemptPriority; (void)SubPriority;
+}
+
+void HAL_NVIC_EnableIRQ(IRQn_Type IRQn)
+{
+  (void)IRQn;
+}
+
+void HAL_GPIO_Init(GPIO_TypeDef *GPIOx, GPIO_InitTypeDef *GPIO_Init)
+{
+  (void)GPIOx; (void)GPIO_Init;
+}
+
+void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState)
+{
+  if (GPIOx == GPIOE)
+  {
+    if (GPIO_Pin & GPIO_PIN_0)
+    {
+      SIM_Module_SetNss(PinState == GPIO_PIN_SET);
+    }
+    if (GPIO_Pin & GPIO_PIN_8)
+    {
+      SIM_Module_SetReset(PinState == GPIO_PIN_SET);
+    }
+  }
+  else if ((GPIOx == GPIOB) && (GPIO_Pin & GPIO_PIN_13))
+  {
+    SIM_Module_SetWakeup(PinState == GPIO_PIN_SET);
+  }
+}
+
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin)
+{
+  if ((GPIOx == GPIOE) && (GPIO_Pin == GPIO_PIN_1))
+  {
+    return SIM_Module_GetDrdy() ? GPIO_PIN_SET : GPIO_PIN_RESET;
+  }
+  return GPIO_PIN_RESET;
+}
+
+HAL_StatusTypeDef HAL_SPI_Init(SPI_HandleTypeDef *hspi)
+{
+  (void)hspi;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_SPI_DeInit(SPI_HandleTypeDef *hspi)
+{
+  (void)hspi;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_SPI_Receive(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size, uint32_t Timeout)
+{
+  uint64_t done = Now + Size * SIM_FrameNs(hspi);
+
+  (void)Timeout;
+  SIM_Module_Read(pData, 2 * Size, done);
+  SIM_Stats.Frames += Size;
+  SIM_Stats.SpiBusyNs += done - Now;
+  SIM_AdvanceTo(done);
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_SPI_Receive_IT(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size)
+{
+  uint64_t done = Now + Size * SIM_FrameNs(hspi);
+
+  SIM_Module_Read(pData, 2 * Size, done);
+  SIM_Stats.Frames += Size;
+  SIM_Stats.SpiBusyNs += done - Now;
+  SIM_Schedule(done, SIM_SpiRxDone, 0);
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_SPI_Transmit_IT(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size)
+{
+  uint64_t done = Now + Size * SIM_FrameNs(hspi);
+
+  SIM_Module_Write(pData, 2 * Size);
+  SIM_Stats.Frames += Size;
+  SIM_Stats.SpiBusyNs += done - Now;
+  SIM_Schedule(done, SIM_SpiTxDone, 0);
+  return HAL_OK;
+}
@@ -0,0 +1,1145 @@
+/**
+  ******************************************************************************
+  * @file    sim_module.c
+  * @brief   Model of the ISM43362 SPI front end and AT command interpreter.
+  *
+  *          SPI protocol as seen by the host:
+  *           - DRDY high with NSS high: the module accepts a command. The host
+  *             drops NSS and clocks the command in 16-bit frames (an odd
+  *             length is completed with '\n').
+  *           - NSS rising ends the command: DRDY falls while it is processed,
+  *             then rises again once the reply is ready.
+  *           - The host drops NSS and reads while DRDY is high. The reply is
+  *             "\r\n<payload>\r\nOK\r\n> " or "\r\nERROR...\r\n> ", the last
+  *             frame padded with 0x15. DRDY falls after the last frame.
+  *           - After reset the module prompts with 0x15 0x15 "\r\n> ".
+  *           - MS=<ms> puts the module to sleep once its reply is read: DRDY
+  *             stays low until the time is up or WAKEUP (PB13) rises, then
+  *             comes back high after the wake latency, with no prompt.
+  *
+  *          Sockets map to host sockets: TCP servers listen on the configured
+  *          port plus an offset (so no privileges are needed for port 80),
+  *          clients and UDP use the addresses they are given.
+  ******************************************************************************
+  */
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include "es_wifi_io.h"
+#include "es_wifi_sim.h"
+
+/* Private define ------------------------------------------------------------*/
+#define MOD_SOCKETS             4
+#define MOD_CMD_SIZE            4096
+#define MOD_RESP_SIZE           8192
+#define MOD_MSG_SIZE            512
+#define MOD_READY_GAP_NS        20000ULL     /* NSS high to DRDY high after a reply */
+#define MOD_DEFAULT_R1          1200
+#define MOD_MAX_R1              1460
+#define MOD_SCAN_MS             2000         /* F0 before the first record        */
+
+#define US                      1000ULL
+#define MS                      1000000ULL
+
+/* Private typedef -----------------------------------------------------------*/
+typedef enum
+{
+  MOD_OFF = 0,          /* held in reset                                      */
+  MOD_BOOT,             /* booting, prompt pending                            */
+  MOD_READY,            /* DRDY high, waiting for a command                   */
+  MOD_CMD,              /* NSS low, command bytes coming in                   */
+  MOD_BUSY,             /* processing, DRDY low                               */
+  MOD_REPLY,            /* reply ready, DRDY high                             */
+  MOD_DONE,             /* reply fully read, waiting for NSS high             */
+  MOD_SLEEP             /* MS: DRDY low, deaf until the timer or WAKEUP       */
+} MOD_State_t;
+
+typedef struct
+{
+  int      proto;       /* P1: 0 TCP, 1 UDP                                   */
+  uint16_t local_port;  /* P2                                                 */
+  char     remote_ip[16];/* P3                                                */
+  uint16_t remote_port; /* P4                                                 */
+  int      backlog;     /* P8                                                 */
+  int      listen_fd;   /* TCP server                                         */
+  int      fd;          /* TCP client / accepted peer, or UDP socket          */
+  int      server;      /* P5 active                                          */
+  int      client;      /* P6 active                                          */
+  struct sockaddr_in peer;
+  uint16_t r1;          /* R1 read size                                       */
+  uint32_t r2;          /* R2 read timeout, ms                                */
+  uint32_t s2;          /* S2 write timeout, ms                               */
+} MOD_Socket_t;
+
+/* Private variables ---------------------------------------------------------*/
+static SIM_Config_t Cfg;
+static MOD_State_t  State;
+static int          Drdy;
+static int          Nss = 1;
+static uint8_t      Cmd[MOD_CMD_SIZE];
+static int          CmdLen;
+static uint8_t      Resp[MOD_RESP_SIZE];
+static int          RespLen;
+static int          RespPos;
+static uint64_t     RespLatency;
+static int          Stuffing;
+
+static MOD_Socket_t Sock[MOD_SOCKETS];
+static int          CurSock;
+static char         Msgs[MOD_MSG_SIZE];
+
+static char         Ssid[33];
+static char         Pswd[33];
+static int          Security;
+static int          Dhcp = 1;
+static char         StaticIp[16] = "0.0.0.0";
+static char         StaticMask[16] = "0.0.0.0";
+static char         StaticGw[16] = "0.0.0.0";
+static char         Dns1[16] = "0.0.0.0";
+static char         Dns2[16] = "0.0.0.0";
+static int          Joined;
+static int          Refusals;       /* C0 attempts the access point still refuses */
+static uint32_t     SleepMs;        /* MS accepted, sleep once the reply is read */
+static uint64_t     SleepStart;
+static int          Wakeup;
+static int8_t       ApRssi[2];      /* access points of the SSID, 0 when absent */
+static int          CurAp;          /* the one C0 joined */
+static int          ScanNext;       /* next F0=2 record, -1 when no scan runs */
+
+/* Private functions ---------------------------------------------------------*/
+static void MOD_SetDrdy(int level)
+{
+  if (level && !Drdy)
+  {
+    Drdy = 1;
+    /* EXTI1 on the rising edge */
+    SPI_WIFI_ISR();
+    return;
+  }
+  Drdy = level;
+}
+
+static void MOD_ReplyReady(int arg)
+{
+  (void)arg;
+  if (State == MOD_BUSY)
+  {
+    State = RespLen ? MOD_REPLY : MOD_READY;
+    MOD_SetDrdy(1);
+  }
+}
+
+static void MOD_BackToReady(int arg)
+{
+  (void)arg;
+  if ((State == MOD_DONE) || (State == MOD_BUSY))
+  {
+    State = MOD_READY;
+    RespLen = 0;
+    MOD_SetDrdy(1);
+  }
+}
+
+static void MOD_DrdyLow(int arg)
+{
+  (void)arg;
+  MOD_SetDrdy(0);
+}
+
+static void MOD_Woken(int arg)
+{
+  (void)arg;
+  if (State == MOD_SLEEP)
+  {
+    SIM_Stats.SleepNs += SIM_NowNs() - SleepStart;
+    State = MOD_READY;
+    RespLen = 0;
+    MOD_SetDrdy(1);
+  }
+}
+
+static void MOD_Booted(int arg)
+{
+  (void)arg;
+  if (State == MOD_BOOT)
+  {
+    memcpy(Resp, "\x15\x15\r\n> ", 6);
+    RespLen = 6;
+    RespPos = 0;
+    State = MOD_REPLY;
+    MOD_SetDrdy(1);
+  }
+}
+
+static void MOD_CloseSocket(MOD_Socket_t *s)
+{
+  if (s->fd >= 0)
+  {
+    close(s->fd);
+  }
+  if (s->listen_fd >= 0)
+  {
+    close(s->listen_fd);
+  }
+  s->fd = -1;
+  s->listen_fd = -1;
+  s->server = 0;
+  s->client = 0;
+}
+
+static void MOD_ResetState(void)
+{
+  int i;
+
+  for (i = 0; i < MOD_SOCKETS; i++)
+  {
+    MOD_CloseSocket(&Sock[i]);
+    memset(&Sock[i], 0, sizeof(Sock[i]));
+    Sock[i].fd = -1;
+    Sock[i].listen_fd = -1;
+    Sock[i].r1 = MOD_DEFAULT_R1;
+    Sock[i].r2 = 1;
+    Sock[i].s2 = 1;
+    strcpy(Sock[i].remote_ip, "0.0.0.0");
+  }
+  CurSock = 0;
+  Msgs[0] = 0;
+  Joined = 0;
+  Ssid[0] = 0;
+  Pswd[0] = 0;
+  Dhcp = 1;
+  CmdLen = 0;
+  RespLen = 0;
+  RespPos = 0;
+  Stuffing = 0;
+  SleepMs = 0;
+  ScanNext = -1;
+  CurAp = 0;
+}
+
+static void MOD_AddMsg(const char *fmt, ...)
+{
+  va_list ap;
+  size_t n = strlen(Msgs);
+
+  va_start(ap, fmt);
+  vsnprintf(Msgs + n, sizeof(Msgs) - n, fmt, ap);
+  va_end(ap);
+}
+
+/* Reply builders ------------------------------------------------------------*/
+static void MOD_Reply(const uint8_t *payload, int len)
+{
+  /* "\r\n" payload "\r\nOK\r\n> ", also with an empty payload (R0 relies on it) */
+  if (len > MOD_RESP_SIZE - 16)
+  {
+    len = MOD_RESP_SIZE - 16;
+  }
+  memcpy(Resp, "\r\n", 2);
+  RespLen = 2;
+  if (len > 0)
+  {
+    memcpy(Resp + RespLen, payload, len);
+    RespLen += len;
+  }
+  memcpy(Resp + RespLen, "\r\nOK\r\n> ", 8);
+  RespLen += 8;
+}
+
+static void MOD_ReplyF(const char *fmt, ...)
+{
+  char buf[512];
+  va_list ap;
+  int n;
+
+  va_start(ap, fmt);
+  n = vsnprintf(buf, sizeof(buf), fmt, ap);
+  va_end(ap);
+  MOD_Reply((uint8_t *)buf, n);
+}
+
+static void MOD_Error(const char *msg)
+{
+  RespLen = snprintf((char *)Resp, MOD_RESP_SIZE, "\r\nERROR%s%s\r\n> ", msg ? ": " : "", msg ? msg : "");
+}
+
+/* one F0=2 record per reply, MR asks for the next, OK after the last. The
+   scan sees the access points of the SSID and a stronger foreign one. */
+static void MOD_ScanReply(void)
+{
+  static const char *mac[3] = { "C4:7F:51:00:10:01", "C4:7F:51:00:20:01", "C4:7F:51:00:10:02" };
+  const char *ssid = Ssid[0] ? Ssid : "sim";
+  int8_t rssi;
+  int ch;
+
+  while (ScanNext < 3)
+  {
+    switch (ScanNext)
+    {
+      case 0:  rssi = ApRssi[0]; ch = 6;  break;
+      case 1:  rssi = -40;       ch = 1;  ssid = "neighbour"; break;
+      default: rssi = ApRssi[1]; ch = 11; ssid = Ssid[0] ? Ssid : "sim"; break;
+    }
+    if (rssi != 0)
+    {
+      RespLen = snprintf((char *)Resp, MOD_RESP_SIZE,
+                         "\r\n#%03d,\"%s\",%s,%d,72.2,Infrastructure,WPA2 AES,2.4GHz,%d\r\n> ",
+                         ScanNext + 1, ssid, mac[ScanNext], rssi, ch);
+      ScanNext++;
+      return;
+    }
+    ScanNext++;
+  }
+  ScanNext = -1;
+  MOD_Reply(NULL, 0);
+}
+
+/* firmware before C3.5.2.5: plain F0, every record in one reply. Weak foreign
+   access points pad it well past the driver's command buffer. */
+static void MOD_ScanAll(void)
+{
+  char buf[1024];
+  int n = 0;
+  int i;
+
+  for (ScanNext = 0; ScanNext < 3; )
+  {
+    RespLen = 0;
+    MOD_ScanReply();
+    if ((ScanNext < 0) || (RespLen < 5))
+    {
+      break;
+    }
+    /* the record without its "\r\n" and "\r\n> " */
+    n += snprintf(buf + n, sizeof(buf) - n, "%s%.*s", n ? "\r\n" : "", RespLen - 6, Resp + 2);
+  }
+  for (i = 0; i < 5; i++)
+  {
+    n += snprintf(buf + n, sizeof(buf) - n,
+                  "%s#%03d,\"far-%d\",C4:7F:51:00:30:%02X,-88,72.2,Infrastructure,WPA2 AES,2.4GHz,%d",
+                  n ? "\r\n" : "", i + 4, i, i, 1 + (5 * i) % 11);
+  }
+  ScanNext = -1;
+  MOD_Reply((uint8_t *)buf, n);
+}
+
+/* Socket helpers ------------------------------------------------------------*/
+static void MOD_NonBlocking(int fd)
+{
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+/* the module pushes every S3 out at once, no Nagle delay on host sockets */
+static void MOD_NoDelay(int fd)
+{
+  int one = 1;
+
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+static int MOD_Resolve(const char *ip, uint16_t port, struct sockaddr_in *sa)
+{
+  memset(sa, 0, sizeof(*sa));
+  sa->sin_family = AF_INET;
+  sa->sin_port = htons(port);
+  return (inet_pton(AF_INET, ip, &sa->sin_addr) == 1) ? 0 : -1;
+}
+
+static void MOD_TryAccept(MOD_Socket_t *s)
+{
+  socklen_t sl = sizeof(s->peer);
+  int fd;
+
+  if (!s->server || (s->proto != 0) || (s->fd >= 0) || (s->listen_fd < 0))
+  {
+    return;
+  }
+  fd = accept(s->listen_fd, (struct sockaddr *)&s->peer, &sl);
+  if (fd >= 0)
+  {
+    MOD_NonBlocking(fd);
+    MOD_NoDelay(fd);
+    s->fd = fd;
+    MOD_AddMsg("Accepted %s:%u", inet_ntoa(s->peer.sin_addr), ntohs(s->peer.sin_port));
+  }
+}
+
+static int MOD_StartServer(MOD_Socket_t *s)
+{
+  struct sockaddr_in sa;
+  int one = 1;
+  int fd;
+
+  MOD_CloseSocket(s);
+  fd = socket(AF_INET, (s->proto == 0) ? SOCK_STREAM : SOCK_DGRAM, 0);
+  if (fd < 0)
+  {
+    return -1;
+  }
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  MOD_Resolve("0.0.0.0", s->local_port + Cfg.PortOffset, &sa);
+  if ((bind(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0) ||
+      ((s->proto == 0) && (listen(fd, s->backlog ? s->backlog : 1) < 0)))
+  {
+    close(fd);
+    return -1;
+  }
+  MOD_NonBlocking(fd);
+  if (s->proto == 0)
+  {
+    s->listen_fd = fd;
+  }
+  else
+  {
+    s->fd = fd;
+  }
+  s->server = 1;
+  return 0;
+}
+
+static int MOD_StartClient(MOD_Socket_t *s)
+{
+  struct sockaddr_in sa;
+  int fd;
+
+  MOD_CloseSocket(s);
+  if (s->proto == 0)
+  {
+    if (MOD_Resolve(s->remote_ip, s->remote_port, &sa) < 0)
+    {
+      return -1;
+    }
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if ((fd < 0) || (connect(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0))
+    {
+      if (fd >= 0)
+      {
+        close(fd);
+      }
+      return -1;
+    }
+    MOD_NoDelay(fd);
+    s->peer = sa;
+  }
+  else
+  {
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0)
+    {
+      return -1;
+    }
+  }
+  MOD_NonBlocking(fd);
+  s->fd = fd;
+  s->client = 1;
+  return 0;
+}
+
+static int MOD_Send(MOD_Socket_t *s, const uint8_t *data, int len)
+{
+  struct sockaddr_in sa;
+  int n;
+
+  if (s->fd < 0)
+  {
+    return -1;
+  }
+  if (s->proto == 0)
+  {
+    struct pollfd p = { s->fd, POLLOUT, 0 };
+    int sent = 0;
+
+    while (sent < len)
+    {
+      n = send(s->fd, data + sent, len - sent, MSG_NOSIGNAL);
+      if (n > 0)
+      {
+        sent += n;
+      }
+      else if ((n < 0) && (errno == EAGAIN) && (poll(&p, 1, (int)s->s2 + 100) > 0))
+      {
+        continue;
+      }
+      else
+      {
+        return -1;
+      }
+    }
+    return sent;
+  }
+  if (MOD_Resolve(s->remote_ip, s->remote_port, &sa) < 0)
+  {
+    return -1;
+  }
+  return (int)sendto(s->fd, data, len, 0, (struct sockaddr *)&sa, sizeof(sa));
+}
+
+static int MOD_Recv(MOD_Socket_t *s, uint8_t *data, int len, uint64_t *waited)
+{
+  struct pollfd p;
+  socklen_t sl = sizeof(s->peer);
+  int n;
+
+  *waited = 0;
+  MOD_TryAccept(s);
+  if (s->fd < 0)
+  {
+    return -1;
+  }
+  p.fd = s->fd;
+  p.events = POLLIN;
+  p.revents = 0;
+  if (poll(&p, 1, Cfg.RealTime ? (int)s->r2 : 0) <= 0)
+  {
+    /* nothing arrived within R2 */
+    *waited = (uint64_t)s->r2 * MS;
+    return 0;
+  }
+  if (s->proto == 0)
+  {
+    n = recv(s->fd, data, len, 0);
+  }
+  else
+  {
+    n = recvfrom(s->fd, data, len, 0, (struct sockaddr *)&s->peer, &sl);
+  }
+  return (n < 0) ? 0 : n;
+}
+
+/* AT interpreter ------------------------------------------------------------*/
+static void MOD_Count(const char *name)
+{
+  uint32_t i;
+
+  SIM_Stats.Commands++;
+  for (i = 0; i < SIM_Stats.Kinds; i++)
+  {
+    if (strncmp(SIM_Stats.KindName[i], name, 2) == 0)
+    {
+      SIM_Stats.KindCount[i]++;
+      return;
+    }
+  }
+  if (SIM_Stats.Kinds < SIM_MAX_CMD_KINDS)
+  {
+    memcpy(SIM_Stats.KindName[i], name, 2);
+    SIM_Stats.KindName[i][2] = 0;
+    SIM_Stats.KindCount[i] = 1;
+    SIM_Stats.Kinds++;
+  }
+}
+
+static void MOD_CopyArg(char *dst, size_t size, const char *arg)
+{
+  size_t n = arg ? strlen(arg) : 0;
+
+  if (n >= size)
+  {
+    n = size - 1;
+  }
+  memcpy(dst, arg ? arg : "", n);
+  dst[n] = 0;
+}
+
+static void MOD_Execute(void)
+{
+  char name[3] = { 0, 0, 0 };
+  char line[256];
+  char *arg;
+  uint8_t *data = NULL;
+  int data_len = 0;
+  int i, n;
+  MOD_Socket_t *s = &Sock[CurSock];
+
+  RespLatency = (uint64_t)Cfg.CmdLatencyUs * US;
+
+  /* command line up to '\r', binary payload of S3 follows it */
+  for (i = 0; (i < CmdLen) && (Cmd[i] != '\r') && (i < (int)sizeof(line) - 1); i++)
+  {
+    line[i] = (char)Cmd[i];
+  }
+  line[i] = 0;
+  if (i < CmdLen)
+  {
+    data = &Cmd[i + 1];
+    data_len = CmdLen - i - 1;
+  }
+  if (strlen(line) < 2)
+  {
+    MOD_Error("Unknown command");
+    return;
+  }
+  memcpy(name, line, 2);
+  arg = (line[2] == '=') ? &line[3] : NULL;
+  MOD_Count(name);
+
+  if (Cfg.Verbose)
+  {
+    fprintf(stderr, "sim: %8.3f ms  <- %s\n", SIM_NowNs() / 1e6, line);
+  }
+
+  if ((Cfg.ErrorRate > 0) && (SIM_Random() < Cfg.ErrorRate))
+  {
+    SIM_Stats.Faults++;
+    MOD_Error("Injected");
+    return;
+  }
+
+  if (!strcmp(name, "I?"))
+  {
+    MOD_ReplyF("ISM43362-M3G-L44-SPI,%s,v3.5.2,v1.4.0.rc1,v8.2.1,120000000,Inventek eS-WiFi",
+               Cfg.OldFirmware ? "C3.5.2.3.BETA9" : "C3.5.2.5.STM");
+  }
+  else if (!strcmp(name, "Z5"))
+  {
+    MOD_ReplyF("C4:7F:51:00:00:01");
+  }
+  else if (!strcmp(name, "C1"))
+  {
+    MOD_CopyArg(Ssid, sizeof(Ssid), arg);
+    MOD_Reply(NULL, 0);
+  }
+  else if (!strcmp(name, "C2"))
+  {
+    MOD_CopyArg(Pswd, sizeof(Pswd), arg);
+    MOD_Reply(NULL, 0);
+  }
+  else if (!strcmp(name, "C3"))
+  {
+    Security = arg ? atoi(arg) : 0;
+    MOD_Reply(NULL, 0);
+  }
+  else if (!strcmp(name, "C4"))
+  {
+    Dhcp = arg ? atoi(arg) : 1;
+    MOD_Reply(NULL, 0);
+  }
+  else if (!strcmp(name, "C6"))
+  {
+    MOD_CopyArg(StaticIp, sizeof(StaticIp), arg);
+    MOD_Reply(NULL, 0);
+  }
+  else if (!strcmp(name, "C7"))
+  {
+    MOD_CopyArg(StaticMask, sizeof(StaticMask), arg);
+    MOD_Reply(NULL, 0);
+  }
+  else if (!strcmp(name, "C8"))
+  {
+    MOD_CopyArg(StaticGw, sizeof(StaticGw), arg);
+    MOD_Reply(NULL, 0);
+  }
+  else if (!strcmp(name, "C9"))
+  {
+    MOD_CopyArg(Dns1, sizeof(Dns1), arg);
+    MOD_Reply(NULL, 0);
+  }
+  else if (!strcmp(name, "CA"))
+  {
+    MOD_CopyArg(Dns2, sizeof(Dns2), arg);
+    MOD_Reply(NULL, 0);
+  }
+  else if (!strcmp(name, "C0"))
+  {
+    RespLatency = (uint64_t)Cfg.JoinLatencyMs * MS;
+    CurAp = (ApRssi[1] != 0) && (ApRssi[1] > ApRssi[0]);
+    if ((Cfg.Ssid && strcmp(Cfg.Ssid, Ssid)) || !Ssid[0] || (Refusals > 0))
+    {
+      Refusals -= (Refusals > 0);
+      Joined = 0;
+      MOD_Error("Failed to connect");
+    }
+    else
+    {
+      Joined = 1;
+      MOD_ReplyF("[JOIN   ] %s,%s,0,0,0", Ssid, Dhcp ? "127.0.0.1" : StaticIp);
+    }
+  }
+  else if (!strcmp(name, "CD"))
+  {
+    /* connections die with the association */
+    for (i = 0; i < MOD_SOCKETS; i++)
+    {
+      MOD_CloseSocket(&Sock[i]);
+    }
+    Joined = 0;
+    MOD_Reply(NULL, 0);
+  }
+  else if (!strcmp(name, "F0") && Cfg.OldFirmware)
+  {
+    RespLatency = (uint64_t)MOD_SCAN_MS * MS;
+    MOD_ScanAll();
+  }
+  else if (!strcmp(name, "F0"))
+  {
+    if (!arg || (atoi(arg) != 2))
+    {
+      MOD_Error("Unsupported");
+    }
+    else
+    {
+      RespLatency = (uint64_t)MOD_SCAN_MS * MS;
+      ScanNext = 0;
+      MOD_ScanReply();
+    }
+  }
+  else if (!strcmp(name, "MS"))
+  {
+    n = arg ? atoi(arg) : 0;
+    if (n <= 0)
+    {
+      MOD_Error("Invalid duration");
+    }
+    else
+    {
+      SleepMs = (uint32_t)n;
+      MOD_Reply(NULL, 0);
+    }
+  }
+  else if (!strcmp(name, "CS"))
+  {
+    MOD_ReplyF("%d", Joined);
+  }
+  else if (!strcmp(name, "CR"))
+  {
+    if (Joined)
+    {
+      MOD_ReplyF("%d", ApRssi[CurAp]);
+    }
+    else
+    {
+      MOD_Error("Not connected");
+    }
+  }
+  else if (!strcmp(name, "C?"))
+  {
+    MOD_ReplyF("%s,%s,%d,%d,0,%s,%s,%s,%s,%s,5,0,0,%d", Ssid, Pswd, Security, Dhcp,
+               Joined ? (Dhcp ? "127.0.0.1" : StaticIp) : "0.0.0.0",
+               Dhcp ? "255.0.0.0" : StaticMask, Dhcp ? "127.0.0.1" : StaticGw,
+               Dns1, Dns2, Joined);
+  }
+  else if (!strcmp(name, "D0"))
+  {
+    MOD_ReplyF("127.0.0.1");
+  }
+  else if (!strcmp(name, "P0"))
+  {
+    n = arg ? atoi(arg) : -1;
+    if ((n < 0) || (n >= MOD_SOCKETS))
+    {
+      MOD_Error("Invalid socket");
+    }
+    else
+    {
+      CurSock = n;
+      MOD_Reply(NULL, 0);
+    }
+  }
+  else if (!strcmp(name, "P1"))
+  {
+    s->proto = arg ? atoi(arg) : 0;
+    MOD_Reply(NULL, 0);
+  }
+  else if (!strcmp(name, "P2"))
+  {
+    s->local_port = arg ? (uint16_t)atoi(arg) : 0;
+    MOD_Reply(NULL, 0);
+  }
+  else if (!strcmp(name, "P3"))
+  {
+    MOD_CopyArg(s->remote_ip, sizeof(s->remote_ip), arg);
+    MOD_Reply(NULL, 0);
+  }
+  else if (!strcmp(name, "P4"))
+  {
+    s->remote_port = arg ? (uint16_t)atoi(arg) : 0;
+    MOD_Reply(NULL, 0);
+  }
+  else if (!strcmp(name, "P8"))
+  {
+    s->backlog = arg ? atoi(arg) : 1;
+    MOD_Reply(NULL, 0);
+  }
+  else if (!strcmp(name, "P7") || !strcmp(name, "P9") || !strcmp(name, "PK"))
+  {
+    MOD_Reply(NULL, 0);
+  }
+  else if (!strcmp(name, "P5"))
+  {
+    n = arg ? atoi(arg) : 0;
+    if (!Joined && (n != 0))
+    {
+      MOD_Error("Not connected");
+    }
+    else if (n == 10)
+    {
+      /* close the current client, the next one is taken from the backlog */
+      if (s->fd >= 0)
+      {
+        close(s->fd);
+        s->fd = -1;
+      }
+      MOD_Reply(NULL, 0);
+    }
+    else if (n == 0)
+    {
+      MOD_CloseSocket(s);
+      MOD_Reply(NULL, 0);
+    }
+    else if (MOD_StartServer(s) < 0)
+    {
+      MOD_Error("Server start failed");
+    }
+    else
+    {
+      MOD_Reply(NULL, 0);
+    }
+  }
+  else if (!strcmp(name, "P6"))
+  {
+    n = arg ? atoi(arg) : 0;
+    if (n == 0)
+    {
+      MOD_CloseSocket(s);
+      MOD_Reply(NULL, 0);
+    }
+    else if (!Joined || (MOD_StartClient(s) < 0))
+    {
+      MOD_Error("Connection failed");
+    }
+    else
+    {
+      RespLatency += (uint64_t)Cfg.NetLatencyUs * US;
+      MOD_Reply(NULL, 0);
+    }
+  }
+  else if (!strcmp(name, "P?"))
+  {
+    char rip[16] = "0.0.0.0";
+    uint16_t rport = 0;
+
+    MOD_TryAccept(s);
+    if ((s->fd >= 0) && (s->proto == 0))
+    {
+      snprintf(rip, sizeof(rip), "%s", inet_ntoa(s->peer.sin_addr));
+      rport = ntohs(s->peer.sin_port);
+    }
+    else if ((s->fd >= 0) && (s->peer.sin_port != 0))
+    {
+      snprintf(rip, sizeof(rip), "%s", inet_ntoa(s->peer.sin_addr));
+      rport = ntohs(s->peer.sin_port);
+    }
+    MOD_ReplyF("%d,%s,%u,%s,%u,%d,%d,%d,1,0", s->proto,
+               (s->fd >= 0) ? "127.0.0.1" : "0.0.0.0", s->local_port,
+               rip, rport, (s->server && (s->proto == 0)), (s->server && (s->proto == 1)), s->backlog);
+  }
+  else if (!strcmp(name, "MR") && (ScanNext >= 0))
+  {
+    MOD_ScanReply();
+  }
+  else if (!strcmp(name, "MR"))
+  {
+    char buf[MOD_MSG_SIZE + 16];
+
+    for (i = 0; i < MOD_SOCKETS; i++)
+    {
+      MOD_TryAccept(&Sock[i]);
+    }
+    snprintf(buf, sizeof(buf), "[SOMA]%s[EOMA]", Msgs);
+    Msgs[0] = 0;
+    MOD_Reply((uint8_t *)buf, strlen(buf));
+  }
+  else if (!strcmp(name, "S2"))
+  {
+    s->s2 = arg ? (uint32_t)atoi(arg) : 1;
+    MOD_Reply(NULL, 0);
+  }
+  else if (!strcmp(name, "S3"))
+  {
+    n = arg ? atoi(arg) : 0;
+    if ((n < 0) || (n > data_len))
+    {
+      MOD_Error("Payload length mismatch");
+    }
+    else
+    {
+      RespLatency += (uint64_t)Cfg.NetLatencyUs * US;
+      n = MOD_Send(s, data, n);
+      if (n < 0)
+      {
+        MOD_ReplyF("-1");
+      }
+      else
+      {
+        SIM_Stats.PayloadSent += n;
+        MOD_ReplyF("%d", n);
+      }
+    }
+  }
+  else if (!strcmp(name, "R1"))
+  {
+    n = arg ? atoi(arg) : 0;
+    if ((n <= 0) || (n > MOD_MAX_R1))
+    {
+      MOD_Error("Invalid length");
+    }
+    else
+    {
+      s->r1 = (uint16_t)n;
+      MOD_Reply(NULL, 0);
+    }
+  }
+  else if (!strcmp(name, "R2"))
+  {
+    s->r2 = arg ? (uint32_t)atoi(arg) : 1;
+    MOD_Reply(NULL, 0);
+  }
+  else if (!strcmp(name, "R0"))
+  {
+    uint8_t buf[MOD_MAX_R1];
+    uint64_t waited;
+
+    n = MOD_Recv(s, buf, s->r1, &waited);
+    if (n < 0)
+    {
+      MOD_Error("Socket not connected");
+    }
+    else
+    {
+      RespLatency += waited + (n ? (uint64_t)Cfg.NetLatencyUs * US : 0);
+      SIM_Stats.PayloadReceived += n;
+      MOD_Reply(buf, n);
+    }
+  }
+  else
+  {
+    MOD_Error("Unknown command");
+  }
+}
+
+static void MOD_Inject(void)
+{
+  if ((Cfg.CorruptRate > 0) && (RespLen > 0) && (SIM_Random() < Cfg.CorruptRate))
+  {
+    SIM_Stats.Faults++;
+    Resp[(int)(SIM_Random() * RespLen)] ^= 0x20;
+  }
+}
+
+static void MOD_Process(void)
+{
+  RespPos = 0;
+  if ((Cfg.StuffingRate > 0) && (SIM_Random() < Cfg.StuffingRate))
+  {
+    /* the driver gives up after ES_WIFI_DATA_SIZE bytes and resets us */
+    SIM_Stats.Faults++;
+    Stuffing = 1;
+    RespLen = 1;
+    Resp[0] = 0x15;
+    SIM_Schedule(SIM_NowNs() + (uint64_t)Cfg.CmdLatencyUs * US, MOD_ReplyReady, 0);
+    return;
+  }
+  MOD_Execute();
+  MOD_Inject();
+  if ((Cfg.StallRate > 0) && (SIM_Random() < Cfg.StallRate))
+  {
+    /* reply lost: DRDY stays low until the module recovers on its own */
+    SIM_Stats.Faults++;
+    RespLen = 0;
+    SIM_Schedule(SIM_NowNs() + (uint64_t)Cfg.StallMs * MS, MOD_BackToReady, 0);
+    return;
+  }
+  SIM_Schedule(SIM_NowNs() + RespLatency, MOD_ReplyReady, 0);
+  if (Cfg.Verbose)
+  {
+    fprintf(stderr, "sim: %8.3f ms  -> %d bytes\n", SIM_NowNs() / 1e6, RespLen);
+  }
+}
+
+/* Exported functions --------------------------------------------------------*/
+void SIM_Module_Init(const SIM_Config_t *cfg)
+{
+  int i;
+
+  Cfg = *cfg;
+  for (i = 0; i < MOD_SOCKETS; i++)
+  {
+    Sock[i].fd = -1;
+    Sock[i].listen_fd = -1;
+  }
+  MOD_ResetState();
+  Refusals = 0;
+  ApRssi[0] = Cfg.Rssi;
+  ApRssi[1] = Cfg.RoamRssi;
+  State = MOD_OFF;
+  Drdy = 0;
+  Nss = 1;
+}
+
+void SIM_Module_Shutdown(void)
+{
+  MOD_ResetState();
+}
+
+void SIM_DropLink(int refusals)
+{
+  int i;
+
+  /* the access point went away: connections die with the association */
+  for (i = 0; i < MOD_SOCKETS; i++)
+  {
+    MOD_CloseSocket(&Sock[i]);
+  }
+  Joined = 0;
+  Refusals = refusals;
+}
+
+void SIM_SetRssi(int8_t rssi, int8_t roam_rssi)
+{
+  /* the association stays where it is until the next C0 */
+  ApRssi[0] = rssi;
+  ApRssi[1] = roam_rssi;
+}
+
+int SIM_Module_GetDrdy(void)
+{
+  return Drdy;
+}
+
+void SIM_Module_SetReset(int level)
+{
+  if (!level)
+  {
+    SIM_Cancel(MOD_ReplyReady);
+    SIM_Cancel(MOD_BackToReady);
+    SIM_Cancel(MOD_DrdyLow);
+    SIM_Cancel(MOD_Booted);
+    SIM_Cancel(MOD_Woken);
+    if (State == MOD_SLEEP)
+    {
+      SIM_Stats.SleepNs += SIM_NowNs() - SleepStart;
+    }
+    MOD_ResetState();
+    State = MOD_OFF;
+    Drdy = 0;
+  }
+  else if (State == MOD_OFF)
+  {
+    SIM_Stats.Resets++;
+    State = MOD_BOOT;
+    SIM_Schedule(SIM_NowNs() + (uint64_t)Cfg.BootMs * MS, MOD_Booted, 0);
+  }
+}
+
+void SIM_Module_SetNss(int level)
+{
+  if (level == Nss)
+  {
+    return;
+  }
+  Nss = level;
+  if (!level)
+  {
+    if (State == MOD_READY)
+    {
+      State = MOD_CMD;
+      CmdLen = 0;
+    }
+    return;
+  }
+
+  /* NSS rising ends a command or a reply read */
+  if ((State == MOD_CMD) && (CmdLen > 0))
+  {
+    State = MOD_BUSY;
+    MOD_SetDrdy(0);
+    MOD_Process();
+  }
+  else if (State == MOD_CMD)
+  {
+    State = MOD_READY;
+  }
+  else if ((State == MOD_DONE) && SleepMs)
+  {
+    SIM_Stats.Sleeps++;
+    State = MOD_SLEEP;
+    SleepStart = SIM_NowNs();
+    SIM_Cancel(MOD_DrdyLow);
+    MOD_SetDrdy(0);
+    SIM_Schedule(SleepStart + (uint64_t)SleepMs * MS + (uint64_t)Cfg.WakeUs * US, MOD_Woken, 0);
+    SleepMs = 0;
+  }
+  else if (State == MOD_DONE)
+  {
+    SIM_Schedule(SIM_NowNs() + MOD_READY_GAP_NS, MOD_BackToReady, 0);
+  }
+}
+
+void SIM_Module_SetWakeup(int level)
+{
+  if (level && !Wakeup && (State == MOD_SLEEP))
+  {
+    /* an early wake-up replaces the timer */
+    SIM_Cancel(MOD_Woken);
+    SIM_Schedule(SIM_NowNs() + (uint64_t)Cfg.WakeUs * US, MOD_Woken, 0);
+  }
+  Wakeup = level;
+}
+
+void SIM_Module_Write(const uint8_t *data, int len)
+{
+  if ((State == MOD_REPLY) || (State == MOD_DONE))
+  {
+    /* host talks over a pending reply: the module drops it */
+    SIM_Cancel(MOD_DrdyLow);
+    SIM_Cancel(MOD_BackToReady);
+    State = MOD_CMD;
+    CmdLen = 0;
+    Stuffing = 0;
+  }
+  if (State != MOD_CMD)
+  {
+    return;
+  }
+  if (CmdLen + len > MOD_CMD_SIZE)
+  {
+    len = MOD_CMD_SIZE - CmdLen;
+  }
+  memcpy(Cmd + CmdLen, data, len);
+  CmdLen += len;
+  SIM_Stats.BytesToModule += len;
+}
+
+void SIM_Module_Read(uint8_t *data, int len, uint64_t done_ns)
+{
+  int i;
+
+  for (i = 0; i < len; i++)
+  {
+    data[i] = (RespPos + i < RespLen) ? Resp[RespPos + i] : 0x15;
+  }
+  if (State != MOD_REPLY)
+  {
+    return;
+  }
+  SIM_Stats.BytesFromModule += len;
+  if (Stuffing)
+  {
+    /* stuffing fault: never runs dry */
+    return;
+  }
+  RespPos += len;
+  if (RespPos >= RespLen)
+  {
+    State = MOD_DONE;
+    SIM_Schedule(done_ns, MOD_DrdyLow, 0);
+  }
+}